@@ -31,6 +31,112 @@ struct OclOptFlowSmooth3Lines {
 	}
 };
 
+/**
+* @brief The patch-match sweep engine used by optical flow.
+*
+* SWEEP_ROWS_COLS	one work-item per row (column) walking serially, left/top then right/bottom.
+* SWEEP_WAVEFRONT	top-left then bottom-right sweeps over tiled anti-diagonal wavefronts,
+*					each pixel takes proposals from both of its already-updated neighbours.
+*/
+enum OclSweepEngine {
+	SWEEP_ROWS_COLS = 0,
+	SWEEP_WAVEFRONT = 1
+};
+
+/**
+* @brief The backend the exported functions run on.
+*
+* BACKEND_AUTO		OpenCL if oclDeviceAvailable(), the CPU otherwise.
+* BACKEND_OPENCL	OpenCL only, oclInitialize() fails without a suitable device.
+* BACKEND_CPU		multi-threaded host code (cv::parallel_for_ and universal intrinsics) giving
+*					the results of the kernels (fp32 buffers, rounded through fp16 with halfStorage),
+*					see oclCompareBackends().
+*/
+enum OclBackend {
+	BACKEND_AUTO = 0,
+	BACKEND_OPENCL = 1,
+	BACKEND_CPU = 2
+};
+
+/**
+* @brief The stages a chunk is rendered in, each one is a task of the render threads.
+*
+* Both flows run in parallel, the novel views (RENDER_NOVEL_VIEW_R in stereo mode only)
+* run when both flows are done.
+*/
+enum OclRenderStage {
+	RENDER_FLOW_LTOR = 0,
+	RENDER_FLOW_RTOL = 1,
+	RENDER_NOVEL_VIEW_L = 2,
+	RENDER_NOVEL_VIEW_R = 3
+};
+
+/**
+* @brief The timing of a render task.
+*
+* frame			the frame id (see oclSubmitStereoPanoramaChunks()).
+* chunk			the chunk (camera pair) index.
+* stage			OclRenderStage.
+* thread		the render thread that ran the task.
+* startMs/endMs	milliseconds since oclInitialize(), including the device work of the task.
+*/
+struct OclRenderTaskTiming {
+	int64 frame;
+	int chunk;
+	int stage;
+	int thread;
+	double startMs;
+	double endMs;
+};
+
+/**
+* @brief The flow quality a frame was rendered with.
+*
+* frame			the frame id (see oclSubmitStereoPanoramaChunks()).
+* renderMs		from the start of the first task of the frame to the end of its last one.
+* levels		the OclFlowQualityLevel of each chunk (camera pair), FLOW_QUALITY_FULL unless
+*				OclInitParameters::targetFrameMs is set.
+*
+* flowRecomputed	the mean fraction of the flow tiles recomputed by the flows of the frame,
+*				1 unless OclInitParameters::incrementalFlow is enabled.
+*
+* With a target, a frame over it twice in a row lowers the level of the chunk that took the
+* longest, and 10 frames under 70% of it raise the lowest level again, one chunk per step.
+*/
+struct OclFrameQuality {
+	int64 frame;
+	double renderMs;
+	std::vector<int> levels;
+	float flowRecomputed;
+};
+
+/**
+* @brief The incremental optical flow: the tiles whose images didn't change keep the previous flow.
+*
+* motionThreshold	> 0 enables it. A tile is active if the mean motion of its pixels (the mean
+*					absolute BGR difference to the previous frame in [0, 1], the larger of both images) exceeds it.
+* tileSize			the tile size, in image pixels.
+* haloTiles			the tiles of context computed around the active ones.
+* maxActive			above this fraction of tiles to compute, the whole flow is computed instead.
+* refreshFrames		every refreshFrames flows of a workspace are computed whole (0: never), so slow
+*					changes below the threshold don't stay in the previous flow for good.
+*
+* The rows of active tiles (with their halo) are grouped into bands, the flow of each band is
+* computed on its own, and its active tiles are copied into the previous flow, the borders
+* with the static tiles blurred as the flow diffusion does.
+* A band is at least 128 pixels, rounded up to 128 pixels and shifted inside the image. It
+* never shrinks below the size of its workspace, so the band workspaces stop growing after a
+* few frames and are reused. Their sum may exceed the one image workspace the plan counts for them.
+* It needs the previous flow and images, the first frame is always computed whole.
+*/
+struct OclIncrementalFlow {
+	float motionThreshold = 0.0f;
+	int tileSize = 64;
+	int haloTiles = 1;
+	float maxActive = 0.6f;
+	int refreshFrames = 30;
+};
+
 /**
 * @brief The parameters used for initializing OpenCL.
 */
@@ -48,6 +154,17 @@ struct OclInitParameters {
 	float inputMotionThreshold = 0.0f;
 	bool usingBilateralFilter = false;
 	bool computeMotionUsingLpair = true;
+	int sweepEngine = SWEEP_ROWS_COLS;
+	int maxFramesInFlight = 2;	// see oclSubmitStereoPanoramaChunks()
+	int numRenderThreads = 0;	// 0: as many as the device memory allows (at most 4)
+	bool halfStorage = false;	// keep flows, pyramids and gradients in fp16 (see oclCompareStoragePrecisions())
+	int backend = BACKEND_AUTO;	// OclBackend, numRenderThreads 0 is 2 threads on the CPU backend
+	size_t memoryBudget = 0;	// bytes of device memory the render threads are planned for and each buffer pool keeps at most,
+								// 0: all of it. Not a cap of the total usage (see OclMemoryPlan)
+	float targetFrameMs = 0.0f;	// > 0: lower the flow quality of the camera pairs to render a frame within it (see OclFrameQuality)
+	OclIncrementalFlow incrementalFlow;	// recompute only the flow of the tiles in motion
+	int maxDevices = 1;			// > 1: spread the camera pairs over up to this many devices (see OclRenderDevice)
+	std::string programCacheDir;	// directory of the program binaries, empty: build from source (see OclStartupReport)
 
 	// 
 	// @unnecessary
@@ -60,6 +177,9 @@ struct OclInitParameters {
 
 /**
 * @brief Check whether there are proper OpenCL devices available.
+*
+* @note Without OPENCV_OPENCL_DEVICE a GPU with at least 4GB is required, otherwise
+*		the configured device is used as is (e.g. OPENCV_OPENCL_DEVICE=:CPU: for PoCL).
 */
 CV_EXPORTS_W bool oclDeviceAvailable();
 
@@ -83,6 +203,49 @@ CV_EXPORTS_W bool oclInitialize(const OclInitParameters* initParams = nullptr);
 CV_EXPORTS_W void oclRelease();
 
 
+/**
+* @brief The backend chosen by oclInitialize(), BACKEND_OPENCL or BACKEND_CPU.
+*/
+CV_EXPORTS_W int oclActiveBackend();
+
+
+/**
+* @brief Where the last oclInitialize() spent its time, and how its programs were built.
+*
+* totalMs		the whole oclInitialize().
+* preloadMs		building the programs and kernels of the caller thread (see oclPreloadKernels()).
+* buffersMs		planning the buffers (see oclPlanMemory()).
+* programs		programs built for a device, one per source, build options and device.
+* loaded		programs loaded from the binaries of OclInitParameters::programCacheDir.
+* built			programs compiled from source (no cache, or no valid binary yet).
+* rejected		binaries not matching their key or failing to load, compiled and written again.
+* saved			binaries written to the cache.
+* loadMs/buildMs	time of loading/compiling the programs.
+*
+* A binary is keyed by the device name and version, the driver version, the build options and
+* the hash of the source, in program_<hash>.bin. It is written aside and renamed, so processes
+* sharing the directory never load a partial file. Without programCacheDir the programs come
+* from the (in memory) program cache of OpenCV and are not counted.
+*/
+struct OclStartupReport {
+	double totalMs = 0;
+	double preloadMs = 0;
+	double buffersMs = 0;
+	int programs = 0;
+	int loaded = 0;
+	int built = 0;
+	int rejected = 0;
+	int saved = 0;
+	double loadMs = 0;
+	double buildMs = 0;
+};
+
+/**
+* @brief Get the startup report of the last oclInitialize().
+*/
+CV_EXPORTS_W OclStartupReport oclGetStartupReport();
+
+
 /**
 * @brief Remap each image in srcImages with specified x/y map
 *
@@ -98,8 +261,89 @@ CV_EXPORTS_W void oclProjection(
 	const std::vector<UMat>& ymap,
 	std::vector<UMat>& dstImages);
 
+/**
+* @brief oclProjection() of all cameras in one launch, without waiting for it.
+*
+* @param srcImages	the input images to be remaped, all CV_8UC3 or all CV_8UC4.
+* @param xmap		the x direction map of each image (type must be CV_32FC1)
+* @param ymap		the y direction map of each image (type must be CV_32FC1)
+* @param dstImages	return the remapped images (type is CV_8UC4), the rows of one buffer.
+*					They are reused if they are the result of a call with the same maps.
+*
+* @note There is one launch if the srcImages are in one buffer (e.g. uploaded into the rows of
+*		one UMat), otherwise one launch per image. The maps are packed on the first call of each
+*		thread and again if their buffers change, so modify the maps by replacing them.
+*/
+CV_EXPORTS_W void oclProjectionBatched(
+	const std::vector<UMat>& srcImages,
+	const std::vector<UMat>& xmap,
+	const std::vector<UMat>& ymap,
+	std::vector<UMat>& dstImages);
+
+/**
+* @brief Release the maps packed by oclProjectionBatched() on the calling thread.
+*/
+CV_EXPORTS_W void oclReleaseProjectionBatch();
+
+/**
+* @brief A projection map compiled by oclCompileProjectionMaps().
+*
+* map			CV_16UC3, the source position p of each pixel in fixed point, q = (p + 3)*2^fracBits:
+*				the integer parts of q.x and q.y, then both fractions in the high and low byte.
+* weights		the bicubic weights of each fraction (CV_32FC4).
+* fracBits		the fraction bits of map, 8 (1/512 pixel at most off, under one LSB on a 255 step edge).
+* srcSize		the size of the images the map projects (at most 65530 pixels).
+* hash			the hash of the cache key, the camera and the sizes, which names the cache file (0 without).
+*/
+struct OclProjectionMap {
+	UMat map;
+	UMat weights;
+	int fracBits = 0;
+	Size srcSize;
+	uint64 hash = 0;
+};
+
+/**
+* @brief Compile the x/y maps of oclProjection() into fixed-point maps, 3/4 of their size.
+*
+* @param xmap		the x direction map of each camera (type must be CV_32FC1)
+* @param ymap		the y direction map of each camera (type must be CV_32FC1)
+* @param srcSizes	the image size of each camera.
+* @param maps		return the compiled maps.
+* @param cacheDir	with cacheKey, the maps are loaded from (or compiled and saved to) projmap_<hash>.bin here.
+* @param cacheKey	identifies the calibration and projection the maps were computed from (e.g. the
+*					calibration file and the sphere size). The maps are cached under it, not under
+*					their content, so a cache hit doesn't read xmap/ymap back from the device.
+*
+* @note The maps depend on the rig calibration only, so compile them once, and give a new cacheKey
+*		whenever the calibration or the projection changes.
+*/
+CV_EXPORTS_W void oclCompileProjectionMaps(
+	const std::vector<UMat>& xmap,
+	const std::vector<UMat>& ymap,
+	const std::vector<Size>& srcSizes,
+	std::vector<OclProjectionMap>& maps,
+	const std::string& cacheDir = std::string(),
+	const std::string& cacheKey = std::string());
+
+/**
+* @brief oclProjection() with the maps compiled by oclCompileProjectionMaps(), without waiting for it.
+*
+* @param srcImages	the input images to be remaped, (type must be CV_8UC3 or CV_8UC4)
+* @param maps		the compiled map of each image.
+* @param dstImages	return the remapped images (type is CV_8UC4)
+*/
+CV_EXPORTS_W void oclProjection(
+	const std::vector<UMat>& srcImages,
+	const std::vector<OclProjectionMap>& maps,
+	std::vector<UMat>& dstImages);
+
 /**
 * @brief Pre-adjust images color by gamma method
+*
+* The spheres (CV_8UC4, same size) are adjusted in place by two launches: a reduction of
+* the overlap samples of all the cameras, then linearise-gain-re-gamma of the 8-bit pixels.
+* Returns false (spheres untouched) if no camera differs by more than adjust_ratio.
 */
 CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 	std::vector<UMat>& spheres,
@@ -136,8 +380,134 @@ CV_EXPORTS_W void oclRenderStereoPanoramaChunks(
 	float motionThreshold = 1.0f);
 
 
+/**
+* @brief Render each imageLs[i] and imageRs[i] straight into its columns of the panorama (of each eye).
+*
+* @param imageLs				the left overlap images.
+* @param imageRs				the right overlap images.
+* @param pano					return the panorama (CV_8UC4, numNovelViews*imageLs.size() columns),
+*								its buffer is reused if it has that size already.
+* @param wrapOffset				the horizontal wrap offset in pixels, chunk i starts at column
+*								(i*numNovelViews + wrapOffset) wrapped around the panorama width.
+* @param motionThreshhold		the motion threshhold for computing the optical flow.
+*
+* @note The result equals oclRemoveChunkLines(), oclStackHorizontal() and oclOffsetHorizontalWrap()
+*		of the chunks, without the copies and the passes over the panorama. Apply oclSharpImage()
+*		and oclSmoothImage() after the wrap offset (the sharpening differs at the wrapped edges only).
+* @note Not an oclRenderStereoPanoramaChunks() overload and without defaults, so a motion threshold
+*		is never taken for a wrap offset.
+*/
+CV_EXPORTS_W void oclRenderStereoPanorama(
+	const std::vector<UMat>& imageLs,
+	const std::vector<UMat>& imageRs,
+	UMat& pano,
+	int wrapOffset,
+	float motionThreshold);
+
+CV_EXPORTS_W void oclRenderStereoPanorama(
+	const std::vector<UMat>& imageLs,
+	const std::vector<UMat>& imageRs,
+	UMat& panoL,
+	UMat& panoR,
+	int wrapOffset,
+	float motionThreshold);
+
+
+/**
+* @brief Submit imageLs[i] and imageRs[i] for rendering without waiting for the chunks.
+*
+* @param imageLs				the left overlap images.
+* @param imageRs				the right overlap images.
+* @param motionThreshhold		the motion threshhold for computing the optical flow.
+*
+* @return the id of the submitted frame, or -1 if OclInitParameters::maxFramesInFlight frames
+*		are submitted and not polled yet.
+*
+* @note The images are referenced, not copied, so don't write them before the frame is polled.
+*		The chunks of a camera pair are rendered in submission order, against the same previous
+*		frame as oclRenderStereoPanoramaChunks() would use.
+*/
+CV_EXPORTS_W int64 oclSubmitStereoPanoramaChunks(
+	const std::vector<UMat>& imageLs,
+	const std::vector<UMat>& imageRs,
+	float motionThreshold = 1.0f);
+
+
+/**
+* @brief Get the chunks of a frame submitted by oclSubmitStereoPanoramaChunks().
+*
+* @param frame		the frame id returned by oclSubmitStereoPanoramaChunks().
+* @param chunks		return the generated panorama chunks.
+* @param wait		wait for the frame if it is not rendered yet.
+*
+* @return true if the chunks are returned, false if the frame is not rendered yet (wait is false).
+*
+* @note The buffers passed in by chunks are recycled by later frames.
+*/
+CV_EXPORTS_W bool oclPollStereoPanoramaChunks(
+	int64 frame,
+	std::vector<UMat>& chunks,
+	bool wait = false);
+
+CV_EXPORTS_W bool oclPollStereoPanoramaChunks(
+	int64 frame,
+	std::vector<UMat>& chunkLs,
+	std::vector<UMat>& chunkRs,
+	bool wait = false);
+
+
+/**
+* @brief Get (and clear) the timings of the render tasks run since the last call.
+*
+* @note At most the last 4096 timings of each render thread are kept.
+*/
+CV_EXPORTS_W void oclGetRenderTaskTimings(std::vector<OclRenderTaskTiming>& timings);
+
+
+/**
+* @brief Get (and clear) the flow quality of the frames rendered since the last call.
+*
+* @note At most the last 4096 frames are kept.
+*/
+CV_EXPORTS_W void oclGetFrameQualities(std::vector<OclFrameQuality>& qualities);
+
+
+/**
+* @brief A device the camera pairs are rendered on (see OclInitParameters::maxDevices).
+*
+* name		the device name, "cpu" on the CPU backend.
+* flowMs	the time of one optical flow of OclInitParameters::opticalFlowSize, measured by oclInitialize().
+* pairs		the camera pairs (chunks) rendered on the device, in proportion to 1/flowMs.
+* threads	the render threads of the device.
+*
+* With maxDevices > 1 the OpenCL context holds all the devices of the platform of the selected one
+* with its type (OpenCV 3 builds its programs for the devices of one context, and the UMats are shared
+* between them), the ones of another name or vendor are not rendered on. Every device gets render
+* threads with their own queues on it and a range of adjacent pairs. The chunks are rendered into the
+* frame buffers, oclRenderStereoPanorama() copies them into the panoramas on the caller's queue, so
+* two devices never write one buffer. There are no more devices than render threads in the memory plan.
+* If there is a single such device, or creating the context fails, it is the single device render.
+*
+* To try it on a CPU runtime, split it into identical devices, e.g. PoCL with
+* POCL_DEVICES="pthread pthread" and POCL_CPU_MAX_CU_COUNT set to half the cores.
+*/
+struct OclRenderDevice {
+	std::string name;
+	double flowMs;
+	std::vector<int> pairs;
+	int threads;
+};
+
+/**
+* @brief The devices chosen by oclInitialize(), a single one unless OclInitParameters::maxDevices > 1.
+*/
+CV_EXPORTS_W void oclGetRenderDevices(std::vector<OclRenderDevice>& devices);
+
+
 /**
 * @brief Clear the previous frame buffers reserved by oclRenderStereoPanoramaChunks().
+*
+* @note The submitted frames are rendered first.
 */
 CV_EXPORTS_W void oclClearPreviousFrames();
 
@@ -193,6 +563,33 @@ CV_EXPORTS_W void oclOffsetHorizontalWrap(
 CV_EXPORTS_W void oclRemoveChunkLines(std::vector<UMat>& chunks);
 
 
+/**
+* @brief The stages of oclPostProcess(), a stage is skipped with its default value.
+*/
+struct OclPostProcessParameters {
+	int chunkWidth = 0;				// as oclRemoveChunkLines() on the chunks of this width
+	float sharpFactor = 0.0f;		// as oclSharpImage()
+	float smoothThreshold = 0.0f;	// as oclSmoothImage() against the previous result
+	bool isPano = true;				// see oclSmoothImage()
+	int wrapOffset = 0;				// as oclOffsetHorizontalWrap()
+};
+
+/**
+* @brief Apply oclRemoveChunkLines(), oclSharpImage(), oclSmoothImage() and oclOffsetHorizontalWrap()
+* to a stacked panorama in one pass.
+*
+* @param pano		the stacked chunks (CV_8UC4).
+* @param previous	the previous result for the smoothing (in the wrapped coordinates), may be empty.
+* @param dst		return the result, must not share the buffer of pano but may be previous.
+* @param params		the stages to apply.
+*/
+CV_EXPORTS_W void oclPostProcess(
+	const UMat& pano,
+	const UMat& previous,
+	UMat& dst,
+	const OclPostProcessParameters& params);
+
+
 }	// namespace imvt
 }	// namespace ocl
 }	// namespace cv
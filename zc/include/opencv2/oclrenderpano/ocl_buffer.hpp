@@ -1,14 +1,86 @@
 #ifndef __OCL_BUFFER_HPP_
 #define __OCL_BUFFER_HPP_
 
+#include <string>
+#include <vector>
 #include <opencv2/core.hpp>
+#include "opencv2/oclrenderpano.hpp"
 
 namespace cv {
 namespace ocl {
 namespace imvt {
 
 
-CV_EXPORTS_W bool oclInitBuffers(int nCams, Size optSize, Size nvSize, int& numThreads);
+/**
+* @brief A buffer of the flow workspace of a render thread, see OclMemoryPlan.
+*
+* first/last	the steps of a flow the buffer is live in: 0 prepare, 1 pyramids, 2 + i the i-th
+*				level (the coarsest first), then the final upscale.
+* slot			the arena slot it is a view of (its top-left corner). The buffers of a slot have
+*				the same type and are never live in the same step.
+*/
+struct OclPlannedBuffer {
+	std::string name;
+	Size size;
+	int type;
+	int first;
+	int last;
+	int slot;
+};
+
+/**
+* @brief The device memory of a render, computed from the shapes and lifetimes of its buffers.
+*
+* budget			the bytes the plan fits in (OclInitParameters::memoryBudget or the device global memory).
+* sharedBytes		the buffers of the camera pairs: previous images, previous and current flows, gamma table.
+* frameBytes		the chunks of the frames in flight.
+* outputBytes		the panoramas of the post-process and their previous ones (allocated by the caller).
+* arenaBytes		the flow workspace of a render thread at the full quality, its buffers aliased.
+* unaliasedBytes	the same workspace with one allocation per buffer.
+* threadBytes		all the workspaces of a render thread: arenaBytes, plus the lower quality ones if
+*					the governor is on (targetFrameMs), plus one for the bands of the incremental flow.
+* numThreads		the render threads the budget fits (at most 4), 0 if none.
+* buffers/slotBytes	the buffers of the full quality arena and the bytes of each slot.
+*
+* The flow workspaces belong to the render threads, not to the camera pairs, so a thread is the
+* unit the budget is split in: the other buffers don't depend on the number of threads.
+* The budget is not enforced on the allocations: the buffers outside the plan (the caller's, the band
+* workspaces) and the free buffers the pools keep for reuse (each pool at most the budget) come on top.
+*/
+struct OclMemoryPlan {
+	size_t budget = 0;
+	size_t sharedBytes = 0;
+	size_t frameBytes = 0;
+	size_t outputBytes = 0;
+	size_t arenaBytes = 0;
+	size_t unaliasedBytes = 0;
+	size_t threadBytes = 0;
+	int numThreads = 0;
+	std::vector<OclPlannedBuffer> buffers;
+	std::vector<size_t> slotBytes;
+};
+
+/**
+* @brief Plan the device memory of a render with params, without allocating anything.
+*
+* @return false if not even one render thread fits the budget.
+*/
+CV_EXPORTS_W bool oclPlanMemory(const OclInitParameters& params, OclMemoryPlan& plan);
+
+/**
+* @brief The plan of the last oclInitialize().
+*/
+CV_EXPORTS_W void oclGetMemoryPlan(OclMemoryPlan& plan);
+
+/**
+* @brief Summary table: the totals of the plan, then the slots of the arena and their buffers.
+*/
+CV_EXPORTS_W std::string oclMemoryPlanSummary(const OclMemoryPlan& plan);
+
+/**
+* @brief The bytes held by the OpenCL buffer pools (OCL, HOST_ALLOC and SVM) for reuse.
+*/
+CV_EXPORTS_W size_t getReservedBufferSize();
 
 
 }	// namespace imvt
@@ -10,8 +10,11 @@ namespace imvt {
 
 CV_EXPORTS_W UMat oclGammaLUT();
 CV_EXPORTS_W UMat oclAntiGammaLUT();
+// @added: 1x256 CV_32F pow(i/256, 1/2.2), the table of the 8-bit oclPreColorAdjustByGamma()
+CV_EXPORTS_W UMat oclAntiGammaLUT8u();
 CV_EXPORTS_W void oclAntiGammaAdjust(const UMat& lut_anti_gamma, UMat& image);
 CV_EXPORTS_W void oclGammaAdjust(const UMat& lut_gamma, UMat& image);
+CV_EXPORTS_W void oclAddBrightnessAndClampMulti(UMat& image, const float value);
 
 CV_EXPORTS_W void oclInitGammaLUT();
 CV_EXPORTS_W void oclReleaseGammaLUT();
@@ -0,0 +1,46 @@
+#ifndef __OCL_KERNELS_HPP__
+#define __OCL_KERNELS_HPP__
+
+#include "opencv2/core.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief Host-side launch counters of the oclrenderpano wrappers.
+*
+* launches	number of kernels enqueued by the wrappers.
+* creations	number of kernel objects built (program cache lookup + clCreateKernel).
+*
+* After oclInitialize() the render path should only increase launches.
+*/
+struct OclKernelStats {
+	int64 launches = 0;
+	int64 creations = 0;
+};
+
+/**
+* @brief Get the launch/creation counters summed over all threads.
+*/
+CV_EXPORTS_W OclKernelStats oclGetKernelStats();
+
+/**
+* @brief Reset the launch/creation counters.
+*/
+CV_EXPORTS_W void oclResetKernelStats();
+
+/**
+* @brief Build all oclrenderpano kernels for the calling thread.
+*
+* @param halfStorage	also build the fp16 storage variants (see OclInitParameters::halfStorage).
+*
+* @note oclInitialize() calls this for the caller and for every render thread.
+*/
+CV_EXPORTS_W void oclPreloadKernels(bool halfStorage = false);
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// __OCL_KERNELS_HPP__
@@ -20,6 +20,51 @@ CV_EXPORTS_W void oclGetWarpOpticalFlow(const UMat& warpBuffer, UMat& warpFlow);
 CV_EXPORTS_W void oclGetWarpComposition(const UMat& warpBuffer, const UMat& warpFlow, UMat& warpComposition, int invertT);
 CV_EXPORTS_W void oclGetNovelViewFlowMag(const UMat& warpBuffer, const UMat& warpFlow, UMat& novelView, UMat& flowMag, int invertT);
 
+/**
+* @brief Render one eye of a chunk from the lazy warp (CV_32FC3) in one launch.
+*
+* Per pixel: bicubically samples both flows at the warp entry and both images at the
+* flow-shifted positions, then blends them as oclCombineLazyViews() does. Gives the result of
+* oclGetWarpOpticalFlow/oclRemap/oclGetWarpComposition/oclRemap/oclGetNovelViewFlowMag for both
+* images and oclCombineLazyViews(), without their intermediate images.
+*/
+CV_EXPORTS_W void oclRenderLazyNovelView(
+	const UMat& warpBuffer,
+	const UMat& imageL, const UMat& imageR,
+	const UMat& flowLtoR, const UMat& flowRtoL, UMat& blendImage);
+
+/**
+* @brief Render one eye of a chunk straight into the columns [panoCol, panoCol + warpBuffer.cols)
+* of pano (CV_8UC4, as many rows as warpBuffer), wrapped around the width of pano.
+*
+* With removeChunkLine the last column of the chunk repeats the one before, as oclRemoveChunkLines() does.
+*/
+CV_EXPORTS_W void oclRenderLazyNovelView(
+	const UMat& warpBuffer,
+	const UMat& imageL, const UMat& imageR,
+	const UMat& flowLtoR, const UMat& flowRtoL,
+	UMat& pano, int panoCol, bool removeChunkLine);
+
+/**
+* @brief The lazy warp of one eye of a chunk in closed form, instead of a CV_32FC3 warp buffer.
+*
+* Entry (x, y) is (camImageWidth/2 - (size.width - x) + slabDisplacement, y, x/size.width).
+*/
+struct OclLazyWarp {
+	Size size;						// numNovelViews x the camera image height
+	int camImageWidth = 0;
+	float slabDisplacement = 0.0f;	// 0 in mono, +/-vergeAtInfinitySlabDisplacement for the left/right eye
+};
+
+/**
+* @brief oclRenderLazyNovelView() with the warp evaluated in the kernel, see OclLazyWarp.
+*/
+CV_EXPORTS_W void oclRenderLazyNovelView(
+	const OclLazyWarp& warp,
+	const UMat& imageL, const UMat& imageR,
+	const UMat& flowLtoR, const UMat& flowRtoL,
+	UMat& pano, int panoCol, bool removeChunkLine);
+
 CV_EXPORTS_W std::pair<UMat, UMat> oclCombineLazyNovelViews(
 	const UMat& warpL,
 	const UMat& warpR,
@@ -41,6 +41,7 @@ the use of this software, even if advised of the possibility of such damage.
 #define __OPENCV_OCL_OPTFLOW_HPP__
 
 
+#include <memory>
 #include "opencv2/core.hpp"
 #include "opencv2/oclrenderpano.hpp"
 
@@ -50,12 +51,22 @@ namespace imvt {
 CV_EXPORTS_W void oclSobleX(const UMat& src, UMat& dst);
 CV_EXPORTS_W void oclSobleY(const UMat& src, UMat& dst);
 CV_EXPORTS_W void oclScale(const UMat& src, UMat& dst, float factor);
+CV_EXPORTS_W void oclScale(const UMat& src, UMat& dst, const UMat& factor);
+CV_EXPORTS_W void oclIntensityRatio(const UMat& lhs, const UMat& lhsAlpha, const UMat& rhs, const UMat& rhsAlpha,
+	UMat& ratio, UMat& sums = UMat());
 CV_EXPORTS_W void oclResize(const UMat& src, UMat& dst, Size dsize);
+CV_EXPORTS_W void oclResizeLinear(const UMat& src, UMat& dst, Size dsize);
+CV_EXPORTS_W void oclConvert(const UMat& src, UMat& dst, int dtype, float factor);
+CV_EXPORTS_W void oclMedianBlur5(const UMat& src, UMat& dst);
 CV_EXPORTS_W void oclMotionDetection(const UMat& cur, const UMat& pre, UMat& motion);
 CV_EXPORTS_W void oclMotionDetectionV2(const UMat& cur, const UMat& pre, UMat& motion);
+CV_EXPORTS_W void oclMotionTiles(const UMat& cur0, const UMat& pre0, const UMat& cur1, const UMat& pre1, int tileSize, UMat& tiles);
 CV_EXPORTS_W void oclAdjustFlowTowardPrevious(const UMat& prevFlow, const UMat& motion, UMat& flow);
 CV_EXPORTS_W void oclAdjustFlowTowardPreviousV2(const UMat& prevFlow, const UMat& motion, UMat& flow, float motionThreshhold);
-CV_EXPORTS_W void oclEstimateFlow(const UMat& I0, const UMat& I1, const UMat& alpha0, const UMat& alpha1, UMat& flow, const Rect& box);
+CV_EXPORTS_W void oclEstimateFlow(const UMat& I0, const UMat& I1, const UMat& alpha0, const UMat& alpha1, UMat& flow, const Rect& box,
+	int maxPercentage = 0);
+CV_EXPORTS_W void oclSearchInitialFlow(const UMat& I0, const UMat& I1, const UMat& alpha0, const UMat& alpha1, UMat& flow,
+	const Rect& box, int maxPercentage);
 CV_EXPORTS_W void oclAlphaFlowDiffusion(const UMat& alpha0, const UMat& alpha1, const UMat& blurredFlow, UMat& flow); 
 CV_EXPORTS_W void oclSweepFromTopLeft(
 	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y, 
@@ -75,7 +86,15 @@ CV_EXPORTS_W void oclSweepFromRight(
 CV_EXPORTS_W void oclSweepFromBottom(
 	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow);
+CV_EXPORTS_W void oclSweepWavefrontFromTopLeft(
+	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
+	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow);
+CV_EXPORTS_W void oclSweepWavefrontFromBottomRight(
+	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
+	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow);
 CV_EXPORTS_W void oclGaussianBlur(const UMat& src, UMat& dst, Size ksize, double sigma);
+CV_EXPORTS_W void oclGradientBlur(const UMat& I0, const UMat& I1,
+	UMat& I0x, UMat& I0y, UMat& I1x, UMat& I1y, Size ksize, double sigma);
 CV_EXPORTS_W void oclGaussianBlurV2(const UMat& src, UMat& dst, Size ksize, double sigma, UMat& tmp = UMat());
 CV_EXPORTS_W void oclSmoothImageV2(UMat& pano, const UMat& previous, float thresh_hold, bool isPano);
 
@@ -86,6 +105,95 @@ enum class DirectionHint {
 	LEFT,
 	UP
 };
+
+/**
+* @brief The quality knobs of oclComputeOpticalFlow, the defaults (or no quality) are the full quality.
+*
+* downscaleFactor			the optical flow resolution, relative to the images.
+* pyrScaleFactor			the scale between two pyramid levels, lower is fewer levels.
+* pyrMaxLevels				at most this many pyramid levels, the coarsest ones are left out.
+* slashSweeping				the diagonal sweeps: -1 below 400 columns, 0 never, 1 always.
+* medianPasses				the median filters of each level, 2 (after both sweeps), 1 (the last) or 0.
+* temporalRegularization	adjust the flow toward the previous flow, if there is one.
+*/
+struct OclFlowQuality {
+	float downscaleFactor = 0.5f;
+	float pyrScaleFactor = 0.9f;
+	int pyrMaxLevels = 1000;
+	int slashSweeping = -1;
+	int medianPasses = 2;
+	bool temporalRegularization = true;
+};
+
+/**
+* @brief The quality levels the governor steps through (see OclInitParameters::targetFrameMs).
+*
+* FLOW_QUALITY_FULL			the defaults of OclFlowQuality.
+* FLOW_QUALITY_NO_SLASH		without the diagonal sweeps.
+* FLOW_QUALITY_SHALLOW		pyramid scale 0.8 (about half the levels) and one median.
+* FLOW_QUALITY_REDUCED		as FLOW_QUALITY_SHALLOW at 3/8 of the resolution.
+* FLOW_QUALITY_LOWEST		pyramid scale 0.75 at 1/4 of the resolution.
+*
+* The temporal regularization is kept at every level, it hides the switches between them.
+*/
+enum OclFlowQualityLevel {
+	FLOW_QUALITY_FULL = 0,
+	FLOW_QUALITY_NO_SLASH = 1,
+	FLOW_QUALITY_SHALLOW = 2,
+	FLOW_QUALITY_REDUCED = 3,
+	FLOW_QUALITY_LOWEST = 4,
+	FLOW_QUALITY_LEVELS
+};
+
+/**
+* @brief The knobs of an OclFlowQualityLevel.
+*/
+CV_EXPORTS_W OclFlowQuality oclFlowQualityLevel(int level);
+
+/**
+* @brief Buffers of one pyramid level of oclComputeOpticalFlow.
+*/
+struct OclFlowLevel {
+	Size size;
+	UMat I0, I1, alpha0, alpha1;		// CV_32FC1 (CV_16SC1 in the fp16 storage)
+	UMat prevFlow;						// CV_32FC2 (CV_16SC2 in the fp16 storage)
+	UMat motion;						// CV_32FC1 (CV_16SC1 in the fp16 storage)
+	UMat I0x, I0y, I1x, I1y;			// CV_32FC1 (CV_16SC1 in the fp16 storage)
+	UMat flow, flowTmp, blurredFlow;	// CV_32FC2 (CV_16SC2 in the fp16 storage)
+};
+
+/**
+* @brief All pyramid levels and temporaries oclComputeOpticalFlow needs for one image size.
+*
+* create() allocates every buffer with its final size and type, so a flow computed with
+* a workspace of the right size doesn't allocate any UMat of its own. Buffers of the same
+* type whose steps don't overlap are views of one allocation (see OclMemoryPlan).
+* Keep one workspace per render thread so buffers are never shared between concurrent
+* flows, the incremental state of a camera pair is copied in and out of incrementalFlows.
+* With half, the float buffers are the fp16 storage (see OclInitParameters::halfStorage).
+* The level sizes follow the downscaleFactor, pyrScaleFactor and pyrMaxLevels of quality.
+* The incremental flow (see OclIncrementalFlow) computes its bands in the band workspaces.
+*/
+struct CV_EXPORTS OclFlowWorkspace {
+	Size imageSize;
+	bool halfStorage = false;
+	OclFlowQuality quality;
+	UMat rgba0, rgba1, prevRgba0, prevRgba1;	// downscaled CV_8UC4
+	UMat grey0, grey1;							// downscaled CV_8UC1
+	UMat blurTmp;								// downscaled CV_32FC1/CV_16SC1
+	std::vector<UMat> channels0, channels1;		// downscaled 4 x CV_8UC1
+	std::vector<OclFlowLevel> levels;			// levels[0] is the downscaled size
+	UMat finalFlowTmp;							// imageSize CV_32FC2/CV_16SC2
+	std::vector<std::shared_ptr<OclFlowWorkspace> > bands;	// of the incremental flow
+	float recomputed = 1.0f;					// fraction of the tiles the last flow computed
+	int incrementalFlows = 0;					// incremental flows since the last whole one
+
+	void create(Size imageSize, bool half = false, const OclFlowQuality& quality = OclFlowQuality());
+	void release();
+	bool empty() const;
+	size_t byteSize() const;
+};
+
 CV_EXPORTS_W void oclComputeOpticalFlow(
 	const UMat& I0BGRA,
 	const UMat& I1BGRA,
@@ -95,7 +203,74 @@ CV_EXPORTS_W void oclComputeOpticalFlow(
 	UMat& flow,
 	DirectionHint hint,
 	float motionThreshhold = 1.0f,
-	const OclInitParameters* params = nullptr);
+	const OclInitParameters* params = nullptr,
+	OclFlowWorkspace* workspace = nullptr,
+	const OclFlowQuality* quality = nullptr);
+
+/**
+* @brief The difference between the flows computed by two configurations
+* (two sweep engines, see OclSweepEngine, or the fp32 and fp16 storages).
+*
+* meanEndpointDiff/maxEndpointDiff	|flowA - flowB| in pixels.
+* meanWarpErrorA/meanWarpErrorB		mean grey difference in [0, 1] between I0 and I1 warped by each flow,
+*									over the pixels that are opaque in both.
+*/
+struct OclFlowComparison {
+	double meanEndpointDiff = 0;
+	double maxEndpointDiff = 0;
+	double meanWarpErrorA = 0;
+	double meanWarpErrorB = 0;
+};
+typedef OclFlowComparison OclSweepComparison;
+
+/**
+* @brief Compute the flow of one image pair with two sweep engines and compare them.
+*/
+CV_EXPORTS_W OclFlowComparison oclCompareSweepEngines(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	DirectionHint hint,
+	const OclInitParameters* params,
+	int engineA = SWEEP_ROWS_COLS,
+	int engineB = SWEEP_WAVEFRONT);
+
+/**
+* @brief Compute the flow of one image pair in the fp32 (A) and the fp16 (B) storage and compare them
+* (see OclInitParameters::halfStorage).
+*/
+CV_EXPORTS_W OclFlowComparison oclCompareStoragePrecisions(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	DirectionHint hint,
+	const OclInitParameters* params);
+
+/**
+* @brief The difference between the OpenCL (A) and the CPU (B) backends (see OclBackend).
+*
+* flow					the flows of the image pair, in the storage of params (see OclInitParameters::halfStorage).
+* maxProjectionDiff		the max channel difference of oclProjection() with a bicubic map.
+* maxNovelViewDiff		of oclRenderLazyNovelView() from the OpenCL flows.
+* maxPostProcessDiff	of oclPostProcess() with chunk lines, sharpening, smoothing and an offset.
+* maxColorAdjustDiff	of oclAntiGammaAdjust() and oclAddBrightnessAndClampMulti() (16 bits).
+*/
+struct OclBackendComparison {
+	OclFlowComparison flow;
+	double maxProjectionDiff = 0;
+	double maxNovelViewDiff = 0;
+	double maxPostProcessDiff = 0;
+	double maxColorAdjustDiff = 0;
+};
+
+/**
+* @brief Run the exported functions of the render path on one image pair with both backends and compare them.
+*
+* @note OpenCL must be active, i.e. oclInitialize() chose BACKEND_OPENCL.
+*/
+CV_EXPORTS_W OclBackendComparison oclCompareBackends(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	DirectionHint hint,
+	const OclInitParameters* params);
 
 }	// namespace imvt
 }	// namespace ocl
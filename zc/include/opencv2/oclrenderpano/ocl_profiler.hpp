@@ -0,0 +1,74 @@
+#ifndef __OCL_PROFILER_HPP__
+#define __OCL_PROFILER_HPP__
+
+#include <string>
+#include <vector>
+#include "opencv2/core.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief A profiled kernel launch or stage of the oclrenderpano wrappers.
+*
+* name		the kernel name, or the stage name if isStage.
+* stage		the innermost stage the kernel was launched in ("" if none).
+* camera	the chunk (camera pair) index, -1 if not rendering a chunk.
+* frame		the frame id (see oclSubmitStereoPanoramaChunks()), -1 if not rendering a chunk.
+* thread	the render thread index, -1 for the caller thread.
+* queuedMs/submitMs/startMs/endMs	device timestamps, in milliseconds since the first record.
+*
+* A stage spans all the commands of its scope on the queue, including the ones enqueued
+* by OpenCV itself (e.g. medianBlur), so nested stages are included in their parents.
+*/
+struct OclProfileRecord {
+	std::string name;
+	std::string stage;
+	bool isStage;
+	int camera;
+	int64 frame;
+	int thread;
+	double queuedMs;
+	double submitMs;
+	double startMs;
+	double endMs;
+};
+
+/**
+* @brief Start/stop profiling the kernels and stages of all threads.
+*
+* While enabled, every thread switches its default queue to a profiling queue before its
+* next launch, and an event of each launch is kept until oclGetProfileRecords().
+*
+* @note The profiler times OpenCL events, it stays disabled on the CPU backend (see OclBackend).
+*/
+CV_EXPORTS_W void oclEnableProfiling(bool enable);
+
+/**
+* @brief Whether profiling is enabled.
+*/
+CV_EXPORTS_W bool oclProfilingEnabled();
+
+/**
+* @brief Get (and clear) the records profiled so far, waiting for their commands to complete.
+*/
+CV_EXPORTS_W void oclGetProfileRecords(std::vector<OclProfileRecord>& records);
+
+/**
+* @brief Summary table: count, total/mean/max device time per stage and per kernel.
+*/
+CV_EXPORTS_W std::string oclProfileSummary(const std::vector<OclProfileRecord>& records);
+
+/**
+* @brief Write the records as Chrome trace JSON (chrome://tracing, Perfetto).
+*
+* Each thread is a track, camera/frame and the queued/submit timestamps are event args.
+*/
+CV_EXPORTS_W bool oclWriteChromeTrace(const std::string& path, const std::vector<OclProfileRecord>& records);
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// __OCL_PROFILER_HPP__
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <map>
+#include <vector>
+#include <mutex>
 #include "opencv2/core.hpp"
 
 namespace cv {
@@ -11,6 +13,25 @@ namespace imvt {
 
 using std::map;
 using std::string;
+using std::vector;
+
+/**
+* @brief The difference of a key between two kinds, see MatTrace::compare().
+*
+* sameShape			both have the key with the same size and type, otherwise the errors are 0.
+* maxError/meanError	|a - b| over all elements and channels.
+* msA/msB				the stage time of each (see MatTrace::capture()), 0 if added.
+*/
+struct MatTraceDiff {
+	string key;
+	bool inA = false;
+	bool inB = false;
+	bool sameShape = false;
+	double maxError = 0;
+	double meanError = 0;
+	double msA = 0;
+	double msB = 0;
+};
 
 struct CV_EXPORTS_W MatTrace {
 	static MatTrace& instance();
@@ -23,9 +44,61 @@ struct CV_EXPORTS_W MatTrace {
 
 	map<string, Mat> diff(const string& kind1, const string& kind2);
     Mat diff(const string& kind1, const string& kind2, const string& key);
+
+	// @added: recording the intermediates of the render path
+
+	/**
+	* @brief Start capturing into kind (cleared first), until stop().
+	*
+	* The flow and the harness call capture() at every stage while recording,
+	* which costs an ocl::finish() and a download per stage.
+	* Recording, its kind, scope and stage clock belong to the calling thread, so the flows
+	* of concurrent threads don't capture into one another's kind or scope.
+	*/
+	void record(const string& kind);
+	void stop();
+	bool recording() const;
+
+	/**
+	* @brief The prefix of the next captured keys of the calling thread (e.g. "flow LtoR"),
+	* restarts its stage clock.
+	*/
+	void scope(const string& name);
+
+	/**
+	* @brief Add value as <scope>/key to the recorded kind, with the milliseconds since the previous
+	* capture (or scope()) as its stage time. No-op if the calling thread is not recording.
+	*
+	* @param half	value is the fp16 storage (CV_16S holding fp16 bits, see OclInitParameters::halfStorage),
+	*				it is captured as float so fp32 and fp16 runs compare. Other CV_16S data is kept as is.
+	*/
+	void capture(const string& key, const UMat& value, bool half = false);
+	void capture(const string& key, const Mat& value, bool half = false);
+
+	/**
+	* @brief The keys of kind in the order they were added.
+	*/
+	vector<string> keys(const string& kind);
+	double time(const string& kind, const string& key);
+
+	/**
+	* @brief Save kind to (load it from) a trace bundle, a binary file of all keys, stage times and matrices.
+	*/
+	bool save(const string& kind, const string& path);
+	bool load(const string& path, const string& kind);
+
+	/**
+	* @brief Compare the keys of two kinds, in the order of kindA then the keys only in kindB.
+	*/
+	vector<MatTraceDiff> compare(const string& kindA, const string& kindB);
             
 private:
+	void put(const string& kind, const string& key, const Mat& value, double ms);
+
 	map<string, map<string, Mat>> mats;
+	map<string, vector<string>> order;			// @added
+	map<string, map<string, double>> times;		// @added
+	std::mutex mutex;
 };
 
 CV_EXPORTS_W string format(const char* fmt, ...);
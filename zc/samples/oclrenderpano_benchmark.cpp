@@ -0,0 +1,614 @@
+/*
+* Benchmark of the oclrenderpano pipeline on a synthetic camera rig.
+*
+* Every frame runs upload -> oclProjection -> oclRenderStereoPanoramaChunks -> oclStackHorizontal
+* -> post-process (oclSharpImage + oclOffsetHorizontalWrap), or with --direct renders the chunks
+* straight into the eye panoramas and post-processes them with oclPostProcess, and reports per-stage and end-to-end
+* latency percentiles, frames/s and the peak buffer-pool usage, optionally as JSON for diffing
+* the results of two commits.
+*
+* The rig is N side cameras looking at a textured panorama that scrolls horizontally. The left
+* overlap of each camera is displaced by a per-row disparity, so the ground truth L->R flow of
+* every camera pair is (-disparity(y), 0) and the flow error of pair 0 is reported too.
+*
+* Run it on a CPU OpenCL device (e.g. PoCL) with:
+*	OPENCV_OPENCL_DEVICE=:CPU: ./example_oclrenderpano_oclrenderpano_benchmark --json=bench.json
+*
+* --backend=cpu runs the native CPU backend instead (see OclBackend). --compare-backends runs
+* OpenCL first, compares the results of both backends on the last frame (oclCompareBackends())
+* and runs the same frames on the CPU backend to report its throughput next to the OpenCL one.
+*/
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/core/ocl.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/oclrenderpano.hpp"
+#include "opencv2/oclrenderpano/ocl_buffer.hpp"
+#include "opencv2/oclrenderpano/ocl_kernels.hpp"
+#include "opencv2/oclrenderpano/ocl_optflow.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+static const char* keys =
+	"{help h       |      | print this message }"
+	"{cams         | 8    | number of side cameras }"
+	"{width        | 512  | width of the equirect image of a camera }"
+	"{height       | 512  | height of the equirect images }"
+	"{overlap      | 128  | width of the overlap of two cameras (optical flow width) }"
+	"{disparity    | 8    | max ground truth disparity in pixels }"
+	"{speed        | 2    | horizontal scene motion in pixels per frame }"
+	"{frames       | 100  | number of measured frames }"
+	"{warmup       | 5    | number of frames run before measuring }"
+	"{threads      | 0    | number of render threads, 0 for the default }"
+	"{mono         |      | render mono chunks instead of stereo }"
+	"{async        |      | pipeline frames with oclSubmit/oclPollStereoPanoramaChunks }"
+	"{direct       |      | render the chunks straight into the panoramas, fused post-process (not with async) }"
+	"{half         |      | keep flows, pyramids and gradients in fp16 (OclInitParameters::halfStorage) }"
+	"{fixed        |      | project with the fixed-point maps of oclCompileProjectionMaps() }"
+	"{backend      | auto | auto, opencl or cpu (OclInitParameters::backend) }"
+	"{compare-backends |  | run OpenCL, then the CPU backend, and compare their results and fps }"
+	"{seed         | 1    | seed of the scene texture }"
+	"{json         |      | write the results to this JSON file }";
+
+static double nowMs() {
+	return getTickCount() * 1000.0 / getTickFrequency();
+}
+
+
+/**
+* @brief N side cameras around a scrolling textured panorama.
+*
+* Camera i sees the texture columns [i*step, i*step + width) with step = width - overlap,
+* so its right overlap and the left overlap of camera i+1 see the same columns. The left
+* overlap of each camera is shifted by disparity(y), fading out over the next overlap width.
+*/
+class SyntheticRig {
+public:
+	SyntheticRig(int numCams, int width, int height, int overlap, float maxDisparity, uint64 seed)
+		: numCams(numCams), width(width), height(height), overlap(overlap), maxDisparity(maxDisparity) {
+		CV_Assert(numCams >= 2 && overlap > 0 && width >= 3 * overlap);
+		int step = width - overlap;
+		Size size(numCams * step, height);
+
+		// coarse and fine noise, upscaled so the texture keeps its contrast
+		RNG rng(seed);
+		Mat coarse(Size(size.width / 16 + 1, size.height / 16 + 1), CV_8UC3);
+		Mat fine(Size(size.width / 2 + 1, size.height / 2 + 1), CV_8UC3);
+		rng.fill(coarse, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+		rng.fill(fine, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+		resize(coarse, coarse, size, 0, 0, INTER_CUBIC);
+		resize(fine, fine, size, 0, 0, INTER_LINEAR);
+		addWeighted(coarse, 0.65, fine, 0.35, 0, texture);
+
+		ymap.create(height, width, CV_32FC1);
+		xmaps.resize(numCams);
+		for (int i = 0; i < numCams; ++i) {
+			xmaps[i].create(height, width, CV_32FC1);
+			for (int y = 0; y < height; ++y) {
+				float d = disparity(y);
+				float* xrow = xmaps[i].ptr<float>(y);
+				float* yrow = ymap.ptr<float>(y);
+				for (int x = 0; x < width; ++x) {
+					float fade = x < overlap ? 1.0f : std::max(0.0f, 2.0f - float(x) / overlap);
+					xrow[x] = float(i * step + x) + d * fade;
+					yrow[x] = float(y);
+				}
+			}
+		}
+	}
+
+	float disparity(int y) const {
+		return maxDisparity * 0.5f * (1.0f + float(sin(4.0 * CV_PI * y / height)));
+	}
+
+	// the camera images (CV_8UC3) of a frame
+	void render(int frame, float speed, vector<Mat>& images) const {
+		float shift = float(fmod(double(frame) * speed, double(texture.cols)));
+		images.resize(numCams);
+		Mat xmap;
+		for (int i = 0; i < numCams; ++i) {
+			add(xmaps[i], Scalar::all(shift), xmap);
+			remap(texture, images[i], xmap, ymap, INTER_LINEAR, BORDER_WRAP);
+		}
+	}
+
+	// mean and max end point error of a L->R flow (CV_32FC2) of any pair, borders excluded
+	void flowError(const Mat& flow, double& mean, double& max) const {
+		int border = 8;
+		double sum = 0;
+		int count = 0;
+		max = 0;
+		for (int y = border; y < flow.rows - border; ++y) {
+			const Point2f* row = flow.ptr<Point2f>(y);
+			float d = disparity(y);
+			for (int x = border; x < flow.cols - border; ++x) {
+				float dx = row[x].x + d;
+				float dy = row[x].y;
+				double e = sqrt(dx * dx + dy * dy);
+				sum += e;
+				max = std::max(max, e);
+				count++;
+			}
+		}
+		mean = count > 0 ? sum / count : 0;
+	}
+
+	const int numCams;
+	const int width;
+	const int height;
+	const int overlap;
+	const float maxDisparity;
+
+private:
+	Mat texture;
+	Mat ymap;
+	vector<Mat> xmaps;
+};
+
+
+/**
+* @brief The latencies of a stage, one per measured frame.
+*/
+struct StageTimes {
+	string name;
+	vector<double> ms;
+
+	double percentile(double p) const {
+		if (ms.empty()) {
+			return 0;
+		}
+		vector<double> sorted(ms);
+		sort(sorted.begin(), sorted.end());
+		double rank = p * (sorted.size() - 1);
+		size_t lo = size_t(rank);
+		size_t hi = std::min(lo + 1, sorted.size() - 1);
+		return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+	}
+
+	double mean() const {
+		double sum = 0;
+		for (double v : ms) {
+			sum += v;
+		}
+		return ms.empty() ? 0 : sum / ms.size();
+	}
+};
+
+
+/**
+* @brief The device buffers of a frame, kept until its chunks are polled.
+*/
+struct FrameSlot {
+	vector<UMat> cams;
+	vector<UMat> spheres;
+	vector<UMat> imageLs;
+	vector<UMat> imageRs;
+	int64 id = -1;
+	double startMs = 0;
+	double uploadMs = 0;
+	double projectionMs = 0;
+	double submitMs = 0;
+};
+
+
+class Benchmark {
+public:
+	Benchmark(const SyntheticRig& rig, bool stereo, bool direct, bool fixed) : rig(rig), stereo(stereo), direct(direct) {
+		cpu = oclActiveBackend() == BACKEND_CPU;
+		device = cpu ? "cpu" : ocl::Device::getDefault().name();
+		const char* names[] = { "upload", "projection", "render", "stack", "post-process" };
+		for (const char* name : names) {
+			StageTimes s;
+			s.name = name;
+			stages.push_back(s);
+		}
+		endToEnd.name = "end-to-end";
+
+		Mat x(rig.height, rig.width, CV_32FC1);
+		Mat y(rig.height, rig.width, CV_32FC1);
+		for (int r = 0; r < rig.height; ++r) {
+			for (int c = 0; c < rig.width; ++c) {
+				x.at<float>(r, c) = float(c);
+				y.at<float>(r, c) = float(r);
+			}
+		}
+		// the spheres are the camera images themselves, the remap cost is the real one
+		UMat ux, uy;
+		x.copyTo(ux);
+		y.copyTo(uy);
+		xmaps.assign(rig.numCams, ux);
+		ymaps.assign(rig.numCams, uy);
+		if (fixed) {
+			oclCompileProjectionMaps(xmaps, ymaps, vector<Size>(rig.numCams, Size(rig.width, rig.height)), fixedMaps);
+		}
+	}
+
+	// upload and project the camera images into slot
+	void prepare(const vector<Mat>& images, FrameSlot& slot) {
+		slot.startMs = nowMs();
+		slot.cams.resize(images.size());
+		for (size_t i = 0; i < images.size(); ++i) {
+			images[i].copyTo(slot.cams[i]);
+		}
+		ocl::finish();
+		double t = nowMs();
+		slot.uploadMs = t - slot.startMs;
+
+		if (fixedMaps.empty()) {
+			oclProjection(slot.cams, xmaps, ymaps, slot.spheres);
+		} else {
+			oclProjection(slot.cams, fixedMaps, slot.spheres);
+			ocl::finish();
+		}
+		slot.projectionMs = nowMs() - t;
+
+		int n = rig.numCams;
+		Rect right(rig.width - rig.overlap, 0, rig.overlap, rig.height);
+		Rect left(0, 0, rig.overlap, rig.height);
+		slot.imageLs.resize(n);
+		slot.imageRs.resize(n);
+		for (int i = 0; i < n; ++i) {
+			slot.imageLs[i] = slot.spheres[i](right);
+			slot.imageRs[i] = slot.spheres[(i + 1) % n](left);
+		}
+	}
+
+	// stack and post-process the chunks of slot, and record its timings if measured
+	void finish(FrameSlot& slot, double renderMs, bool measured) {
+		double t0 = nowMs();
+		if (direct) {
+			// the eyes are rendered as stacked chunks already, oclPostProcess() writes them into the pano
+			int eyes = stereo ? 2 : 1;
+			pano.create(directEyes[0].rows*eyes, directEyes[0].cols, CV_8UC4);
+		} else if (stereo) {
+			vector<UMat> eyes(2);
+			oclStackHorizontal(chunkLs, eyes[0]);
+			oclStackHorizontal(chunkRs, eyes[1]);
+			oclStackVertical(eyes, pano);
+		} else {
+			oclStackHorizontal(chunkLs, pano);
+		}
+		ocl::finish();
+		double t1 = nowMs();
+
+		if (direct) {
+			OclPostProcessParameters post;
+			post.sharpFactor = 0.5f;
+			post.wrapOffset = rig.overlap / 2;
+			for (int i = 0; i < (stereo ? 2 : 1); ++i) {
+				UMat eye = pano(Rect(0, i*directEyes[i].rows, directEyes[i].cols, directEyes[i].rows));
+				oclPostProcess(directEyes[i], UMat(), eye, post);
+			}
+		} else {
+			oclSharpImage(pano, 0.5f);
+			oclOffsetHorizontalWrap(pano, float(rig.overlap) * 0.5f);
+		}
+		ocl::finish();
+		double t2 = nowMs();
+
+		peakReserved = std::max(peakReserved, getReservedBufferSize());
+		if (measured) {
+			double times[] = { slot.uploadMs, slot.projectionMs, renderMs, t1 - t0, t2 - t1 };
+			for (size_t i = 0; i < stages.size(); ++i) {
+				stages[i].ms.push_back(times[i]);
+			}
+			endToEnd.ms.push_back(t2 - slot.startMs);
+		}
+	}
+
+	// every stage runs to completion before the next one
+	void runSync(int frames, int warmup, float speed) {
+		FrameSlot slot;
+		vector<Mat> images;
+		for (int frame = 0; frame < warmup + frames; ++frame) {
+			if (frame == warmup) {
+				startMeasure();
+			}
+			double t = nowMs();
+			rig.render(frame, speed, images);
+			excludedMs += nowMs() - t;
+
+			prepare(images, slot);
+			t = nowMs();
+			if (direct && stereo) {
+				oclRenderStereoPanorama(slot.imageLs, slot.imageRs, directEyes[0], directEyes[1], 0, 1.0f);
+			} else if (direct) {
+				oclRenderStereoPanorama(slot.imageLs, slot.imageRs, directEyes[0], 0, 1.0f);
+			} else if (stereo) {
+				oclRenderStereoPanoramaChunks(slot.imageLs, slot.imageRs, chunkLs, chunkRs);
+			} else {
+				oclRenderStereoPanoramaChunks(slot.imageLs, slot.imageRs, chunkLs);
+			}
+			finish(slot, nowMs() - t, frame >= warmup);
+		}
+		stopMeasure(frames);
+		lastImageL = slot.imageLs[0];
+		lastImageR = slot.imageRs[0];
+	}
+
+	// frame k is uploaded, projected and submitted while frame k - inFlight + 1 is rendered,
+	// "render" is the time from its submission to the end of its poll
+	void runAsync(int frames, int warmup, float speed, int inFlight) {
+		vector<FrameSlot> slots(inFlight);
+		vector<Mat> images;
+		int total = warmup + frames;
+		for (int frame = 0; frame < total + inFlight - 1; ++frame) {
+			if (frame == warmup) {
+				startMeasure();
+			}
+			if (frame < total) {
+				double t = nowMs();
+				rig.render(frame, speed, images);
+				excludedMs += nowMs() - t;
+
+				FrameSlot& slot = slots[frame % inFlight];
+				prepare(images, slot);
+				slot.submitMs = nowMs();
+				slot.id = oclSubmitStereoPanoramaChunks(slot.imageLs, slot.imageRs);
+				CV_Assert(slot.id >= 0);
+			}
+			int done = frame - inFlight + 1;
+			if (done >= 0) {
+				FrameSlot& slot = slots[done % inFlight];
+				if (stereo) {
+					oclPollStereoPanoramaChunks(slot.id, chunkLs, chunkRs, true);
+				} else {
+					oclPollStereoPanoramaChunks(slot.id, chunkLs, true);
+				}
+				finish(slot, nowMs() - slot.submitMs, done >= warmup);
+			}
+		}
+		stopMeasure(frames);
+		const FrameSlot& last = slots[(total - 1) % inFlight];
+		lastImageL = last.imageLs[0];
+		lastImageR = last.imageRs[0];
+	}
+
+	// the flow of pair 0 of the last frame against the ground truth
+	void measureFlow(const OclInitParameters& params) {
+		UMat flow;
+		oclComputeOpticalFlow(lastImageL, lastImageR, UMat(), UMat(), UMat(), flow,
+			DirectionHint::LEFT, 1.0f, &params);
+		Mat f;
+		if (flow.depth() == CV_16S) {
+			convertFp16(flow.getMat(ACCESS_READ), f);
+		} else {
+			flow.copyTo(f);
+		}
+		rig.flowError(f, flowMeanError, flowMaxError);
+	}
+
+	// both backends on pair 0 of the last frame, OpenCL must be active
+	OclBackendComparison compareBackends(const OclInitParameters& params) const {
+		return oclCompareBackends(lastImageL, lastImageR, DirectionHint::LEFT, &params);
+	}
+
+	const string& deviceName() const {
+		return device;
+	}
+
+	double framesPerSecond() const {
+		return fps;
+	}
+
+	void print() const {
+		printf("%-16s %10s %10s %10s %10s %10s\n", "stage(ms)", "mean", "p50", "p90", "p99", "max");
+		for (const StageTimes& s : stages) {
+			printRow(s);
+		}
+		printRow(endToEnd);
+		printf("\nfps: %.2f\n", fps);
+		printf("peak reserved buffer size: %.1f MB\n", peakReserved / 1048576.0);
+		printf("kernel launches per frame: %.1f, kernel creations: %lld\n",
+			launchesPerFrame, (long long)kernelCreations);
+		printf("flow error of pair 0: mean %.3f, max %.3f pixels\n", flowMeanError, flowMaxError);
+	}
+
+	// with cpuBench and diff, the results of --compare-backends
+	bool writeJson(const string& path, const OclInitParameters& params, const CommandLineParser& parser,
+		const Benchmark* cpuBench = nullptr, const OclBackendComparison* diff = nullptr) const {
+		FILE* fp = fopen(path.c_str(), "w");
+		if (!fp) {
+			return false;
+		}
+		string device = this->device;
+		replace(device.begin(), device.end(), '"', '\'');
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"config\": {\"device\": \"%s\", \"backend\": \"%s\", \"mode\": \"%s\", \"async\": %s, \"direct\": %s, \"half\": %s, \"fixed\": %s, "
+			"\"cams\": %d, \"width\": %d, \"height\": %d, \"overlap\": %d, \"novel_views\": %d, "
+			"\"disparity\": %.2f, \"speed\": %.2f, \"frames\": %d, \"warmup\": %d, \"threads\": %d},\n",
+			device.c_str(), cpu ? "cpu" : "opencl", stereo ? "stereo" : "mono", parser.has("async") ? "true" : "false",
+			direct ? "true" : "false",
+			params.halfStorage ? "true" : "false", fixedMaps.empty() ? "false" : "true",
+			rig.numCams, rig.width, rig.height, rig.overlap, params.numNovelViews,
+			rig.maxDisparity, parser.get<float>("speed"), parser.get<int>("frames"), parser.get<int>("warmup"),
+			params.numRenderThreads);
+		fprintf(fp, "  \"stages\": {\n");
+		for (size_t i = 0; i < stages.size(); ++i) {
+			fprintf(fp, "    \"%s\": ", stages[i].name.c_str());
+			writeStats(fp, stages[i]);
+			fprintf(fp, "%s\n", i + 1 < stages.size() ? "," : "");
+		}
+		fprintf(fp, "  },\n");
+		fprintf(fp, "  \"end_to_end\": ");
+		writeStats(fp, endToEnd);
+		fprintf(fp, ",\n");
+		fprintf(fp, "  \"fps\": %.3f,\n", fps);
+		fprintf(fp, "  \"peak_reserved_bytes\": %llu,\n", (unsigned long long)peakReserved);
+		fprintf(fp, "  \"kernel_launches_per_frame\": %.1f,\n", launchesPerFrame);
+		fprintf(fp, "  \"kernel_creations\": %lld,\n", (long long)kernelCreations);
+		fprintf(fp, "  \"flow_error\": {\"mean\": %.4f, \"max\": %.4f}%s\n", flowMeanError, flowMaxError, cpuBench && diff ? "," : "");
+		if (cpuBench && diff) {
+			fprintf(fp, "  \"backend_comparison\": {\"cpu_fps\": %.3f, \"cpu_fps_ratio\": %.3f, \"cpu_end_to_end\": ",
+				cpuBench->fps, fps > 0 ? cpuBench->fps / fps : 0);
+			writeStats(fp, cpuBench->endToEnd);
+			fprintf(fp, ",\n    \"cpu_flow_error\": {\"mean\": %.4f, \"max\": %.4f}, "
+				"\"flow\": {\"mean_endpoint_diff\": %.4f, \"max_endpoint_diff\": %.4f, \"mean_warp_error_opencl\": %.4f, \"mean_warp_error_cpu\": %.4f},\n"
+				"    \"max_projection_diff\": %.1f, \"max_novel_view_diff\": %.1f, \"max_post_process_diff\": %.1f, \"max_color_adjust_diff\": %.1f}\n",
+				cpuBench->flowMeanError, cpuBench->flowMaxError,
+				diff->flow.meanEndpointDiff, diff->flow.maxEndpointDiff, diff->flow.meanWarpErrorA, diff->flow.meanWarpErrorB,
+				diff->maxProjectionDiff, diff->maxNovelViewDiff, diff->maxPostProcessDiff, diff->maxColorAdjustDiff);
+		}
+		fprintf(fp, "}\n");
+		return fclose(fp) == 0;
+	}
+
+private:
+	void startMeasure() {
+		oclResetKernelStats();
+		excludedMs = 0;
+		measureStartMs = nowMs();
+	}
+
+	void stopMeasure(int frames) {
+		double elapsed = nowMs() - measureStartMs - excludedMs;
+		fps = elapsed > 0 ? frames * 1000.0 / elapsed : 0;
+		OclKernelStats stats = oclGetKernelStats();
+		launchesPerFrame = frames > 0 ? double(stats.launches) / frames : 0;
+		kernelCreations = stats.creations;
+	}
+
+	static void printRow(const StageTimes& s) {
+		printf("%-16s %10.3f %10.3f %10.3f %10.3f %10.3f\n", s.name.c_str(),
+			s.mean(), s.percentile(0.5), s.percentile(0.9), s.percentile(0.99), s.percentile(1.0));
+	}
+
+	static void writeStats(FILE* fp, const StageTimes& s) {
+		fprintf(fp, "{\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+			s.mean(), s.percentile(0.5), s.percentile(0.9), s.percentile(0.99), s.percentile(1.0));
+	}
+
+	const SyntheticRig& rig;
+	bool stereo;
+	bool direct;
+	bool cpu;		// on the CPU backend
+	string device;
+	vector<UMat> xmaps, ymaps;
+	vector<OclProjectionMap> fixedMaps;	// --fixed
+	vector<UMat> chunkLs, chunkRs;
+	vector<UMat> directEyes = vector<UMat>(2);	// --direct
+	UMat pano;
+	UMat lastImageL, lastImageR;
+
+	vector<StageTimes> stages;
+	StageTimes endToEnd;
+	double measureStartMs = 0;
+	double excludedMs = 0;	// synthesizing the camera images on the host
+	double fps = 0;
+	size_t peakReserved = 0;
+	double launchesPerFrame = 0;
+	int64 kernelCreations = 0;
+	double flowMeanError = 0;
+	double flowMaxError = 0;
+};
+
+
+int main(int argc, char** argv) {
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("oclrenderpano benchmark on a synthetic camera rig");
+	if (parser.has("help")) {
+		parser.printMessage();
+		return 0;
+	}
+	int numCams = parser.get<int>("cams");
+	int width = parser.get<int>("width");
+	int height = parser.get<int>("height");
+	int overlap = parser.get<int>("overlap");
+	int frames = parser.get<int>("frames");
+	int warmup = parser.get<int>("warmup");
+	float speed = parser.get<float>("speed");
+	bool stereo = !parser.has("mono");
+	bool async = parser.has("async");
+	bool direct = parser.has("direct");
+	string backend = parser.get<string>("backend");
+	bool compare = parser.has("compare-backends");
+	string json = parser.get<string>("json");
+	if (!parser.check()) {
+		parser.printErrors();
+		return 1;
+	}
+	if (numCams < 2 || overlap <= 0 || width < 3 * overlap || frames <= 0 || warmup < 0) {
+		fprintf(stderr, "invalid rig: need cams >= 2, width >= 3 * overlap > 0 and frames > 0\n");
+		return 1;
+	}
+	if (direct && async) {
+		fprintf(stderr, "--direct renders synchronously, don't combine it with --async\n");
+		return 1;
+	}
+	if (backend != "auto" && backend != "opencl" && backend != "cpu") {
+		fprintf(stderr, "invalid backend: %s, need auto, opencl or cpu\n", backend.c_str());
+		return 1;
+	}
+	if (compare && backend == "cpu") {
+		fprintf(stderr, "--compare-backends runs OpenCL first, don't combine it with --backend=cpu\n");
+		return 1;
+	}
+
+	OclInitParameters params;
+	params.isMonoMode = !stereo;
+	params.numSideCams = numCams;
+	params.camImageWidth = width;
+	params.numNovelViews = width - overlap;
+	params.opticalFlowSize = Size(overlap, height);
+	params.smooth3LinesFactor = OclOptFlowSmooth3Lines(0.1f, 0.5f, 0.5f, 1.0f, 1.0f, 1.0f, 1.0f);
+	params.numRenderThreads = parser.get<int>("threads");
+	params.halfStorage = parser.has("half");
+	params.backend = backend == "cpu" ? BACKEND_CPU : (backend == "opencl" || compare) ? BACKEND_OPENCL : BACKEND_AUTO;
+	if (!oclInitialize(&params)) {
+		fprintf(stderr, "oclInitialize failed, set OPENCV_OPENCL_DEVICE (e.g. :CPU:) to use another device\n");
+		return 1;
+	}
+
+	SyntheticRig rig(numCams, width, height, overlap, parser.get<float>("disparity"), parser.get<int>("seed"));
+	auto run = [&](Benchmark& bench, const OclInitParameters& p) {
+		printf("device: %s\n", bench.deviceName().c_str());
+		if (async) {
+			bench.runAsync(frames, warmup, speed, p.maxFramesInFlight);
+		} else {
+			bench.runSync(frames, warmup, speed);
+		}
+		bench.measureFlow(p);
+		bench.print();
+	};
+	Benchmark bench(rig, stereo, direct, parser.has("fixed"));
+	run(bench, params);
+
+	// the same frames on the CPU backend
+	unique_ptr<Benchmark> cpuBench;
+	OclBackendComparison diff;
+	if (compare) {
+		diff = bench.compareBackends(params);
+		oclRelease();
+		OclInitParameters cpuParams = params;
+		cpuParams.backend = BACKEND_CPU;
+		if (!oclInitialize(&cpuParams)) {
+			fprintf(stderr, "oclInitialize failed on the CPU backend\n");
+			return 1;
+		}
+		printf("\n");
+		cpuBench.reset(new Benchmark(rig, stereo, direct, parser.has("fixed")));
+		run(*cpuBench, cpuParams);
+		printf("\nopencl vs cpu: flow endpoint diff mean %.4f, max %.4f pixels, warp error %.4f vs %.4f\n",
+			diff.flow.meanEndpointDiff, diff.flow.maxEndpointDiff, diff.flow.meanWarpErrorA, diff.flow.meanWarpErrorB);
+		printf("max channel diff: projection %.0f, novel view %.0f, post-process %.0f, color adjust %.0f\n",
+			diff.maxProjectionDiff, diff.maxNovelViewDiff, diff.maxPostProcessDiff, diff.maxColorAdjustDiff);
+		printf("cpu fps: %.2f (%.2fx of opencl)\n", cpuBench->framesPerSecond(),
+			bench.framesPerSecond() > 0 ? cpuBench->framesPerSecond() / bench.framesPerSecond() : 0.0);
+	}
+
+	int ret = 0;
+	if (!json.empty() && !bench.writeJson(json, params, parser, cpuBench.get(), compare ? &diff : nullptr)) {
+		fprintf(stderr, "can't write %s\n", json.c_str());
+		ret = 1;
+	}
+	oclRelease();
+	return ret;
+}
@@ -0,0 +1,296 @@
+/*
+* Golden-output regression harness of the optical flow and novel-view path, built on MatTrace.
+*
+* Every traced frame runs oclComputeOpticalFlow (L->R and R->L, from the second frame on with
+* the previous frame's flows and images) -> oclRenderLazyNovelView -> oclPostProcess on a fixed
+* synthetic image pair, and MatTrace captures every intermediate of the flows (prepared images,
+* gradients, sweeps, medians, diffusion, temporal and upscaled flow of each pyramid level) and
+* the outputs, with the time of each stage.
+*
+* --record writes them, with the input images, to a trace bundle. --replay runs the inputs of
+* a bundle again (e.g. with a later build, --half or --wavefront) and reports the max/mean error
+* and the time of every stage side by side:
+*	./example_oclrenderpano_oclrenderpano_golden --record=golden.trace
+*	./example_oclrenderpano_oclrenderpano_golden --replay=golden.trace --max-error=0.5
+*/
+#include <stdio.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/core/ocl.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/oclrenderpano.hpp"
+#include "opencv2/oclrenderpano/ocl_novelview.hpp"
+#include "opencv2/oclrenderpano/ocl_optflow.hpp"
+#include "opencv2/oclrenderpano/trace.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+static const char* keys =
+	"{help h       |      | print this message }"
+	"{record       |      | write the trace bundle of this run to this file }"
+	"{replay       |      | run the inputs of this trace bundle and compare against it }"
+	"{width        | 192  | width of the overlap images (optical flow width) }"
+	"{height       | 256  | height of the overlap images }"
+	"{disparity    | 8    | max ground truth disparity in pixels }"
+	"{frames       | 2    | number of traced frames }"
+	"{half         |      | keep flows, pyramids and gradients in fp16 (OclInitParameters::halfStorage) }"
+	"{wavefront    |      | use the wavefront sweeps (SWEEP_WAVEFRONT) }"
+	"{backend      | auto | auto, opencl or cpu (OclInitParameters::backend) }"
+	"{seed         | 1    | seed of the scene texture }"
+	"{max-error    | -1   | with --replay, fail if an output differs by more than this (-1: report only) }"
+	"{json         |      | write the comparison to this JSON file }";
+
+static const char* kGolden = "golden";
+static const char* kCurrent = "current";
+
+
+/**
+* @brief The overlap images (CV_8UC4) of a camera pair looking at a scrolling texture,
+* the right image is displaced by a per-row disparity.
+*/
+static void syntheticPair(int frame, int width, int height, float maxDisparity, uint64 seed, Mat& I0, Mat& I1) {
+	const int speed = 2;
+	Size size(width + 64 + 2*speed*frame, height);
+	RNG rng(seed);
+	Mat coarse(Size(size.width / 8 + 1, size.height / 8 + 1), CV_8UC3);
+	Mat fine(Size(size.width / 2 + 1, size.height / 2 + 1), CV_8UC3);
+	rng.fill(coarse, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+	rng.fill(fine, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+	resize(coarse, coarse, size, 0, 0, INTER_CUBIC);
+	resize(fine, fine, size, 0, 0, INTER_LINEAR);
+	Mat texture;
+	addWeighted(coarse, 0.65, fine, 0.35, 0, texture);
+
+	Mat xmap0(height, width, CV_32FC1), xmap1(height, width, CV_32FC1), ymap(height, width, CV_32FC1);
+	for (int y = 0; y < height; ++y) {
+		float d = maxDisparity * 0.5f * (1.0f + float(sin(4.0 * CV_PI * y / height)));
+		for (int x = 0; x < width; ++x) {
+			xmap0.at<float>(y, x) = float(32 + speed*frame + x);
+			xmap1.at<float>(y, x) = float(32 + speed*frame + x) + d;
+			ymap.at<float>(y, x) = float(y);
+		}
+	}
+	Mat image;
+	remap(texture, image, xmap0, ymap, INTER_LINEAR, BORDER_REFLECT);
+	cvtColor(image, I0, COLOR_BGR2BGRA);
+	remap(texture, image, xmap1, ymap, INTER_LINEAR, BORDER_REFLECT);
+	cvtColor(image, I1, COLOR_BGR2BGRA);
+}
+
+
+/**
+* @brief The frames of one run, each traced under "frame<n>/" if recording.
+*/
+class GoldenRun {
+public:
+	explicit GoldenRun(const OclInitParameters& params) : params(params) {
+		warp.size = Size(params.numNovelViews, params.opticalFlowSize.height);
+		warp.camImageWidth = params.camImageWidth;
+	}
+
+	void frame(int index, const Mat& imageL, const Mat& imageR) {
+		MatTrace& trace = MatTrace::instance();
+		UMat I0, I1;
+		imageL.copyTo(I0);
+		imageR.copyTo(I1);
+		trace.scope(cv::format("frame%d/input", index));
+		trace.capture("I0", imageL);
+		trace.capture("I1", imageR);
+
+		UMat flowLtoR, flowRtoL;
+		trace.scope(cv::format("frame%d/flow LtoR", index));
+		oclComputeOpticalFlow(I0, I1, prevFlowLtoR, prevI0, prevI1, flowLtoR, DirectionHint::LEFT, 1.0f, &params);
+		trace.scope(cv::format("frame%d/flow RtoL", index));
+		oclComputeOpticalFlow(I1, I0, prevFlowRtoL, prevI1, prevI0, flowRtoL, DirectionHint::RIGHT, 1.0f, &params);
+
+		trace.scope(cv::format("frame%d/novel view", index));
+		UMat view(warp.size, CV_8UC4);
+		oclRenderLazyNovelView(warp, I0, I1, flowLtoR, flowRtoL, view, 0, true);
+		trace.capture("view", view);
+
+		trace.scope(cv::format("frame%d/post-process", index));
+		OclPostProcessParameters post;
+		post.sharpFactor = 0.5f;
+		post.smoothThreshold = 0.1f;
+		post.wrapOffset = warp.size.width / 3;
+		UMat pano;
+		oclPostProcess(view, prevPano, pano, post);
+		trace.capture("pano", pano);
+		ocl::finish();
+
+		prevI0 = I0;
+		prevI1 = I1;
+		prevFlowLtoR = flowLtoR;
+		prevFlowRtoL = flowRtoL;
+		prevPano = pano;
+	}
+
+private:
+	OclInitParameters params;
+	OclLazyWarp warp;
+	UMat prevI0, prevI1;
+	UMat prevFlowLtoR, prevFlowRtoL;
+	UMat prevPano;
+};
+
+// the outputs checked against --max-error
+static bool isOutput(const string& key) {
+	auto endsWith = [&key](const string& s) {
+		return key.size() >= s.size() && key.compare(key.size() - s.size(), s.size(), s) == 0;
+	};
+	return endsWith("/final flow") || endsWith("/view") || endsWith("/pano");
+}
+
+static bool writeJson(const string& path, const vector<MatTraceDiff>& diffs, double maxError, bool failed) {
+	FILE* fp = fopen(path.c_str(), "w");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\n  \"max_error\": %.4f,\n  \"failed\": %s,\n  \"stages\": [\n", maxError, failed ? "true" : "false");
+	for (size_t i = 0; i < diffs.size(); ++i) {
+		const MatTraceDiff& d = diffs[i];
+		fprintf(fp, "    {\"key\": \"%s\", \"golden\": %s, \"current\": %s, \"same_shape\": %s, "
+			"\"max\": %.6f, \"mean\": %.6f, \"golden_ms\": %.3f, \"current_ms\": %.3f}%s\n",
+			d.key.c_str(), d.inA ? "true" : "false", d.inB ? "true" : "false", d.sameShape ? "true" : "false",
+			d.maxError, d.meanError, d.msA, d.msB, i + 1 < diffs.size() ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	return fclose(fp) == 0;
+}
+
+
+int main(int argc, char** argv) {
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("golden-output regression harness of the optical flow and novel-view path");
+	if (parser.has("help")) {
+		parser.printMessage();
+		return 0;
+	}
+	string record = parser.get<string>("record");
+	string replay = parser.get<string>("replay");
+	int width = parser.get<int>("width");
+	int height = parser.get<int>("height");
+	int frames = parser.get<int>("frames");
+	string backend = parser.get<string>("backend");
+	double maxError = parser.get<double>("max-error");
+	string json = parser.get<string>("json");
+	if (!parser.check()) {
+		parser.printErrors();
+		return 1;
+	}
+	if (record.empty() && replay.empty()) {
+		fprintf(stderr, "nothing to do, need --record and/or --replay\n");
+		return 1;
+	}
+	if (backend != "auto" && backend != "opencl" && backend != "cpu") {
+		fprintf(stderr, "invalid backend: %s, need auto, opencl or cpu\n", backend.c_str());
+		return 1;
+	}
+
+	// the inputs of the bundle replace the synthetic ones
+	MatTrace& trace = MatTrace::instance();
+	vector<Mat> imageLs, imageRs;
+	if (!replay.empty()) {
+		if (!trace.load(replay, kGolden)) {
+			fprintf(stderr, "can't load the trace bundle %s\n", replay.c_str());
+			return 1;
+		}
+		map<string, Mat> golden = trace.get(kGolden);
+		for (int i = 0; golden.count(cv::format("frame%d/input/I0", i)) > 0; ++i) {
+			imageLs.push_back(golden[cv::format("frame%d/input/I0", i)]);
+			imageRs.push_back(golden[cv::format("frame%d/input/I1", i)]);
+		}
+		if (imageLs.empty()) {
+			fprintf(stderr, "no input images in %s\n", replay.c_str());
+			return 1;
+		}
+		width = imageLs[0].cols;
+		height = imageLs[0].rows;
+	} else {
+		if (width <= 0 || height <= 0 || frames <= 0) {
+			fprintf(stderr, "invalid input: need width, height and frames > 0\n");
+			return 1;
+		}
+		for (int i = 0; i < frames; ++i) {
+			Mat I0, I1;
+			syntheticPair(i, width, height, parser.get<float>("disparity"), parser.get<int>("seed"), I0, I1);
+			imageLs.push_back(I0);
+			imageRs.push_back(I1);
+		}
+	}
+
+	OclInitParameters params;
+	params.isMonoMode = true;
+	params.numSideCams = 1;
+	params.camImageWidth = 2 * width;
+	params.numNovelViews = width;
+	params.opticalFlowSize = Size(width, height);
+	params.smooth3LinesFactor = OclOptFlowSmooth3Lines(0.1f, 0.5f, 0.5f, 1.0f, 1.0f, 1.0f, 1.0f);
+	params.numRenderThreads = 1;
+	params.halfStorage = parser.has("half");
+	params.sweepEngine = parser.has("wavefront") ? SWEEP_WAVEFRONT : SWEEP_ROWS_COLS;
+	params.backend = backend == "cpu" ? BACKEND_CPU : backend == "opencl" ? BACKEND_OPENCL : BACKEND_AUTO;
+	if (!oclInitialize(&params)) {
+		fprintf(stderr, "oclInitialize failed, set OPENCV_OPENCL_DEVICE (e.g. :CPU:) to use another device\n");
+		return 1;
+	}
+	printf("device: %s, %d frames of %dx%d\n", oclActiveBackend() == BACKEND_CPU ? "cpu" : ocl::Device::getDefault().name().c_str(),
+		(int)imageLs.size(), width, height);
+
+	// once untraced, so no stage time includes building the kernels
+	{
+	GoldenRun warmup(params);
+	for (size_t i = 0; i < imageLs.size(); ++i) {
+		warmup.frame((int)i, imageLs[i], imageRs[i]);
+	}
+	}
+	GoldenRun run(params);
+	trace.record(kCurrent);
+	for (size_t i = 0; i < imageLs.size(); ++i) {
+		run.frame((int)i, imageLs[i], imageRs[i]);
+	}
+	trace.stop();
+
+	int ret = 0;
+	if (!replay.empty()) {
+		vector<MatTraceDiff> diffs = trace.compare(kGolden, kCurrent);
+		double goldenMs = 0;
+		double currentMs = 0;
+		bool failed = false;
+		printf("%-36s %12s %12s %10s %10s\n", "stage", "max error", "mean error", "golden ms", "ms");
+		for (const MatTraceDiff& d : diffs) {
+			goldenMs += d.msA;
+			currentMs += d.msB;
+			bool bad = !d.sameShape || (maxError >= 0 && isOutput(d.key) && d.maxError > maxError);
+			failed = failed || bad;
+			if (d.sameShape) {
+				printf("%-36s %12.5f %12.6f %10.3f %10.3f%s\n", d.key.c_str(), d.maxError, d.meanError, d.msA, d.msB, bad ? "  FAIL" : "");
+			} else {
+				printf("%-36s %25s %10.3f %10.3f  FAIL\n", d.key.c_str(),
+					!d.inA ? "not in golden" : !d.inB ? "missing" : "size/type differs", d.msA, d.msB);
+			}
+		}
+		printf("%-36s %25s %10.3f %10.3f\n", "total", "", goldenMs, currentMs);
+		printf("%s\n", failed ? "FAILED" : "passed");
+		if (!json.empty() && !writeJson(json, diffs, maxError, failed)) {
+			fprintf(stderr, "can't write %s\n", json.c_str());
+			ret = 1;
+		}
+		ret = failed ? 2 : ret;
+	}
+	if (!record.empty()) {
+		if (trace.save(kCurrent, record)) {
+			printf("recorded %d stages to %s\n", (int)trace.keys(kCurrent).size(), record.c_str());
+		} else {
+			fprintf(stderr, "can't write %s\n", record.c_str());
+			ret = 1;
+		}
+	}
+	oclRelease();
+	return ret;
+}
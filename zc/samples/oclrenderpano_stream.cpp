@@ -0,0 +1,1051 @@
+/*
+* Streaming render of a multi-camera sequence, for soak-testing the renderer as it runs in production.
+*
+* A reader thread decodes the frames of all cameras into a bounded queue, the main thread uploads
+* and projects them, keeps OclInitParameters::maxFramesInFlight frames in oclSubmitStereoPanoramaChunks(),
+* stacks and post-processes (oclPostProcess) the chunks of the oldest one and hands the panorama to a
+* writer thread. Nothing grows with the length of the sequence: the queues, the frame slots and the
+* latency histograms are fixed, and the render threads and buffer pools are planned for --budget-mb
+* (OclInitParameters::memoryBudget, which caps the pools and the number of threads, not the total usage).
+*
+* The input is one of:
+*	--input=rig/cam%d/frame*.jpg	a folder per camera (%d is the camera index), the files in name order
+*	--raw=rig.raw			a raw container (see RawHeader): the frames of all cameras, uncompressed
+*	neither					a synthetic scrolling scene of --cams cameras
+* --pack=rig.raw writes the input into a raw container and exits, so the decoding is out of the soak.
+*
+* --fps paces the reader as a live rig: a frame arriving while the input queue is full is dropped.
+* Otherwise the reader waits for the pipeline and only --output drops frames, if the writer falls
+* behind. The report has the p50/p95/p99 latency of each stage (arrival -> submit, submit -> chunks,
+* arrival -> panorama), the dropped frames, the frames per flow quality level (--target-ms lets the
+* governor lower it, see OclFrameQuality), the share of the flow tiles recomputed (--incremental
+* keeps the previous flow of the static tiles, see OclIncrementalFlow) and the device memory: the
+* high-water mark of the free buffers the pools keep for reuse, the live buffers of the memory plan
+* (see OclMemoryPlan) and their sum, the footprint. Buffers outside the plan (the band workspaces of
+* the incremental flow, the projection maps) are not in it. --devices spreads the camera pairs over the devices like the selected one
+* (see OclRenderDevice), --program-cache keeps the compiled programs for the next start (see
+* OclStartupReport):
+*	./example_oclrenderpano_oclrenderpano_stream --raw=rig.raw --overlap=256 --fps=30 --budget-mb=3072 --json=soak.json
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/core/ocl.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/oclrenderpano.hpp"
+#include "opencv2/oclrenderpano/ocl_buffer.hpp"
+#include "opencv2/oclrenderpano/ocl_optflow.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+static const char* keys =
+	"{help h       |      | print this message }"
+	"{input        |      | image files of each camera, %d is the camera index (e.g. rig/cam%d/frame*.jpg) }"
+	"{raw          |      | read the frames from this raw container }"
+	"{pack         |      | write the input frames into this raw container and exit }"
+	"{cams         | 8    | number of cameras of the synthetic scene }"
+	"{width        | 512  | image width of the synthetic scene }"
+	"{height       | 512  | image height of the synthetic scene }"
+	"{overlap      | 128  | width of the overlap of two cameras (optical flow width) }"
+	"{maps         |      | projection maps of the cameras (xmap<i>/ymap<i>, CV_32FC1), identity if empty }"
+	"{fixed        |      | project with the fixed-point maps of oclCompileProjectionMaps() }"
+	"{map-cache    |      | directory of the compiled maps (see oclCompileProjectionMaps()) }"
+	"{map-key      |      | cache key of the maps (e.g. the calibration version), the maps file and its size if empty }"
+	"{program-cache|      | directory of the program binaries (OclInitParameters::programCacheDir) }"
+	"{frames       | 1000 | max number of frames, 0 for the whole input }"
+	"{warmup       | 10   | number of frames not in the latencies }"
+	"{fps          | 0    | rate of the frames arriving, 0 to read as fast as the pipeline takes them }"
+	"{queue        | 4    | depth of the input queue (frames) }"
+	"{write-queue  | 4    | depth of the output queue (panoramas) }"
+	"{output       |      | write the panoramas, to image files if it has %d, otherwise to a raw container }"
+	"{mono         |      | render mono chunks instead of stereo }"
+	"{sharp        | 0.5  | sharpening factor of the post-process }"
+	"{smooth       | 0.05 | temporal smoothing threshold of the post-process, 0 to disable }"
+	"{threads      | 0    | number of render threads, 0 for the default }"
+	"{devices      | 1    | max number of devices the camera pairs are spread over (OclInitParameters::maxDevices) }"
+	"{in-flight    | 2    | frames submitted and not polled yet (OclInitParameters::maxFramesInFlight) }"
+	"{budget-mb    | 0    | device memory budget in MB (OclInitParameters::memoryBudget), 0 for all of it }"
+	"{target-ms    | 0    | render time of a frame the flow quality is lowered to hold (OclInitParameters::targetFrameMs) }"
+	"{incremental  | 0    | tile motion above which the flow of a tile is recomputed (OclIncrementalFlow), 0 for whole flows }"
+	"{tile         | 64   | tile size of the incremental flow }"
+	"{half         |      | keep flows, pyramids and gradients in fp16 (OclInitParameters::halfStorage) }"
+	"{backend      | auto | auto, opencl or cpu (OclInitParameters::backend) }"
+	"{json         |      | write the results to this JSON file }";
+
+static double nowMs() {
+	return getTickCount() * 1000.0 / getTickFrequency();
+}
+
+// the device buffers of the plan of oclInitialize() that are live while rendering (see OclMemoryPlan)
+static size_t plannedLiveBytes() {
+	OclMemoryPlan plan;
+	oclGetMemoryPlan(plan);
+	return plan.sharedBytes + plan.frameBytes + plan.outputBytes + size_t(plan.numThreads)*plan.threadBytes;
+}
+
+
+/**
+* @brief The header of a raw container, followed by frames of cams images of rows*cols*elemSize bytes.
+*
+* frames is 0 if the writer didn't finish, the frames are then read up to the end of the file.
+*/
+struct RawHeader {
+	uint32_t magic;		// kRawMagic
+	uint32_t version;	// kRawVersion
+	int32_t cams;
+	int32_t rows;
+	int32_t cols;
+	int32_t type;		// CV_8UC3 or CV_8UC4
+	int64_t frames;
+};
+
+static const uint32_t kRawMagic = 0x5752435a;	// "ZCRW"
+static const uint32_t kRawVersion = 1;
+
+
+/**
+* @brief Appends frames of the same shape to a raw container, the frame count is written by close().
+*/
+class RawWriter {
+public:
+	~RawWriter() {
+		close();
+	}
+
+	bool write(const vector<Mat>& images) {
+		if (!fp) {
+			return false;
+		}
+		if (frames == 0) {
+			header.magic = kRawMagic;
+			header.version = kRawVersion;
+			header.cams = (int32_t)images.size();
+			header.rows = images[0].rows;
+			header.cols = images[0].cols;
+			header.type = images[0].type();
+			header.frames = 0;
+			if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+				return false;
+			}
+		}
+		CV_Assert((int)images.size() == header.cams);
+		for (const Mat& image : images) {
+			CV_Assert(image.rows == header.rows && image.cols == header.cols && image.type() == header.type);
+			size_t rowBytes = image.cols * image.elemSize();
+			for (int y = 0; y < image.rows; ++y) {
+				if (fwrite(image.ptr(y), 1, rowBytes, fp) != rowBytes) {
+					return false;
+				}
+			}
+		}
+		frames++;
+		return true;
+	}
+
+	bool open(const string& path) {
+		fp = fopen(path.c_str(), "wb");
+		return fp != nullptr;
+	}
+
+	bool close() {
+		if (!fp) {
+			return true;
+		}
+		bool ok = true;
+		if (frames > 0) {
+			header.frames = frames;
+			ok = fseek(fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fp) == 1;
+		}
+		ok = fclose(fp) == 0 && ok;
+		fp = nullptr;
+		return ok;
+	}
+
+private:
+	FILE* fp = nullptr;
+	RawHeader header;
+	int64 frames = 0;
+};
+
+
+/**
+* @brief The frames of all cameras of a sequence, read one after the other.
+*/
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+	// the images of the next frame, false at the end of the sequence
+	virtual bool read(vector<Mat>& images) = 0;
+	virtual int numCams() const = 0;
+	virtual Size size() const = 0;
+	virtual int type() const {
+		return CV_8UC3;
+	}
+};
+
+// --input: the files of camera i are the matches of the pattern with %d replaced by i
+class FolderSource : public FrameSource {
+public:
+	bool open(const string& pattern) {
+		for (int i = 0; ; ++i) {
+			vector<String> names;
+			glob(cv::format(pattern.c_str(), i), names, false);
+			if (names.empty() || (i > 0 && pattern.find("%d") == string::npos)) {
+				break;
+			}
+			sort(names.begin(), names.end());
+			files.push_back(vector<string>(names.begin(), names.end()));
+		}
+		if (files.empty()) {
+			return false;
+		}
+		numFrames = files[0].size();
+		for (const vector<string>& f : files) {
+			numFrames = std::min(numFrames, f.size());
+		}
+		Mat first = imread(files[0][0], IMREAD_COLOR);
+		imageSize = first.size();
+		return !first.empty();
+	}
+
+	bool read(vector<Mat>& images) override {
+		if (next >= numFrames) {
+			return false;
+		}
+		images.resize(files.size());
+		for (size_t i = 0; i < files.size(); ++i) {
+			images[i] = imread(files[i][next], IMREAD_COLOR);
+			if (images[i].size() != imageSize) {
+				fprintf(stderr, "%s: missing or not %dx%d\n", files[i][next].c_str(), imageSize.width, imageSize.height);
+				return false;
+			}
+		}
+		next++;
+		return true;
+	}
+
+	int numCams() const override {
+		return (int)files.size();
+	}
+
+	Size size() const override {
+		return imageSize;
+	}
+
+private:
+	vector<vector<string> > files;
+	size_t numFrames = 0;
+	size_t next = 0;
+	Size imageSize;
+};
+
+// --raw
+class RawSource : public FrameSource {
+public:
+	~RawSource() {
+		if (fp) {
+			fclose(fp);
+		}
+	}
+
+	bool open(const string& path) {
+		fp = fopen(path.c_str(), "rb");
+		if (!fp || fread(&header, sizeof(header), 1, fp) != 1) {
+			return false;
+		}
+		return header.magic == kRawMagic && header.version == kRawVersion && header.cams > 0
+			&& header.rows > 0 && header.cols > 0 && (header.type == CV_8UC3 || header.type == CV_8UC4);
+	}
+
+	bool read(vector<Mat>& images) override {
+		if (header.frames > 0 && next >= header.frames) {
+			return false;
+		}
+		images.resize(header.cams);
+		for (Mat& image : images) {
+			image.create(header.rows, header.cols, header.type);
+			size_t bytes = image.total() * image.elemSize();
+			if (fread(image.data, 1, bytes, fp) != bytes) {
+				return false;
+			}
+		}
+		next++;
+		return true;
+	}
+
+	int numCams() const override {
+		return header.cams;
+	}
+
+	Size size() const override {
+		return Size(header.cols, header.rows);
+	}
+
+	int type() const override {
+		return header.type;
+	}
+
+private:
+	FILE* fp = nullptr;
+	RawHeader header;
+	int64 next = 0;
+};
+
+// camera i sees the columns [i*step, i*step + width) of a textured panorama scrolling by speed pixels per frame
+class SyntheticSource : public FrameSource {
+public:
+	SyntheticSource(int numCams, Size size, int overlap, uint64 seed) : cams(numCams), imageSize(size) {
+		step = size.width - overlap;
+		Size textureSize(numCams * step, size.height);
+		RNG rng(seed);
+		Mat coarse(Size(textureSize.width / 16 + 1, textureSize.height / 16 + 1), CV_8UC3);
+		Mat fine(Size(textureSize.width / 2 + 1, textureSize.height / 2 + 1), CV_8UC3);
+		rng.fill(coarse, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+		rng.fill(fine, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+		resize(coarse, coarse, textureSize, 0, 0, INTER_CUBIC);
+		resize(fine, fine, textureSize, 0, 0, INTER_LINEAR);
+		addWeighted(coarse, 0.65, fine, 0.35, 0, texture);
+	}
+
+	bool read(vector<Mat>& images) override {
+		const int speed = 2;
+		images.resize(cams);
+		for (int i = 0; i < cams; ++i) {
+			images[i].create(imageSize, CV_8UC3);
+			// the columns wrap around the texture
+			int x0 = int((int64(i) * step + next * speed) % texture.cols);
+			int n = std::min(imageSize.width, texture.cols - x0);
+			texture(Rect(x0, 0, n, imageSize.height)).copyTo(images[i](Rect(0, 0, n, imageSize.height)));
+			for (int x = n; x < imageSize.width; x += texture.cols) {
+				int m = std::min(imageSize.width - x, texture.cols);
+				texture(Rect(0, 0, m, imageSize.height)).copyTo(images[i](Rect(x, 0, m, imageSize.height)));
+			}
+		}
+		next++;
+		return true;
+	}
+
+	int numCams() const override {
+		return cams;
+	}
+
+	Size size() const override {
+		return imageSize;
+	}
+
+private:
+	int cams;
+	Size imageSize;
+	int step;
+	Mat texture;
+	int64 next = 0;
+};
+
+
+/**
+* @brief A FIFO of at most capacity items, shared by one producer and one consumer.
+*/
+template <typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+	// wait for room, false if closed
+	bool push(T&& item) {
+		unique_lock<mutex> lock(mtx);
+		notFull.wait(lock, [this] { return items.size() < capacity || closed; });
+		if (closed) {
+			return false;
+		}
+		items.push_back(std::move(item));
+		peak = std::max(peak, items.size());
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// false if full or closed, the item is not taken then
+	bool tryPush(T&& item) {
+		lock_guard<mutex> lock(mtx);
+		if (items.size() >= capacity || closed) {
+			return false;
+		}
+		items.push_back(std::move(item));
+		peak = std::max(peak, items.size());
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// wait for an item, false if closed and empty
+	bool pop(T& item) {
+		unique_lock<mutex> lock(mtx);
+		notEmpty.wait(lock, [this] { return !items.empty() || closed; });
+		if (items.empty()) {
+			return false;
+		}
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	// the items pushed are still popped
+	void close() {
+		lock_guard<mutex> lock(mtx);
+		closed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+	size_t peakSize() {
+		lock_guard<mutex> lock(mtx);
+		return peak;
+	}
+
+private:
+	const size_t capacity;
+	deque<T> items;
+	size_t peak = 0;
+	bool closed = false;
+	mutex mtx;
+	condition_variable notEmpty;
+	condition_variable notFull;
+};
+
+
+/**
+* @brief Latencies in 0.1ms bins up to 10s, so thousands of frames take the memory of one.
+*/
+class LatencyHistogram {
+public:
+	static const int kBins = 100000;
+
+	explicit LatencyHistogram(const char* name) : name(name), bins(kBins, 0) {}
+
+	void add(double ms) {
+		int bin = std::min(std::max(cvFloor(ms * 10), 0), kBins - 1);
+		bins[bin]++;
+		count++;
+		sum += ms;
+		maxMs = std::max(maxMs, ms);
+	}
+
+	// the upper edge of the bin of the p-th latency, the max for the last bin
+	double percentile(double p) const {
+		if (count == 0) {
+			return 0;
+		}
+		uint64 rank = std::max<uint64>(uint64(ceil(p * count)), 1);
+		uint64 seen = 0;
+		for (int i = 0; i < kBins; ++i) {
+			seen += bins[i];
+			if (seen >= rank) {
+				return std::min((i + 1) * 0.1, maxMs);
+			}
+		}
+		return maxMs;
+	}
+
+	double mean() const {
+		return count > 0 ? sum / count : 0;
+	}
+
+	// the frames in [edges[i-1], edges[i]) ms, the last count is the frames above the last edge
+	vector<uint64> buckets(const vector<double>& edges) const {
+		vector<uint64> counts(edges.size() + 1, 0);
+		size_t b = 0;
+		for (int i = 0; i < kBins; ++i) {
+			while (b < edges.size() && i * 0.1 >= edges[b] - 1e-9) {
+				b++;
+			}
+			counts[b] += bins[i];
+		}
+		return counts;
+	}
+
+	const string name;
+	uint64 count = 0;
+	double maxMs = 0;
+
+private:
+	vector<uint32_t> bins;
+	double sum = 0;
+};
+
+static const vector<double> kBucketEdges = { 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000 };
+
+
+/**
+* @brief The images of all cameras of a frame and when they arrived.
+*/
+struct Frame {
+	int64 index = -1;
+	vector<Mat> images;
+	double arrivalMs = 0;
+};
+
+/**
+* @brief The device buffers of a submitted frame, kept until its chunks are polled.
+*/
+struct FrameSlot {
+	vector<UMat> cams;
+	vector<UMat> spheres;
+	vector<UMat> imageLs;
+	vector<UMat> imageRs;
+	int64 index = -1;
+	int64 id = -1;
+	double arrivalMs = 0;
+	double submitMs = 0;
+};
+
+
+class Stream {
+public:
+	Stream(int numCams, Size sphereSize, int overlap, bool stereo, const OclPostProcessParameters& post)
+		: numCams(numCams), sphereSize(sphereSize), overlap(overlap), stereo(stereo), post(post),
+		queueWait("arrival -> submit"), render("submit -> chunks"), endToEnd("arrival -> panorama") {
+	}
+
+	// identity maps if xmaps is empty, compiled if fixed
+	void setMaps(const vector<Mat>& xmaps, const vector<Mat>& ymaps, Size camSize, bool fixed,
+		const string& cacheDir, const string& cacheKey) {
+		ux.resize(numCams);
+		uy.resize(numCams);
+		for (int i = 0; i < numCams; ++i) {
+			if (xmaps.empty()) {
+				Mat x(sphereSize, CV_32FC1), y(sphereSize, CV_32FC1);
+				for (int r = 0; r < sphereSize.height; ++r) {
+					for (int c = 0; c < sphereSize.width; ++c) {
+						x.at<float>(r, c) = float(c);
+						y.at<float>(r, c) = float(r);
+					}
+				}
+				x.copyTo(ux[i]);
+				y.copyTo(uy[i]);
+			} else {
+				xmaps[i].copyTo(ux[i]);
+				ymaps[i].copyTo(uy[i]);
+			}
+		}
+		if (fixed) {
+			oclCompileProjectionMaps(ux, uy, vector<Size>(numCams, camSize), fixedMaps, cacheDir, cacheKey);
+		}
+	}
+
+	// render all frames of input, the panoramas go to output if not null
+	void run(BoundedQueue<Frame>& input, BoundedQueue<Mat>* output, int inFlight, int warmup) {
+		vector<FrameSlot> slots(inFlight);
+		deque<int> pending;
+		int64 submitted = 0;
+		bool end = false;
+		Frame frame;
+		while (!end || !pending.empty()) {
+			if (!end && (int)pending.size() < inFlight) {
+				if (!input.pop(frame)) {
+					end = true;
+					continue;
+				}
+				int s = int(submitted++ % inFlight);
+				submit(frame, slots[s]);
+				if (frame.index >= warmup) {
+					queueWait.add(slots[s].submitMs - frame.arrivalMs);
+				}
+				pending.push_back(s);
+				continue;
+			}
+			FrameSlot& slot = slots[pending.front()];
+			pending.pop_front();
+			finish(slot, output, slot.index >= warmup);
+		}
+		// the previous frames of the last sequence are not the ones of the next
+		oclClearPreviousFrames();
+	}
+
+	void print() const {
+		printf("frames: %lld rendered, %lld written, dropped %lld on input and %lld on output\n",
+			(long long)rendered, (long long)written, (long long)droppedInput, (long long)droppedOutput);
+		printf("%-20s %10s %10s %10s %10s %10s\n", "latency(ms)", "mean", "p50", "p95", "p99", "max");
+		for (const LatencyHistogram* h : { &queueWait, &render, &endToEnd }) {
+			printf("%-20s %10.2f %10.2f %10.2f %10.2f %10.2f\n", h->name.c_str(),
+				h->mean(), h->percentile(0.5), h->percentile(0.95), h->percentile(0.99), h->maxMs);
+		}
+		printf("\n%s histogram:\n", endToEnd.name.c_str());
+		vector<uint64> counts = endToEnd.buckets(kBucketEdges);
+		for (size_t i = 0; i < counts.size(); ++i) {
+			string range = i < kBucketEdges.size() ? cv::format("< %g ms", kBucketEdges[i]) : cv::format(">= %g ms", kBucketEdges.back());
+			double share = endToEnd.count > 0 ? 100.0 * counts[i] / endToEnd.count : 0;
+			printf("%12s %8llu %6.2f%% %s\n", range.c_str(), (unsigned long long)counts[i], share,
+				string(size_t(share / 2 + 0.5), '#').c_str());
+		}
+		printf("\nframes by their lowest flow quality level:");
+		for (int level = 0; level < FLOW_QUALITY_LEVELS; ++level) {
+			printf(" %d: %lld", level, (long long)qualityFrames[level]);
+		}
+		printf("\n");
+		printf("flow tiles recomputed: %.1f%%\n", 100.0 * recomputed());
+		printf("\nfps: %.2f\n", fps);
+		size_t planned = plannedLiveBytes();
+		printf("peak pooled (free) buffers: %.1f MB, planned live buffers: %.1f MB, peak footprint: %.1f MB\n",
+			peakPooled / 1048576.0, planned / 1048576.0, (planned + peakPooled) / 1048576.0);
+		printf("peak queued: %llu input frames (%.1f MB), %llu panoramas (%.1f MB)\n",
+			(unsigned long long)peakInput, peakInput * frameBytes / 1048576.0,
+			(unsigned long long)peakOutput, peakOutput * panoBytes / 1048576.0);
+	}
+
+	bool writeJson(const string& path, const OclInitParameters& params, const CommandLineParser& parser) const {
+		FILE* fp = fopen(path.c_str(), "w");
+		if (!fp) {
+			return false;
+		}
+		string device = oclActiveBackend() == BACKEND_CPU ? "cpu" : ocl::Device::getDefault().name();
+		replace(device.begin(), device.end(), '"', '\'');
+		fprintf(fp, "{\n");
+		fprintf(fp, "  \"config\": {\"device\": \"%s\", \"backend\": \"%s\", \"mode\": \"%s\", \"half\": %s, \"fixed\": %s, "
+			"\"cams\": %d, \"width\": %d, \"height\": %d, \"overlap\": %d, \"fps\": %.2f, \"in_flight\": %d, "
+			"\"threads\": %d, \"budget_bytes\": %llu, \"target_ms\": %.2f, \"warmup\": %d},\n",
+			device.c_str(), oclActiveBackend() == BACKEND_CPU ? "cpu" : "opencl", stereo ? "stereo" : "mono",
+			params.halfStorage ? "true" : "false", fixedMaps.empty() ? "false" : "true",
+			numCams, sphereSize.width, sphereSize.height, overlap, parser.get<double>("fps"), params.maxFramesInFlight,
+			params.numRenderThreads, (unsigned long long)params.memoryBudget, params.targetFrameMs, parser.get<int>("warmup"));
+		vector<OclRenderDevice> devices;
+		oclGetRenderDevices(devices);
+		fprintf(fp, "  \"devices\": [");
+		for (size_t i = 0; i < devices.size(); ++i) {
+			string name = devices[i].name;
+			replace(name.begin(), name.end(), '"', '\'');
+			fprintf(fp, "%s{\"name\": \"%s\", \"flow_ms\": %.3f, \"pairs\": %d, \"threads\": %d}", i > 0 ? ", " : "",
+				name.c_str(), devices[i].flowMs, int(devices[i].pairs.size()), devices[i].threads);
+		}
+		fprintf(fp, "],\n");
+		OclStartupReport startup = oclGetStartupReport();
+		fprintf(fp, "  \"startup\": {\"total_ms\": %.3f, \"preload_ms\": %.3f, \"buffers_ms\": %.3f, \"programs\": %d, "
+			"\"loaded\": %d, \"built\": %d, \"rejected\": %d, \"load_ms\": %.3f, \"build_ms\": %.3f},\n",
+			startup.totalMs, startup.preloadMs, startup.buffersMs, startup.programs, startup.loaded, startup.built,
+			startup.rejected, startup.loadMs, startup.buildMs);
+		OclMemoryPlan plan;
+		oclGetMemoryPlan(plan);
+		fprintf(fp, "  \"memory_plan\": {\"threads\": %d, \"budget\": %zu, \"shared\": %zu, \"frames\": %zu, "
+			"\"output\": %zu, \"arena\": %zu, \"unaliased\": %zu, \"thread\": %zu},\n",
+			plan.numThreads, plan.budget, plan.sharedBytes, plan.frameBytes, plan.outputBytes,
+			plan.arenaBytes, plan.unaliasedBytes, plan.threadBytes);
+		fprintf(fp, "  \"frames\": {\"rendered\": %lld, \"written\": %lld, \"dropped_input\": %lld, \"dropped_output\": %lld},\n",
+			(long long)rendered, (long long)written, (long long)droppedInput, (long long)droppedOutput);
+		fprintf(fp, "  \"latency\": {\n");
+		const LatencyHistogram* hists[] = { &queueWait, &render, &endToEnd };
+		const char* names[] = { "queue", "render", "end_to_end" };
+		for (int i = 0; i < 3; ++i) {
+			const LatencyHistogram& h = *hists[i];
+			fprintf(fp, "    \"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, \"max\": %.3f}%s\n",
+				names[i], h.mean(), h.percentile(0.5), h.percentile(0.95), h.percentile(0.99), h.maxMs, i < 2 ? "," : "");
+		}
+		fprintf(fp, "  },\n");
+		fprintf(fp, "  \"histogram\": {\"edges_ms\": [");
+		for (size_t i = 0; i < kBucketEdges.size(); ++i) {
+			fprintf(fp, "%s%g", i > 0 ? ", " : "", kBucketEdges[i]);
+		}
+		fprintf(fp, "], \"counts\": [");
+		vector<uint64> counts = endToEnd.buckets(kBucketEdges);
+		for (size_t i = 0; i < counts.size(); ++i) {
+			fprintf(fp, "%s%llu", i > 0 ? ", " : "", (unsigned long long)counts[i]);
+		}
+		fprintf(fp, "]},\n");
+		fprintf(fp, "  \"quality_levels\": [");
+		for (int level = 0; level < FLOW_QUALITY_LEVELS; ++level) {
+			fprintf(fp, "%s%lld", level > 0 ? ", " : "", (long long)qualityFrames[level]);
+		}
+		fprintf(fp, "],\n");
+		fprintf(fp, "  \"flow_recomputed\": %.4f,\n", recomputed());
+		fprintf(fp, "  \"fps\": %.3f,\n", fps);
+		fprintf(fp, "  \"peak_pooled_bytes\": %llu,\n", (unsigned long long)peakPooled);
+		fprintf(fp, "  \"planned_live_bytes\": %llu,\n", (unsigned long long)plannedLiveBytes());
+		fprintf(fp, "  \"peak_footprint_bytes\": %llu,\n", (unsigned long long)(plannedLiveBytes() + peakPooled));
+		fprintf(fp, "  \"peak_queued_bytes\": {\"input\": %llu, \"output\": %llu}\n",
+			(unsigned long long)(peakInput * frameBytes), (unsigned long long)(peakOutput * panoBytes));
+		fprintf(fp, "}\n");
+		return fclose(fp) == 0;
+	}
+
+	int64 rendered = 0;
+	int64 written = 0;
+	int64 droppedInput = 0;
+	int64 droppedOutput = 0;
+	double fps = 0;
+	size_t peakInput = 0;
+	size_t peakOutput = 0;
+	size_t frameBytes = 0;
+
+private:
+	// mean share of the flow tiles recomputed per frame
+	double recomputed() const {
+		return qualityCount > 0 ? recomputedSum / qualityCount : 1.0;
+	}
+
+	// upload, project and submit a frame
+	void submit(Frame& frame, FrameSlot& slot) {
+		slot.index = frame.index;
+		slot.arrivalMs = frame.arrivalMs;
+		slot.cams.resize(numCams);
+		for (int i = 0; i < numCams; ++i) {
+			frame.images[i].copyTo(slot.cams[i]);
+		}
+		if (fixedMaps.empty()) {
+			oclProjection(slot.cams, ux, uy, slot.spheres);
+		} else {
+			oclProjection(slot.cams, fixedMaps, slot.spheres);
+		}
+		Rect right(sphereSize.width - overlap, 0, overlap, sphereSize.height);
+		Rect left(0, 0, overlap, sphereSize.height);
+		slot.imageLs.resize(numCams);
+		slot.imageRs.resize(numCams);
+		for (int i = 0; i < numCams; ++i) {
+			slot.imageLs[i] = slot.spheres[i](right);
+			slot.imageRs[i] = slot.spheres[(i + 1) % numCams](left);
+		}
+		slot.submitMs = nowMs();
+		slot.id = oclSubmitStereoPanoramaChunks(slot.imageLs, slot.imageRs);
+		CV_Assert(slot.id >= 0);
+	}
+
+	// poll, stack and post-process the chunks of slot, then hand the panorama to the writer
+	void finish(FrameSlot& slot, BoundedQueue<Mat>* output, bool measured) {
+		if (stereo) {
+			oclPollStereoPanoramaChunks(slot.id, chunkLs, chunkRs, true);
+		} else {
+			oclPollStereoPanoramaChunks(slot.id, chunkLs, true);
+		}
+		double polledMs = nowMs();
+
+		int numEyes = stereo ? 2 : 1;
+		for (int e = 0; e < numEyes; ++e) {
+			oclStackHorizontal(e == 0 ? chunkLs : chunkRs, stacked[e]);
+			// the previous result is smoothed against, and replaced in place
+			oclPostProcess(stacked[e], eyes[e].empty() ? UMat() : eyes[e], eyes[e], post);
+		}
+		if (stereo) {
+			oclStackVertical(eyes, pano);
+		} else {
+			pano = eyes[0];
+		}
+		Mat host;
+		pano.copyTo(host);
+		double doneMs = nowMs();
+		rendered++;
+		panoBytes = host.total() * host.elemSize();
+		// the pools only count the free buffers, the live ones are the plan's
+		peakPooled = std::max(peakPooled, getReservedBufferSize());
+
+		if (measured) {
+			render.add(polledMs - slot.submitMs);
+			endToEnd.add(doneMs - slot.arrivalMs);
+		}
+		oclGetFrameQualities(qualities);
+		for (const OclFrameQuality& q : qualities) {
+			int lowest = q.levels.empty() ? 0 : *max_element(q.levels.begin(), q.levels.end());
+			qualityFrames[lowest]++;
+			recomputedSum += q.flowRecomputed;
+			qualityCount++;
+		}
+		if (output) {
+			if (output->tryPush(std::move(host))) {
+				written++;
+			} else {
+				droppedOutput++;
+			}
+		}
+	}
+
+	const int numCams;
+	const Size sphereSize;
+	const int overlap;
+	const bool stereo;
+	const OclPostProcessParameters post;
+	vector<UMat> ux, uy;
+	vector<OclProjectionMap> fixedMaps;	// --fixed
+	vector<UMat> chunkLs, chunkRs;
+	vector<UMat> stacked = vector<UMat>(2);
+	vector<UMat> eyes = vector<UMat>(2);
+	UMat pano;
+
+	LatencyHistogram queueWait;
+	LatencyHistogram render;
+	LatencyHistogram endToEnd;
+	vector<OclFrameQuality> qualities;
+	vector<int64> qualityFrames = vector<int64>(FLOW_QUALITY_LEVELS, 0);
+	double recomputedSum = 0;
+	int64 qualityCount = 0;
+	size_t peakPooled = 0;
+	size_t panoBytes = 0;
+};
+
+
+static bool loadMaps(const string& path, int numCams, vector<Mat>& xmaps, vector<Mat>& ymaps) {
+	FileStorage fs(path, FileStorage::READ);
+	if (!fs.isOpened()) {
+		return false;
+	}
+	xmaps.resize(numCams);
+	ymaps.resize(numCams);
+	for (int i = 0; i < numCams; ++i) {
+		fs[cv::format("xmap%d", i)] >> xmaps[i];
+		fs[cv::format("ymap%d", i)] >> ymaps[i];
+		if (xmaps[i].type() != CV_32FC1 || ymaps[i].type() != CV_32FC1
+			|| xmaps[i].size() != xmaps[0].size() || ymaps[i].size() != xmaps[0].size()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// the key the compiled maps are cached under: the maps file and its size, or the identity maps of size
+static string mapsKey(const string& path, Size size) {
+	if (path.empty()) {
+		return format("identity %dx%d", size.width, size.height);
+	}
+	long bytes = -1;
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (fp) {
+		fseek(fp, 0, SEEK_END);
+		bytes = ftell(fp);
+		fclose(fp);
+	}
+	return format("%s %ld", path.c_str(), bytes);
+}
+
+
+int main(int argc, char** argv) {
+	CommandLineParser parser(argc, argv, keys);
+	parser.about("streaming render of a multi-camera sequence with latency percentiles");
+	if (parser.has("help")) {
+		parser.printMessage();
+		return 0;
+	}
+	string input = parser.get<string>("input");
+	string raw = parser.get<string>("raw");
+	string pack = parser.get<string>("pack");
+	int overlap = parser.get<int>("overlap");
+	int64 maxFrames = parser.get<int>("frames");
+	int warmup = parser.get<int>("warmup");
+	double fps = parser.get<double>("fps");
+	string output = parser.get<string>("output");
+	bool stereo = !parser.has("mono");
+	string backend = parser.get<string>("backend");
+	string json = parser.get<string>("json");
+	if (!parser.check()) {
+		parser.printErrors();
+		return 1;
+	}
+	if (backend != "auto" && backend != "opencl" && backend != "cpu") {
+		fprintf(stderr, "invalid backend: %s, need auto, opencl or cpu\n", backend.c_str());
+		return 1;
+	}
+
+	unique_ptr<FrameSource> source;
+	if (!input.empty()) {
+		FolderSource* folders = new FolderSource();
+		source.reset(folders);
+		if (!folders->open(input)) {
+			fprintf(stderr, "no images match %s\n", input.c_str());
+			return 1;
+		}
+	} else if (!raw.empty()) {
+		RawSource* container = new RawSource();
+		source.reset(container);
+		if (!container->open(raw)) {
+			fprintf(stderr, "%s is not a raw container\n", raw.c_str());
+			return 1;
+		}
+	} else {
+		int cams = parser.get<int>("cams");
+		Size size(parser.get<int>("width"), parser.get<int>("height"));
+		if (cams < 2 || overlap <= 0 || size.width < 3 * overlap || size.height <= 0) {
+			fprintf(stderr, "invalid scene: need cams >= 2 and width >= 3 * overlap > 0\n");
+			return 1;
+		}
+		source.reset(new SyntheticSource(cams, size, overlap, 1));
+		if (maxFrames <= 0) {
+			fprintf(stderr, "the synthetic scene has no end, need frames > 0\n");
+			return 1;
+		}
+	}
+	int numCams = source->numCams();
+
+	if (!pack.empty()) {
+		RawWriter writer;
+		if (!writer.open(pack)) {
+			fprintf(stderr, "can't write %s\n", pack.c_str());
+			return 1;
+		}
+		vector<Mat> images;
+		int64 n = 0;
+		for (; (maxFrames <= 0 || n < maxFrames) && source->read(images); ++n) {
+			if (!writer.write(images)) {
+				fprintf(stderr, "can't write %s\n", pack.c_str());
+				return 1;
+			}
+		}
+		if (!writer.close()) {
+			fprintf(stderr, "can't write %s\n", pack.c_str());
+			return 1;
+		}
+		printf("packed %lld frames of %d cameras into %s\n", (long long)n, numCams, pack.c_str());
+		return 0;
+	}
+
+	vector<Mat> xmaps, ymaps;
+	if (parser.has("maps") && !loadMaps(parser.get<string>("maps"), numCams, xmaps, ymaps)) {
+		fprintf(stderr, "can't load the CV_32FC1 maps xmap0..%d/ymap0..%d of the same size from %s\n",
+			numCams - 1, numCams - 1, parser.get<string>("maps").c_str());
+		return 1;
+	}
+	Size sphereSize = xmaps.empty() ? source->size() : xmaps[0].size();
+	if (numCams < 2 || overlap <= 0 || sphereSize.width < 3 * overlap) {
+		fprintf(stderr, "invalid rig: need 2 cameras or more and a projected width >= 3 * overlap > 0\n");
+		return 1;
+	}
+
+	OclInitParameters params;
+	params.isMonoMode = !stereo;
+	params.numSideCams = numCams;
+	params.camImageWidth = sphereSize.width;
+	params.numNovelViews = sphereSize.width - overlap;
+	params.opticalFlowSize = Size(overlap, sphereSize.height);
+	params.smooth3LinesFactor = OclOptFlowSmooth3Lines(0.1f, 0.5f, 0.5f, 1.0f, 1.0f, 1.0f, 1.0f);
+	params.numRenderThreads = parser.get<int>("threads");
+	params.maxDevices = std::max(parser.get<int>("devices"), 1);
+	params.programCacheDir = parser.get<string>("program-cache");
+	params.maxFramesInFlight = std::max(parser.get<int>("in-flight"), 1);
+	params.memoryBudget = size_t(std::max(parser.get<double>("budget-mb"), 0.0) * 1048576.0);
+	params.targetFrameMs = parser.get<float>("target-ms");
+	params.incrementalFlow.motionThreshold = parser.get<float>("incremental");
+	params.incrementalFlow.tileSize = std::max(parser.get<int>("tile"), 16);
+	params.halfStorage = parser.has("half");
+	params.backend = backend == "cpu" ? BACKEND_CPU : backend == "opencl" ? BACKEND_OPENCL : BACKEND_AUTO;
+	if (!oclInitialize(&params)) {
+		fprintf(stderr, "oclInitialize failed, set OPENCV_OPENCL_DEVICE (e.g. :CPU:) or raise --budget-mb\n");
+		return 1;
+	}
+	printf("device: %s, %d cameras of %dx%d, projected to %dx%d\n",
+		oclActiveBackend() == BACKEND_CPU ? "cpu" : ocl::Device::getDefault().name().c_str(),
+		numCams, source->size().width, source->size().height, sphereSize.width, sphereSize.height);
+	OclStartupReport startup = oclGetStartupReport();
+	printf("startup: %.1f ms (programs %.1f ms, buffers %.1f ms), %d programs: %d loaded in %.1f ms, "
+		"%d built in %.1f ms, %d rejected\n", startup.totalMs, startup.preloadMs, startup.buffersMs,
+		startup.programs, startup.loaded, startup.loadMs, startup.built, startup.buildMs, startup.rejected);
+	OclMemoryPlan plan;
+	oclGetMemoryPlan(plan);
+	if (plan.numThreads > 0) {
+		printf("memory: %d render threads, flow arena %.1f MB (%.1f MB unaliased), shared %.1f MB\n",
+			plan.numThreads, plan.arenaBytes/1048576.0, plan.unaliasedBytes/1048576.0, plan.sharedBytes/1048576.0);
+	}
+	vector<OclRenderDevice> devices;
+	oclGetRenderDevices(devices);
+	for (size_t i = 0; devices.size() > 1 && i < devices.size(); ++i) {
+		printf("device %d: %s, %.2f ms per flow, %d camera pairs, %d threads\n", int(i),
+			devices[i].name.c_str(), devices[i].flowMs, int(devices[i].pairs.size()), devices[i].threads);
+	}
+
+	OclPostProcessParameters post;
+	post.chunkWidth = params.numNovelViews;
+	post.sharpFactor = parser.get<float>("sharp");
+	post.smoothThreshold = parser.get<float>("smooth");
+	post.wrapOffset = overlap / 2;
+	Stream stream(numCams, sphereSize, overlap, stereo, post);
+	string mapKey = parser.has("map-key") ? parser.get<string>("map-key")
+		: mapsKey(parser.has("maps") ? parser.get<string>("maps") : string(), sphereSize);
+	stream.setMaps(xmaps, ymaps, source->size(), parser.has("fixed"), parser.get<string>("map-cache"), mapKey);
+	stream.frameBytes = size_t(numCams) * source->size().area() * CV_ELEM_SIZE(source->type());
+
+	// the reader paces the frames with --fps, and drops them if the input queue is full then
+	BoundedQueue<Frame> inputQueue(parser.get<int>("queue"));
+	atomic<int64> droppedInput(0);
+	double startMs = nowMs();
+	thread reader([&]() {
+		for (int64 n = 0; maxFrames <= 0 || n < maxFrames; ++n) {
+			Frame frame;
+			frame.index = n;
+			if (!source->read(frame.images)) {
+				break;
+			}
+			if (fps > 0) {
+				double dueMs = startMs + n * 1000.0 / fps;
+				double waitMs = dueMs - nowMs();
+				if (waitMs > 0) {
+					this_thread::sleep_for(chrono::microseconds(int64(waitMs * 1000)));
+				}
+				frame.arrivalMs = nowMs();
+				if (!inputQueue.tryPush(std::move(frame))) {
+					droppedInput++;
+				}
+			} else {
+				frame.arrivalMs = nowMs();
+				inputQueue.push(std::move(frame));
+			}
+		}
+		inputQueue.close();
+	});
+
+	// the writer takes the panoramas in order, with a bounded queue
+	unique_ptr<BoundedQueue<Mat> > outputQueue;
+	thread writer;
+	atomic<bool> writeFailed(false);
+	if (!output.empty()) {
+		outputQueue.reset(new BoundedQueue<Mat>(parser.get<int>("write-queue")));
+		writer = thread([&]() {
+			RawWriter container;
+			bool images = output.find('%') != string::npos;
+			if (!images && !container.open(output)) {
+				writeFailed = true;
+			}
+			Mat pano;
+			for (int64 n = 0; outputQueue->pop(pano); ++n) {
+				if (writeFailed) {
+					continue;
+				}
+				bool ok = images ? imwrite(cv::format(output.c_str(), (int)n), pano) : container.write(vector<Mat>(1, pano));
+				writeFailed = !ok;
+			}
+			if (!images && !container.close()) {
+				writeFailed = true;
+			}
+		});
+	}
+
+	stream.run(inputQueue, outputQueue.get(), params.maxFramesInFlight, warmup);
+	double elapsedMs = nowMs() - startMs;
+	reader.join();
+	if (outputQueue) {
+		outputQueue->close();
+		writer.join();
+		stream.peakOutput = outputQueue->peakSize();
+	}
+	stream.droppedInput = droppedInput;
+	stream.peakInput = inputQueue.peakSize();
+	stream.fps = elapsedMs > 0 ? stream.rendered * 1000.0 / elapsedMs : 0;
+	stream.print();
+
+	int ret = 0;
+	if (writeFailed) {
+		fprintf(stderr, "can't write %s\n", output.c_str());
+		ret = 1;
+	}
+	if (!json.empty() && !stream.writeJson(json, params, parser)) {
+		fprintf(stderr, "can't write %s\n", json.c_str());
+		ret = 1;
+	}
+	oclRelease();
+	return ret;
+}
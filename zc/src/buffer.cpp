@@ -1,5 +1,7 @@
 #include "opencv2/core/ocl.hpp"
 #include "opencv2/oclrenderpano.hpp"
+#include "kernels.hpp"
+#include "memplan.hpp"
 
 
 #if 0
@@ -14,16 +16,6 @@ namespace imvt {
 
 using namespace std;
 
-#define APPEND(a) append(buffers, a);
-
-inline void  append(vector<UMat>& c, const UMat& e) {
-	c.insert(c.end(), e);
-}
-
-inline void  append(vector<UMat>& c, const vector<UMat>& a) {
-	c.insert(c.end(), a.begin(), a.end());
-}
-
 inline size_t allocGranularity(size_t size) {
 	if (size < 1024 * 1024)
 		return 4096;
@@ -33,187 +25,8 @@ inline size_t allocGranularity(size_t size) {
 		return 1024 * 1024;
 }
 
-size_t estimate(vector<UMat>& buffers) {
-	size_t s = 0;
-	for (int i = 0; i < buffers.size(); ++i) {
-		size_t size = buffers[i].rows * buffers[i].cols * buffers[i].elemSize();
-		s += alignSize(size, (int)allocGranularity(size));
-	}
-	return s;
-}
-
-vector<UMat> buildPyramid(const UMat& src) {
-	vector<UMat> pyramid = { src };
-	while (pyramid.size() < 1000) {
-		Size newSize(pyramid.back().cols * 0.9f + 0.5f, pyramid.back().rows * 0.9f + 0.5f);
-		if (newSize.height <= 24 || newSize.width <= 24) {
-			break;
-		}
-		UMat scaledImage(newSize, src.type());
-		pyramid.push_back(scaledImage);
-	}
-	return pyramid;
-}
-
-/**
-* @brief allocate buffers for optical flow
-*/
-void allocForOpticalFlow(vector<UMat>& buffers, Size imgSize) {
-
-	Size downscaleSize(imgSize.width *  0.5f, imgSize.height * 0.5f);
-	
-	// for finalFlow, finalFlowTmp
-	UMat finalFlow(imgSize, CV_32FC2);
-	UMat finalFlowTmp(imgSize, CV_32FC2);
-	APPEND(finalFlow);
-	APPEND(finalFlowTmp);
-
-	// for rgba0byteDownscaled, rgba1byteDownscaled, prevI0BGRADownscaled, prevI1BGRADownscaled
-	UMat rgba0byteDownscaled(downscaleSize, CV_8UC4);
-	UMat rgba1byteDownscaled(downscaleSize, CV_8UC4); 
-	UMat prevI0BGRADownscaled(downscaleSize, CV_8UC4);
-	UMat prevI1BGRADownscaled(downscaleSize, CV_8UC4);
-	APPEND(rgba0byteDownscaled);
-	APPEND(rgba1byteDownscaled);
-	APPEND(prevI0BGRADownscaled);
-	APPEND(prevI1BGRADownscaled);
-
-	// for I0Grey, I1Grey, 
-	UMat I0Grey(downscaleSize, CV_8UC1); 
-	UMat I1Grey(downscaleSize, CV_8UC1);
-	APPEND(I0Grey);
-	APPEND(I1Grey);
-
-	// for I0Tmp,(Gaussian blur)
-	UMat I0Tmp(downscaleSize, CV_32F);
-	APPEND(I0Tmp);
-
-	// for channels0, channels1
-	vector<UMat> channels0;
-	vector<UMat> channels1;
-	split(rgba0byteDownscaled, channels0);
-	split(rgba1byteDownscaled, channels1);
-	APPEND(channels0);
-	APPEND(channels1);
 
-	// for I0, I1, alpha0, alpha1, prevFlowDownscaled, motion
-	UMat I0(downscaleSize, CV_32F);
-	UMat I1(downscaleSize, CV_32F);
-	UMat alpha0(downscaleSize, CV_32F);
-	UMat alpha1(downscaleSize, CV_32F);
-	UMat prevFlowDownscaled(downscaleSize, CV_32FC2);
-	UMat motion(downscaleSize, CV_32F);
-	vector<UMat> pyramidI0 = buildPyramid(I0);
-	vector<UMat> pyramidI1 = buildPyramid(I1);
-	vector<UMat> pyramidAlpha0 = buildPyramid(alpha0);
-	vector<UMat> pyramidAlpha1 = buildPyramid(alpha1);
-	vector<UMat> prevFlowPyramid = buildPyramid(prevFlowDownscaled);
-	vector<UMat> motionPyramid = buildPyramid(motion);
-	APPEND(pyramidI0);
-	APPEND(pyramidI1);
-	APPEND(pyramidAlpha0);
-	APPEND(pyramidAlpha1);
-	APPEND(prevFlowPyramid);
-	APPEND(motionPyramid);
-
-	// for flow, flowTmp blurredFlow, I0x, I0y, I1x, I1y
-	UMat flow(downscaleSize, CV_32FC2);
-	UMat flowTmp(downscaleSize, CV_32FC2);
-	UMat blurredFlow(downscaleSize, CV_32FC2);
-	UMat I0x(downscaleSize, CV_32F);
-	UMat I0y(downscaleSize, CV_32F);
-	UMat I1x(downscaleSize, CV_32F);
-	UMat I1y(downscaleSize, CV_32F);
-	vector<UMat> pyramidFlow = buildPyramid(flow);
-	vector<UMat> pyramidFlowTmp = buildPyramid(flowTmp);
-	vector<UMat> pyramidBlurredFlow = buildPyramid(blurredFlow);
-	vector<UMat> pyramidI0x = buildPyramid(I0x);
-	vector<UMat> pyramidI0y = buildPyramid(I0y);
-	vector<UMat> pyramidI1x = buildPyramid(I1x);
-	vector<UMat> pyramidI1y = buildPyramid(I1y);
-	APPEND(pyramidFlow);
-	APPEND(pyramidFlowTmp);
-	APPEND(pyramidBlurredFlow);
-	APPEND(pyramidI0x);
-	APPEND(pyramidI0y);
-	APPEND(pyramidI1x);
-	APPEND(pyramidI1y);
-}
-
-
-void allocForNovelView(vector<UMat>& buffers, Size nvSize) {
-	// for render Lazy Novel View
-	UMat warpOpticalFlow(nvSize, CV_32FC2);
-	UMat remappedFlow(nvSize, CV_32FC2);
-	APPEND(warpOpticalFlow);
-	APPEND(remappedFlow);
-
-	// for novelView, novelViewFlowMag
-	UMat novelView(nvSize, CV_8UC4);
-	UMat novelViewFlowMag(nvSize, CV_32F);
-	for (int i = 0; i < 4; ++i) {
-		APPEND(novelView);
-		APPEND(novelViewFlowMag);
-	}
-}
-
-void allocForRenderChunks(vector<UMat>& buffers, int nCams, Size optSize, Size nvSize) {
-	vector<UMat> flowLtoRs;
-	vector<UMat> flowRtoLs;
-	vector<UMat> chunkLs;
-	vector<UMat> chunkRs;
-	for (int i = 0; i < nCams; ++i) {
-		flowLtoRs.push_back(UMat(optSize, CV_32FC2));
-		flowRtoLs.push_back(UMat(optSize, CV_32FC2));
-		chunkLs.push_back(UMat(nvSize, CV_32FC2));
-		chunkRs.push_back(UMat(nvSize, CV_32FC2));
-
-		allocForOpticalFlow(buffers, optSize);
-		allocForNovelView(buffers, nvSize);
-	}
-	APPEND(flowLtoRs);
-	APPEND(flowRtoLs);
-	APPEND(chunkLs);
-	APPEND(chunkRs);
-}
-
-void allocForGammaLUT(vector<UMat>& buffers) {
-	UMat lutGamma(1, 65536, CV_16U);
-	UMat lutAntiGamma(1, 65536, CV_16U);
-	APPEND(lutGamma);
-	APPEND(lutAntiGamma);
-}
-
-void allocForWarps(vector<UMat>& buffers, Size nvSize) {
-	vector<UMat> warpLs;
-	vector<UMat> warpRs;
-	for (int i = 0; i < 1; ++i) {
-		warpLs.push_back(UMat(nvSize, CV_32FC3));
-		warpRs.push_back(UMat(nvSize, CV_32FC3));
-	}
-	APPEND(warpLs);
-	APPEND(warpRs);
-}
-
-void allocForPrevious(vector<UMat>& buffers, int nCams, Size optSize) {
-	vector<UMat> imgLs;
-	vector<UMat> imgRs;
-	vector<UMat> flowLtoRs;
-	vector<UMat> flowRtoLs;
-	for (int i = 0; i < nCams; ++i) {
-		imgLs.push_back(UMat(optSize, CV_8UC4));
-		imgRs.push_back(UMat(optSize, CV_8UC4));
-		flowLtoRs.push_back(UMat(optSize, CV_32FC2));
-		flowRtoLs.push_back(UMat(optSize, CV_32FC2));
-	}
-	APPEND(imgLs);
-	APPEND(imgRs);
-	APPEND(flowLtoRs);
-	APPEND(flowRtoLs);
-}
-
-
-size_t getReservedBufferSize() {
+CV_EXPORTS_W size_t getReservedBufferSize() {
 	MatAllocator* allocator = ocl::getOpenCLAllocator();
 	BufferPoolController* controller = allocator->getBufferPoolController("OCL");
 	size_t s = 0;
@@ -231,99 +44,171 @@ size_t getReservedBufferSize() {
 	return s;
 }
 
-CV_EXPORTS_W bool oclInitBuffers(int nCams, Size optSize, Size nvSize, int& numThreads) {
-	
-	try {
-	LOGD("before init, reserved buffer size: %llu\n", getReservedBufferSize());
 
-	// hold buffers for render chunks
-	vector<UMat> common;
-	allocForGammaLUT(common);
-	allocForWarps(common, nvSize);
-	allocForPrevious(common, nCams, optSize);
-	size_t commonSize = estimate(common);
-	LOGD("common buffer size: %llu\n", commonSize);
-	LOGD("after common alloc, reserved buffer size: %llu\n", getReservedBufferSize());
-
-	// run all functions except render chunks
-	{
-	vector<UMat> images(nCams);
-	vector<UMat> chunkLs(nCams);
-	vector<UMat> chunkRs(nCams);
-	for (int i = 0; i < nCams; ++i) {
-		images[i] = UMat(Size(optSize.width + nvSize.width, optSize.height), CV_8UC4);
-		chunkLs[i] = UMat(nvSize, CV_8UC4);
-		chunkRs[i] = UMat(nvSize, CV_8UC4);
-	}
-	oclPreColorAdjustByGamma(images, -1, 180, 0.01, false, false, true);
+// @added: the memory planner
+static const int kMaxRenderThreads = 4;
 
-	oclRemoveChunkLines(chunkLs);
-	oclRemoveChunkLines(chunkRs);
-
-	UMat panoL;
-	UMat panoR;
-	oclStackHorizontal(chunkLs, panoL);
-	oclStackHorizontal(chunkRs, panoR);
-
-	oclSharpImage(panoL, 0.5);
-	oclSharpImage(panoR, 0.5);
+static size_t bufferBytes(Size size, int type) {
+	size_t bytes = size_t(size.area()) * CV_ELEM_SIZE(type);
+	return alignSize(bytes, (int)allocGranularity(bytes));
+}
 
-	UMat prePanoL(panoL.size(), panoL.type());
-	UMat prePanoR(panoR.size(), panoR.type());
-	oclSmoothImage(panoL, prePanoL, 0.05f, true);
-	oclSmoothImage(panoR, prePanoR, 0.05f, true);
+static string typeName(int type) {
+	static const char* depths[] = { "8U", "8S", "16U", "16S", "32S", "32F", "64F", "16F" };
+	return format("CV_%sC%d", depths[CV_MAT_DEPTH(type)], CV_MAT_CN(type));
+}
 
-	oclOffsetHorizontalWrap(panoL, 150);
-	oclOffsetHorizontalWrap(panoR, -150);
+void MemoryLayout::add(UMat* target, const string& name, Size size, int type, int first, int last) {
+	OclPlannedBuffer b = { name, size, type, first, last, -1 };
+	planned.push_back(b);
+	targets.push_back(target);
+}
 
-	UMat pano;
-	vector<UMat> panos = { panoL, panoR };
-	oclStackHorizontal(panos, pano);
+void MemoryLayout::assign() {
+	vector<int> order(planned.size());
+	for (size_t i = 0; i < order.size(); ++i) {
+		order[i] = (int)i;
 	}
-	ocl::finish();
-	size_t otherSize = getReservedBufferSize();
-	LOGD("after warm up, reserved buffer size: %llu\n", getReservedBufferSize());
-
-	vector<UMat> chunks;
-	allocForRenderChunks(chunks, 1, optSize, nvSize);
-	ocl::finish();
-	size_t chunkSize = estimate(chunks);
-	LOGD("chunk buffer size: %llu\n", chunkSize);
-	LOGD("after one chunk alloc, reserved buffer size: %llu\n", getReservedBufferSize());
+	stable_sort(order.begin(), order.end(), [this](int a, int b) {
+		return bufferBytes(planned[a].size, planned[a].type) > bufferBytes(planned[b].size, planned[b].type);
+	});
+	slots.clear();
+	for (int i : order) {
+		OclPlannedBuffer& b = planned[i];
+		b.slot = -1;
+		for (int s = 0; s < (int)slots.size() && b.slot < 0; ++s) {
+			if (slots[s].type != b.type) {
+				continue;
+			}
+			bool free = true;
+			for (const OclPlannedBuffer& other : planned) {
+				if (other.slot == s && other.first <= b.last && b.first <= other.last) {
+					free = false;
+					break;
+				}
+			}
+			if (free) {
+				b.slot = s;
+				slots[s].size = Size(std::max(slots[s].size.width, b.size.width), std::max(slots[s].size.height, b.size.height));
+			}
+		}
+		if (b.slot < 0) {
+			b.slot = (int)slots.size();
+			Slot slot = { b.type, b.size };
+			slots.push_back(slot);
+		}
+	}
+}
 
-	size_t globalSize = ocl::Device::getDefault().globalMemSize();
-	if (commonSize + chunkSize + otherSize > globalSize) {
-		return false;
+void MemoryLayout::allocate() {
+	vector<UMat> memory(slots.size());
+	for (size_t s = 0; s < slots.size(); ++s) {
+		memory[s].create(slots[s].size, slots[s].type);
+	}
+	for (size_t i = 0; i < planned.size(); ++i) {
+		const OclPlannedBuffer& b = planned[i];
+		*targets[i] = memory[b.slot](Rect(0, 0, b.size.width, b.size.height));
 	}
-	numThreads = (globalSize - commonSize - otherSize) / chunkSize;
-	LOGD("max thread num: %d\n", numThreads);
-	numThreads = nCams > numThreads ? numThreads/2 : numThreads;
-	numThreads = numThreads >= 2 ? (numThreads >= 4 ? 4 : 2) : 1;
-	LOGD("suggest thread num: %d\n", numThreads);
+}
 
-	allocForRenderChunks(chunks, numThreads - 1, optSize, nvSize);
-	ocl::finish();
-	LOGD("after other chunks alloc, reserved buffer size: %llu\n", getReservedBufferSize());
+size_t MemoryLayout::bytes() const {
+	size_t s = 0;
+	for (const Slot& slot : slots) {
+		s += bufferBytes(slot.size, slot.type);
+	}
+	return s;
+}
 
-	chunks.clear();
-	ocl::finish();
-	LOGD("after chunks release, reserved buffer size: %llu\n", getReservedBufferSize());
+size_t MemoryLayout::unaliasedBytes() const {
+	size_t s = 0;
+	for (const OclPlannedBuffer& b : planned) {
+		s += bufferBytes(b.size, b.type);
+	}
+	return s;
+}
 
-	common.clear();
-	ocl::finish();
-	LOGD("after init, reserved buffer size: %llu\n", getReservedBufferSize());
-	
-	} catch (...) {
-		LOGD("init buffer failed!");
-		return false;
+vector<size_t> MemoryLayout::slotBytes() const {
+	vector<size_t> bytes;
+	for (const Slot& slot : slots) {
+		bytes.push_back(bufferBytes(slot.size, slot.type));
 	}
-	return true;
+	return bytes;
 }
 
+// the bytes of a flow workspace of a render thread
+static size_t workspaceBytes(Size size, bool half, int level, MemoryLayout& layout) {
+	OclFlowWorkspace ws;
+	describeFlowWorkspace(ws, size, half, oclFlowQualityLevel(level), layout);
+	layout.assign();
+	return layout.bytes();
+}
 
+CV_EXPORTS_W bool oclPlanMemory(const OclInitParameters& params, OclMemoryPlan& plan) {
+	plan = OclMemoryPlan();
+	const int nCams = params.numSideCams;
+	const Size optSize = params.opticalFlowSize;
+	const Size nvSize(params.numNovelViews, optSize.height);
+	const bool half = params.halfStorage && params.backend != BACKEND_CPU;
+	const int eyes = params.isMonoMode ? 1 : 2;
+
+	// 0 without a device nor a budget: the threads are not bounded by the memory
+	plan.budget = ocl::useOpenCL() ? ocl::Device::getDefault().globalMemSize() : 0;
+	if (params.memoryBudget > 0) {
+		plan.budget = plan.budget > 0 ? std::min(plan.budget, params.memoryBudget) : params.memoryBudget;
+	}
 
+	// as RenderContext: the previous images and flows, the current flows, the gamma table
+	plan.sharedBytes = bufferBytes(Size(256, 1), CV_32FC1);
+	plan.sharedBytes += nCams * (2*bufferBytes(optSize, CV_8UC4) + 4*bufferBytes(optSize, storageType(2, half)));
+	plan.frameBytes = std::max(params.maxFramesInFlight, 1) * nCams * eyes * bufferBytes(nvSize, CV_8UC4);
+	plan.outputBytes = 2 * eyes * bufferBytes(Size(nCams * nvSize.width, nvSize.height), CV_8UC4);
+
+	MemoryLayout layout;
+	plan.arenaBytes = workspaceBytes(optSize, half, FLOW_QUALITY_FULL, layout);
+	plan.unaliasedBytes = layout.unaliasedBytes();
+	plan.buffers = layout.buffers();
+	plan.slotBytes = layout.slotBytes();
+	plan.threadBytes = plan.arenaBytes;
+	if (params.targetFrameMs > 0) {
+		for (int level = FLOW_QUALITY_FULL + 1; level < FLOW_QUALITY_LEVELS; ++level) {
+			MemoryLayout lower;
+			plan.threadBytes += workspaceBytes(optSize, half, level, lower);
+		}
+	}
+	if (params.incrementalFlow.motionThreshold > 0) {
+		// one image workspace for the bands, they may grow past it (see OclIncrementalFlow)
+		plan.threadBytes += plan.arenaBytes;
+	}
 
+	size_t fixed = plan.sharedBytes + plan.frameBytes + plan.outputBytes;
+	if (plan.budget == 0) {
+		plan.numThreads = kMaxRenderThreads;
+	} else if (fixed + plan.threadBytes <= plan.budget) {
+		plan.numThreads = (int)std::min<size_t>(kMaxRenderThreads, (plan.budget - fixed) / plan.threadBytes);
+	}
+	LOGD("memory plan: %d threads of %llu bytes\n", plan.numThreads, (unsigned long long)plan.threadBytes);
+	return plan.numThreads > 0;
+}
 
+CV_EXPORTS_W string oclMemoryPlanSummary(const OclMemoryPlan& plan) {
+	const double MB = 1048576.0;
+	string s = format("budget %.1f MB, %d render threads of %.1f MB\n", plan.budget / MB, plan.numThreads, plan.threadBytes / MB);
+	s += format("shared %.1f MB, frames %.1f MB, output %.1f MB, arena %.1f MB (%.1f MB unaliased)\n",
+		plan.sharedBytes / MB, plan.frameBytes / MB, plan.outputBytes / MB, plan.arenaBytes / MB, plan.unaliasedBytes / MB);
+	s += format("%-6s %-10s %10s  %s\n", "slot", "type", "MB", "buffers (first-last step)");
+	for (size_t slot = 0; slot < plan.slotBytes.size(); ++slot) {
+		string names;
+		int type = 0;
+		for (const OclPlannedBuffer& b : plan.buffers) {
+			if (b.slot == (int)slot) {
+				names += format("%s%s (%d-%d)", names.empty() ? "" : ", ", b.name.c_str(), b.first, b.last);
+				type = b.type;
+			}
+		}
+		s += format("%-6d %-10s %10.2f  %s\n", (int)slot, typeName(type).c_str(), plan.slotBytes[slot] / MB, names.c_str());
+	}
+	return s;
+}
 
 
 }	// namespace imvt
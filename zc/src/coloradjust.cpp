@@ -3,6 +3,9 @@
 #include <opencv2/imgproc.hpp>
 #include "precomp.hpp"
 #include "opencl_kernels_oclrenderpano.hpp"
+#include "kernels.hpp"
+#include "profiler.hpp"
+#include "cpubackend.hpp"
 
 namespace cv {
 namespace ocl {
@@ -35,7 +38,13 @@ CV_EXPORTS_W UMat oclAntiGammaLUT() {
 
 CV_EXPORTS_W void oclAntiGammaAdjust(const UMat& lut_anti_gamma, UMat& image) {
 	CV_Assert(lut_anti_gamma.type() == CV_16UC1 && image.type() == CV_16UC4);
-	ocl::Kernel k( "anti_gamma_lut_adjust", ocl::oclrenderpano::coloradjust_oclsrc);
+	// @added
+	if (cpuBackend()) {
+		Mat m = image.getMat(ACCESS_RW);
+		cpuLutAdjust(lut_anti_gamma.getMat(ACCESS_READ), m);
+		return;
+	}
+	OclKernel& k = oclKernel("anti_gamma_lut_adjust", ocl::oclrenderpano::coloradjust_oclsrc);
 	k.args(ocl::KernelArg::ReadOnlyNoSize(lut_anti_gamma),
 		ocl::KernelArg::ReadWrite(image));
 	size_t globalsize[] = { image.cols, image.rows };
@@ -45,7 +54,13 @@ CV_EXPORTS_W void oclAntiGammaAdjust(const UMat& lut_anti_gamma, UMat& image) {
 
 CV_EXPORTS_W void oclGammaAdjust(const UMat& lut_gamma, UMat& image) {
 	CV_Assert(lut_gamma.type() == CV_16UC1 && image.type() == CV_16UC4);
-	ocl::Kernel k( "gamma_lut_adjust", ocl::oclrenderpano::coloradjust_oclsrc);
+	// @added
+	if (cpuBackend()) {
+		Mat m = image.getMat(ACCESS_RW);
+		cpuLutAdjust(lut_gamma.getMat(ACCESS_READ), m);
+		return;
+	}
+	OclKernel& k = oclKernel("gamma_lut_adjust", ocl::oclrenderpano::coloradjust_oclsrc);
 	k.args(ocl::KernelArg::ReadOnlyNoSize(lut_gamma),
 		ocl::KernelArg::ReadWrite(image));
 	size_t globalsize[] = { image.cols, image.rows };
@@ -55,7 +70,13 @@ CV_EXPORTS_W void oclGammaAdjust(const UMat& lut_gamma, UMat& image) {
 
 CV_EXPORTS_W void oclAddBrightnessAndClampMulti(UMat& image, const float value) {
 	CV_Assert(image.type() == CV_16UC4);
-	ocl::Kernel k("add_brightness_and_clamp_multi", ocl::oclrenderpano::coloradjust_oclsrc);
+	// @added
+	if (cpuBackend()) {
+		Mat m = image.getMat(ACCESS_RW);
+		cpuAddBrightnessAndClampMulti(m, value);
+		return;
+	}
+	OclKernel& k = oclKernel("add_brightness_and_clamp_multi", ocl::oclrenderpano::coloradjust_oclsrc);
 	k.args(ocl::KernelArg::ReadWrite(image),
 		ocl::KernelArg::Constant(&value, sizeof(value)));
 	size_t globalsize[] = { image.cols, image.rows };
@@ -132,9 +153,47 @@ float calcBrightnessRatioByGrid(UMat L, UMat R, float& average, int type = 0) {
 	return ratio;
 }
 
+// @added: the gain of each camera, split from adjustImagesToStandardUsingMul()
+void calcAdjustColors(int standardSeq, int numCams, const vector<double>& colorP, vector<double>& adjustColor, bool debug) {
+
+	int standard = 0;
+	vector<double> resort(numCams, 0.0);
+	resort[0] = 1.0;
+
+	for (int i = 1; i < numCams; i++) {
+		resort[i] = colorP[i - 1] * resort[i - 1];
+	}
+	vector<double> sorted = vector<double>(resort);
+	sort(sorted.begin(), sorted.end());
+
+	if (standardSeq != -1) {
+		for (int i = 0; i < numCams; i++) {
+			if (sorted[standardSeq] == resort[i]) {
+				standard = i;
+				break;
+			}
+		}
+	}
+	for (int i = 0; i < numCams; i++) {
+		if (standardSeq != -1) {
+			adjustColor[i] = resort[i] / resort[standard];
+		}
+		else {
+			adjustColor[i] = resort[i] / sorted[sorted.size() - 2];
+		}
+	}
+	if (debug) {
+		printf("%d standard is \n", standard);
+		for (int i = 0; i < numCams; i++) {
+			printf("adjustImagesToStandardUsingMul  %d %f \n", i, adjustColor[i]);
+		}
+	}
+}
+
 void adjustImagesToStandardUsingMul(int standardSeq, vector<UMat>& images, 
 	vector<double>& colorP, vector<double>& adjustColor, int type, bool debug) {
 
+	/* @changed: the gains are computed by calcAdjustColors()
 	int standard = 0;
 	vector<double> resort(images.size(), 0.0);
 	resort[0] = 1.0;
@@ -164,10 +223,14 @@ void adjustImagesToStandardUsingMul(int standardSeq, vector<UMat>& images,
 	if (debug) {
 		printf("%d standard is \n", standard);
 	}
+	*/
+	calcAdjustColors(standardSeq, images.size(), colorP, adjustColor, debug);
 	for (int i = 0; i < images.size(); i++) {
+		/* @changed: printed by calcAdjustColors()
 		if (debug) {
 			printf("adjustImagesToStandardUsingMul  %d %f \n", i, adjustColor[i]);
 		}
+		*/
 		if (adjustColor[i] != 1.0) {
 			//adjusted[i] = oclAddBrightnessAndClampMulti(images[i], adjustColor[i]);
 			oclAddBrightnessAndClampMulti(images[i], adjustColor[i]);
@@ -179,6 +242,136 @@ void adjustImagesToStandardUsingMul(int standardSeq, vector<UMat>& images,
 }
 
 
+// @added: the 8-bit path of oclPreColorAdjustByGamma()
+CV_EXPORTS_W UMat oclAntiGammaLUT8u() {
+	Mat lut(1, 256, CV_32F);
+	for (int i = 0; i < 256; i++) {
+		lut.at<float>(0, i) = pow(i / 256.0, 1 / 2.2);
+	}
+	UMat result;
+	lut.copyTo(result);
+	return result;
+}
+
+// @added
+static const int kColorMaxCams = 16;		// COLOR_MAX_CAMS of coloradjust.cl
+static const int kColorReduceSize = 256;	// COLOR_REDUCE_SIZE of coloradjust.cl
+
+/**
+ * @brief The overlap samples of oclPreColorAdjustByGamma(), in row bands as calcBrightnessRatioByGrid()
+ *
+ * The first gridRows bands are gridHeight rows, the last band (bins = gridRows + 1) has the remaining rows.
+ */
+struct OverlapGrid {
+	int leftX;
+	int rightX;
+	int sampleWidth;
+	int gridHeight;
+	int gridRows;
+	int bins;
+};
+
+static int setImages(OclKernel& k, int i, const vector<UMat>& images, int first, int count, bool write) {
+	for (int j = 0; j < kColorMaxCams; j++) {
+		const UMat& image = images[first + (j < count ? j : 0)];
+		i = k.set(i, write ? ocl::KernelArg::ReadWriteNoSize(image) : ocl::KernelArg::ReadOnlyNoSize(image));
+	}
+	return i;
+}
+
+/**
+ * @brief Linear BGR sums and pixel count of every band and side, stats is 1 x (numCams*bins*2) CV_32FC4.
+ *
+ * A launch of color_overlap_stats per kColorMaxCams cameras, then the only wait of the stage.
+ */
+static void colorOverlapStats(const UMat& lut, const vector<UMat>& images, const OverlapGrid& grid, Mat& stats) {
+	int numCams = images.size();
+	if (cpuBackend()) {
+		stats.create(1, numCams*grid.bins*2, CV_32FC4);
+		Mat table = lut.getMat(ACCESS_READ);
+		for (int i = 0; i < numCams; i++) {
+			cpuColorOverlapStats(table, images[i].getMat(ACCESS_READ), grid.leftX, grid.rightX,
+				grid.sampleWidth, grid.gridHeight, grid.bins, stats.ptr<Vec4f>() + i*grid.bins*2);
+		}
+		return;
+	}
+	UMat result(1, numCams*grid.bins*2, CV_32FC4);
+	for (int first = 0; first < numCams; first += kColorMaxCams) {
+		int count = std::min(kColorMaxCams, numCams - first);
+		OclKernel& k = oclKernel("color_overlap_stats", ocl::oclrenderpano::coloradjust_oclsrc);
+		int i = k.set(0, ocl::KernelArg::PtrReadOnly(lut));
+		i = setImages(k, i, images, first, count, false);
+		i = k.set(i, first);
+		i = k.set(i, images[0].rows);
+		i = k.set(i, grid.leftX);
+		i = k.set(i, grid.rightX);
+		i = k.set(i, grid.sampleWidth);
+		i = k.set(i, grid.gridHeight);
+		i = k.set(i, grid.bins);
+		k.set(i, ocl::KernelArg::PtrWriteOnly(result));
+		size_t globalsize[] = { size_t(kColorReduceSize), size_t(grid.bins*2), size_t(count) };
+		size_t localsize[] = { size_t(kColorReduceSize), 1, 1 };
+		k.run(3, globalsize, localsize, false);
+	}
+	result.copyTo(stats);
+}
+
+/**
+ * @brief In place linearise, gain and re-gamma of the 8-bit images, a launch of color_harmonize_8u per kColorMaxCams cameras.
+ */
+static void colorHarmonize(const UMat& lut, vector<UMat>& images, const vector<double>& gains) {
+	int numCams = images.size();
+	if (cpuBackend()) {
+		Mat table = lut.getMat(ACCESS_READ);
+		for (int i = 0; i < numCams; i++) {
+			Mat m = images[i].getMat(ACCESS_RW);
+			cpuColorHarmonize(table, m, gains[i]);
+		}
+		return;
+	}
+	Mat values(1, numCams, CV_32F);
+	for (int i = 0; i < numCams; i++) {
+		values.at<float>(0, i) = gains[i];
+	}
+	UMat gainsBuffer;
+	values.copyTo(gainsBuffer);
+	for (int first = 0; first < numCams; first += kColorMaxCams) {
+		int count = std::min(kColorMaxCams, numCams - first);
+		OclKernel& k = oclKernel("color_harmonize_8u", ocl::oclrenderpano::coloradjust_oclsrc);
+		int i = k.set(0, ocl::KernelArg::PtrReadOnly(lut));
+		i = setImages(k, i, images, first, count, true);
+		i = k.set(i, first);
+		i = k.set(i, images[0].rows);
+		i = k.set(i, images[0].cols);
+		k.set(i, ocl::KernelArg::PtrReadOnly(gainsBuffer));
+		size_t globalsize[] = { size_t(images[0].cols), size_t(images[0].rows), size_t(count) };
+		size_t localsize[] = { 16, 16, 1 };
+		k.run(3, globalsize, localsize, false);
+	}
+}
+
+static float brightness(const Vec4f& s) {
+	return s[3] > 0 ? (s[0] * 0.114f + s[1] * 0.587f + s[2] * 0.299f) / s[3] : 0.0f;
+}
+
+/**
+ * @brief calcBrightnessRatioByGrid() of the left sample of L and the right sample of R (their bins*2 stats).
+ */
+static float calcBrightnessRatioByGrid(const Vec4f* L, const Vec4f* R, const OverlapGrid& grid) {
+	Vec4f all(0, 0, 0, 0);
+	for (int y = 0; y < grid.bins; y++) {
+		all += L[y * 2];
+	}
+	float b_avg = brightness(all);
+	for (int y = 0; y < grid.gridRows; y++) {
+		float b = brightness(L[y * 2]);
+		if (b > b_avg) {
+			return b / brightness(R[y * 2 + 1]);
+		}
+	}
+	// a flat sample, the 16-bit path divided by an empty rect here
+	return 1.0;
+}
 
 
 struct GammaLUT {
@@ -189,13 +382,17 @@ struct GammaLUT {
 	}
 
 	void init() {
+		/* @changed: the 16-bit tables are only built for oclGammaAdjust()/oclAntiGammaAdjust() callers
 		lut_gamma = oclGammaLUT();
 		lut_anti_gamma = oclAntiGammaLUT();
+		*/
+		lut_anti_gamma_8u = oclAntiGammaLUT8u();
 	}
 
 	void release() {
 		lut_gamma = UMat();
 		lut_anti_gamma = UMat();
+		lut_anti_gamma_8u = UMat();
 	}
 
 	UMat gammaTable() {
@@ -212,9 +409,18 @@ struct GammaLUT {
 		return lut_anti_gamma;
 	}
 
+	// @added
+	UMat antiGammaTable8u() {
+		if (lut_anti_gamma_8u.empty()) {
+			lut_anti_gamma_8u = oclAntiGammaLUT8u();
+		}
+		return lut_anti_gamma_8u;
+	}
+
 private:
 	UMat lut_gamma;
 	UMat lut_anti_gamma;
+	UMat lut_anti_gamma_8u;
 };
 
 
@@ -235,6 +441,7 @@ CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 	bool mean_color, 
 	bool is_hdr) {
 
+	ProfileStage stage("color adjust");
 	int numCams = spheres.size();
 	static vector<double> colorP = vector<double>(numCams);
 	static vector<float>  color = vector<float>(numCams);
@@ -249,6 +456,7 @@ CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 		initialized_gamma_table = true;
 	}
 
+	/* @changed: 8-bit in and out, the stage is a color_overlap_stats and a color_harmonize_8u launch
 	// apply anti-gamma adjust
 	vector<UMat> gammaMats = vector<UMat>(numCams);
 	UMat lut_anti_gamma = GammaLUT::instance().antiGammaTable();
@@ -257,6 +465,12 @@ CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 		multiply(gammaMats[i], 256, gammaMats[i]);
 		oclAntiGammaAdjust(lut_anti_gamma, gammaMats[i]);
 	}
+	*/
+	CV_Assert(numCams >= 2 && spheres[0].type() == CV_8UC4 && spheres[0].rows >= 6);
+	for (int i = 1; i < numCams; i++) {
+		CV_Assert(spheres[i].type() == CV_8UC4 && spheres[i].size() == spheres[0].size());
+	}
+	UMat lut_anti_gamma = GammaLUT::instance().antiGammaTable8u();
 
 	// get left/right overlap image bigthness ratio
 	if (true) {
@@ -273,11 +487,27 @@ CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 		Rect left(spheres[0].cols - overlapImageWidth + shift + shift_parallox, sampleHight_start, sample_width, sampleHight);
 		Rect right(shift, sampleHight_start, sample_width, sampleHight);
 
+		// @added: all the grid rows of all the cameras in one reduction
+		OverlapGrid grid;
+		grid.leftX = left.x;
+		grid.rightX = right.x;
+		grid.sampleWidth = sample_width;
+		grid.gridHeight = sampleHight / 6;
+		grid.gridRows = sampleHight / grid.gridHeight;
+		grid.bins = grid.gridRows + 1;
+		Mat stats;
+		colorOverlapStats(lut_anti_gamma, spheres, grid, stats);
+
 		for (int i = 0; i < numCams; i++) {
+			/* @changed: ratios of the stats
 			UMat overlapImageL = gammaMats[i](left);
 			UMat overlapImageR = gammaMats[(i + 1) % numCams](right);
 
 			colorP[i] = calcBrightnessRatioByGrid(overlapImageL, overlapImageR, color[i]);
+			*/
+			const Vec4f* L = stats.ptr<Vec4f>() + i*grid.bins*2;
+			const Vec4f* R = stats.ptr<Vec4f>() + (i + 1) % numCams*grid.bins*2;
+			colorP[i] = calcBrightnessRatioByGrid(L, R, grid);
 			if (colorP[i] < 0.3 || colorP[i] > 2.0) {
 				colorP[i] = 1.0;
 			}
@@ -303,6 +533,7 @@ CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 		}
 	}
 
+	/* @changed: the gains are applied with the gamma by colorHarmonize()
 	// adjust image using muliple method
 	if (!is_hdr) {
 		adjustImagesToStandardUsingMul(standard, gammaMats, colorP, adjustColor, 0, save_debug);
@@ -318,6 +549,9 @@ CV_EXPORTS_W bool oclPreColorAdjustByGamma(
 		multiply(gammaMats[i], 1.0/256, gammaMats[i]);
 		gammaMats[i].convertTo(spheres[i], CV_8UC4);
 	}
+	*/
+	calcAdjustColors(is_hdr ? -1 : standard, numCams, colorP, adjustColor, save_debug);
+	colorHarmonize(lut_anti_gamma, spheres, adjustColor);
 	ocl::finish();
 	return true;
 }
@@ -0,0 +1,1364 @@
+#include <atomic>
+#include <cmath>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "precomp.hpp"
+#include "opencv2/core/hal/intrin.hpp"
+#include "cpubackend.hpp"
+#include "opencv2/oclrenderpano/trace.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+using namespace std;
+
+static std::atomic<bool> cpuBackendActive(false);
+
+bool cpuBackend() {
+	return cpuBackendActive.load();
+}
+
+void setCpuBackend(bool cpu) {
+	cpuBackendActive.store(cpu);
+}
+
+
+//
+// a BGRA pixel as float4, one register with the universal intrinsics
+//
+#if CV_SIMD128
+typedef v_float32x4 Pixel4f;
+
+static inline Pixel4f pixelZero() {
+	return v_setzero_f32();
+}
+
+static inline Pixel4f pixelLoad(const uchar* p) {
+	return v_cvt_f32(v_reinterpret_as_s32(v_load_expand_q(p)));
+}
+
+static inline Pixel4f pixelScale(const Pixel4f& p, float w) {
+	return p * v_setall_f32(w);
+}
+
+// acc + p*w
+static inline Pixel4f pixelMad(const Pixel4f& p, float w, const Pixel4f& acc) {
+	return acc + p * v_setall_f32(w);
+}
+
+// convert_uchar4_sat (toward zero)
+static inline void pixelStore(uchar* d, const Pixel4f& p) {
+	v_int32x4 i = v_trunc(p);
+	v_int16x8 s = v_pack(i, i);
+	unsigned v = v_reinterpret_as_u32(v_pack_u(s, s)).get0();
+	memcpy(d, &v, 4);
+}
+
+// convert_uchar4_sat_rte
+static inline void pixelStoreRte(uchar* d, const Pixel4f& p) {
+	v_int32x4 i = v_round(p);
+	v_int16x8 s = v_pack(i, i);
+	unsigned v = v_reinterpret_as_u32(v_pack_u(s, s)).get0();
+	memcpy(d, &v, 4);
+}
+#else
+struct Pixel4f {
+	float v[4];
+};
+
+static inline Pixel4f pixelZero() {
+	Pixel4f p = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	return p;
+}
+
+static inline Pixel4f pixelLoad(const uchar* p) {
+	Pixel4f r = { { float(p[0]), float(p[1]), float(p[2]), float(p[3]) } };
+	return r;
+}
+
+static inline Pixel4f pixelScale(const Pixel4f& p, float w) {
+	Pixel4f r = { { p.v[0]*w, p.v[1]*w, p.v[2]*w, p.v[3]*w } };
+	return r;
+}
+
+static inline Pixel4f pixelMad(const Pixel4f& p, float w, const Pixel4f& acc) {
+	Pixel4f r = { { acc.v[0] + p.v[0]*w, acc.v[1] + p.v[1]*w, acc.v[2] + p.v[2]*w, acc.v[3] + p.v[3]*w } };
+	return r;
+}
+
+static inline void pixelStore(uchar* d, const Pixel4f& p) {
+	for (int i = 0; i < 4; ++i) {
+		d[i] = p.v[i] <= 0.0f ? 0 : p.v[i] >= 255.0f ? 255 : uchar(p.v[i]);
+	}
+}
+
+static inline void pixelStoreRte(uchar* d, const Pixel4f& p) {
+	for (int i = 0; i < 4; ++i) {
+		d[i] = saturate_cast<uchar>(p.v[i]);
+	}
+}
+#endif
+
+// a CV_8UC3 pixel with alpha 0, as read_8uc
+static inline Pixel4f pixelLoad3(const uchar* p) {
+	uchar q[4] = { p[0], p[1], p[2], 0 };
+	return pixelLoad(q);
+}
+
+// convert_uchar_sat (toward zero)
+static inline uchar satTrunc(float v) {
+	return v <= 0.0f ? 0 : v >= 255.0f ? 255 : uchar(v);
+}
+
+// v as the fp16 storage holds it: vstore_half (round to nearest even) then vload_half
+static inline float roundHalf(float v) {
+	Cv32suf u;
+	u.f = v;
+	unsigned sign = u.u & 0x80000000u;
+	unsigned a = u.u ^ sign;
+	if (a >= 0x477ff000u) {
+		// 65520 and above round to infinity, NaN stays NaN
+		u.u = sign | (a > 0x7f800000u ? a : 0x7f800000u);
+	} else if (a < 0x38800000u) {
+		// below 2^-14 the fp16 subnormals are the multiples of 2^-24
+		u.f = std::nearbyint(u.f*16777216.0f)*(1.0f/16777216.0f);
+	} else {
+		// 13 of the 23 mantissa bits go
+		a += 0xfffu + ((a >> 13) & 1u);
+		u.u = sign | (a & ~0x1fffu);
+	}
+	return u.f;
+}
+
+static inline Point2f roundHalf(Point2f v) {
+	return Point2f(roundHalf(v.x), roundHalf(v.y));
+}
+
+// the bicubic weights of get_bicubic_8uc4() for the fraction x
+static inline void cubicWeights(float x, float w[4]) {
+	const float A = -0.75f;
+	w[0] = ((A*(x + 1) - 5*A)*(x + 1) + 8*A)*(x + 1) - 4*A;
+	w[1] = ((A + 2)*x - (A + 3))*x*x + 1;
+	w[2] = ((A + 2)*(1 - x) - (A + 3))*(1 - x)*(1 - x) + 1;
+	w[3] = 1.f - w[0] - w[1] - w[2];
+}
+
+// BORDER_REFLECT_101 of i in [0, m], as REFLECT_101 of post_process
+static inline int reflect101(int i, int m) {
+	return std::min(i < 0 ? -i : (i > m ? 2*m - i : i), m);
+}
+
+// the bicubic sample of a CV_8UC3/CV_8UC4 image (zero outside) with its taps from (x0 - 1, y0 - 1), as cubic_sample_8uc
+static inline Pixel4f cubicSample(const Mat& src, int cn, int x0, int y0, const float wx[4], const float wy[4]) {
+	Pixel4f sum = pixelZero();
+	bool inside = x0 >= 1 && x0 + 2 < src.cols;
+	for (int dy = -1; dy < 3; ++dy) {
+		if (y0 + dy < 0 || y0 + dy >= src.rows) {
+			continue;
+		}
+		const uchar* row = src.ptr<uchar>(y0 + dy);
+		Pixel4f v = pixelZero();
+		if (inside && cn == 4) {
+			const uchar* p = row + 4*(x0 - 1);
+			v = pixelScale(pixelLoad(p), wx[0]);
+			v = pixelMad(pixelLoad(p + 4), wx[1], v);
+			v = pixelMad(pixelLoad(p + 8), wx[2], v);
+			v = pixelMad(pixelLoad(p + 12), wx[3], v);
+		} else {
+			for (int dx = -1; dx < 3; ++dx) {
+				int x = x0 + dx;
+				if (0 <= x && x < src.cols) {
+					v = pixelMad(cn == 4 ? pixelLoad(row + 4*x) : pixelLoad3(row + 3*x), wx[dx + 1], v);
+				}
+			}
+		}
+		sum = pixelMad(v, wy[dy + 1], sum);
+	}
+	return sum;
+}
+
+// src(pos) as sample_8uc4/cubic_remap_8UC4_32FC1 sample it
+static inline Pixel4f cubicSample(const Mat& src, int cn, float sx, float sy) {
+	// every tap is outside (NaN included)
+	if (!(sx > -3.0f && sx < src.cols + 1.0f && sy > -3.0f && sy < src.rows + 1.0f)) {
+		return pixelZero();
+	}
+	int x0 = int(sx);
+	int y0 = int(sy);
+	float wx[4], wy[4];
+	cubicWeights(sx - x0, wx);
+	cubicWeights(sy - y0, wy);
+	return cubicSample(src, cn, x0, y0, wx, wy);
+}
+
+// flow(pos) as sample_real2 samples it (bicubic, zero outside)
+static inline Point2f cubicSampleFlow(const Mat& flow, float sx, float sy) {
+	if (!(sx > -3.0f && sx < flow.cols + 1.0f && sy > -3.0f && sy < flow.rows + 1.0f)) {
+		return Point2f(0.0f, 0.0f);
+	}
+	int x0 = int(sx);
+	int y0 = int(sy);
+	float wx[4], wy[4];
+	cubicWeights(sx - x0, wx);
+	cubicWeights(sy - y0, wy);
+	Point2f sum(0.0f, 0.0f);
+	for (int dy = -1; dy < 3; ++dy) {
+		if (y0 + dy < 0 || y0 + dy >= flow.rows) {
+			continue;
+		}
+		const Point2f* row = flow.ptr<Point2f>(y0 + dy);
+		Point2f v(0.0f, 0.0f);
+		for (int dx = -1; dx < 3; ++dx) {
+			int x = x0 + dx;
+			if (0 <= x && x < flow.cols) {
+				v += row[x]*wx[dx + 1];
+			}
+		}
+		sum += v*wy[dy + 1];
+	}
+	return sum;
+}
+
+
+void cpuProjection(const Mat& src, const Mat& mapx, const Mat& mapy, Mat& dst) {
+	CV_Assert(src.type() == CV_8UC4 || src.type() == CV_8UC3);
+	CV_Assert(mapx.type() == CV_32FC1 && mapy.type() == CV_32FC1 && mapx.size() == mapy.size());
+	dst.create(mapx.size(), CV_8UC4);
+	int cn = src.channels();
+	parallel_for_(Range(0, dst.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			const float* xs = mapx.ptr<float>(y);
+			const float* ys = mapy.ptr<float>(y);
+			uchar* d = dst.ptr<uchar>(y);
+			for (int x = 0; x < dst.cols; ++x) {
+				pixelStore(d + 4*x, cubicSample(src, cn, xs[x], ys[x]));
+				if (cn == 3) {
+					d[4*x + 3] = 255;
+				}
+			}
+		}
+	});
+}
+
+void cpuProjection(const Mat& src, const Mat& map, const Mat& weights, int fracBits, Mat& dst) {
+	CV_Assert(src.type() == CV_8UC4 || src.type() == CV_8UC3);
+	CV_Assert(map.type() == CV_16UC3 && weights.type() == CV_32FC4 && (int)weights.total() == 2 << fracBits);
+	dst.create(map.size(), CV_8UC4);
+	int cn = src.channels();
+	const float* w = weights.ptr<float>();
+	parallel_for_(Range(0, dst.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			const ushort* m = map.ptr<ushort>(y);
+			uchar* d = dst.ptr<uchar>(y);
+			for (int x = 0; x < dst.cols; ++x) {
+				// as fixed_cubic_remap: the integer part is truncated toward zero
+				int px = ((int(m[3*x]) << fracBits) | (m[3*x + 2] >> 8)) - (3 << fracBits);
+				int py = ((int(m[3*x + 1]) << fracBits) | (m[3*x + 2] & 0xff)) - (3 << fracBits);
+				int x0 = px < 0 ? -((-px) >> fracBits) : px >> fracBits;
+				int y0 = py < 0 ? -((-py) >> fracBits) : py >> fracBits;
+				const float* wx = w + 4*(px - (x0 << fracBits) + (1 << fracBits));
+				const float* wy = w + 4*(py - (y0 << fracBits) + (1 << fracBits));
+				pixelStore(d + 4*x, cubicSample(src, cn, x0, y0, wx, wy));
+				if (cn == 3) {
+					d[4*x + 3] = 255;
+				}
+			}
+		}
+	});
+}
+
+
+//
+// optical flow, as OpticalFlow of optflow.cpp. The host buffers are fp32, with halfStorage
+// every value is rounded through fp16 where the kernels store it into the fp16 storage.
+//
+
+// as oclResize() (resize_8UC4/resize_32FC*): bicubic with the border replicated, src position = dst position*factor
+static void cubicResize(const Mat& src, Mat& dst, Size dsize, bool half) {
+	CV_Assert(src.type() == CV_8UC4 || src.type() == CV_32FC1 || src.type() == CV_32FC2);
+	dst.create(dsize, src.type());
+	float factorX = float(double(src.cols) / double(dst.cols));
+	float factorY = float(double(src.rows) / double(dst.rows));
+	int cn = src.channels();
+	parallel_for_(Range(0, dst.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			float sy = y*factorY;
+			int y0 = int(sy);
+			float wy[4];
+			cubicWeights(sy - y0, wy);
+			const uchar* rows[4];
+			for (int i = 0; i < 4; ++i) {
+				rows[i] = src.ptr<uchar>(std::min(std::max(y0 + i - 1, 0), src.rows - 1));
+			}
+			for (int x = 0; x < dst.cols; ++x) {
+				float sx = x*factorX;
+				int x0 = int(sx);
+				float wx[4];
+				cubicWeights(sx - x0, wx);
+				int xs[4];
+				for (int i = 0; i < 4; ++i) {
+					xs[i] = std::min(std::max(x0 + i - 1, 0), src.cols - 1);
+				}
+				if (cn == 4) {
+					Pixel4f sum = pixelZero();
+					for (int i = 0; i < 4; ++i) {
+						Pixel4f v = pixelScale(pixelLoad(rows[i] + 4*xs[0]), wx[0]);
+						v = pixelMad(pixelLoad(rows[i] + 4*xs[1]), wx[1], v);
+						v = pixelMad(pixelLoad(rows[i] + 4*xs[2]), wx[2], v);
+						v = pixelMad(pixelLoad(rows[i] + 4*xs[3]), wx[3], v);
+						sum = pixelMad(v, wy[i], sum);
+					}
+					pixelStore(dst.ptr<uchar>(y) + 4*x, sum);
+				} else {
+					float* d = dst.ptr<float>(y) + cn*x;
+					for (int c = 0; c < cn; ++c) {
+						float sum = 0.0f;
+						for (int i = 0; i < 4; ++i) {
+							const float* s = (const float*)rows[i];
+							float v = s[cn*xs[0] + c]*wx[0] + s[cn*xs[1] + c]*wx[1] + s[cn*xs[2] + c]*wx[2] + s[cn*xs[3] + c]*wx[3];
+							sum += v*wy[i];
+						}
+						d[c] = half ? roundHalf(sum) : sum;
+					}
+				}
+			}
+		}
+	});
+}
+
+// as resize_linear_32FC1/resize_linear_32FC2, the pixel centers of cv::resize(..., INTER_LINEAR)
+static void linearResize(const Mat& src, Mat& dst, Size dsize, bool half) {
+	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2);
+	CV_Assert(src.data != dst.data);
+	dst.create(dsize, src.type());
+	float factorX = float(double(src.cols) / double(dst.cols));
+	float factorY = float(double(src.rows) / double(dst.rows));
+	int cn = src.channels();
+	parallel_for_(Range(0, dst.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			float sy = (y + 0.5f)*factorY - 0.5f;
+			int y0 = (int)std::floor(sy);
+			float yR = sy - y0;
+			const float* s0 = src.ptr<float>(std::min(std::max(y0, 0), src.rows - 1));
+			const float* s1 = src.ptr<float>(std::min(std::max(y0 + 1, 0), src.rows - 1));
+			float* d = dst.ptr<float>(y);
+			for (int x = 0; x < dst.cols; ++x) {
+				float sx = (x + 0.5f)*factorX - 0.5f;
+				int x0 = (int)std::floor(sx);
+				float xR = sx - x0;
+				int x1 = cn*std::min(std::max(x0 + 1, 0), src.cols - 1);
+				x0 = cn*std::min(std::max(x0, 0), src.cols - 1);
+				for (int c = 0; c < cn; ++c) {
+					float v0 = s0[x0 + c] + (s0[x1 + c] - s0[x0 + c])*xR;
+					float v1 = s1[x0 + c] + (s1[x1 + c] - s1[x0 + c])*xR;
+					float v = v0 + (v1 - v0)*yR;
+					d[cn*x + c] = half ? roundHalf(v) : v;
+				}
+			}
+		}
+	});
+}
+
+// as convert_8UC1 of oclConvert()
+static void convertScaled(const Mat& src, Mat& dst, float factor, bool half) {
+	CV_Assert(src.type() == CV_8UC1);
+	dst.create(src.size(), CV_32FC1);
+	parallel_for_(Range(0, src.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			const uchar* s = src.ptr<uchar>(y);
+			float* d = dst.ptr<float>(y);
+			for (int x = 0; x < src.cols; ++x) {
+				float v = factor*(float)s[x];
+				d[x] = half ? roundHalf(v) : v;
+			}
+		}
+	});
+}
+
+// as scale_self_32FC1/scale_self_32FC2 of oclScale()
+static void scaleReal(Mat& m, float factor, bool half) {
+	CV_Assert(m.depth() == CV_32F);
+	parallel_for_(Range(0, m.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			float* p = m.ptr<float>(y);
+			for (int x = 0; x < m.cols*m.channels(); ++x) {
+				float v = p[x]*factor;
+				p[x] = half ? roundHalf(v) : v;
+			}
+		}
+	});
+}
+
+// as oclGaussianBlurV2(): filter_row_32FC* into tmp, filter_col_32FC* into dst, BORDER_REFLECT_101,
+// the kernel of getGaussianKernel(CV_32F) accumulated in float from its first tap. dst may be src.
+static void gaussianBlur(const Mat& src, Mat& dst, int ksize, double sigma, Mat& tmp, bool half) {
+	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2);
+	CV_Assert(tmp.data != src.data);
+	Mat k = getGaussianKernel(ksize, sigma, CV_32F);
+	const float* w = k.ptr<float>();
+	const int radius = ksize/2;
+	const int cn = src.channels();
+	const int rows = src.rows;
+	const int cols = src.cols;
+	tmp.create(src.size(), src.type());
+	parallel_for_(Range(0, rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			const float* s = src.ptr<float>(y);
+			float* d = tmp.ptr<float>(y);
+			for (int x = 0; x < cols; ++x) {
+				for (int c = 0; c < cn; ++c) {
+					float sum = 0.0f;
+					for (int dx = -radius; dx <= radius; ++dx) {
+						sum += s[cn*reflect101(x + dx, cols - 1) + c]*w[dx + radius];
+					}
+					d[cn*x + c] = half ? roundHalf(sum) : sum;
+				}
+			}
+		}
+	});
+	dst.create(src.size(), src.type());
+	parallel_for_(Range(0, rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			float* d = dst.ptr<float>(y);
+			for (int x = 0; x < cols*cn; ++x) {
+				float sum = 0.0f;
+				for (int dy = -radius; dy <= radius; ++dy) {
+					sum += tmp.ptr<float>(reflect101(y + dy, rows - 1))[x]*w[dy + radius];
+				}
+				d[x] = half ? roundHalf(sum) : sum;
+			}
+		}
+	});
+}
+
+// as gradient_blur_32FC1: the central differences (border replicated) at the reflected (BORDER_REFLECT_101)
+// taps of the blur, summed with the weights ky*kx from the top-left tap
+static void gradientBlur(const Mat& I0, const Mat& I1, Mat& I0x, Mat& I0y, Mat& I1x, Mat& I1y,
+	int ksize, double sigma, bool half) {
+	CV_Assert(I0.type() == CV_32FC1 && I1.type() == CV_32FC1 && I0.size() == I1.size());
+	Mat k = getGaussianKernel(ksize, sigma, CV_32F);
+	const float* w = k.ptr<float>();
+	const int radius = ksize/2;
+	const int rows = I0.rows;
+	const int cols = I0.cols;
+	I0x.create(I0.size(), CV_32FC1);
+	I0y.create(I0.size(), CV_32FC1);
+	I1x.create(I0.size(), CV_32FC1);
+	I1y.create(I0.size(), CV_32FC1);
+	parallel_for_(Range(0, rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			for (int x = 0; x < cols; ++x) {
+				float sum0x = 0.0f;
+				float sum0y = 0.0f;
+				float sum1x = 0.0f;
+				float sum1y = 0.0f;
+				for (int dy = -radius; dy <= radius; ++dy) {
+					int qy = reflect101(y + dy, rows - 1);
+					int up = std::max(qy - 1, 0);
+					int down = std::min(qy + 1, rows - 1);
+					for (int dx = -radius; dx <= radius; ++dx) {
+						int qx = reflect101(x + dx, cols - 1);
+						int left = std::max(qx - 1, 0);
+						int right = std::min(qx + 1, cols - 1);
+						float wk = w[dy + radius]*w[dx + radius];
+						sum0x += wk*(I0.at<float>(qy, right) - I0.at<float>(qy, left));
+						sum0y += wk*(I0.at<float>(down, qx) - I0.at<float>(up, qx));
+						sum1x += wk*(I1.at<float>(qy, right) - I1.at<float>(qy, left));
+						sum1y += wk*(I1.at<float>(down, qx) - I1.at<float>(up, qx));
+					}
+				}
+				I0x.at<float>(y, x) = half ? roundHalf(sum0x) : sum0x;
+				I0y.at<float>(y, x) = half ? roundHalf(sum0y) : sum0y;
+				I1x.at<float>(y, x) = half ? roundHalf(sum1x) : sum1x;
+				I1y.at<float>(y, x) = half ? roundHalf(sum1y) : sum1y;
+			}
+		}
+	});
+}
+
+// as median_blur5_32FC2: the median of each component over the 5x5 window, border replicated
+static void flowMedianBlur5(const Mat& src, Mat& dst) {
+	CV_Assert(src.type() == CV_32FC2 && src.data != dst.data);
+	dst.create(src.size(), src.type());
+	parallel_for_(Range(0, src.rows), [&](const Range& r) {
+		float u[25];
+		float v[25];
+		for (int y = r.start; y < r.end; ++y) {
+			Point2f* d = dst.ptr<Point2f>(y);
+			for (int x = 0; x < src.cols; ++x) {
+				int n = 0;
+				for (int dy = -2; dy <= 2; ++dy) {
+					const Point2f* s = src.ptr<Point2f>(std::min(std::max(y + dy, 0), src.rows - 1));
+					for (int dx = -2; dx <= 2; ++dx) {
+						const Point2f& f = s[std::min(std::max(x + dx, 0), src.cols - 1)];
+						u[n] = f.x;
+						v[n] = f.y;
+						++n;
+					}
+				}
+				// the 13th smallest is the element the selection sort of the kernel stops at
+				std::nth_element(u, u + 12, u + 25);
+				std::nth_element(v, v + 12, v + 25);
+				d[x] = Point2f(u[12], v[12]);
+			}
+		}
+	});
+}
+
+// the motion of each pixel against the previous frame, as motion_detection_v2
+static void motionDetection(const Mat& cur, const Mat& pre, Mat& motion, bool half) {
+	motion.create(cur.size(), CV_32FC1);
+	parallel_for_(Range(0, cur.rows), [&](const Range& r) {
+		const float topBottomThresh = 0.3f;
+		for (int y = r.start; y < r.end; ++y) {
+			const uchar* c = cur.ptr<uchar>(y);
+			const uchar* p = pre.ptr<uchar>(y);
+			float* m = motion.ptr<float>(y);
+			float delta;
+			if (y < cur.rows*topBottomThresh) {
+				delta = y / (cur.rows*topBottomThresh);
+			} else if (y > cur.rows*(1.0f - topBottomThresh)) {
+				delta = (cur.rows - y) / (cur.rows*topBottomThresh);
+			} else {
+				delta = 1.01f;
+			}
+			for (int x = 0; x < cur.cols; ++x) {
+				float v = (std::fabs((float)c[4*x] - (float)p[4*x])
+					+ std::fabs((float)c[4*x + 1] - (float)p[4*x + 1])
+					+ std::fabs((float)c[4*x + 2] - (float)p[4*x + 2]))/(3.0f*255.0f);
+				if (delta < 1.01f) {
+					v *= std::max(delta, 0.1f);
+				}
+				m[x] = half ? roundHalf(v) : v;
+			}
+		}
+	});
+}
+
+// the Mat headers of the level buffers of an OclFlowWorkspace
+struct CpuFlowLevel {
+	Mat I0, I1, alpha0, alpha1;
+	Mat prevFlow, motion;
+	Mat I0x, I0y, I1x, I1y;
+	Mat flow, flowTmp, blurredFlow;
+};
+
+struct CpuOpticalFlow {
+	// same as OpticalFlow of optflow.cpp, the scale factors are in quality
+	static constexpr float kGradEpsilon = 0.001f;
+	static constexpr float kUpdateAlphaThreshold = 0.9f;
+	static constexpr int   kMedianBlurSize = 5;
+	static constexpr int   kPreBlurKernelWidth = 5;
+	static constexpr float kPreBlurSigma = 0.25f;
+	static constexpr int   kFinalFlowBlurKernelWidth = 3;
+	static constexpr float kFinalFlowBlurSigma = 1.0f;
+	static constexpr int   kGradientBlurKernelWidth = 3;
+	static constexpr float kGradientBlurSigma = 0.5f;
+	static constexpr int   kBlurredFlowKernelWidth = 15;
+	static constexpr float kBlurredFlowSigma = 8.0f;
+	static constexpr float kSmoothnessCoef = 0.001f;
+	static constexpr float kVerticalRegularizationCoef = 0.01f;
+	static constexpr float kGradientStepSize = 0.5f;
+	// tile of the wavefront sweeps, as SWEEP_TILE
+	static constexpr int   kSweepTile = 32;
+
+	bool useSlashSweeping = false;
+	int sweepEngine = SWEEP_ROWS_COLS;
+	bool halfStorage = false;
+	int traceLevel = -1;
+	OclFlowQuality quality;
+
+	// the same stages as OpticalFlow::trace()
+	void trace(const char* stage, const Mat& m) const {
+		MatTrace& t = MatTrace::instance();
+		if (t.recording()) {
+			t.capture(traceLevel < 0 ? string(stage) : format("level%02d/%s", traceLevel, stage), m);
+		}
+	}
+
+	// the buffers of the level being swept
+	const Mat* alpha0 = nullptr;
+	const Mat* alpha1 = nullptr;
+	const Mat* I0x = nullptr;
+	const Mat* I0y = nullptr;
+	const Mat* I1x = nullptr;
+	const Mat* I1y = nullptr;
+	const Mat* blurred = nullptr;
+	Mat* flow = nullptr;
+
+	void computeOpticalFlow(
+		const Mat& rgba0byte,
+		const Mat& rgba1byte,
+		const Mat& prevFlow,
+		const Mat& prevI0BGRA,
+		const Mat& prevI1BGRA,
+		Mat& finalFlow,
+		const OclInitParameters* params,
+		OclFlowWorkspace* ws,
+		const OclFlowQuality* flowQuality) {
+
+		if (flowQuality) {
+			quality = *flowQuality;
+		}
+		ws->create(rgba0byte.size(), false, quality);
+		halfStorage = params->halfStorage;
+		const bool half = halfStorage;
+		useSlashSweeping = quality.slashSweeping < 0 ? rgba0byte.cols < 400 : quality.slashSweeping > 0;
+		sweepEngine = params->sweepEngine;
+
+		// headers on the workspace, released before it
+		vector<CpuFlowLevel> levels(ws->levels.size());
+		for (size_t l = 0; l < levels.size(); ++l) {
+			OclFlowLevel& b = ws->levels[l];
+			CpuFlowLevel& m = levels[l];
+			m.I0 = b.I0.getMat(ACCESS_RW);
+			m.I1 = b.I1.getMat(ACCESS_RW);
+			m.alpha0 = b.alpha0.getMat(ACCESS_RW);
+			m.alpha1 = b.alpha1.getMat(ACCESS_RW);
+			m.prevFlow = b.prevFlow.getMat(ACCESS_RW);
+			m.motion = b.motion.getMat(ACCESS_RW);
+			m.I0x = b.I0x.getMat(ACCESS_RW);
+			m.I0y = b.I0y.getMat(ACCESS_RW);
+			m.I1x = b.I1x.getMat(ACCESS_RW);
+			m.I1y = b.I1y.getMat(ACCESS_RW);
+			m.flow = b.flow.getMat(ACCESS_RW);
+			m.flowTmp = b.flowTmp.getMat(ACCESS_RW);
+			m.blurredFlow = b.blurredFlow.getMat(ACCESS_RW);
+		}
+		Mat rgba0 = ws->rgba0.getMat(ACCESS_RW);
+		Mat rgba1 = ws->rgba1.getMat(ACCESS_RW);
+		Mat prevRgba0 = ws->prevRgba0.getMat(ACCESS_RW);
+		Mat prevRgba1 = ws->prevRgba1.getMat(ACCESS_RW);
+		Mat grey0 = ws->grey0.getMat(ACCESS_RW);
+		Mat grey1 = ws->grey1.getMat(ACCESS_RW);
+		Mat blurTmp = ws->blurTmp.getMat(ACCESS_RW);
+		Mat finalFlowTmp = ws->finalFlowTmp.getMat(ACCESS_RW);
+
+		// pre-scale everything to a smaller size
+		Size downscaleSize = levels[0].I0.size();
+		cubicResize(rgba0byte, rgba0, downscaleSize, half);
+		cubicResize(rgba1byte, rgba1, downscaleSize, half);
+
+		bool usePrevFlow = !prevFlow.empty() && quality.temporalRegularization;
+		if (usePrevFlow) {
+			cubicResize(prevFlow, levels[0].prevFlow, downscaleSize, half);
+			scaleReal(levels[0].prevFlow, float(downscaleSize.height) / float(prevFlow.rows), half);
+			cubicResize(prevI0BGRA, prevRgba0, downscaleSize, half);
+			cubicResize(prevI1BGRA, prevRgba1, downscaleSize, half);
+			cpuSmoothImage(rgba0, prevRgba0, params->inputMotionThreshold, true);
+			cpuSmoothImage(rgba1, prevRgba1, params->inputMotionThreshold, true);
+			if (params->computeMotionUsingLpair) {
+				motionDetection(rgba0, prevRgba0, levels[0].motion, half);
+			} else {
+				motionDetection(rgba1, prevRgba1, levels[0].motion, half);
+			}
+		}
+
+		// grey and alpha in [0, 1]
+		cvtColor(rgba0, grey0, CV_BGRA2GRAY);
+		cvtColor(rgba1, grey1, CV_BGRA2GRAY);
+		convertScaled(grey0, levels[0].I0, 1.0f/255.0f, half);
+		convertScaled(grey1, levels[0].I1, 1.0f/255.0f, half);
+		extractChannel(rgba0, grey0, 3);
+		extractChannel(rgba1, grey1, 3);
+		convertScaled(grey0, levels[0].alpha0, 1.0f/255.0f, half);
+		convertScaled(grey1, levels[0].alpha1, 1.0f/255.0f, half);
+		gaussianBlur(levels[0].I0, levels[0].I0, kPreBlurKernelWidth, kPreBlurSigma, blurTmp, half);
+		gaussianBlur(levels[0].I1, levels[0].I1, kPreBlurKernelWidth, kPreBlurSigma, blurTmp, half);
+		if (usePrevFlow) {
+			trace("prepare/motion", levels[0].motion);
+		}
+		trace("prepare/I0", levels[0].I0);
+		trace("prepare/I1", levels[0].I1);
+		trace("prepare/alpha0", levels[0].alpha0);
+		trace("prepare/alpha1", levels[0].alpha1);
+
+		// the pyramids, level l resized from level l - 1
+		for (size_t l = 1; l < levels.size(); ++l) {
+			Size size = levels[l].I0.size();
+			linearResize(levels[l - 1].I0, levels[l].I0, size, half);
+			linearResize(levels[l - 1].I1, levels[l].I1, size, half);
+			linearResize(levels[l - 1].alpha0, levels[l].alpha0, size, half);
+			linearResize(levels[l - 1].alpha1, levels[l].alpha1, size, half);
+			if (usePrevFlow) {
+				linearResize(levels[l - 1].prevFlow, levels[l].prevFlow, size, half);
+				linearResize(levels[l - 1].motion, levels[l].motion, size, half);
+			}
+		}
+		if (usePrevFlow) {
+			for (size_t l = 1; l < levels.size(); ++l) {
+				scaleReal(levels[l].prevFlow, float(levels[l].prevFlow.rows) / float(levels[0].prevFlow.rows), half);
+			}
+		}
+
+		Mat levelFlow;
+		for (int level = (int)levels.size() - 1; level >= 0; --level) {
+			CpuFlowLevel& L = levels[level];
+			traceLevel = level;
+			if (levelFlow.empty()) {
+				levelFlow = L.flow;
+				levelFlow.setTo(Scalar::all(0));
+			}
+			patchMatchPropagationAndSearch(L, levelFlow);
+			if (usePrevFlow) {
+				adjustFlowTowardPrevious(L.prevFlow, L.motion, levelFlow, params->smooth3LinesFactor, half);
+				trace("temporal", levelFlow);
+			}
+			if (level > 0) {
+				Mat& upscaled = levels[level - 1].flow;
+				cubicResize(levelFlow, upscaled, upscaled.size(), half);
+				levelFlow = upscaled;
+				scaleReal(levelFlow, 1.0f/quality.pyrScaleFactor, half);
+				trace("upscale", levelFlow);
+			}
+		}
+		traceLevel = -1;
+
+		// scale the flow result back to full size
+		finalFlow.create(rgba0byte.size(), CV_32FC2);
+		linearResize(levelFlow, finalFlow, finalFlow.size(), half);
+		scaleReal(finalFlow, 1.0f/quality.downscaleFactor, half);
+		gaussianBlur(finalFlow, finalFlow, kFinalFlowBlurKernelWidth, kFinalFlowBlurSigma, finalFlowTmp, half);
+		trace("final flow", finalFlow);
+	}
+
+	void patchMatchPropagationAndSearch(CpuFlowLevel& L, Mat& levelFlow) {
+		// blurred image gradients
+		gradientBlur(L.I0, L.I1, L.I0x, L.I0y, L.I1x, L.I1y, kGradientBlurKernelWidth, kGradientBlurSigma, halfStorage);
+		trace("gradient/I0x", L.I0x);
+		trace("gradient/I0y", L.I0y);
+		trace("gradient/I1x", L.I1x);
+		trace("gradient/I1y", L.I1y);
+
+		// blur flow. we will regularize against this
+		gaussianBlur(levelFlow, L.blurredFlow, kBlurredFlowKernelWidth, kBlurredFlowSigma, L.flowTmp, halfStorage);
+		trace("blurred flow", L.blurredFlow);
+
+		alpha0 = &L.alpha0;
+		alpha1 = &L.alpha1;
+		I0x = &L.I0x;
+		I0y = &L.I0y;
+		I1x = &L.I1x;
+		I1y = &L.I1y;
+		blurred = &L.blurredFlow;
+		flow = &levelFlow;
+
+		// sweep from top/left
+		if (sweepEngine == SWEEP_WAVEFRONT) {
+			sweepWavefront(false);
+		} else {
+			sweepFromLeft();
+			sweepFromTop();
+		}
+		if (useSlashSweeping) {
+			sweepTo(1, 1);
+			sweepTo(-1, 1);
+		}
+		trace("sweeps 1", levelFlow);
+		if (quality.medianPasses >= 2) {
+			medianBlur5(L, levelFlow);
+			trace("median 1", levelFlow);
+		}
+
+		// sweep from bottom/right
+		if (sweepEngine == SWEEP_WAVEFRONT) {
+			sweepWavefront(true);
+		} else {
+			sweepFromRight();
+			sweepFromBottom();
+		}
+		if (useSlashSweeping) {
+			sweepTo(-1, -1);
+			sweepTo(1, -1);
+		}
+		trace("sweeps 2", levelFlow);
+		if (quality.medianPasses >= 1) {
+			medianBlur5(L, levelFlow);
+			trace("median 2", levelFlow);
+		}
+
+		// low alpha flow diffusion, as alpha_flow_diffusion
+		gaussianBlur(levelFlow, L.blurredFlow, kBlurredFlowKernelWidth, kBlurredFlowSigma, L.flowTmp, halfStorage);
+		const bool half = halfStorage;
+		parallel_for_(Range(0, levelFlow.rows), [&](const Range& r) {
+			for (int y = r.start; y < r.end; ++y) {
+				const float* a0 = L.alpha0.ptr<float>(y);
+				const float* a1 = L.alpha1.ptr<float>(y);
+				const Point2f* b = L.blurredFlow.ptr<Point2f>(y);
+				Point2f* f = levelFlow.ptr<Point2f>(y);
+				for (int x = 0; x < levelFlow.cols; ++x) {
+					float diffusionCoef = 1 - a0[x]*a1[x];
+					Point2f v = diffusionCoef*b[x] + (1 - diffusionCoef)*f[x];
+					f[x] = half ? roundHalf(v) : v;
+				}
+			}
+		});
+		trace("diffusion", levelFlow);
+	}
+
+	// ping-pong the level buffers, levelFlow stays a header on L.flow
+	void medianBlur5(CpuFlowLevel& L, Mat& levelFlow) {
+		flowMedianBlur5(levelFlow, L.flowTmp);
+		swap(L.flow, L.flowTmp);
+		levelFlow = L.flow;
+		flow = &levelFlow;
+	}
+
+	// as adjust_flow_toward_previous_v3
+	static void adjustFlowTowardPrevious(const Mat& prevFlow, const Mat& motion, Mat& levelFlow, const OclOptFlowSmooth3Lines& f, bool half) {
+		parallel_for_(Range(0, levelFlow.rows), [&](const Range& r) {
+			for (int y = r.start; y < r.end; ++y) {
+				const Point2f* pre = prevFlow.ptr<Point2f>(y);
+				const float* m = motion.ptr<float>(y);
+				Point2f* cur = levelFlow.ptr<Point2f>(y);
+				for (int x = 0; x < levelFlow.cols; ++x) {
+					float flowMotion = m[x];
+					float adjustFactor = 0.0f;
+					if (flowMotion < f.of_a_x && flowMotion > 0) {
+						adjustFactor = flowMotion * f.of_a_y / f.of_a_x;
+						adjustFactor = adjustFactor * f.of_0a_factor;
+					} else if (flowMotion >= f.of_a_x && flowMotion < f.of_b_x && (f.of_b_x - f.of_a_x) != 0) {
+						adjustFactor = f.of_a_y + (flowMotion - f.of_a_x) * (f.of_b_y - f.of_a_y) / (f.of_b_x - f.of_a_x);
+						adjustFactor = adjustFactor * f.of_ab_factor;
+					} else if (flowMotion >= f.of_b_x) {
+						adjustFactor = f.of_b_y + (flowMotion - f.of_b_x) * (1.0f - f.of_b_y) / (1.0f - f.of_b_x);
+						adjustFactor = adjustFactor * f.of_b1_factor;
+					}
+					if (adjustFactor > 1.0f) {
+						adjustFactor = 1.0f;
+					}
+					Point2f v = adjustFactor*cur[x] + (1.0f - adjustFactor)*pre[x];
+					cur[x] = half ? roundHalf(v) : v;
+				}
+			}
+		});
+	}
+
+	// as get_pix_bilinear32f_extend
+	static inline float bilinear(const Mat& img, float x, float y) {
+		x = std::min(img.cols - 2.0f, std::max(0.0f, x));
+		y = std::min(img.rows - 2.0f, std::max(0.0f, y));
+		int x0 = int(x);
+		int y0 = int(y);
+		float xR = x - x0;
+		float yR = y - y0;
+		const float* r0 = img.ptr<float>(y0);
+		const float* r1 = img.ptr<float>(y0 + 1);
+		float f00 = r0[x0];
+		float f10 = r0[x0 + 1];
+		float f01 = r1[x0];
+		float f11 = r1[x0 + 1];
+		return f00 + (f10 - f00)*xR + (f01 - f00)*yR + (f00 + f11 - f10 - f01)*xR*yR;
+	}
+
+	// as error_function
+	inline float errorFunction(int x, int y, Point2f f) const {
+		float matchX = x + f.x;
+		float matchY = y + f.y;
+		float dx = I0x->at<float>(y, x) - bilinear(*I1x, matchX, matchY);
+		float dy = I0y->at<float>(y, x) - bilinear(*I1y, matchX, matchY);
+		Point2f s = blurred->at<Point2f>(y, x) - f;
+		return std::sqrt(dx*dx + dy*dy)
+			+ std::sqrt(s.x*s.x + s.y*s.y) * kSmoothnessCoef
+			+ kVerticalRegularizationCoef * std::fabs(f.y) / flow->cols;
+	}
+
+	// as the sweep kernels: the proposals of the already updated neighbours a and b (if any), then a gradient step
+	inline void update(int x, int y, const Point2f* a, const Point2f* b) const {
+		if (alpha0->at<float>(y, x) > kUpdateAlphaThreshold && alpha1->at<float>(y, x) > kUpdateAlphaThreshold) {
+			Point2f& f = flow->at<Point2f>(y, x);
+			float currErr = errorFunction(x, y, f);
+			if (a) {
+				float proposalErr = errorFunction(x, y, *a);
+				if (proposalErr < currErr) {
+					f = *a;
+					currErr = proposalErr;
+				}
+			}
+			if (b) {
+				float proposalErr = errorFunction(x, y, *b);
+				if (proposalErr < currErr) {
+					f = *b;
+					currErr = proposalErr;
+				}
+			}
+			float fx = errorFunction(x, y, f + Point2f(kGradEpsilon, 0.0f));
+			float fy = errorFunction(x, y, f + Point2f(0.0f, kGradEpsilon));
+			f -= kGradientStepSize * Point2f((fx - currErr)*1000.0f, (fy - currErr)*1000.0f);
+			if (halfStorage) {
+				f = roundHalf(f);
+			}
+		}
+	}
+
+	// the rows (columns) are independent, as in sweep_from_left/right (top/bottom)
+	void sweepFromLeft() {
+		parallel_for_(Range(0, flow->rows), [&](const Range& r) {
+			for (int y = r.start; y < r.end; ++y) {
+				Point2f* f = flow->ptr<Point2f>(y);
+				for (int x = 0; x < flow->cols; ++x) {
+					update(x, y, x > 0 ? &f[x - 1] : nullptr, nullptr);
+				}
+			}
+		});
+	}
+
+	void sweepFromRight() {
+		parallel_for_(Range(0, flow->rows), [&](const Range& r) {
+			for (int y = r.start; y < r.end; ++y) {
+				Point2f* f = flow->ptr<Point2f>(y);
+				for (int x = flow->cols - 1; x >= 0; --x) {
+					update(x, y, x < flow->cols - 1 ? &f[x + 1] : nullptr, nullptr);
+				}
+			}
+		});
+	}
+
+	void sweepFromTop() {
+		parallel_for_(Range(0, flow->cols), [&](const Range& r) {
+			for (int y = 0; y < flow->rows; ++y) {
+				const Point2f* above = y > 0 ? flow->ptr<Point2f>(y - 1) : nullptr;
+				for (int x = r.start; x < r.end; ++x) {
+					update(x, y, above ? &above[x] : nullptr, nullptr);
+				}
+			}
+		});
+	}
+
+	void sweepFromBottom() {
+		parallel_for_(Range(0, flow->cols), [&](const Range& r) {
+			for (int y = flow->rows - 1; y >= 0; --y) {
+				const Point2f* below = y < flow->rows - 1 ? flow->ptr<Point2f>(y + 1) : nullptr;
+				for (int x = r.start; x < r.end; ++x) {
+					update(x, y, below ? &below[x] : nullptr, nullptr);
+				}
+			}
+		});
+	}
+
+	// as sweep_to, each line in direction (dx, dy) is independent
+	void sweepTo(int dx, int dy) {
+		int rows = flow->rows;
+		int cols = flow->cols;
+		parallel_for_(Range(0, rows + cols - 1), [&](const Range& r) {
+			for (int k = r.start; k < r.end; ++k) {
+				int startX = k < cols ? k : dx == 1 ? 0 : cols - 1;
+				int startY = k < cols ? (dy == 1 ? 0 : rows - 1) : (dy == 1 ? k - cols + 1 : k - cols);
+				for (int x = startX, y = startY; 0 <= x && x < cols && 0 <= y && y < rows; x += dx, y += dy) {
+					bool hasPrev = 0 <= x - dx && x - dx < cols && 0 <= y - dy && y - dy < rows;
+					update(x, y, hasPrev ? &flow->at<Point2f>(y - dy, x - dx) : nullptr, nullptr);
+				}
+			}
+		});
+	}
+
+	// as sweep_wavefront: the tiles of a tile anti-diagonal in parallel, each in raster order,
+	// so every pixel sees its updated left/top (right/bottom) neighbours as in a serial sweep
+	void sweepWavefront(bool reverse) {
+		int rows = flow->rows;
+		int cols = flow->cols;
+		int d = reverse ? -1 : 1;
+		int tilesX = (cols + kSweepTile - 1) / kSweepTile;
+		int tilesY = (rows + kSweepTile - 1) / kSweepTile;
+		for (int diagonal = 0; diagonal < tilesX + tilesY - 1; ++diagonal) {
+			int first = std::max(0, diagonal - tilesY + 1);
+			int last = std::min(diagonal, tilesX - 1);
+			parallel_for_(Range(first, last + 1), [&](const Range& r) {
+				for (int tx = r.start; tx < r.end; ++tx) {
+					int ty = diagonal - tx;
+					int ry1 = std::min((ty + 1)*kSweepTile, rows);
+					int rx1 = std::min((tx + 1)*kSweepTile, cols);
+					for (int ry = ty*kSweepTile; ry < ry1; ++ry) {
+						for (int rx = tx*kSweepTile; rx < rx1; ++rx) {
+							int x = reverse ? cols - 1 - rx : rx;
+							int y = reverse ? rows - 1 - ry : ry;
+							bool hasX = 0 <= x - d && x - d < cols;
+							bool hasY = 0 <= y - d && y - d < rows;
+							update(x, y,
+								hasX ? &flow->at<Point2f>(y, x - d) : nullptr,
+								hasY ? &flow->at<Point2f>(y - d, x) : nullptr);
+						}
+					}
+				}
+			});
+		}
+	}
+};
+
+void cpuComputeOpticalFlow(
+	const Mat& I0BGRA,
+	const Mat& I1BGRA,
+	const Mat& prevFlow,
+	const Mat& prevI0BGRA,
+	const Mat& prevI1BGRA,
+	Mat& flow,
+	const OclInitParameters* params,
+	OclFlowWorkspace* workspace,
+	const OclFlowQuality* quality) {
+	CV_Assert(params != nullptr);
+	CV_Assert(I0BGRA.type() == CV_8UC4 && I1BGRA.type() == CV_8UC4 && I0BGRA.size() == I1BGRA.size());
+	CV_Assert(prevFlow.empty() || (prevFlow.type() == CV_32FC2 && prevFlow.size() == I0BGRA.size()));
+
+	// all pyramid levels and temporaries live in the workspace (in host memory)
+	OclFlowWorkspace localWorkspace;
+	if (workspace == nullptr) {
+		workspace = &localWorkspace;
+	}
+	CpuOpticalFlow().computeOpticalFlow(I0BGRA, I1BGRA, prevFlow, prevI0BGRA, prevI1BGRA, flow, params, workspace, quality);
+}
+
+
+//
+// novel views
+//
+
+// as combine_lazy_colors
+static inline void combineLazyColors(const uchar* colorL, const uchar* colorR, float magL, float magR, uchar* colorMixed) {
+	uchar outAlpha = std::max(colorL[3], colorR[3])/255.0f > 0.1 ? 255 : 0;
+	if (colorL[3] == 0 && colorR[3] == 0) {
+		colorMixed[0] = colorMixed[1] = colorMixed[2] = 0;
+		colorMixed[3] = outAlpha;
+	} else if (colorL[3] == 0) {
+		memcpy(colorMixed, colorR, 3);
+		colorMixed[3] = outAlpha;
+	} else if (colorR[3] == 0) {
+		memcpy(colorMixed, colorL, 3);
+		colorMixed[3] = outAlpha;
+	} else {
+		float blendL = colorL[3];
+		float blendR = colorR[3];
+		float norm = blendL + blendR;
+		blendL /= norm;
+		blendR /= norm;
+		float colorDiff =
+			(std::fabs((float)colorL[0] - (float)colorR[0]) +
+			 std::fabs((float)colorL[1] - (float)colorR[1]) +
+			 std::fabs((float)colorL[2] - (float)colorR[2])) / 255.0f;
+		const float kColorDiffCoef = 10.0f;
+		const float kSoftmaxSharpness = 10.0f;
+		const float kFlowMagCoef = 20.0f;
+		float deghostCoef = std::tanh(colorDiff * kColorDiffCoef);
+		double expL = std::exp(kSoftmaxSharpness * blendL * (1.0 + kFlowMagCoef * magL));
+		double expR = std::exp(kSoftmaxSharpness * blendR * (1.0 + kFlowMagCoef * magR));
+		double sumExp = expL + expR + 0.00001;
+		float softmaxL = float(expL / sumExp);
+		float softmaxR = float(expR / sumExp);
+		float wL = blendL*(1 - deghostCoef) + softmaxL*deghostCoef;
+		float wR = blendR*(1 - deghostCoef) + softmaxR*deghostCoef;
+		for (int c = 0; c < 3; ++c) {
+			colorMixed[c] = satTrunc(colorL[c]*wL + colorR[c]*wR);
+		}
+		colorMixed[3] = 255;
+	}
+}
+
+// as render_lazy_pixel
+static inline void renderLazyPixel(
+	const Mat& imageL, const Mat& imageR,
+	const Mat& flowLtoR, const Mat& flowRtoL,
+	Point2f xy, float z, int cols, uchar* dst) {
+	uchar colorL[4], colorR[4];
+	float tL = z;
+	Point2f flowL = cubicSampleFlow(flowRtoL, xy.x, xy.y);
+	pixelStore(colorL, cubicSample(imageL, 4, xy.x + flowL.x*tL, xy.y + flowL.y*tL));
+	colorL[3] = uchar((1.0f - tL) * colorL[3]);
+
+	float tR = 1.0f - z;
+	Point2f flowR = cubicSampleFlow(flowLtoR, xy.x, xy.y);
+	pixelStore(colorR, cubicSample(imageR, 4, xy.x + flowR.x*tR, xy.y + flowR.y*tR));
+	colorR[3] = uchar((1.0f - tR) * colorR[3]);
+
+	float magL = std::sqrt(flowL.x*flowL.x + flowL.y*flowL.y) / cols;
+	float magR = std::sqrt(flowR.x*flowR.x + flowR.y*flowR.y) / cols;
+	combineLazyColors(colorL, colorR, magL, magR, dst);
+}
+
+void cpuRenderLazyNovelView(
+	const Mat& warpBuffer, const OclLazyWarp& warp,
+	const Mat& imageL, const Mat& imageR,
+	const Mat& flowLtoR, const Mat& flowRtoL,
+	Mat& pano, int panoCol, bool removeChunkLine) {
+	bool procedural = warpBuffer.empty();
+	Size size = procedural ? warp.size : warpBuffer.size();
+	CV_Assert(procedural || warpBuffer.type() == CV_32FC3);
+	CV_Assert(imageL.type() == CV_8UC4 && imageR.type() == CV_8UC4);
+	CV_Assert(flowLtoR.type() == CV_32FC2 && flowRtoL.type() == CV_32FC2);
+	CV_Assert(pano.type() == CV_8UC4 && pano.rows == size.height && pano.cols >= size.width);
+	CV_Assert(0 <= panoCol && panoCol < pano.cols);
+	int cols = size.width;
+	float camWidth = float(warp.camImageWidth);
+	parallel_for_(Range(0, size.height), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			const float* w = procedural ? nullptr : warpBuffer.ptr<float>(y);
+			uchar* d = pano.ptr<uchar>(y);
+			for (int x = 0; x < cols; ++x) {
+				int sx = (removeChunkLine && x == cols - 1 && x > 0) ? x - 1 : x;
+				Point2f xy;
+				float z;
+				if (procedural) {
+					float slabShift = camWidth * 0.5f - (float)(cols - sx);
+					xy = Point2f(slabShift + warp.slabDisplacement, (float)y);
+					z = (float)sx / (float)cols;
+				} else {
+					xy = Point2f(w[3*sx], w[3*sx + 1]);
+					z = w[3*sx + 2];
+				}
+				int dx = x + panoCol;
+				dx = dx < pano.cols ? dx : dx - pano.cols;
+				renderLazyPixel(imageL, imageR, flowLtoR, flowRtoL, xy, z, cols, d + 4*dx);
+			}
+		}
+	});
+}
+
+
+//
+// post-processing
+//
+
+// the weight of the motion in row y, as smooth_image (delta is float, compared in double as the kernel does)
+static inline float smoothDelta(int y, int rows, bool isPano) {
+	const float topBottomThresh = 0.3f;
+	float delta;
+	if (y > rows*(1.0f - topBottomThresh) && isPano) {
+		delta = (rows - y) / (rows * topBottomThresh);
+	} else if (y < rows*topBottomThresh && isPano) {
+		delta = y / (rows * topBottomThresh);
+	} else {
+		delta = 1.01;
+	}
+	if (delta < 1.01) {
+		if (delta < 0.8) {
+			delta = 0.8;
+		}
+		return delta;
+	}
+	return 1.0f;
+}
+
+// as smooth_image, cur is updated in place
+static inline void smoothPixel(uchar* cur, const uchar* pre, float delta, float threshold) {
+	float motion = (std::fabs((float)cur[0] - (float)pre[0])
+		+ std::fabs((float)cur[1] - (float)pre[1])
+		+ std::fabs((float)cur[2] - (float)pre[2])) / (255.0f*3.0f);
+	if (delta != 1.0f) {
+		motion *= delta;
+	}
+	if (motion < threshold/2) {
+		memcpy(cur, pre, 3);
+	} else if (motion < threshold) {
+		float factor = motion / threshold / 2;
+		for (int c = 0; c < 3; ++c) {
+			cur[c] = satTrunc(factor*cur[c] + (1 - factor)*pre[c]);
+		}
+	}
+}
+
+void cpuSmoothImage(Mat& pano, const Mat& previous, float threshold, bool isPano) {
+	CV_Assert(pano.type() == CV_8UC4 && previous.type() == CV_8UC4 && previous.size() == pano.size());
+	parallel_for_(Range(0, pano.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			float delta = smoothDelta(y, pano.rows, isPano);
+			uchar* cur = pano.ptr<uchar>(y);
+			const uchar* pre = previous.ptr<uchar>(y);
+			for (int x = 0; x < pano.cols; ++x) {
+				smoothPixel(cur + 4*x, pre + 4*x, delta, threshold);
+			}
+		}
+	});
+}
+
+void cpuGaussianBlur(const Mat& src, Mat& dst, int ksize, double sigma, Mat& tmp, bool half) {
+	gaussianBlur(src, dst, ksize, sigma, tmp, half);
+}
+
+void cpuMotionTiles(const Mat& cur0, const Mat& pre0, const Mat& cur1, const Mat& pre1, int tileSize, Mat& tiles) {
+	CV_Assert(cur0.type() == CV_8UC4 && tiles.type() == CV_32FC1);
+	parallel_for_(Range(0, tiles.rows), [&](const Range& r) {
+		for (int ty = r.start; ty < r.end; ++ty) {
+			int y0 = ty*tileSize;
+			int y1 = std::min(y0 + tileSize, cur0.rows);
+			for (int tx = 0; tx < tiles.cols; ++tx) {
+				int x0 = tx*tileSize;
+				int x1 = std::min(x0 + tileSize, cur0.cols);
+				float sum = 0;
+				for (int y = y0; y < y1; ++y) {
+					const uchar* c0 = cur0.ptr<uchar>(y);
+					const uchar* p0 = pre0.ptr<uchar>(y);
+					const uchar* c1 = cur1.ptr<uchar>(y);
+					const uchar* p1 = pre1.ptr<uchar>(y);
+					for (int x = 4*x0; x < 4*x1; x += 4) {
+						int d0 = std::abs(c0[x] - p0[x]) + std::abs(c0[x + 1] - p0[x + 1]) + std::abs(c0[x + 2] - p0[x + 2]);
+						int d1 = std::abs(c1[x] - p1[x]) + std::abs(c1[x + 1] - p1[x + 1]) + std::abs(c1[x + 2] - p1[x + 2]);
+						sum += std::max(d0, d1);
+					}
+				}
+				tiles.at<float>(ty, tx) = sum/(3.0f*255.0f*(y1 - y0)*(x1 - x0));
+			}
+		}
+	});
+}
+
+void cpuPostProcess(const Mat& pano, const Mat& previous, Mat& dst, const OclPostProcessParameters& params) {
+	CV_Assert(pano.type() == CV_8UC4 && dst.type() == CV_8UC4 && dst.size() == pano.size() && dst.data != pano.data);
+	int rows = pano.rows;
+	int cols = pano.cols;
+	bool smooth = params.smoothThreshold > 0.0f && !previous.empty();
+	CV_Assert(!smooth || (previous.type() == CV_8UC4 && previous.size() == pano.size()));
+	float factor = params.sharpFactor;
+	float threshold = params.smoothThreshold;
+	int offset = params.wrapOffset % cols;
+	offset += offset < 0 ? cols : 0;
+
+	// the source column of the columns -1 .. cols, border and chunk lines resolved
+	vector<int> srcCols(cols + 2);
+	for (int x = -1; x <= cols; ++x) {
+		int sx = reflect101(x, cols - 1);
+		if (params.chunkWidth > 1 && sx % params.chunkWidth == params.chunkWidth - 1) {
+			sx -= 1;
+		}
+		srcCols[x + 1] = sx;
+	}
+	const int* srcCol = &srcCols[1];
+
+	Mat k = getGaussianKernel(3, 3.0, CV_32F);
+	const float kx[3] = { k.at<float>(0), k.at<float>(1), k.at<float>(2) };
+
+	parallel_for_(Range(0, rows), [&](const Range& r) {
+		// the row pass of the 3x3 gaussian (as filter_row_8UC4) of the rows r.start - 1 .. r.end
+		vector<uchar> rowPass;
+		if (factor != 0.0f) {
+			rowPass.resize(size_t(r.end - r.start + 2)*cols*4);
+			for (int y = r.start - 1; y <= r.end; ++y) {
+				const uchar* s = pano.ptr<uchar>(reflect101(y, rows - 1));
+				uchar* d = &rowPass[size_t(y - r.start + 1)*cols*4];
+				for (int x = 0; x < cols; ++x) {
+					Pixel4f sum = pixelScale(pixelLoad(s + 4*srcCol[x - 1]), kx[0]);
+					sum = pixelMad(pixelLoad(s + 4*srcCol[x]), kx[1], sum);
+					sum = pixelMad(pixelLoad(s + 4*srcCol[x + 1]), kx[2], sum);
+					pixelStore(d + 4*x, sum);
+				}
+			}
+		}
+		for (int y = r.start; y < r.end; ++y) {
+			const uchar* s = pano.ptr<uchar>(y);
+			const uchar* pre = smooth ? previous.ptr<uchar>(y) : nullptr;
+			uchar* d = dst.ptr<uchar>(y);
+			float delta = smoothDelta(y, rows, params.isPano);
+			for (int x = 0; x < cols; ++x) {
+				uchar cur[4];
+				memcpy(cur, s + 4*srcCol[x], 4);
+				if (factor != 0.0f) {
+					// col pass as filter_col_8UC4, then addWeighted(cur, 1 + factor, blured, -factor, 0)
+					const uchar* p = &rowPass[size_t(y - r.start)*cols*4 + 4*x];
+					Pixel4f sum = pixelScale(pixelLoad(p), kx[0]);
+					sum = pixelMad(pixelLoad(p + cols*4), kx[1], sum);
+					sum = pixelMad(pixelLoad(p + 2*cols*4), kx[2], sum);
+					uchar blured[4];
+					pixelStore(blured, sum);
+					pixelStoreRte(cur, pixelMad(pixelLoad(blured), -factor, pixelScale(pixelLoad(cur), 1.0f + factor)));
+				}
+				int dx = x + offset;
+				dx = dx < cols ? dx : dx - cols;
+				if (smooth) {
+					smoothPixel(cur, pre + 4*dx, delta, threshold);
+				}
+				memcpy(d + 4*dx, cur, 4);
+			}
+		}
+	});
+}
+
+void cpuRemoveChunkLine(Mat& chunk) {
+	CV_Assert(chunk.type() == CV_8UC4 && chunk.cols >= 2);
+	for (int y = 0; y < chunk.rows; ++y) {
+		uchar* p = chunk.ptr<uchar>(y);
+		memcpy(p + 4*(chunk.cols - 1), p + 4*(chunk.cols - 2), 4);
+	}
+}
+
+
+//
+// color adjustment
+//
+
+void cpuLutAdjust(const Mat& lut, Mat& image) {
+	CV_Assert(lut.type() == CV_16UC1 && lut.total() == 65536 && image.type() == CV_16UC4);
+	const ushort* table = lut.ptr<ushort>();
+	parallel_for_(Range(0, image.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			ushort* p = image.ptr<ushort>(y);
+			for (int x = 0; x < image.cols; ++x, p += 4) {
+				p[0] = table[p[0]];
+				p[1] = table[p[1]];
+				p[2] = table[p[2]];
+			}
+		}
+	});
+}
+
+void cpuAddBrightnessAndClampMulti(Mat& image, float value) {
+	CV_Assert(image.type() == CV_16UC4);
+	parallel_for_(Range(0, image.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			ushort* p = image.ptr<ushort>(y);
+			for (int x = 0; x < image.cols; ++x, p += 4) {
+				for (int c = 0; c < 3; ++c) {
+					// clamp((ushort)(color*val), 0, 65525), saturated before the cast
+					float v = std::min(std::max(p[c]*value, 0.0f), 65535.0f);
+					p[c] = std::min(ushort(v), ushort(65525));
+				}
+			}
+		}
+	});
+}
+
+void cpuColorOverlapStats(const Mat& lut, const Mat& image, int leftX, int rightX,
+	int sampleWidth, int gridHeight, int bins, Vec4f* stats) {
+	CV_Assert(lut.type() == CV_32FC1 && lut.total() == 256 && image.type() == CV_8UC4);
+	const float* table = lut.ptr<float>();
+	parallel_for_(Range(0, bins*2), [&](const Range& r) {
+		for (int j = r.start; j < r.end; ++j) {
+			int band = j >> 1;
+			int x0 = (j & 1) ? rightX : leftX;
+			int y0 = band*gridHeight;
+			int y1 = band < bins - 1 ? y0 + gridHeight : image.rows;
+			Vec4f sum(0, 0, 0, float((y1 - y0)*sampleWidth));
+			for (int y = y0; y < y1; ++y) {
+				const uchar* p = image.ptr<uchar>(y) + x0*4;
+				for (int x = 0; x < sampleWidth; ++x, p += 4) {
+					sum[0] += table[p[0]];
+					sum[1] += table[p[1]];
+					sum[2] += table[p[2]];
+				}
+			}
+			stats[j] = sum;
+		}
+	});
+}
+
+void cpuColorHarmonize(const Mat& lut, Mat& image, float gain) {
+	CV_Assert(lut.type() == CV_32FC1 && lut.total() == 256 && image.type() == CV_8UC4);
+	uchar table[256];
+	for (int i = 0; i < 256; ++i) {
+		table[i] = saturate_cast<uchar>(std::pow(std::min(lut.ptr<float>()[i]*gain, 1.0f), 2.2f)*256.0f);
+	}
+	parallel_for_(Range(0, image.rows), [&](const Range& r) {
+		for (int y = r.start; y < r.end; ++y) {
+			uchar* p = image.ptr<uchar>(y);
+			for (int x = 0; x < image.cols; ++x, p += 4) {
+				p[0] = table[p[0]];
+				p[1] = table[p[1]];
+				p[2] = table[p[2]];
+			}
+		}
+	});
+}
+
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
@@ -0,0 +1,110 @@
+#ifndef _OPENCV_IMVT_CPUBACKEND_HPP_
+#define _OPENCV_IMVT_CPUBACKEND_HPP_
+
+#include "precomp.hpp"
+#include "opencv2/oclrenderpano.hpp"
+#include "opencv2/oclrenderpano/ocl_optflow.hpp"
+#include "opencv2/oclrenderpano/ocl_novelview.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief Whether the exported functions run on the CPU backend (see OclBackend), set by oclInitialize().
+*
+* The exported functions of the render path check it first and call the cpu* function of the
+* same name on Mat headers of their UMats (host memory, OpenCL is off on the render threads).
+* The cpu* functions give the results of the kernels they replace. Their buffers are fp32, the flow
+* rounds its values through fp16 where the kernels store into the fp16 storage (see OclInitParameters::halfStorage).
+*/
+bool cpuBackend();
+void setCpuBackend(bool cpu);
+
+/**
+* @brief As cubic_remap_8UC4_32FC1/cubic_remap_8UC3_32FC1 followed by the BGR2BGRA of oclProjection(), dst is CV_8UC4.
+*/
+void cpuProjection(const Mat& src, const Mat& mapx, const Mat& mapy, Mat& dst);
+
+/**
+* @brief As fixed_cubic_remap with the map and weights of an OclProjectionMap, dst is CV_8UC4.
+*/
+void cpuProjection(const Mat& src, const Mat& map, const Mat& weights, int fracBits, Mat& dst);
+
+/**
+* @brief oclComputeOpticalFlow() on the CPU, flow is CV_32FC2 (its values fp16 ones with params->halfStorage).
+*
+* With a workspace its (host) buffers are used, see OclFlowWorkspace. No quality is the full quality.
+*/
+void cpuComputeOpticalFlow(
+	const Mat& I0BGRA,
+	const Mat& I1BGRA,
+	const Mat& prevFlow,
+	const Mat& prevI0BGRA,
+	const Mat& prevI1BGRA,
+	Mat& flow,
+	const OclInitParameters* params,
+	OclFlowWorkspace* workspace = nullptr,
+	const OclFlowQuality* quality = nullptr);
+
+/**
+* @brief As render_lazy_novel_view (warpBuffer) or render_procedural_novel_view (warp), see oclRenderLazyNovelView().
+*/
+void cpuRenderLazyNovelView(
+	const Mat& warpBuffer, const OclLazyWarp& warp,
+	const Mat& imageL, const Mat& imageR,
+	const Mat& flowLtoR, const Mat& flowRtoL,
+	Mat& pano, int panoCol, bool removeChunkLine);
+
+/**
+* @brief As motion_tiles, tiles must be allocated (CV_32FC1, one element per tile).
+*/
+void cpuMotionTiles(const Mat& cur0, const Mat& pre0, const Mat& cur1, const Mat& pre1, int tileSize, Mat& tiles);
+
+/**
+* @brief As oclGaussianBlurV2() on CV_32FC1/CV_32FC2, rounded through fp16 with half. dst may be src.
+*/
+void cpuGaussianBlur(const Mat& src, Mat& dst, int ksize, double sigma, Mat& tmp, bool half);
+
+/**
+* @brief As post_process, see oclPostProcess(). dst must be allocated and must not be pano.
+*/
+void cpuPostProcess(const Mat& pano, const Mat& previous, Mat& dst, const OclPostProcessParameters& params);
+
+/**
+* @brief As smooth_image, in place.
+*/
+void cpuSmoothImage(Mat& pano, const Mat& previous, float threshold, bool isPano);
+
+/**
+* @brief As remove_chunk_line, in place.
+*/
+void cpuRemoveChunkLine(Mat& chunk);
+
+/**
+* @brief As anti_gamma_lut_adjust/gamma_lut_adjust, in place.
+*/
+void cpuLutAdjust(const Mat& lut, Mat& image);
+
+/**
+* @brief As add_brightness_and_clamp_multi, in place.
+*/
+void cpuAddBrightnessAndClampMulti(Mat& image, float value);
+
+/**
+* @brief As color_overlap_stats for one image, stats are its bins*2 (band, side) sums.
+*/
+void cpuColorOverlapStats(const Mat& lut, const Mat& image, int leftX, int rightX,
+	int sampleWidth, int gridHeight, int bins, Vec4f* stats);
+
+/**
+* @brief As color_harmonize_8u for one image, in place.
+*/
+void cpuColorHarmonize(const Mat& lut, Mat& image, float gain);
+
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// _OPENCV_IMVT_CPUBACKEND_HPP_
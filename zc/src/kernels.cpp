@@ -0,0 +1,727 @@
+#include <stdio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "precomp.hpp"
+#include "kernels.hpp"
+#include "profiler.hpp"
+#include "opencl_kernels_oclrenderpano.hpp"
+#include "opencv2/oclrenderpano/ocl_kernels.hpp"
+#ifdef HAVE_OPENCL_SVM
+#include "opencv2/core/opencl/opencl_svm.hpp"
+#endif
+
+#if 0
+#define LOGD printf
+#else
+#define LOGD(...)
+#endif
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+using namespace std;
+
+static std::atomic<int64> kernelLaunches(0);
+static std::atomic<int64> kernelCreations(0);
+
+
+OclKernel::OclKernel(const char* name, const ProgramSource& source, const String& options)
+	: name(name), source(&source), options(options), direct(true) {
+	++kernelCreations;
+	ProgramCache& cache = ProgramCache::instance();
+	cl_kernel k = cache.enabled() ? cache.createKernel(name, source, options) : 0;
+	if (k) {
+		cached.reset(k, [](cl_kernel p) { clReleaseKernel(p); });
+	} else {
+		kernel.create(name, source, options);
+	}
+	if (empty()) {
+		LOGD("failed to build kernel %s\n", name);
+	}
+}
+
+bool OclKernel::empty() const {
+	return !cached && kernel.empty();
+}
+
+// @added
+cl_kernel OclKernel::handle() const {
+	return cached ? cached.get() : (cl_kernel)kernel.ptr();
+}
+
+// the argument i, replaced when it is bound again
+OclKernel::BoundArg& OclKernel::argument(int i) {
+	for (BoundArg& b : bound) {
+		if (b.index == i) {
+			return b;
+		}
+	}
+	bound.push_back(BoundArg());
+	bound.back().index = i;
+	return bound.back();
+}
+
+int OclKernel::set(int i, const void* value, size_t size) {
+	if (empty() || i < 0) {
+		return -1;
+	}
+	reset(i);
+	BoundArg& b = argument(i);
+	b.arg = KernelArg::Constant(value, size);
+	b.umat.release();
+	b.value.assign((const uchar*)value, (const uchar*)value + size);
+	setDirect(i, size, value);
+	return i + 1;
+}
+
+// an argument of the direct launch, on an error the launch is left to runFallback()
+void OclKernel::setDirect(int i, size_t size, const void* value) {
+	if (!direct) {
+		return;
+	}
+	cl_int retval = clSetKernelArg(handle(), (cl_uint)i, size, value);
+	if (retval != CL_SUCCESS) {
+		LOGD("failed to set argument %d of kernel %s: %d\n", i, name.c_str(), retval);
+		direct = false;
+	}
+}
+
+// same argument layout as ocl::Kernel::set(int, const KernelArg&)
+int OclKernel::set(int i, const KernelArg& arg) {
+	if (empty() || i < 0) {
+		return -1;
+	}
+	if (!arg.m) {
+		if (arg.flags & KernelArg::LOCAL) {
+			reset(i);
+			BoundArg& b = argument(i);
+			b.arg = arg;
+			b.umat.release();
+			b.value.clear();
+			setDirect(i, arg.sz, 0);
+			return i + 1;
+		}
+		return set(i, arg.obj, arg.sz);
+	}
+
+	CV_Assert(arg.m->dims <= 2);
+	reset(i);
+	BoundArg& b = argument(i);
+	b.arg = arg;
+	b.umat = *arg.m;
+	b.value.clear();
+	// as ocl::Kernel (haveTempSrcUMats/haveTempDstUMats), the Mat of a temporary UMat is read after the launch
+	if (arg.m->u && arg.m->u->tempUMat()) {
+		temp = true;
+	}
+
+	int accessFlags = ((arg.flags & KernelArg::READ_ONLY) ? ACCESS_READ : 0) +
+		((arg.flags & KernelArg::WRITE_ONLY) ? ACCESS_WRITE : 0);
+	cl_mem h = (cl_mem)arg.m->handle(accessFlags);
+	if (!h) {
+		return -1;
+	}
+#ifdef HAVE_OPENCL_SVM
+	if (arg.m->u->allocatorFlags_ & svm::OPENCL_SVM_BUFFER_MASK) {
+		// SVM buffers are bound by ocl::Kernel (see runFallback)
+		direct = false;
+	}
+#endif
+	setDirect(i, sizeof(h), &h);
+	if (arg.flags & KernelArg::PTR_ONLY) {
+		return i + 1;
+	}
+	int step = (int)arg.m->step[0];
+	int offset = (int)arg.m->offset;
+	setDirect(i + 1, sizeof(step), &step);
+	setDirect(i + 2, sizeof(offset), &offset);
+	i += 3;
+	if (!(arg.flags & KernelArg::NO_SIZE)) {
+		int rows = arg.m->rows;
+		int cols = arg.m->cols*arg.wscale / arg.iwscale;
+		setDirect(i, sizeof(rows), &rows);
+		setDirect(i + 1, sizeof(cols), &cols);
+		i += 2;
+	}
+	return i;
+}
+
+// binding argument 0 starts a new launch
+void OclKernel::reset(int i) {
+	if (i == 0) {
+		bound.clear();
+		direct = true;
+		temp = false;
+	}
+}
+
+void OclKernel::retained(vector<UMat>& umats) const {
+	umats.clear();
+	for (const BoundArg& b : bound) {
+		if (!b.umat.empty()) {
+			umats.push_back(b.umat);
+		}
+	}
+}
+
+// the last launch completed, the arguments left bound are the values only
+void OclKernel::releaseBuffers() {
+	for (size_t j = 0; j < bound.size(); ) {
+		if (bound[j].arg.m) {
+			bound.erase(bound.begin() + j);
+		} else {
+			++j;
+		}
+	}
+}
+
+bool OclKernel::run(int dims, size_t _globalsize[], size_t _localsize[], bool sync) {
+	if (empty()) {
+		return false;
+	}
+	++kernelLaunches;
+	// before collect(), so a completed earlier launch doesn't release the buffers of this one
+	++launches;
+	sync = sync || temp;
+	if (!direct) {
+		return runFallback(dims, _globalsize, _localsize, sync);
+	}
+
+	// round up the global size as ocl::Kernel::run does
+	size_t offset[CV_MAX_DIM] = { 0 };
+	size_t globalsize[CV_MAX_DIM] = { 1, 1, 1 };
+	for (int i = 0; i < dims; i++) {
+		size_t val = _localsize ? _localsize[i] :
+			dims == 1 ? 64 : dims == 2 ? (i == 0 ? 256 : 8) : dims == 3 ? (8 >> (int)(i > 0)) : 1;
+		CV_Assert(val > 0);
+		globalsize[i] = ((_globalsize[i] + val - 1) / val)*val;
+	}
+
+	KernelRegistry& registry = KernelRegistry::instance();
+	registry.collect();
+	if (Profiler::enabled()) {
+		Profiler::prepareQueue();
+	}
+
+	cl_event event = 0;
+	cl_command_queue q = (cl_command_queue)ocl::Queue::getDefault().ptr();
+	cl_int retval = clEnqueueNDRangeKernel(q, handle(), (cl_uint)dims,
+		offset, globalsize, _localsize, 0, 0, &event);
+	if (retval != CL_SUCCESS) {
+		LOGD("failed to run kernel %s: %d\n", name.c_str(), retval);
+		return false;
+	}
+	if (Profiler::enabled()) {
+		Profiler::kernel(name.c_str(), event);
+	}
+	if (sync) {
+		clFinish(q);
+		clReleaseEvent(event);
+		releaseBuffers();
+		return true;
+	}
+	registry.retain(event, this);
+	return true;
+}
+
+bool OclKernel::runFallback(int dims, size_t globalsize[], size_t localsize[], bool sync) {
+	ocl::Kernel k(name.c_str(), *source, options);
+	++kernelCreations;
+	for (size_t j = 0; j < bound.size(); ++j) {
+		KernelArg arg = bound[j].arg;
+		if (arg.m) {
+			arg.m = &bound[j].umat;
+		} else if (!bound[j].value.empty()) {
+			arg.obj = bound[j].value.data();
+		}
+		k.set(bound[j].index, arg);
+	}
+	if (!k.run(dims, globalsize, localsize, sync)) {
+		return false;
+	}
+	// ocl::Kernel references the buffers itself, the marker tells when the kernel can drop them
+	cl_event event = 0;
+	cl_command_queue q = (cl_command_queue)ocl::Queue::getDefault().ptr();
+	if (sync || clEnqueueMarkerWithWaitList(q, 0, 0, &event) != CL_SUCCESS) {
+		releaseBuffers();
+		return true;
+	}
+	KernelRegistry::instance().retain(event, this);
+	return true;
+}
+
+
+bool KernelRegistry::Key::operator<(const Key& k) const {
+	if (source != k.source) {
+		return source < k.source;
+	}
+	if (name != k.name) {
+		return name < k.name;
+	}
+	return options < k.options;
+}
+
+KernelRegistry& KernelRegistry::instance() {
+	static thread_local KernelRegistry registry;
+	return registry;
+}
+
+KernelRegistry::~KernelRegistry() {
+	release();
+}
+
+OclKernel& KernelRegistry::get(const char* name, const ProgramSource& source, const String& options) {
+	Key key = { &source, name, options.c_str() };
+	auto it = kernels.find(key);
+	if (it == kernels.end()) {
+		it = kernels.insert(make_pair(key, OclKernel(name, source, options))).first;
+	}
+	return it->second;
+}
+
+const String& KernelRegistry::gaussianOptions(int kernelSize, double sigma, bool half) {
+	auto key = make_tuple(kernelSize, sigma, half);
+	auto it = blurOptions.find(key);
+	if (it == blurOptions.end()) {
+		Mat k = getGaussianKernel(kernelSize, sigma, CV_32F);
+		String options = ocl::kernelToStr(k, CV_32F, "KERNEL_X_DATA") + ocl::kernelToStr(k, CV_32F, "KERNEL_Y_DATA");
+		if (half) {
+			options += " -D STORAGE_HALF";
+		}
+		it = blurOptions.insert(make_pair(key, options)).first;
+	}
+	return it->second;
+}
+
+const String& KernelRegistry::gradientBlurOptions(int kernelSize, double sigma, bool half) {
+	auto key = make_tuple(kernelSize, sigma, half);
+	auto it = gradientOptions.find(key);
+	if (it == gradientOptions.end()) {
+		String options = gaussianOptions(kernelSize, sigma, half) + format(" -D BLUR_RADIUS=%d", kernelSize / 2);
+		it = gradientOptions.insert(make_pair(key, options)).first;
+	}
+	return it->second;
+}
+
+void KernelRegistry::retain(cl_event event, OclKernel* kernel) {
+	vector<UMat> umats;
+	kernel->retained(umats);
+	// the diagonal sweeps launch the same buffers many times in a row, only the last event matters
+	if (!inflight.empty() && inflight.back().kernel == kernel && inflight.back().umats.size() == umats.size()) {
+		Launch& last = inflight.back();
+		bool same = true;
+		for (size_t i = 0; i < umats.size() && same; ++i) {
+			same = last.umats[i].u == umats[i].u;
+		}
+		if (same) {
+			clReleaseEvent(last.event);
+			last.event = event;
+			last.launch = kernel->launches;
+			return;
+		}
+	}
+	Launch launch = { event, umats, kernel, kernel->launches };
+	inflight.push_back(launch);
+}
+
+void KernelRegistry::collect(bool wait) {
+	while (!inflight.empty()) {
+		Launch& launch = inflight.front();
+		if (wait) {
+			clWaitForEvents(1, &launch.event);
+		} else {
+			cl_int status = CL_COMPLETE;
+			clGetEventInfo(launch.event, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, 0);
+			// queue is in order, so no later launch is done
+			if (status > CL_COMPLETE) {
+				break;
+			}
+		}
+		clReleaseEvent(launch.event);
+		if (launch.kernel->launches == launch.launch) {
+			launch.kernel->releaseBuffers();
+		}
+		inflight.pop_front();
+	}
+}
+
+void KernelRegistry::release() {
+	collect(true);
+	kernels.clear();
+	blurOptions.clear();
+	gradientOptions.clear();
+}
+
+void KernelRegistry::preload(bool half) {
+	static const char* optflowKernels[] = {
+		"motion_detection", "motion_detection_v2",
+		"adjust_flow_toward_previous", "adjust_flow_toward_previous_v2", "adjust_flow_toward_previous_v3",
+		"estimate_flow", "alpha_flow_diffusion",
+		"sweep_from_left", "sweep_from_right", "sweep_from_top", "sweep_from_bottom",
+		"sweep_from_top_left", "sweep_from_bottom_right", "sweep_to", "sweep_wavefront",
+		"median_blur5_32FC2"
+	};
+	static const char* sobelKernels[] = {
+		"sobel_x_1_border_replicate", "sobel_y_1_border_replicate"
+	};
+	static const char* scaleKernels[] = {
+		"scale_32FC1", "scale_32FC2", "scale_32FC4",
+		"scale_self_32FC1", "scale_self_32FC2", "scale_self_32FC4", "scale_by_32FC1",
+		"convert_8UC1"
+	};
+	static const char* reduceKernels[] = {
+		"intensity_sums_32FC1", "intensity_ratio"
+	};
+	static const char* resizeKernels[] = {
+		"resize_32FC1", "resize_32FC2", "resize_8UC4", "resize_linear_32FC1", "resize_linear_32FC2"
+	};
+	static const char* remapKernels[] = {
+		"remap_8UC4_32FC2", "remap_32FC2_32FC2", "cubic_remap_8UC4_32FC1", "cubic_remap_8UC3_32FC1",
+		"batch_cubic_remap", "fixed_cubic_remap"
+	};
+	static const char* novelviewKernels[] = {
+		"get_flow_warp_map", "combine_novel_views", "combine_lazy_views",
+		"get_warp_optical_flow", "get_warp_composition", "get_novel_view_flow_mag",
+		"render_lazy_novel_view", "render_procedural_novel_view"
+	};
+	static const char* zcamutilsKernels[] = {
+		"smooth_image", "offset_horizontal_wrap", "remove_chunk_line"
+	};
+	static const char* coloradjustKernels[] = {
+		"anti_gamma_lut_adjust", "gamma_lut_adjust", "add_brightness_and_clamp_multi"
+	};
+	static const char* filterKernels[] = {
+		"filter_row_32FC1", "filter_col_32FC1", "filter_row_32FC2", "filter_col_32FC2",
+		"filter_row_8UC4", "filter_col_8UC4"
+	};
+	// Gaussian blurs used by optical flow (pre-blur, gradient, flow, final flow) and oclSharpImage
+	static const struct { int size; double sigma; } blurs[] = {
+		{ 5, 0.25 }, { 3, 0.5 }, { 15, 8.0 }, { 3, 1.0 }, { 3, 3.0 }
+	};
+
+	struct Group { const char** names; size_t count; const ProgramSource& source; };
+	const Group groups[] = {
+		{ optflowKernels, sizeof(optflowKernels) / sizeof(optflowKernels[0]), ocl::oclrenderpano::optflow_oclsrc },
+		{ sobelKernels, sizeof(sobelKernels) / sizeof(sobelKernels[0]), ocl::oclrenderpano::sobel_oclsrc },
+		{ scaleKernels, sizeof(scaleKernels) / sizeof(scaleKernels[0]), ocl::oclrenderpano::scale_oclsrc },
+		{ reduceKernels, sizeof(reduceKernels) / sizeof(reduceKernels[0]), ocl::oclrenderpano::reduce_oclsrc },
+		{ resizeKernels, sizeof(resizeKernels) / sizeof(resizeKernels[0]), ocl::oclrenderpano::resize_oclsrc },
+		{ remapKernels, sizeof(remapKernels) / sizeof(remapKernels[0]), ocl::oclrenderpano::remap_oclsrc },
+		{ novelviewKernels, sizeof(novelviewKernels) / sizeof(novelviewKernels[0]), ocl::oclrenderpano::novelview_oclsrc },
+		{ zcamutilsKernels, sizeof(zcamutilsKernels) / sizeof(zcamutilsKernels[0]), ocl::oclrenderpano::zcamutils_oclsrc },
+		{ coloradjustKernels, sizeof(coloradjustKernels) / sizeof(coloradjustKernels[0]), ocl::oclrenderpano::coloradjust_oclsrc },
+	};
+	for (const Group& g : groups) {
+		for (size_t i = 0; i < g.count; ++i) {
+			get(g.names[i], g.source);
+		}
+	}
+	for (auto& b : blurs) {
+		const String& options = gaussianOptions(b.size, b.sigma);
+		for (size_t i = 0; i < sizeof(filterKernels) / sizeof(filterKernels[0]); ++i) {
+			get(filterKernels[i], ocl::oclrenderpano::sepfilter2d_oclsrc, options);
+		}
+	}
+	// gradient blur of optical flow
+	get("gradient_blur_32FC1", ocl::oclrenderpano::gradblur_oclsrc, gradientBlurOptions(3, 0.5));
+	// the 3x3 sharpening of oclPostProcess()
+	get("post_process", ocl::oclrenderpano::zcamutils_oclsrc, gaussianOptions(3, 3.0));
+
+	if (!half) {
+		return;
+	}
+	// the kernels accessing the flow/pyramid buffers, built again for the fp16 storage
+	static const char* halfScaleKernels[] = {
+		"scale_32FC1", "scale_32FC2", "scale_self_32FC1", "scale_self_32FC2", "scale_by_32FC1", "convert_8UC1"
+	};
+	static const char* halfReduceKernels[] = {
+		"intensity_sums_32FC1"
+	};
+	static const char* halfResizeKernels[] = {
+		"resize_32FC1", "resize_32FC2", "resize_linear_32FC1", "resize_linear_32FC2"
+	};
+	static const char* halfRemapKernels[] = {
+		"remap_32FC2_32FC2"
+	};
+	static const char* halfNovelviewKernels[] = {
+		"get_flow_warp_map", "combine_novel_views", "combine_lazy_views",
+		"get_warp_composition", "get_novel_view_flow_mag", "render_lazy_novel_view",
+		"render_procedural_novel_view"
+	};
+	const String halfOptions = "-D STORAGE_HALF";
+	const Group halfGroups[] = {
+		{ optflowKernels, sizeof(optflowKernels) / sizeof(optflowKernels[0]), ocl::oclrenderpano::optflow_oclsrc },
+		{ halfScaleKernels, sizeof(halfScaleKernels) / sizeof(halfScaleKernels[0]), ocl::oclrenderpano::scale_oclsrc },
+		{ halfReduceKernels, sizeof(halfReduceKernels) / sizeof(halfReduceKernels[0]), ocl::oclrenderpano::reduce_oclsrc },
+		{ halfResizeKernels, sizeof(halfResizeKernels) / sizeof(halfResizeKernels[0]), ocl::oclrenderpano::resize_oclsrc },
+		{ halfRemapKernels, sizeof(halfRemapKernels) / sizeof(halfRemapKernels[0]), ocl::oclrenderpano::remap_oclsrc },
+		{ halfNovelviewKernels, sizeof(halfNovelviewKernels) / sizeof(halfNovelviewKernels[0]), ocl::oclrenderpano::novelview_oclsrc },
+	};
+	for (const Group& g : halfGroups) {
+		for (size_t i = 0; i < g.count; ++i) {
+			get(g.names[i], g.source, halfOptions);
+		}
+	}
+	for (auto& b : blurs) {
+		const String& options = gaussianOptions(b.size, b.sigma, true);
+		for (size_t i = 0; i < 4; ++i) {	// the 32FC1/32FC2 filters
+			get(filterKernels[i], ocl::oclrenderpano::sepfilter2d_oclsrc, options);
+		}
+	}
+	get("gradient_blur_32FC1", ocl::oclrenderpano::gradblur_oclsrc, gradientBlurOptions(3, 0.5, true));
+}
+
+
+// @added: the program binary cache
+static const int kProgramBinaryMagic = 0x4250435a;	// "ZCPB"
+static const int kProgramBinaryVersion = 1;
+
+// the header of a cached program, followed by its key and its binary
+struct ProgramBinaryHeader {
+	int magic;
+	int version;
+	uint64 keySize;
+	uint64 binarySize;
+};
+
+// FNV-1a
+static uint64 hashBytes(const void* data, size_t size) {
+	uint64 h = 14695981039346656037ULL;
+	const uchar* p = (const uchar*)data;
+	for (size_t i = 0; i < size; ++i) {
+		h = (h ^ p[i]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+static string deviceString(cl_device_id device, cl_device_info param) {
+	size_t size = 0;
+	if (clGetDeviceInfo(device, param, 0, 0, &size) != CL_SUCCESS || size == 0) {
+		return string();
+	}
+	vector<char> value(size + 1, '\0');
+	clGetDeviceInfo(device, param, size, value.data(), 0);
+	return string(value.data());
+}
+
+// the binary of a program built for a single device
+static bool programBinary(cl_program program, vector<uchar>& binary) {
+	size_t size = 0;
+	if (clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, 0) != CL_SUCCESS || size == 0) {
+		return false;
+	}
+	binary.resize(size);
+	uchar* data = binary.data();
+	return clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(data), &data, 0) == CL_SUCCESS;
+}
+
+// exists is false if there is no file, a file with another key or version is not loaded
+static bool loadProgramBinary(const string& path, const string& key, vector<uchar>& binary, bool& exists) {
+	FILE* fp = fopen(path.c_str(), "rb");
+	exists = fp != nullptr;
+	if (!fp) {
+		return false;
+	}
+	ProgramBinaryHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 && header.magic == kProgramBinaryMagic
+		&& header.version == kProgramBinaryVersion && header.keySize == key.size()
+		&& header.binarySize > 0 && header.binarySize < (uint64(1) << 30);
+	if (ok) {
+		string stored(key.size(), '\0');
+		ok = fread(&stored[0], 1, stored.size(), fp) == stored.size() && stored == key;
+	}
+	if (ok) {
+		binary.resize(size_t(header.binarySize));
+		ok = fread(binary.data(), 1, binary.size(), fp) == binary.size();
+	}
+	fclose(fp);
+	return ok;
+}
+
+// written aside and renamed, so no process ever loads a partial file
+static bool saveProgramBinary(const string& path, const string& key, const vector<uchar>& binary) {
+	string temp = path + format(".%llx.tmp", (unsigned long long)getTickCount());
+	FILE* fp = fopen(temp.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	ProgramBinaryHeader header = { kProgramBinaryMagic, kProgramBinaryVersion, key.size(), binary.size() };
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+		&& fwrite(key.data(), 1, key.size(), fp) == key.size()
+		&& fwrite(binary.data(), 1, binary.size(), fp) == binary.size();
+	ok = fclose(fp) == 0 && ok;
+	if (ok && rename(temp.c_str(), path.c_str()) != 0) {
+		// rename doesn't replace a file on Windows
+		remove(path.c_str());
+		ok = rename(temp.c_str(), path.c_str()) == 0;
+	}
+	if (!ok) {
+		remove(temp.c_str());
+	}
+	return ok;
+}
+
+
+bool ProgramCache::Key::operator<(const Key& k) const {
+	if (context != k.context) {
+		return context < k.context;
+	}
+	if (device != k.device) {
+		return device < k.device;
+	}
+	if (source != k.source) {
+		return source < k.source;
+	}
+	return options < k.options;
+}
+
+ProgramCache& ProgramCache::instance() {
+	static ProgramCache cache;
+	return cache;
+}
+
+void ProgramCache::setDirectory(const string& dir) {
+	lock_guard<std::mutex> lock(mutex);
+	directory = dir;
+}
+
+bool ProgramCache::enabled() {
+	lock_guard<std::mutex> lock(mutex);
+	return !directory.empty();
+}
+
+cl_kernel ProgramCache::createKernel(const char* name, const ProgramSource& source, const String& options) {
+	cl_command_queue q = (cl_command_queue)ocl::Queue::getDefault().ptr();
+	Key key = { (cl_context)ocl::Context::getDefault().ptr(), 0, &source, options.c_str() };
+	if (!q || !key.context || clGetCommandQueueInfo(q, CL_QUEUE_DEVICE, sizeof(key.device), &key.device, 0) != CL_SUCCESS) {
+		return 0;
+	}
+	lock_guard<std::mutex> lock(mutex);
+	auto it = programs.find(key);
+	if (it == programs.end()) {
+		// a program failing to build is kept as 0, and not built again
+		it = programs.insert(make_pair(key, build(key))).first;
+	}
+	if (!it->second) {
+		return 0;
+	}
+	cl_int status = CL_SUCCESS;
+	cl_kernel k = clCreateKernel(it->second, name, &status);
+	return status == CL_SUCCESS ? k : 0;
+}
+
+// called with the mutex locked
+cl_program ProgramCache::build(const Key& key) {
+	const String& text = key.source->source();
+	auto h = sourceHashes.find(key.source);
+	if (h == sourceHashes.end()) {
+		h = sourceHashes.insert(make_pair(key.source, hashBytes(text.c_str(), text.size()))).first;
+	}
+	string id = format("%s\n%s\n%s\n%s\n%016llx", deviceString(key.device, CL_DEVICE_NAME).c_str(),
+		deviceString(key.device, CL_DEVICE_VERSION).c_str(), deviceString(key.device, CL_DRIVER_VERSION).c_str(),
+		key.options.c_str(), (unsigned long long)h->second);
+	string path = directory + format("/program_%016llx.bin", (unsigned long long)hashBytes(id.data(), id.size()));
+	report.programs++;
+
+	// the binary, if it is the one of this key and the driver takes it
+	int64 start = getTickCount();
+	cl_program program = 0;
+	vector<uchar> binary;
+	bool exists = false;
+	if (loadProgramBinary(path, id, binary, exists)) {
+		const uchar* data = binary.data();
+		size_t size = binary.size();
+		cl_int status = CL_SUCCESS;
+		cl_int err = CL_SUCCESS;
+		program = clCreateProgramWithBinary(key.context, 1, &key.device, &size, &data, &status, &err);
+		if (program && (err != CL_SUCCESS || status != CL_SUCCESS
+			|| clBuildProgram(program, 1, &key.device, key.options.c_str(), 0, 0) != CL_SUCCESS)) {
+			clReleaseProgram(program);
+			program = 0;
+		}
+	}
+	if (program) {
+		report.loaded++;
+		report.loadMs += (getTickCount() - start)*1000.0/getTickFrequency();
+		return program;
+	}
+	if (exists) {
+		LOGD("rejected program binary %s\n", path.c_str());
+		report.rejected++;
+	}
+
+	// otherwise from source, and saved for the next time
+	start = getTickCount();
+	const char* src = text.c_str();
+	size_t length = text.size();
+	cl_int err = CL_SUCCESS;
+	program = clCreateProgramWithSource(key.context, 1, &src, &length, &err);
+	if (program && (err != CL_SUCCESS || clBuildProgram(program, 1, &key.device, key.options.c_str(), 0, 0) != CL_SUCCESS)) {
+		clReleaseProgram(program);
+		program = 0;
+	}
+	if (!program) {
+		LOGD("failed to build program %s\n", path.c_str());
+		return 0;
+	}
+	report.built++;
+	report.buildMs += (getTickCount() - start)*1000.0/getTickFrequency();
+	if (programBinary(program, binary) && saveProgramBinary(path, id, binary)) {
+		report.saved++;
+	} else {
+		LOGD("failed to save program binary %s\n", path.c_str());
+	}
+	return program;
+}
+
+void ProgramCache::getReport(OclStartupReport& r) {
+	lock_guard<std::mutex> lock(mutex);
+	r.programs = report.programs;
+	r.loaded = report.loaded;
+	r.built = report.built;
+	r.rejected = report.rejected;
+	r.saved = report.saved;
+	r.loadMs = report.loadMs;
+	r.buildMs = report.buildMs;
+}
+
+void ProgramCache::resetReport() {
+	lock_guard<std::mutex> lock(mutex);
+	report = OclStartupReport();
+}
+
+// the kernels keep their programs alive
+void ProgramCache::release() {
+	lock_guard<std::mutex> lock(mutex);
+	for (auto& p : programs) {
+		if (p.second) {
+			clReleaseProgram(p.second);
+		}
+	}
+	programs.clear();
+	sourceHashes.clear();
+}
+
+
+CV_EXPORTS_W OclKernelStats oclGetKernelStats() {
+	OclKernelStats stats;
+	stats.launches = kernelLaunches.load();
+	stats.creations = kernelCreations.load();
+	return stats;
+}
+
+CV_EXPORTS_W void oclResetKernelStats() {
+	kernelLaunches = 0;
+	kernelCreations = 0;
+}
+
+CV_EXPORTS_W void oclPreloadKernels(bool halfStorage) {
+	KernelRegistry::instance().preload(halfStorage);
+}
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
@@ -0,0 +1,200 @@
+#ifndef _OPENCV_IMVT_KERNELS_HPP_
+#define _OPENCV_IMVT_KERNELS_HPP_
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <tuple>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "precomp.hpp"
+#include "opencv2/oclrenderpano.hpp"
+#include "opencv2/core/opencl/runtime/opencl_core.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief A compiled kernel cached by the KernelRegistry of the calling thread.
+*
+* The interface follows ocl::Kernel (set/args/run), but arguments are bound directly
+* to the cached cl_kernel and launches are enqueued on the default queue of the thread,
+* so a launch never looks up the program cache or creates a kernel object.
+*/
+class OclKernel {
+public:
+	OclKernel(const char* name, const ProgramSource& source, const String& options);
+
+	int set(int i, const void* value, size_t size);
+	int set(int i, const KernelArg& arg);
+	template<typename T> int set(int i, const T& value) {
+		return set(i, &value, sizeof(value));
+	}
+
+	template<typename... Args> OclKernel& args(const Args&... kernelArgs) {
+		bind(0, kernelArgs...);
+		return *this;
+	}
+
+	bool run(int dims, size_t globalsize[], size_t localsize[], bool sync);
+	bool empty() const;
+
+private:
+	friend class KernelRegistry;
+	void bind(int) {}
+	template<typename T, typename... Args> void bind(int i, const T& arg, const Args&... rest) {
+		bind(set(i, arg), rest...);
+	}
+	void reset(int i);
+	bool runFallback(int dims, size_t globalsize[], size_t localsize[], bool sync);
+	cl_kernel handle() const;
+	void setDirect(int i, size_t size, const void* value);
+
+	// the bound arguments, replayed on a new ocl::Kernel when a buffer can't be bound directly
+	struct BoundArg {
+		int index;
+		KernelArg arg;
+		UMat umat;
+		std::vector<uchar> value;
+	};
+	BoundArg& argument(int i);
+	void retained(std::vector<UMat>& umats) const;
+	void releaseBuffers();
+
+	String name;
+	const ProgramSource* source;
+	String options;
+	ocl::Kernel kernel;
+	std::shared_ptr<_cl_kernel> cached;	// @added: the kernel of a ProgramCache program, kernel is empty then
+	std::vector<BoundArg> bound;	// one per argument index
+	uint64 launches = 0;			// the launch the buffers of bound are referenced for
+	bool direct;
+	bool temp = false;				// a bound UMat is temporary (Mat::getUMat()), the launch is synchronous
+};
+
+
+/**
+* @brief Per-thread cache of compiled kernels.
+*
+* Every render thread owns its default queue, so the registry is thread local as well.
+* The buffers used by a launch are referenced until its event completes, the same
+* lifetime guarantee ocl::Kernel gives to UMat arguments. A kernel drops its own references
+* once its last launch completes, so it pins no buffer between frames.
+*/
+class KernelRegistry {
+public:
+	static KernelRegistry& instance();
+	~KernelRegistry();
+
+	OclKernel& get(const char* name, const ProgramSource& source, const String& options = String());
+	const String& gaussianOptions(int kernelSize, double sigma, bool half = false);
+	const String& gradientBlurOptions(int kernelSize, double sigma, bool half = false);
+
+	void preload(bool half = false);
+	void collect(bool wait = false);
+	void release();
+
+private:
+	friend class OclKernel;
+	void retain(cl_event event, OclKernel* kernel);
+
+	struct Key {
+		const ProgramSource* source;
+		std::string name;
+		std::string options;
+		bool operator<(const Key& k) const;
+	};
+	struct Launch {
+		cl_event event;
+		std::vector<UMat> umats;
+		OclKernel* kernel;
+		uint64 launch;
+	};
+
+	std::map<Key, OclKernel> kernels;
+	std::map<std::tuple<int, double, bool>, String> blurOptions;
+	std::map<std::tuple<int, double, bool>, String> gradientOptions;
+	std::deque<Launch> inflight;
+};
+
+
+/**
+* @brief Process-wide cache of the programs built for a device, backed by a directory of program binaries.
+*
+* Enabled by OclInitParameters::programCacheDir. A program is built once per source, build options
+* and device (the device of the default queue of the calling thread), loaded with
+* clCreateProgramWithBinary if its binary matches, otherwise compiled from source and saved.
+*/
+class ProgramCache {
+public:
+	static ProgramCache& instance();
+
+	void setDirectory(const std::string& directory);
+	bool enabled();
+
+	// a new kernel of the program, 0 if it can't be built
+	cl_kernel createKernel(const char* name, const ProgramSource& source, const String& options);
+	void getReport(OclStartupReport& report);
+	void resetReport();
+	void release();
+
+private:
+	struct Key {
+		cl_context context;
+		cl_device_id device;
+		const ProgramSource* source;
+		std::string options;
+		bool operator<(const Key& k) const;
+	};
+	cl_program build(const Key& key);
+
+	std::mutex mutex;
+	std::string directory;
+	std::map<Key, cl_program> programs;
+	std::map<const ProgramSource*, uint64> sourceHashes;
+	OclStartupReport report;
+};
+
+
+/**
+* @brief Type of a flow/pyramid buffer, see OclInitParameters::halfStorage.
+*
+* OpenCV 3 has no half type, the fp16 buffers are CV_16SC1/CV_16SC2 UMats holding the raw bits.
+*/
+inline int storageType(int channels, bool half) {
+	return half ? CV_16SC(channels) : CV_32FC(channels);
+}
+
+inline bool isHalfStorage(const UMat& m) {
+	return m.depth() == CV_16S;
+}
+
+/**
+* @brief Build options selecting the storage of the kernels that access m (-D STORAGE_HALF, see optflow.cl).
+*/
+inline const String& storageOptions(const UMat& m) {
+	static const String half("-D STORAGE_HALF");
+	static const String single;
+	return isHalfStorage(m) ? half : single;
+}
+
+
+/**
+* @brief Shortcut of KernelRegistry::instance().get()
+*/
+inline OclKernel& oclKernel(const char* name, const ProgramSource& source, const String& options = String()) {
+	return KernelRegistry::instance().get(name, source, options);
+}
+
+inline OclKernel& oclKernel(const std::string& name, const ProgramSource& source, const String& options = String()) {
+	return KernelRegistry::instance().get(name.c_str(), source, options);
+}
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// _OPENCV_IMVT_KERNELS_HPP_
@@ -0,0 +1,57 @@
+#ifndef _OPENCV_IMVT_MEMPLAN_HPP_
+#define _OPENCV_IMVT_MEMPLAN_HPP_
+
+#include <string>
+#include <vector>
+
+#include "precomp.hpp"
+#include "opencv2/oclrenderpano/ocl_optflow.hpp"
+#include "opencv2/oclrenderpano/ocl_buffer.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief The buffers of a workspace with the steps they are live in, see OclPlannedBuffer.
+*
+* assign() puts each buffer (the largest first) into the first slot of its type that holds no
+* buffer live in its steps, or into a new slot. allocate() creates a UMat per slot, as large
+* as its largest buffer, and each buffer as a view on its top-left corner: the kernels take
+* the step of the slot, and a buffer of a slot is only written when the others are dead.
+*/
+class MemoryLayout {
+public:
+	void add(UMat* target, const std::string& name, Size size, int type, int first, int last);
+	void assign();
+	void allocate();
+
+	size_t bytes() const;
+	size_t unaliasedBytes() const;
+	std::vector<size_t> slotBytes() const;
+	const std::vector<OclPlannedBuffer>& buffers() const { return planned; }
+
+private:
+	struct Slot {
+		int type;
+		Size size;
+	};
+	std::vector<OclPlannedBuffer> planned;
+	std::vector<UMat*> targets;
+	std::vector<Slot> slots;
+};
+
+/**
+* @brief Size the levels of ws as OclFlowWorkspace::create() and add all its buffers to layout.
+*
+* The lifetimes follow oclComputeOpticalFlow: the downscaled images and the blur temporary only
+* live in the prepare step, the gradients and the blurred flow of a level in its own step, its
+* flow ping-pong buffers from the upscale of the coarser level to the upscale into the finer one.
+*/
+void describeFlowWorkspace(OclFlowWorkspace& ws, Size imageSize, bool half, const OclFlowQuality& quality, MemoryLayout& layout);
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// _OPENCV_IMVT_MEMPLAN_HPP_
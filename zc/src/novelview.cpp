@@ -11,6 +11,8 @@
 #include <vector>
 #include "precomp.hpp"
 #include "opencl_kernels_oclrenderpano.hpp"
+#include "kernels.hpp"
+#include "cpubackend.hpp"
 #include "opencv2/oclrenderpano/ocl_novelview.hpp"
 
 namespace cv {
@@ -20,15 +22,16 @@ namespace imvt {
 using namespace std;
 
 CV_EXPORTS_W void oclRemap(const UMat& src, UMat& dst, const UMat& map) {
-	CV_Assert(src.type() == CV_8UC4 || src.type() == CV_32FC2);
+	CV_Assert(src.type() == CV_8UC4 || src.type() == CV_32FC2 || src.type() == CV_16SC2);
 	CV_Assert(map.type() == CV_32FC2);
 	UMat s = src;
 	// dst.create(s.size(), s.type());
 	dst.create(map.size(), s.type());
+	// a CV_16SC2 src is a flow in the fp16 storage
 	string srcType = s.type() == CV_8UC4 ? "_8UC4" : "_32FC2";
 	string mapType = "_32FC2";
 	string kernelName = string("remap") + srcType + mapType;
-	ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::remap_oclsrc);
+	OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::remap_oclsrc, storageOptions(s));
 	k.args(ocl::KernelArg::ReadOnly(src),
 		ocl::KernelArg::WriteOnly(dst),
 		ocl::KernelArg::ReadOnlyNoSize(map));
@@ -39,7 +42,7 @@ CV_EXPORTS_W void oclRemap(const UMat& src, UMat& dst, const UMat& map) {
 
 CV_EXPORTS_W void oclGetFlowWarpMap(const UMat& flow, UMat& warpMap, float t) {
 	CV_Assert(flow.size() == warpMap.size());
-	ocl::Kernel k("get_flow_warp_map", ocl::oclrenderpano::novelview_oclsrc);
+	OclKernel& k = oclKernel("get_flow_warp_map", ocl::oclrenderpano::novelview_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(flow),
 		ocl::KernelArg::WriteOnly(warpMap),
 		ocl::KernelArg::Constant(&t, sizeof(t)));
@@ -52,7 +55,8 @@ CV_EXPORTS_W void oclCombineNovelViews(
 	const UMat& imageL, float blendL,
 	const UMat& imageR, float blendR,
 	const UMat& flowLtoR, const UMat& flowRtoL, UMat& blendImage) {
-	ocl::Kernel k("combine_novel_views", ocl::oclrenderpano::novelview_oclsrc);
+	CV_Assert(flowLtoR.type() == flowRtoL.type());
+	OclKernel& k = oclKernel("combine_novel_views", ocl::oclrenderpano::novelview_oclsrc, storageOptions(flowLtoR));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(imageL),
 		ocl::KernelArg::ReadOnlyNoSize(imageR),
 		ocl::KernelArg::ReadOnlyNoSize(flowLtoR),
@@ -68,7 +72,8 @@ CV_EXPORTS_W void oclCombineNovelViews(
 CV_EXPORTS_W void oclCombineLazyViews(
 	const UMat& imageL, const UMat& imageR,
 	const UMat& flowMagL, const UMat& flowMagR, UMat& blendImage) {
-	ocl::Kernel k("combine_lazy_views", ocl::oclrenderpano::novelview_oclsrc);
+	CV_Assert(flowMagL.type() == flowMagR.type());
+	OclKernel& k = oclKernel("combine_lazy_views", ocl::oclrenderpano::novelview_oclsrc, storageOptions(flowMagL));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(imageL),
 		ocl::KernelArg::ReadOnlyNoSize(imageR),
 		ocl::KernelArg::ReadOnlyNoSize(flowMagL),
@@ -80,7 +85,7 @@ CV_EXPORTS_W void oclCombineLazyViews(
 }
 
 CV_EXPORTS_W void oclGetWarpOpticalFlow(const UMat& warpBuffer, UMat& warpFlow) {
-	ocl::Kernel k("get_warp_optical_flow", ocl::oclrenderpano::novelview_oclsrc);
+	OclKernel& k = oclKernel("get_warp_optical_flow", ocl::oclrenderpano::novelview_oclsrc);
 	k.args(ocl::KernelArg::ReadOnlyNoSize(warpBuffer),
 		ocl::KernelArg::WriteOnly(warpFlow));
 	size_t globalsize[] = { warpFlow.cols, warpFlow.rows };
@@ -89,7 +94,7 @@ CV_EXPORTS_W void oclGetWarpOpticalFlow(const UMat& warpBuffer, UMat& warpFlow)
 }
 
 CV_EXPORTS_W void oclGetWarpComposition(const UMat& warpBuffer, const UMat& warpFlow, UMat& warpComposition, int invertT) {
-	ocl::Kernel k("get_warp_composition", ocl::oclrenderpano::novelview_oclsrc);
+	OclKernel& k = oclKernel("get_warp_composition", ocl::oclrenderpano::novelview_oclsrc, storageOptions(warpFlow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(warpBuffer),
 		ocl::KernelArg::ReadOnlyNoSize(warpFlow),
 		ocl::KernelArg::WriteOnly(warpComposition),
@@ -100,7 +105,8 @@ CV_EXPORTS_W void oclGetWarpComposition(const UMat& warpBuffer, const UMat& warp
 }
 
 CV_EXPORTS_W void oclGetNovelViewFlowMag(const UMat& warpBuffer, const UMat& warpFlow, UMat& novelView, UMat& flowMag, int invertT) {
-	ocl::Kernel k("get_novel_view_flow_mag", ocl::oclrenderpano::novelview_oclsrc);
+	CV_Assert(warpFlow.depth() == flowMag.depth());
+	OclKernel& k = oclKernel("get_novel_view_flow_mag", ocl::oclrenderpano::novelview_oclsrc, storageOptions(warpFlow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(warpBuffer),
 		ocl::KernelArg::ReadOnlyNoSize(warpFlow),
 		ocl::KernelArg::ReadWriteNoSize(novelView),
@@ -112,6 +118,84 @@ CV_EXPORTS_W void oclGetNovelViewFlowMag(const UMat& warpBuffer, const UMat& war
 }
 
 
+// @added: renderLazyNovelView() from both images and oclCombineLazyViews() in one launch, without the intermediates
+CV_EXPORTS_W void oclRenderLazyNovelView(
+	const UMat& warpBuffer,
+	const UMat& imageL, const UMat& imageR,
+	const UMat& flowLtoR, const UMat& flowRtoL,
+	UMat& pano, int panoCol, bool removeChunkLine) {
+	CV_Assert(warpBuffer.type() == CV_32FC3);
+	CV_Assert(imageL.type() == CV_8UC4 && imageR.type() == CV_8UC4);
+	CV_Assert(flowLtoR.type() == flowRtoL.type());
+	CV_Assert(pano.type() == CV_8UC4 && pano.rows == warpBuffer.rows && pano.cols >= warpBuffer.cols);
+	CV_Assert(0 <= panoCol && panoCol < pano.cols);
+	// @added
+	if (cpuBackend()) {
+		Mat out = pano.getMat(ACCESS_RW);
+		cpuRenderLazyNovelView(warpBuffer.getMat(ACCESS_READ), OclLazyWarp(), imageL.getMat(ACCESS_READ), imageR.getMat(ACCESS_READ),
+			flowLtoR.getMat(ACCESS_READ), flowRtoL.getMat(ACCESS_READ), out, panoCol, removeChunkLine);
+		return;
+	}
+	int removeLine = removeChunkLine ? 1 : 0;
+	OclKernel& k = oclKernel("render_lazy_novel_view", ocl::oclrenderpano::novelview_oclsrc, storageOptions(flowLtoR));
+	k.args(ocl::KernelArg::ReadOnly(warpBuffer),
+		ocl::KernelArg::ReadOnly(imageL),
+		ocl::KernelArg::ReadOnly(imageR),
+		ocl::KernelArg::ReadOnly(flowLtoR),
+		ocl::KernelArg::ReadOnly(flowRtoL),
+		ocl::KernelArg::WriteOnly(pano),
+		ocl::KernelArg::Constant(&panoCol, sizeof(panoCol)),
+		ocl::KernelArg::Constant(&removeLine, sizeof(removeLine)));
+	size_t globalsize[] = { warpBuffer.cols, warpBuffer.rows };
+	size_t localsize[] = { 16, 16 };
+	k.run(2, globalsize, localsize, false);
+}
+
+CV_EXPORTS_W void oclRenderLazyNovelView(
+	const UMat& warpBuffer,
+	const UMat& imageL, const UMat& imageR,
+	const UMat& flowLtoR, const UMat& flowRtoL, UMat& blendImage) {
+	blendImage.create(warpBuffer.size(), CV_8UC4);
+	oclRenderLazyNovelView(warpBuffer, imageL, imageR, flowLtoR, flowRtoL, blendImage, 0, false);
+}
+
+// @added
+CV_EXPORTS_W void oclRenderLazyNovelView(
+	const OclLazyWarp& warp,
+	const UMat& imageL, const UMat& imageR,
+	const UMat& flowLtoR, const UMat& flowRtoL,
+	UMat& pano, int panoCol, bool removeChunkLine) {
+	CV_Assert(imageL.type() == CV_8UC4 && imageR.type() == CV_8UC4);
+	CV_Assert(flowLtoR.type() == flowRtoL.type());
+	CV_Assert(pano.type() == CV_8UC4 && pano.rows == warp.size.height && pano.cols >= warp.size.width);
+	CV_Assert(0 <= panoCol && panoCol < pano.cols);
+	// @added
+	if (cpuBackend()) {
+		Mat out = pano.getMat(ACCESS_RW);
+		cpuRenderLazyNovelView(Mat(), warp, imageL.getMat(ACCESS_READ), imageR.getMat(ACCESS_READ),
+			flowLtoR.getMat(ACCESS_READ), flowRtoL.getMat(ACCESS_READ), out, panoCol, removeChunkLine);
+		return;
+	}
+	int removeLine = removeChunkLine ? 1 : 0;
+	float camWidth = float(warp.camImageWidth);
+	OclKernel& k = oclKernel("render_procedural_novel_view", ocl::oclrenderpano::novelview_oclsrc, storageOptions(flowLtoR));
+	k.args(ocl::KernelArg::ReadOnly(imageL),
+		ocl::KernelArg::ReadOnly(imageR),
+		ocl::KernelArg::ReadOnly(flowLtoR),
+		ocl::KernelArg::ReadOnly(flowRtoL),
+		ocl::KernelArg::WriteOnly(pano),
+		ocl::KernelArg::Constant(&warp.size.height, sizeof(int)),
+		ocl::KernelArg::Constant(&warp.size.width, sizeof(int)),
+		ocl::KernelArg::Constant(&camWidth, sizeof(camWidth)),
+		ocl::KernelArg::Constant(&warp.slabDisplacement, sizeof(warp.slabDisplacement)),
+		ocl::KernelArg::Constant(&panoCol, sizeof(panoCol)),
+		ocl::KernelArg::Constant(&removeLine, sizeof(removeLine)));
+	size_t globalsize[] = { size_t(warp.size.width), size_t(warp.size.height) };
+	size_t localsize[] = { 16, 16 };
+	k.run(2, globalsize, localsize, false);
+}
+
+
 // when rendering panoramas from slices of many novel views, there is lots of
 // wasted computation. this is an idea for reducing that computation: build up
 // a datastructure of just the pieces of the novel views we need, then do it
@@ -253,7 +337,7 @@ struct OCLNovelViewGeneratorLazyFlow {
 			}
 		}
 		*/
-		UMat novelViewFlowMag(novelView.size(), CV_32F);
+		UMat novelViewFlowMag(novelView.size(), storageType(1, isHalfStorage(opticalFlow)));
 		oclGetNovelViewFlowMag(novelViewWarpBuffer, remappedFlow, novelView, novelViewFlowMag, invertT ? 1 : 0);
 		return make_pair(novelView, novelViewFlowMag);
 	}
@@ -278,14 +362,14 @@ struct OCLNovelViewGeneratorLazyFlow {
 		oclGetWarpComposition(novelViewWarpBuffer, remappedFlow, warpComposition, invertT ? 1 : 0);
 		oclRemap(srcImage, novelView, warpComposition);
 
-		novelViewFlowMag.create(novelView.size(), CV_32F);
+		novelViewFlowMag.create(novelView.size(), storageType(1, isHalfStorage(opticalFlow)));
 		oclGetNovelViewFlowMag(novelViewWarpBuffer, remappedFlow, novelView, novelViewFlowMag, invertT ? 1 : 0);
 	}
 
 
 	pair<UMat, UMat> combineLazyNovelViews(
 		const OCLLazyNovelViewBuffer& lazyBuffer) {
-
+		/* @optimized
 		// two images for the left eye (to be combined)
 		pair<UMat, UMat> leftEyeFromLeft = renderLazyNovelView(
 			lazyBuffer.warpL,
@@ -326,12 +410,17 @@ struct OCLNovelViewGeneratorLazyFlow {
 			rightEyeFromRight.second,
 			rightEyeCombined);
 		return make_pair(leftEyeCombined, rightEyeCombined);
+		*/
+		UMat leftEyeCombined, rightEyeCombined;
+		oclRenderLazyNovelView(lazyBuffer.warpL, imageL, imageR, flowLtoR, flowRtoL, leftEyeCombined);
+		oclRenderLazyNovelView(lazyBuffer.warpR, imageL, imageR, flowLtoR, flowRtoL, rightEyeCombined);
+		return make_pair(leftEyeCombined, rightEyeCombined);
 	}
 
 
 	void combineLazyNovelViews(
 		const OCLLazyNovelViewBuffer& lazyBuffer, UMat& leftEyeCombined, UMat& rightEyeCombined) {
-
+		/* @optimized
 		UMat tmp1;
 		UMat tmp2;
 
@@ -398,9 +487,13 @@ struct OCLNovelViewGeneratorLazyFlow {
 			rightEyeFromLeft.second,
 			rightEyeFromRight.second,
 			rightEyeCombined);
+		*/
+		oclRenderLazyNovelView(lazyBuffer.warpL, imageL, imageR, flowLtoR, flowRtoL, leftEyeCombined);
+		oclRenderLazyNovelView(lazyBuffer.warpR, imageL, imageR, flowLtoR, flowRtoL, rightEyeCombined);
 	}
 
 	UMat combineLazyNovelViews(const UMat& warp) {
+		/* @optimized
 		pair<UMat, UMat> leftEyeFromLeft = renderLazyNovelView(
 			warp,
 			imageL,
@@ -422,10 +515,14 @@ struct OCLNovelViewGeneratorLazyFlow {
 			leftEyeCombined);
 
 		return leftEyeCombined;
+		*/
+		UMat leftEyeCombined;
+		oclRenderLazyNovelView(warp, imageL, imageR, flowLtoR, flowRtoL, leftEyeCombined);
+		return leftEyeCombined;
 	}
 
 	void combineLazyNovelViews(const UMat& warp, UMat& combined) {
-
+		/* @optimized
 		UMat tmp1;
 		UMat tmp2;
 
@@ -458,6 +555,8 @@ struct OCLNovelViewGeneratorLazyFlow {
 			leftEyeFromLeft.second,
 			leftEyeFromRight.second,
 			combined);
+		*/
+		oclRenderLazyNovelView(warp, imageL, imageR, flowLtoR, flowRtoL, combined);
 	}
 };
 
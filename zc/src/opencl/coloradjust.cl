@@ -113,4 +113,122 @@ __kernel void add_brightness_and_clamp_multi_v2(
 			color.s3);
 	}
 }
-*/
\ No newline at end of file
+*/
+
+/**
+ * @brief 8-bit color harmonisation, see oclPreColorAdjustByGamma()
+ *
+ * The camera images are separate buffers, a launch takes up to COLOR_MAX_CAMS of them
+ * and get_global_id(2) selects one (the unused arguments repeat the first image).
+ * lut is the 256-entry anti-gamma table pow(v/256, 1/2.2), copied to local memory.
+ */
+#define COLOR_MAX_CAMS		16
+#define COLOR_REDUCE_SIZE	256
+
+#define IMAGE_ARG(n)		__global uchar* img##n, int img##n##_step, int img##n##_offset
+#define IMAGE_ARGS 	IMAGE_ARG(0), IMAGE_ARG(1), IMAGE_ARG(2), IMAGE_ARG(3), \
+	IMAGE_ARG(4), IMAGE_ARG(5), IMAGE_ARG(6), IMAGE_ARG(7), \
+	IMAGE_ARG(8), IMAGE_ARG(9), IMAGE_ARG(10), IMAGE_ARG(11), \
+	IMAGE_ARG(12), IMAGE_ARG(13), IMAGE_ARG(14), IMAGE_ARG(15)
+
+#define SELECT_IMAGE(n)		case n: base = img##n + img##n##_offset; step = img##n##_step; break;
+#define SELECT_IMAGES(i) 	switch (i) { \
+	SELECT_IMAGE(0) SELECT_IMAGE(1) SELECT_IMAGE(2) SELECT_IMAGE(3) \
+	SELECT_IMAGE(4) SELECT_IMAGE(5) SELECT_IMAGE(6) SELECT_IMAGE(7) \
+	SELECT_IMAGE(8) SELECT_IMAGE(9) SELECT_IMAGE(10) SELECT_IMAGE(11) \
+	SELECT_IMAGE(12) SELECT_IMAGE(13) SELECT_IMAGE(14) SELECT_IMAGE(15) }
+
+#define rmat8uc4(base, step, x, y) 		vload4((x), (base) + mul24((y), (step)))
+#define wmat8uc4(base, step, x, y, v) 	vstore4((v), (x), (base) + mul24((y), (step)))
+
+
+/**
+ * @brief linear BGR sums of the overlap samples of each grid row of each camera
+ *
+ * NDRange (COLOR_REDUCE_SIZE, bins*2, cams), a work-group per (row band, side, camera).
+ * Band b covers rows [b*grid_height, (b + 1)*grid_height), the last band the remaining rows.
+ * Side 0 is the left sample [left_x, left_x + sample_width), side 1 the right one.
+ * stats[((cam_base + camera)*bins + b)*2 + side] = (sum b, sum g, sum r, pixel count).
+ */
+__kernel void color_overlap_stats(
+	__global const float* lut,
+	IMAGE_ARGS, int cam_base,
+	int rows, int left_x, int right_x, int sample_width, int grid_height, int bins,
+	__global float4* stats)
+{
+	__local float table[256];
+	__local float4 sums[COLOR_REDUCE_SIZE];
+
+	int lid = get_local_id(0);
+	table[lid] = lut[lid];
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int band = get_global_id(1) >> 1;
+	int side = get_global_id(1) & 1;
+	int camera = get_global_id(2);
+	__global uchar* base = img0 + img0_offset;
+	int step = img0_step;
+	SELECT_IMAGES(camera)
+
+	int x0 = side ? right_x : left_x;
+	int y0 = band*grid_height;
+	int y1 = band < bins - 1 ? y0 + grid_height : rows;
+	int total = mul24(y1 - y0, sample_width);
+	float4 sum = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+	for (int i = lid; i < total; i += COLOR_REDUCE_SIZE) {
+		uchar4 v = rmat8uc4(base, step, x0 + i % sample_width, y0 + i / sample_width);
+		sum += (float4)(table[v.s0], table[v.s1], table[v.s2], 0.0f);
+	}
+
+	sums[lid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (int n = COLOR_REDUCE_SIZE >> 1; n > 0; n >>= 1) {
+		if (lid < n) {
+			sums[lid] += sums[lid + n];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0) {
+		sum = sums[0];
+		sum.s3 = total;
+		stats[((cam_base + camera)*bins + band)*2 + side] = sum;
+	}
+}
+
+
+/**
+ * @brief in place v = pow(min(lut[v]*gain, 1), 2.2)*256 of the BGR channels
+ *
+ * NDRange (cols, rows, cams) with 16x16 work-groups, every work-group first builds
+ * the 8-bit table of its camera in local memory, so each work-item evaluates one pow().
+ * gains[cam_base + camera] is the gain of the camera.
+ */
+__kernel void color_harmonize_8u(
+	__global const float* lut,
+	IMAGE_ARGS, int cam_base,
+	int rows, int cols,
+	__global const float* gains)
+{
+	__local uchar table[256];
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int camera = get_global_id(2);
+	float gain = gains[cam_base + camera];
+	int lid = mad24(get_local_id(1), get_local_size(0), get_local_id(0));
+	if (lid < 256) {
+		table[lid] = convert_uchar_sat_rte(pow(min(lut[lid]*gain, 1.0f), 2.2f)*256.0f);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	__global uchar* base = img0 + img0_offset;
+	int step = img0_step;
+	SELECT_IMAGES(camera)
+	if (x < cols && y < rows) {
+		uchar4 v = rmat8uc4(base, step, x, y);
+		v.s0 = table[v.s0];
+		v.s1 = table[v.s1];
+		v.s2 = table[v.s2];
+		wmat8uc4(base, step, x, y, v);
+	}
+}
@@ -0,0 +1,137 @@
+/**
+ * @brief the following macros are used for accessing img(x, y)
+ */
+#define rmat32fc1(addr, x, y)   ((__global const float*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))[x]
+#define wmat32fc1(addr, x, y) 	((__global float*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))[x]
+
+#define rmat(addr, x, y) 	rmat32fc1(addr, x, y)
+#define wmat(addr, x, y) 	wmat32fc1(addr, x, y)
+
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
+
+/**
+ * @brief the following macros must be defined in build options
+ *
+ * BLUR_RADIUS		radius of the gaussian kernel, i.e. kernel size/2
+ * KERNEL_X_DATA	gaussian kernel coefficients (see ocl::kernelToStr)
+ * KERNEL_Y_DATA
+ */
+#define DIG(a) a,
+__constant float kernel_x[] = { KERNEL_X_DATA };
+__constant float kernel_y[] = { KERNEL_Y_DATA };
+
+// BORDER_REFLECT_101: gfedcb|abcdefgh|gfedcba, same as sepfilter2d.cl
+#define REFLECT(i, m)	((i) < 0 ? -(i) : ((i) > (m) ? ((m)<<1)-(i) : (i)))
+
+#define TILE 			16
+#define GRAD_SIZE		(TILE + 2*BLUR_RADIUS)
+#define SRC_SIZE		(GRAD_SIZE + 2)
+
+
+/**
+ * @brief blurred image gradients of I0 and I1 in one pass
+ *
+ * Same result as sobel_x_1_border_replicate/sobel_y_1_border_replicate followed by
+ * filter_row_32FC1/filter_col_32FC1 on each gradient, but the sources are read once
+ * per tile and the unblurred gradients never leave local memory.
+ * The work-group size must be TILE x TILE.
+ */
+__kernel void gradient_blur_32FC1(
+	__global const real_t* I0, int I0_step, int I0_offset, int rows, int cols,
+	__global const real_t* I1, int I1_step, int I1_offset,
+	__global real_t* I0x, int I0x_step, int I0x_offset,
+	__global real_t* I0y, int I0y_step, int I0y_offset,
+	__global real_t* I1x, int I1x_step, int I1x_offset,
+	__global real_t* I1y, int I1y_step, int I1y_offset)
+{
+	__local float src0[SRC_SIZE][SRC_SIZE];
+	__local float src1[SRC_SIZE][SRC_SIZE];
+	__local float grad0x[GRAD_SIZE][GRAD_SIZE];
+	__local float grad0y[GRAD_SIZE][GRAD_SIZE];
+	__local float grad1x[GRAD_SIZE][GRAD_SIZE];
+	__local float grad1y[GRAD_SIZE][GRAD_SIZE];
+
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int lid = mad24(ly, TILE, lx);
+	// top-left of the source tile in image coordinates
+	int sx0 = mul24((int)get_group_id(0), TILE) - BLUR_RADIUS - 1;
+	int sy0 = mul24((int)get_group_id(1), TILE) - BLUR_RADIUS - 1;
+
+	// sources with replicated border, as the sobel kernels read them
+	for (int i = lid; i < SRC_SIZE*SRC_SIZE; i += TILE*TILE) {
+		int sx = i % SRC_SIZE;
+		int sy = i / SRC_SIZE;
+		int x = clamp(sx0 + sx, 0, cols - 1);
+		int y = clamp(sy0 + sy, 0, rows - 1);
+		src0[sy][sx] = rreal(I0, x, y);
+		src1[sy][sx] = rreal(I1, x, y);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// gradients at the reflected positions the blur reads
+	for (int i = lid; i < GRAD_SIZE*GRAD_SIZE; i += TILE*TILE) {
+		int gx = i % GRAD_SIZE;
+		int gy = i / GRAD_SIZE;
+		int qx = clamp(REFLECT(sx0 + 1 + gx, cols - 1), 0, cols - 1) - sx0;
+		int qy = clamp(REFLECT(sy0 + 1 + gy, rows - 1), 0, rows - 1) - sy0;
+		// past the image of a partial tile the reflection may leave the source tile,
+		// such a gradient is only read by the work-items outside the image, which write nothing
+		if (qx < 1 || qx > SRC_SIZE - 2 || qy < 1 || qy > SRC_SIZE - 2) {
+			grad0x[gy][gx] = 0.0f;
+			grad0y[gy][gx] = 0.0f;
+			grad1x[gy][gx] = 0.0f;
+			grad1y[gy][gx] = 0.0f;
+			continue;
+		}
+		grad0x[gy][gx] = src0[qy][qx + 1] - src0[qy][qx - 1];
+		grad0y[gy][gx] = src0[qy + 1][qx] - src0[qy - 1][qx];
+		grad1x[gy][gx] = src1[qy][qx + 1] - src1[qy][qx - 1];
+		grad1y[gy][gx] = src1[qy + 1][qx] - src1[qy - 1][qx];
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < cols && y < rows) {
+		float sum0x = 0.0f;
+		float sum0y = 0.0f;
+		float sum1x = 0.0f;
+		float sum1y = 0.0f;
+		for (int dy = 0; dy <= 2*BLUR_RADIUS; ++dy) {
+			for (int dx = 0; dx <= 2*BLUR_RADIUS; ++dx) {
+				float w = kernel_y[dy]*kernel_x[dx];
+				sum0x += w*grad0x[ly + dy][lx + dx];
+				sum0y += w*grad0y[ly + dy][lx + dx];
+				sum1x += w*grad1x[ly + dy][lx + dx];
+				sum1y += w*grad1y[ly + dy][lx + dx];
+			}
+		}
+		wreal(I0x, x, y, sum0x);
+		wreal(I0y, x, y, sum0y);
+		wreal(I1x, x, y, sum1x);
+		wreal(I1y, x, y, sum1y);
+	}
+}
@@ -20,6 +20,29 @@
 #define wmat(addr, x, y)		wmat32fc1(addr, x, y)
 #define wmat2(addr, x, y) 		wmat32fc2(addr, x, y)
 
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
 #define lerp(x0, x1, alpha)	 ((x0)*(1 - (alpha)) + (x1)*(alpha))
 
 /* @unnecessary
@@ -32,14 +55,14 @@ for (int x = 0; x < w; ++x) {
 }
 
 __kernel void get_flow_warp_map(
-	__global const float2* flow, int flow_step, int flow_offset,
+	__global const real2_t* flow, int flow_step, int flow_offset,
 	__global float2* warpMap, int warpMap_step, int warpMap_offset, int warpMap_rows, int warpMap_cols,
 	float t)
 {
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 	if (x < warpMap_cols && y < warpMap_rows) {
-		wmat2(warpMap, x, y) = (float2)(x, y) + rmat2(flow, x, y)*t;
+		wmat2(warpMap, x, y) = (float2)(x, y) + rreal2(flow, x, y)*t;
 	}		
 }
 */
@@ -92,8 +115,8 @@ for (int x = 0; x < imageL.cols; ++x) {
 __kernel void combine_novel_views(
 	__global const uchar4* imageL, int imageL_step, int imageL_offset,
 	__global const uchar4* imageR, int imageR_step, int imageR_offset,
-	__global float2* flowLtoR, int flowLtoR_step, int flowLtoR_offset, 
-	__global float2* flowRtoL, int flowRtoL_step, int flowRtoL_offset,
+	__global const real2_t* flowLtoR, int flowLtoR_step, int flowLtoR_offset, 
+	__global const real2_t* flowRtoL, int flowRtoL_step, int flowRtoL_offset,
 	__global uchar4* blendImage, int blendImage_step, int blendImage_offset, int blendImage_rows, int blendImage_cols,
 	float blendL, float blendR)
 {
@@ -110,8 +133,8 @@ __kernel void combine_novel_views(
 		} else if (colorL.s3 == 0 && colorR.s3 > 0) {
 			colorMixed =  (uchar4)(colorR.s0, colorR.s1, colorR.s2, 255);
 		} else {
-			float2 fLR = rmat2(flowLtoR, x, y);
-			float2 fRL = rmat2(flowRtoL, x, y);
+			float2 fLR = rreal2(flowLtoR, x, y);
+			float2 fRL = rreal2(flowRtoL, x, y);
 			float flowMagLR = sqrt(fLR.x * fLR.x + fLR.y * fLR.y) / blendImage_cols;
 			float flowMagRL = sqrt(fRL.x * fRL.x + fRL.y * fRL.y) / blendImage_cols;
 			float colorDiff =
@@ -186,11 +209,50 @@ for (int x = 0; x < imageL.cols; ++x) {
 }
 */
 
+// @added: the blend of combine_lazy_views, magL/magR are the flow magnitudes divided by the image width
+uchar4 combine_lazy_colors(uchar4 colorL, uchar4 colorR, float magL, float magR)
+{
+	uchar outAlpha = max(colorL.s3, colorR.s3)/255.0f > 0.1 ? 255 : 0;
+	uchar4 colorMixed;
+	if (colorL.s3 == 0 && colorR.s3 == 0) {
+		colorMixed = (uchar4)(0, 0, 0, outAlpha);
+	} else if (colorL.s3 == 0) {
+		colorMixed = (uchar4)(colorR.s0, colorR.s1, colorR.s2, outAlpha);
+	} else if (colorR.s3 == 0) {
+		colorMixed = (uchar4)(colorL.s0, colorL.s1, colorL.s2, outAlpha);
+	} else {
+		float blendL = colorL.s3;
+		float blendR = colorR.s3;
+		float norm = blendL + blendR;
+		blendL /= norm;	// blendL = colorL.s3/(colorL.s3 + colorR.s3); is better ?
+		blendR /= norm;	// blendR = 1.0f - blendL; is better ?
+		float colorDiff =
+			(fabs((float)colorL.s0 - (float)colorR.s0) +
+			 fabs((float)colorL.s1 - (float)colorR.s1) +
+			 fabs((float)colorL.s2 - (float)colorR.s2)) / 255.0f;
+		const float kColorDiffCoef = 10.0f;
+		const float kSoftmaxSharpness = 10.0f;
+		const float kFlowMagCoef = 20.0f; // NOTE: this is scaled differently than the test version due to normalizing magL & magR by imageL.cols
+		float deghostCoef = tanh(colorDiff * kColorDiffCoef);
+		double expL = exp(kSoftmaxSharpness * blendL * (1.0 + kFlowMagCoef * magL));
+		double expR = exp(kSoftmaxSharpness * blendR * (1.0 + kFlowMagCoef * magR));
+		double sumExp = expL + expR + 0.00001;
+		float softmaxL = expL / sumExp;  // float softmaxL = expL / (expL + expR + 0.00001); is better ?
+		float softmaxR = expR / sumExp;	 // float softmaxR = expR / (expL + expR + 0.00001); is better ?
+		colorMixed = (uchar4)(
+			colorL.s0 * lerp(blendL, softmaxL, deghostCoef) + colorR.s0 * lerp(blendR, softmaxR, deghostCoef),
+			colorL.s1 * lerp(blendL, softmaxL, deghostCoef) + colorR.s1 * lerp(blendR, softmaxR, deghostCoef),
+			colorL.s2 * lerp(blendL, softmaxL, deghostCoef) + colorR.s2 * lerp(blendR, softmaxR, deghostCoef),
+			255);
+	}
+	return colorMixed;
+}
+
 __kernel void combine_lazy_views(
 	__global const uchar4* imageL, int imageL_step, int imageL_offset,
 	__global const uchar4* imageR, int imageR_step, int imageR_offset,
-	__global const float* flowMagL, int flowMagL_step, int flowMagL_offset,
-	__global const float* flowMagR, int flowMagR_step, int flowMagR_offset,	
+	__global const real_t* flowMagL, int flowMagL_step, int flowMagL_offset,
+	__global const real_t* flowMagR, int flowMagR_step, int flowMagR_offset,	
 	__global uchar4* blendImage, int blendImage_step, int blendImage_offset, int blendImage_rows, int blendImage_cols)
 {
 	int x = get_global_id(0);
@@ -198,6 +260,7 @@ __kernel void combine_lazy_views(
 	if (x < blendImage_cols && y < blendImage_rows) {
 		uchar4 colorL = rmat8uc4(imageL, x, y);
 		uchar4 colorR = rmat8uc4(imageR, x, y);
+		/* @changed
 		uchar outAlpha = max(colorL.s3, colorR.s3)/255.0f > 0.1 ? 255 : 0;
 		uchar4 colorMixed;
 		if (colorL.s3 == 0 && colorR.s3 == 0) {
@@ -207,8 +270,8 @@ __kernel void combine_lazy_views(
 		} else if (colorR.s3 == 0) {
 			colorMixed = (uchar4)(colorL.s0, colorL.s1, colorL.s2, outAlpha);
 		} else {
-			float magL = rmat(flowMagL, x, y) / blendImage_cols;
-			float magR = rmat(flowMagR, x, y) / blendImage_cols;
+			float magL = rreal(flowMagL, x, y) / blendImage_cols;
+			float magR = rreal(flowMagR, x, y) / blendImage_cols;
 			float blendL = colorL.s3;
 			float blendR = colorR.s3;
 			float norm = blendL + blendR;
@@ -233,6 +296,10 @@ __kernel void combine_lazy_views(
 				colorL.s2 * lerp(blendL, softmaxL, deghostCoef) + colorR.s2 * lerp(blendR, softmaxR, deghostCoef),
 				255);
 		}
+		*/
+		float magL = rreal(flowMagL, x, y) / blendImage_cols;
+		float magR = rreal(flowMagR, x, y) / blendImage_cols;
+		uchar4 colorMixed = combine_lazy_colors(colorL, colorR, magL, magR);
 		wmat8uc4(blendImage, x, y) = colorMixed;
 	}
 }
@@ -274,7 +341,7 @@ for (int x = 0; x < width; ++x) {
 */
 __kernel void get_warp_composition(
 	__global const float3* warpBuffer, int warpBuffer_step, int warpBuffer_offset,
-	__global const float2* warpFlow, int warpFlow_step, int warpFlow_offset, 	
+	__global const real2_t* warpFlow, int warpFlow_step, int warpFlow_offset, 	
 	__global float2* warpComposition, int warpComposition_step, int warpComposition_offset, int warpComposition_rows, int warpComposition_cols,
 	int invertT)
 {
@@ -284,7 +351,7 @@ __kernel void get_warp_composition(
 		float lazyWarp_x = rmat3(warpBuffer, x, y, 0);
 		float lazyWarp_y = rmat3(warpBuffer, x, y, 1);
 		float lazyWarp_z = rmat3(warpBuffer, x, y, 2);
-		float2 flowDir = rmat2(warpFlow, x, y);
+		float2 flowDir = rreal2(warpFlow, x, y);
 		float t = invertT ? (1.0f - lazyWarp_z) : lazyWarp_z;
 		wmat2(warpComposition, x, y) = (float2) (lazyWarp_x + flowDir.x * t, lazyWarp_y + flowDir.y * t);	
 	}
@@ -311,9 +378,9 @@ for (int x = 0; x < width; ++x) {
 */
 __kernel void get_novel_view_flow_mag(
 	__global const float3* warpBuffer, int warpBuffer_step, int warpBuffer_offset,
-	__global const float2* warpFlow, int warpFlow_step, int warpFlow_offset,
+	__global const real2_t* warpFlow, int warpFlow_step, int warpFlow_offset,
 	__global uchar4* novelView, int novelView_step, int novelView_offset, 	
-	__global float* flowMag, int flowMag_step, int flowMag_offset, int flowMag_rows, int flowMag_cols,
+	__global real_t* flowMag, int flowMag_step, int flowMag_offset, int flowMag_rows, int flowMag_cols,
 	int invertT)
 {
 	int x = get_global_id(0);
@@ -322,8 +389,180 @@ __kernel void get_novel_view_flow_mag(
 		float lazyWarp_z = rmat3(warpBuffer, x, y, 2);
 		float t = invertT ? (1.0f - lazyWarp_z) : lazyWarp_z;
 		wmat8uc4(novelView, x, y).s3 = (1.0f - t) * rmat8uc4(novelView, x, y).s3;
-		float2 flowDir = rmat2(warpFlow, x, y);										// 
-		wmat(flowMag, x, y) = sqrt(flowDir.x * flowDir.x + flowDir.y * flowDir.y);	// wmat(flowMag, x, y) = length(rmat2(warpFlow, x, y)) is better ?
+		float2 flowDir = rreal2(warpFlow, x, y);										// 
+		wreal(flowMag, x, y, sqrt(flowDir.x * flowDir.x + flowDir.y * flowDir.y));	// wmat(flowMag, x, y) = length(rmat2(warpFlow, x, y)) is better ?
+	}
+}
+
+
+
+//
+// @added: renderLazyNovelView() of both images and combine_lazy_views in one pass
+//
+
+float4 get_bicubic_8uc4(float4 p0, float4 p1, float4 p2, float4 p3, float x)
+{
+	const float A = -0.75f;
+	const float w0 = ((A*(x + 1) - 5*A)*(x + 1) + 8*A)*(x + 1) - 4*A;
+	const float w1 = ((A + 2)*x - (A + 3))*x*x + 1;
+	const float w2 = ((A + 2)*(1 - x) - (A + 3))*(1 - x)*(1 - x) + 1;
+	const float w3 = 1.f - w0 - w1 - w2;
+	return p0*w0 + p1*w1 + p2*w2 + p3*w3;
+}
+
+float2 get_bicubic_32fc2(float2 p0, float2 p1, float2 p2, float2 p3, float x)
+{
+	const float A = -0.75f;
+	const float w0 = ((A*(x + 1) - 5*A)*(x + 1) + 8*A)*(x + 1) - 4*A;
+	const float w1 = ((A + 2)*x - (A + 3))*x*x + 1;
+	const float w2 = ((A + 2)*(1 - x) - (A + 3))*(1 - x)*(1 - x) + 1;
+	const float w3 = 1.f - w0 - w1 - w2;
+	return p0*w0 + p1*w1 + p2*w2 + p3*w3;
+}
+
+// src(src_pos) as remap_8UC4_32FC2 samples it (bicubic, zero outside)
+uchar4 sample_8uc4(
+	__global const uchar4* src, int src_step, int src_offset, int src_rows, int src_cols,
+	float2 src_pos)
+{
+	int x0 = convert_int_rtz(src_pos.x);
+	int y0 = convert_int_rtz(src_pos.y);
+	float xR = src_pos.x - x0;
+	float yR = src_pos.y - y0;
+
+	uchar4 u[4];
+	float4 v[4];
+	for (int dy=-1; dy < 3; ++dy) {
+		if (y0 + dy < 0 || y0 + dy >= src_rows) {
+			v[dy+1] = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+		} else {
+			u[0] = (0 <= x0 - 1 && x0 - 1 < src_cols) ? rmat8uc4(src, x0 - 1, y0 + dy) : (uchar4)(0, 0, 0, 0);
+			u[1] = (0 <= x0     && x0     < src_cols) ? rmat8uc4(src, x0 	, y0 + dy) : (uchar4)(0, 0, 0, 0);
+			u[2] = (0 <= x0 + 1 && x0 + 1 < src_cols) ? rmat8uc4(src, x0 + 1, y0 + dy) : (uchar4)(0, 0, 0, 0);
+			u[3] = (0 <= x0 + 2 && x0 + 2 < src_cols) ? rmat8uc4(src, x0 + 2, y0 + dy) : (uchar4)(0, 0, 0, 0);
+			v[dy+1] = get_bicubic_8uc4(convert_float4(u[0]), convert_float4(u[1]), convert_float4(u[2]), convert_float4(u[3]), xR);
+		}
+	}
+	return convert_uchar4_sat(get_bicubic_8uc4(v[0], v[1], v[2], v[3], yR));
+}
+
+// src(src_pos) as remap_32FC2_32FC2 samples it (bicubic, zero outside)
+float2 sample_real2(
+	__global const real2_t* src, int src_step, int src_offset, int src_rows, int src_cols,
+	float2 src_pos)
+{
+	int x0 = convert_int_rtz(src_pos.x);
+	int y0 = convert_int_rtz(src_pos.y);
+	float xR = src_pos.x - x0;
+	float yR = src_pos.y - y0;
+
+	float2 u[4];
+	float2 v[4];
+	for (int dy=-1; dy < 3; ++dy) {
+		if (y0 + dy < 0 || y0 + dy >= src_rows) {
+			v[dy+1] = (float2)(0.0f, 0.0f);
+		} else {
+			u[0] = (0 <= x0 - 1 && x0 - 1 < src_cols) ? rreal2(src, x0 - 1, y0 + dy) : (float2)(0.0f, 0.0f);
+			u[1] = (0 <= x0     && x0     < src_cols) ? rreal2(src, x0 	, y0 + dy) : (float2)(0.0f, 0.0f);
+			u[2] = (0 <= x0 + 1 && x0 + 1 < src_cols) ? rreal2(src, x0 + 1, y0 + dy) : (float2)(0.0f, 0.0f);
+			u[3] = (0 <= x0 + 2 && x0 + 2 < src_cols) ? rreal2(src, x0 + 2, y0 + dy) : (float2)(0.0f, 0.0f);
+			v[dy+1] = get_bicubic_32fc2(u[0], u[1], u[2], u[3], xR);
+		}
+	}
+	return get_bicubic_32fc2(v[0], v[1], v[2], v[3], yR);
+}
+
+// @added: the blended color of the eye pixel with the lazy warp entry (lazyWarp_xy, lazyWarp_z), see render_lazy_novel_view
+uchar4 render_lazy_pixel(
+	__global const uchar4* imageL, int imageL_step, int imageL_offset, int imageL_rows, int imageL_cols,
+	__global const uchar4* imageR, int imageR_step, int imageR_offset, int imageR_rows, int imageR_cols,
+	__global const real2_t* flowLtoR, int flowLtoR_step, int flowLtoR_offset, int flowLtoR_rows, int flowLtoR_cols,
+	__global const real2_t* flowRtoL, int flowRtoL_step, int flowRtoL_offset, int flowRtoL_rows, int flowRtoL_cols,
+	float2 lazyWarp_xy, float lazyWarp_z, int cols)
+{
+	float tL = lazyWarp_z;
+	float2 flowL = sample_real2(flowRtoL, flowRtoL_step, flowRtoL_offset, flowRtoL_rows, flowRtoL_cols, lazyWarp_xy);
+	uchar4 colorL = sample_8uc4(imageL, imageL_step, imageL_offset, imageL_rows, imageL_cols, lazyWarp_xy + flowL * tL);
+	colorL.s3 = (1.0f - tL) * colorL.s3;
+
+	float tR = 1.0f - lazyWarp_z;
+	float2 flowR = sample_real2(flowLtoR, flowLtoR_step, flowLtoR_offset, flowLtoR_rows, flowLtoR_cols, lazyWarp_xy);
+	uchar4 colorR = sample_8uc4(imageR, imageR_step, imageR_offset, imageR_rows, imageR_cols, lazyWarp_xy + flowR * tR);
+	colorR.s3 = (1.0f - tR) * colorR.s3;
+
+	float magL = sqrt(flowL.x * flowL.x + flowL.y * flowL.y) / cols;
+	float magR = sqrt(flowR.x * flowR.x + flowR.y * flowR.y) / cols;
+	return combine_lazy_colors(colorL, colorR, magL, magR);
+}
+
+/*
+for each eye pixel (x, y) with lazyWarp = warpBuffer(x, y):
+	// from imageL along flowRtoL at t = lazyWarp.z, from imageR along flowLtoR at t = 1 - lazyWarp.z
+	flow = remap(flow, lazyWarp.xy)
+	color = remap(image, lazyWarp.xy + flow * t), color.a *= 1 - t
+	blendImage(x, y) = combine_lazy_views(colorL, colorR, |flowL|, |flowR|)
+
+The eye is written to the columns [dst_x, dst_x + warpBuffer_cols) of blendImage, wrapped
+around its width, and with remove_chunk_line its last column repeats the one before
+(as remove_chunk_line does).
+*/
+__kernel void render_lazy_novel_view(
+	__global const float3* warpBuffer, int warpBuffer_step, int warpBuffer_offset, int warpBuffer_rows, int warpBuffer_cols,
+	__global const uchar4* imageL, int imageL_step, int imageL_offset, int imageL_rows, int imageL_cols,
+	__global const uchar4* imageR, int imageR_step, int imageR_offset, int imageR_rows, int imageR_cols,
+	__global const real2_t* flowLtoR, int flowLtoR_step, int flowLtoR_offset, int flowLtoR_rows, int flowLtoR_cols,
+	__global const real2_t* flowRtoL, int flowRtoL_step, int flowRtoL_offset, int flowRtoL_rows, int flowRtoL_cols,
+	__global uchar4* blendImage, int blendImage_step, int blendImage_offset, int blendImage_rows, int blendImage_cols,
+	int dst_x, int remove_chunk_line)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < warpBuffer_cols && y < warpBuffer_rows) {
+		int sx = (remove_chunk_line && x == warpBuffer_cols - 1 && x > 0) ? x - 1 : x;
+		float2 lazyWarp_xy = (float2)(rmat3(warpBuffer, sx, y, 0), rmat3(warpBuffer, sx, y, 1));
+		float lazyWarp_z = rmat3(warpBuffer, sx, y, 2);
+		int dx = x + dst_x;
+		dx = dx < blendImage_cols ? dx : dx - blendImage_cols;
+		// @changed: the blend is shared with render_procedural_novel_view
+		wmat8uc4(blendImage, dx, y) = render_lazy_pixel(
+			imageL, imageL_step, imageL_offset, imageL_rows, imageL_cols,
+			imageR, imageR_step, imageR_offset, imageR_rows, imageR_cols,
+			flowLtoR, flowLtoR_step, flowLtoR_offset, flowLtoR_rows, flowLtoR_cols,
+			flowRtoL, flowRtoL_step, flowRtoL_offset, flowRtoL_rows, flowRtoL_cols,
+			lazyWarp_xy, lazyWarp_z, warpBuffer_cols);
 	}
 }
 
+// @added
+/*
+render_lazy_novel_view with the lazy warp of the eye computed in place instead of read from a
+CV_32FC3 buffer (see OclLazyWarp):
+	warpBuffer(x, y) = (cam_width*0.5 - (cols - x) + slab_displacement, y, x/cols)
+for an eye of rows x cols pixels. slab_displacement is 0 in mono and +/- the verge at infinity
+slab displacement for the left/right eye in stereo.
+*/
+__kernel void render_procedural_novel_view(
+	__global const uchar4* imageL, int imageL_step, int imageL_offset, int imageL_rows, int imageL_cols,
+	__global const uchar4* imageR, int imageR_step, int imageR_offset, int imageR_rows, int imageR_cols,
+	__global const real2_t* flowLtoR, int flowLtoR_step, int flowLtoR_offset, int flowLtoR_rows, int flowLtoR_cols,
+	__global const real2_t* flowRtoL, int flowRtoL_step, int flowRtoL_offset, int flowRtoL_rows, int flowRtoL_cols,
+	__global uchar4* blendImage, int blendImage_step, int blendImage_offset, int blendImage_rows, int blendImage_cols,
+	int rows, int cols, float cam_width, float slab_displacement, int dst_x, int remove_chunk_line)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < cols && y < rows) {
+		int sx = (remove_chunk_line && x == cols - 1 && x > 0) ? x - 1 : x;
+		float slabShift = cam_width * 0.5f - (float)(cols - sx);
+		float2 lazyWarp_xy = (float2)(slabShift + slab_displacement, (float)y);
+		float lazyWarp_z = (float)sx / (float)cols;
+		int dx = x + dst_x;
+		dx = dx < blendImage_cols ? dx : dx - blendImage_cols;
+		wmat8uc4(blendImage, dx, y) = render_lazy_pixel(
+			imageL, imageL_step, imageL_offset, imageL_rows, imageL_cols,
+			imageR, imageR_step, imageR_offset, imageR_rows, imageR_cols,
+			flowLtoR, flowLtoR_step, flowLtoR_offset, flowLtoR_rows, flowLtoR_cols,
+			flowRtoL, flowRtoL_step, flowRtoL_offset, flowRtoL_rows, flowRtoL_cols,
+			lazyWarp_xy, lazyWarp_z, cols);
+	}
+}
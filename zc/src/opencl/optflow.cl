@@ -22,6 +22,29 @@
 #define wmat(addr, x, y) 	wmat32fc1(addr, x, y)
 #define wmat2(addr, x, y) 	wmat32fc2(addr, x, y)
 
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
 
 /**
  * @brief motion detection
@@ -29,22 +52,22 @@
 __kernel void motion_detection(
 	__global const uchar4* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
 	__global const uchar4* pre, int pre_step, int pre_offset,
-	__global float* motion, int motion_step, int motion_offset) 
+	__global real_t* motion, int motion_step, int motion_offset) 
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
 	if (x < cur_cols && y < cur_rows) {
-		wmat(motion, x, y) = 
+		wreal(motion, x, y,
 			( fabs((float)rmat8uc4(cur, x, y).x - (float)rmat8uc4(pre, x, y).x)
 			+ fabs((float)rmat8uc4(cur, x, y).y - (float)rmat8uc4(pre, x, y).y)
-			+ fabs((float)rmat8uc4(cur, x, y).z - (float)rmat8uc4(pre, x, y).z))/(3.0f*255.0f);
+			+ fabs((float)rmat8uc4(cur, x, y).z - (float)rmat8uc4(pre, x, y).z))/(3.0f*255.0f));
 	}
 }
 
 __kernel void motion_detection_v2(
 	__global const uchar4* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
 	__global const uchar4* pre, int pre_step, int pre_offset,
-	__global float* motion, int motion_step, int motion_offset) 
+	__global real_t* motion, int motion_step, int motion_offset) 
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
@@ -69,7 +92,53 @@ __kernel void motion_detection_v2(
 			}
 			m *= delta;
 		}
-		wmat(motion, x, y) = m;
+		wreal(motion, x, y, m);
+	}
+}
+
+/**
+ * @brief mean motion of each tile_size x tile_size tile, the larger of the two image pairs
+ *
+ * NDRange (tiles_cols*16, tiles_rows*16) with 16x16 work-groups, a work-group per tile.
+ * Used by the incremental flow (see OclIncrementalFlow) to keep the previous flow of static tiles.
+ */
+__kernel void motion_tiles(
+	__global const uchar4* cur0, int cur0_step, int cur0_offset, int rows, int cols,
+	__global const uchar4* pre0, int pre0_step, int pre0_offset,
+	__global const uchar4* cur1, int cur1_step, int cur1_offset,
+	__global const uchar4* pre1, int pre1_step, int pre1_offset,
+	int tile_size,
+	__global float* tiles, int tiles_step, int tiles_offset, int tiles_rows, int tiles_cols)
+{
+	__local float sums[256];
+
+	int lid = mad24(get_local_id(1), 16, get_local_id(0));
+	int tx = get_group_id(0);
+	int ty = get_group_id(1);
+	int x0 = mul24(tx, tile_size);
+	int y0 = mul24(ty, tile_size);
+	int w = min(tile_size, cols - x0);
+	int h = min(tile_size, rows - y0);
+
+	float sum = 0.0f;
+	for (int i = lid; i < mul24(w, h); i += 256) {
+		int x = x0 + i % w;
+		int y = y0 + i / w;
+		float4 d0 = fabs(convert_float4(rmat8uc4(cur0, x, y)) - convert_float4(rmat8uc4(pre0, x, y)));
+		float4 d1 = fabs(convert_float4(rmat8uc4(cur1, x, y)) - convert_float4(rmat8uc4(pre1, x, y)));
+		sum += max(d0.x + d0.y + d0.z, d1.x + d1.y + d1.z);
+	}
+
+	sums[lid] = sum;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (int n = 128; n > 0; n >>= 1) {
+		if (lid < n) {
+			sums[lid] += sums[lid + n];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	if (lid == 0 && tx < tiles_cols && ty < tiles_rows) {
+		wmat32fc1(tiles, tx, ty) = sums[0]/(3.0f*255.0f*mul24(w, h));
 	}
 }
 
@@ -77,21 +146,21 @@ __kernel void motion_detection_v2(
  * @brief adjust flow toward previous
  */
 __kernel void adjust_flow_toward_previous(
-	__global float2* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
-	__global const float2* pre, int pre_step, int pre_offset,
-	__global const float* motion, int motion_step, int motion_offset) 
+	__global real2_t* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
+	__global const real2_t* pre, int pre_step, int pre_offset,
+	__global const real_t* motion, int motion_step, int motion_offset) 
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
 	if (x < cur_cols && y < cur_rows) {
-		float w = 1.0f - rmat(motion, x, y);
-		wmat2(cur, x, y) = (1.0f - w) * rmat2(cur, x, y) + w * rmat2(pre, x, y);
+		float w = 1.0f - rreal(motion, x, y);
+		wreal2(cur, x, y, (1.0f - w) * rreal2(cur, x, y) + w * rreal2(pre, x, y));
 	}
 }
 __kernel void adjust_flow_toward_previous_v2(
-	__global float2* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
-	__global const float2* pre, int pre_step, int pre_offset,
-	__global const float* motion, int motion_step, int motion_offset,
+	__global real2_t* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
+	__global const real2_t* pre, int pre_step, int pre_offset,
+	__global const real_t* motion, int motion_step, int motion_offset,
 	float motion_threshhold) 
 {
 	int x = get_global_id(0);
@@ -99,7 +168,7 @@ __kernel void adjust_flow_toward_previous_v2(
 
 	if (x < cur_cols && y < cur_rows) {
 		const float top_bottom_thresh = 0.2f;
-		float flowMotion = rmat(motion, x, y);
+		float flowMotion = rreal(motion, x, y);
 		if (y < cur_rows * top_bottom_thresh || y > cur_rows* (1 - top_bottom_thresh)) {
 			//pass we assume there is little move in such area.. 
 		} else {
@@ -108,7 +177,7 @@ __kernel void adjust_flow_toward_previous_v2(
 			}
 		}
 		float w = 1.0f - flowMotion;
-		wmat2(cur, x, y) = (1.0f - w) * rmat2(cur, x, y) + w * rmat2(pre, x, y);
+		wreal2(cur, x, y, (1.0f - w) * rreal2(cur, x, y) + w * rreal2(pre, x, y));
 	}
 }
 
@@ -138,9 +207,9 @@ __kernel void adjust_flow_toward_previous_v2(
 	flow(y, x) = make_float2(flowValue.x * adjust_factor + prevFlowValue.x * (1 - adjust_factor), flowValue.y * adjust_factor + prevFlowValue.y * (1 - adjust_factor));
 */		
 __kernel void adjust_flow_toward_previous_v3(
-	__global float2* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
-	__global const float2* pre, int pre_step, int pre_offset,
-	__global const float* motion, int motion_step, int motion_offset,
+	__global real2_t* cur, int cur_step, int cur_offset, int cur_rows, int cur_cols,
+	__global const real2_t* pre, int pre_step, int pre_offset,
+	__global const real_t* motion, int motion_step, int motion_offset,
 	float of_a_x,
 	float of_a_y,
 	float of_b_x,
@@ -153,7 +222,7 @@ __kernel void adjust_flow_toward_previous_v3(
 	int y = get_global_id(1);
 
 	if (x < cur_cols && y < cur_rows) {
-		float flowMotion = rmat(motion, x, y);
+		float flowMotion = rreal(motion, x, y);
 		
 		float adjust_factor = 0.0f;
 		if (flowMotion < of_a_x && flowMotion > 0) {
@@ -172,7 +241,7 @@ __kernel void adjust_flow_toward_previous_v3(
 			adjust_factor = 1.0f;
 		}
 		
-		wmat2(cur, x, y) = adjust_factor * rmat2(cur, x, y) + (1.0f - adjust_factor) * rmat2(pre, x, y);
+		wreal2(cur, x, y, adjust_factor * rreal2(cur, x, y) + (1.0f - adjust_factor) * rreal2(pre, x, y));
 	}
 }
 
@@ -205,14 +274,17 @@ __constant float kGradientStepSize 				= 0.5f;
 // __constant float kDownscaleFactor 			= 0.5f;
 __constant float kDirectionalRegularizationCoef = 0.0f;
 __constant int   kUseDirectionalRegularization 	= 0;
-__constant int   kMaxPercentage 				= 0;	// NOTES: this value can't be zero, and should be same as the one in host program
+#ifndef MAX_PERCENTAGE
+#define MAX_PERCENTAGE 0
+#endif
+__constant int   kMaxPercentage 				= MAX_PERCENTAGE;	// NOTES: this value can't be zero, and should be same as the one in host program (-D MAX_PERCENTAGE)
 
 
 float compute_patch_error(
-	__global const float* I0, int I0_step, int I0_offset, int I0_rows, int I0_cols, int i0x, int i0y, 
-	__global const float* I1, int I1_step, int I1_offset, int I1_rows, int I1_cols, int i1x, int i1y,
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset)
+	__global const real_t* I0, int I0_step, int I0_offset, int I0_rows, int I0_cols, int i0x, int i0y, 
+	__global const real_t* I1, int I1_step, int I1_offset, int I1_rows, int I1_cols, int i1x, int i1y,
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset)
 {
 	// compute sum-of-absolute-differences in 5x5 patch
 	const int kPatchRadius = 2;
@@ -227,8 +299,8 @@ float compute_patch_error(
 				int d1y = min(max(0, i1y + dy), I1_rows - 1);
 				int d1x = min(max(0, i1x + dx), I1_cols - 1);
 				
-				sad += fabs(rmat(I0, d0x, d0y) - rmat(I1, d1x, d1y));
-				alpha += rmat(alpha0, d0x, d0y) * rmat(alpha1, d1x, d1y);
+				sad += fabs(rreal(I0, d0x, d0y) - rreal(I1, d1x, d1y));
+				alpha += rreal(alpha0, d0x, d0y) * rreal(alpha1, d1x, d1y);
 			}
 		}
 	}
@@ -246,16 +318,16 @@ float compute_patch_error(
  * @brief estimate flow by searching the closet rect area
  */
 __kernel void estimate_flow(
-	__global const float* I0, int I0_step, int I0_offset, int I0_rows, int I0_cols,
-	__global const float* I1, int I1_step, int I1_offset, int I1_rows, int I1_cols,
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global float2* flow, int flow_step, int flow_offset,
+	__global const real_t* I0, int I0_step, int I0_offset, int I0_rows, int I0_cols,
+	__global const real_t* I1, int I1_step, int I1_offset, int I1_rows, int I1_cols,
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global real2_t* flow, int flow_step, int flow_offset,
 	int box_x, int box_y, int box_width, int box_height)
 {
 	int i0x = get_global_id(0);
 	int i0y = get_global_id(1);
-	if (i0x < I0_cols && i0y < I0_rows && rmat(alpha0, i0x, i0y) > kUpdateAlphaThreshold) {
+	if (i0x < I0_cols && i0y < I0_rows && rreal(alpha0, i0x, i0y) > kUpdateAlphaThreshold) {
 		const float kFraction = 0.8f; // lower the fraction to increase affinity
 		float errorBest = kFraction * compute_patch_error(
 			I0, I0_step, I0_offset, I0_rows, I0_cols, i0x, i0y,
@@ -286,7 +358,7 @@ __kernel void estimate_flow(
 			}
 		}	
 		// use the best match
-		wmat2(flow, i0x, i0y) = (float2)(i1xBest - i0x, i1yBest - i0y);
+		wreal2(flow, i0x, i0y, (float2)(i1xBest - i0x, i1yBest - i0y));
 	}
 }
 
@@ -294,22 +366,22 @@ __kernel void estimate_flow(
  * @brief low alpha flow diffusion
  */
 __kernel void alpha_flow_diffusion(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
 {
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 	if (x < flow_cols && y < flow_rows) {
-		float diffusionCoef = 1 - rmat(alpha0, x, y) * rmat(alpha1, x, y);
-		wmat2(flow, x, y) = diffusionCoef * rmat2(blurred, x, y) +  (1-diffusionCoef) * rmat2(flow, x, y);
+		float diffusionCoef = 1 - rreal(alpha0, x, y) * rreal(alpha1, x, y);
+		wreal2(flow, x, y, diffusionCoef * rreal2(blurred, x, y) +  (1-diffusionCoef) * rreal2(flow, x, y));
 	}
 }
 
 
 float get_pix_bilinear32f_extend(
-	__global const float* img, int img_step, int img_offset, 
+	__global const real_t* img, int img_step, int img_offset, 
 	int img_rows, int img_cols,
 	float x, float y)
 {
@@ -319,29 +391,29 @@ float get_pix_bilinear32f_extend(
 	int y0 = convert_int_rtz(y);
 	float xR = x - x0;
 	float yR = y - y0;
-	float f00 = rmat(img, x0, y0);
-	float f01 = rmat(img, x0, y0 + 1);
-	float f10 = rmat(img, x0 + 1, y0);
-	float f11 = rmat(img, x0 + 1, y0 + 1);
+	float f00 = rreal(img, x0, y0);
+	float f01 = rreal(img, x0, y0 + 1);
+	float f10 = rreal(img, x0 + 1, y0);
+	float f11 = rreal(img, x0 + 1, y0 + 1);
 	return f00 + (f10 - f00)*xR + (f01 - f00)*yR + (f00 + f11 - f10 - f01)*xR*yR;
 }
 
 float error_function(
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
 	int flow_rows, int flow_cols, 
 	int x, int y, float2 flow)
 {	
 	float matchX      = x + flow.x;
 	float matchY      = y + flow.y;
-	float i0x         = rmat(I0x, x, y);
-	float i0y         = rmat(I0y, x, y);
+	float i0x         = rreal(I0x, x, y);
+	float i0y         = rreal(I0y, x, y);
 	float i1x         = get_pix_bilinear32f_extend(I1x, I1x_step, I1x_offset, flow_rows, flow_cols, matchX, matchY); // NOTES: flow, blurred, I0, I1, I0x, I0y, I1x, I1y has the same width/height
 	float i1y         = get_pix_bilinear32f_extend(I1y, I1y_step, I1y_offset, flow_rows, flow_cols, matchX, matchY);
-	float smoothness  =	distance(rmat2(blurred, x, y), flow);
+	float smoothness  =	distance(rreal2(blurred, x, y), flow);
 	
 	float err = distance((float2)(i0x, i0y), (float2)(i1x, i1y))
 		+ smoothness * kSmoothnessCoef
@@ -349,7 +421,7 @@ float error_function(
 		+ kHorizontalRegularizationCoef * fabs(flow.x) / flow_cols;	
 		
 	if (kUseDirectionalRegularization) {
-		float2 blurredFlow = rmat2(blurred, x, y);
+		float2 blurredFlow = rreal2(blurred, x, y);
 		const float kEpsilon = 0.001f;
 		// NOTES: ... dot(normalize(blurredFlow), normalize(flow)) is better ?
 		err -= kDirectionalRegularizationCoef * dot(blurredFlow/(length(blurredFlow) + kEpsilon), flow/(length(flow) + kEpsilon));
@@ -358,12 +430,12 @@ float error_function(
 }
 
 void propose_flow_update(
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
 	int updateX, int updateY, float2 proposedFlow, float* currErr) 
 {
 	float proposalErr = error_function(
@@ -375,18 +447,18 @@ void propose_flow_update(
 		flow_rows, flow_cols,
 		updateX, updateY, proposedFlow);
 	if (proposalErr < (*currErr)) {
-		wmat2(flow, updateX, updateY) = proposedFlow;
+		wreal2(flow, updateX, updateY, proposedFlow);
 		*currErr = proposalErr;
 	}
 }
 
 float2 error_gradient(
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset,
 	int flow_rows, int flow_cols,
 	int x, int y, float currErr) 
 {
@@ -400,7 +472,7 @@ float2 error_gradient(
 		I1y, I1y_step, I1y_offset,
 		blurred, blurred_step, blurred_offset,
 		flow_rows, flow_cols,
-		x, y, rmat2(flow, x, y)+dx);		
+		x, y, rreal2(flow, x, y)+dx);		
 	float fy = error_function(
 		I0x, I0x_step, I0x_offset,
 		I0y, I0y_step, I0y_offset,
@@ -408,7 +480,7 @@ float2 error_gradient(
 		I1y, I1y_step, I1y_offset,
 		blurred, blurred_step, blurred_offset,
 		flow_rows, flow_cols,
-		x, y, rmat2(flow, x, y)+dy);
+		x, y, rreal2(flow, x, y)+dy);
 	
 	//return (float2)((fx - currErr)/kGradEpsilon, (fy - currErr)/kGradEpsilon);
 	return (float2)((fx - currErr)*1000.0f, (fy - currErr)*1000.0f);
@@ -418,14 +490,14 @@ float2 error_gradient(
  * @brief sweep from top left
  */
 __kernel void sweep_from_top_left(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
 	int start_x, int start_y)
 {
 	int k = get_global_id(0);
@@ -433,8 +505,8 @@ __kernel void sweep_from_top_left(
 	int y = start_y - k;
 	
 	if (0 <= x && x < flow_cols && 0 <= y && y < flow_rows 
-		&& rmat(alpha0, x, y) > kUpdateAlphaThreshold 
-		&& rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+		&& rreal(alpha0, x, y) > kUpdateAlphaThreshold 
+		&& rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 		float currErr = error_function(
 			I0x, I0x_step, I0x_offset,
 			I0y, I0y_step, I0y_offset,
@@ -442,7 +514,7 @@ __kernel void sweep_from_top_left(
 			I1y, I1y_step, I1y_offset,
 			blurred, blurred_step, blurred_offset,
 			flow_rows, flow_cols,
-			x, y, rmat2(flow, x, y));
+			x, y, rreal2(flow, x, y));
 			
 		if (x > 0) {
 			propose_flow_update(
@@ -452,7 +524,7 @@ __kernel void sweep_from_top_left(
 				I1y, I1y_step, I1y_offset,
 				blurred, blurred_step, blurred_offset,
 				flow, flow_step, flow_offset, flow_rows, flow_cols,
-				x, y, rmat2(flow, x-1, y), &currErr);
+				x, y, rreal2(flow, x-1, y), &currErr);
 		}
 		if (y > 0) {
 			propose_flow_update(
@@ -462,17 +534,17 @@ __kernel void sweep_from_top_left(
 				I1y, I1y_step, I1y_offset,
 				blurred, blurred_step, blurred_offset,
 				flow, flow_step, flow_offset, flow_rows, flow_cols,
-				x, y, rmat2(flow, x, y-1), &currErr);
+				x, y, rreal2(flow, x, y-1), &currErr);
 		}
 		
-		wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+		wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 			I0x, I0x_step, I0x_offset,
 			I0y, I0y_step, I0y_offset,
 			I1x, I1x_step, I1x_offset,
 			I1y, I1y_step, I1y_offset,
 			blurred, blurred_step, blurred_offset,
 			flow, flow_step, flow_offset, flow_rows, flow_cols,
-			x, y, currErr);
+			x, y, currErr));
 	}
 }
 
@@ -480,14 +552,14 @@ __kernel void sweep_from_top_left(
  * @brief sweep from bottom right
  */
 __kernel void sweep_from_bottom_right(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
 	int start_x, int start_y) 
 {
 	int k = get_global_id(0);
@@ -495,8 +567,8 @@ __kernel void sweep_from_bottom_right(
 	int y = start_y - k;
 	
 	if (0 <= x && x < flow_cols && 0 <= y && y < flow_rows
-		&& rmat(alpha0, x, y) > kUpdateAlphaThreshold 
-		&& rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+		&& rreal(alpha0, x, y) > kUpdateAlphaThreshold 
+		&& rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 		float currErr = error_function(
 			I0x, I0x_step, I0x_offset,
 			I0y, I0y_step, I0y_offset,
@@ -504,7 +576,7 @@ __kernel void sweep_from_bottom_right(
 			I1y, I1y_step, I1y_offset,
 			blurred, blurred_step, blurred_offset,
 			flow_rows, flow_cols,
-			x, y, rmat2(flow, x, y));
+			x, y, rreal2(flow, x, y));
 			
 		if (x < flow_cols - 1) {
 			propose_flow_update(
@@ -514,7 +586,7 @@ __kernel void sweep_from_bottom_right(
 				I1y, I1y_step, I1y_offset,
 				blurred, blurred_step, blurred_offset,
 				flow, flow_step, flow_offset, flow_rows, flow_cols,
-				x, y, rmat2(flow, x+1, y), &currErr);
+				x, y, rreal2(flow, x+1, y), &currErr);
 		}
 		if (y < flow_rows - 1) {
 			propose_flow_update(
@@ -524,35 +596,35 @@ __kernel void sweep_from_bottom_right(
 				I1y, I1y_step, I1y_offset,
 				blurred, blurred_step, blurred_offset,
 				flow, flow_step, flow_offset, flow_rows, flow_cols,
-				x, y, rmat2(flow, x, y+1), &currErr);
+				x, y, rreal2(flow, x, y+1), &currErr);
 		}
 		
-		wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+		wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 			I0x, I0x_step, I0x_offset,
 			I0y, I0y_step, I0y_offset,
 			I1x, I1x_step, I1x_offset,
 			I1y, I1y_step, I1y_offset,
 			blurred, blurred_step, blurred_offset,
 			flow, flow_step, flow_offset, flow_rows, flow_cols,
-			x, y, currErr);
+			x, y, currErr));
 	}
 }
 
 
 __kernel void sweep_from_left(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
 {
 	int y = get_global_id(0);
 	if (y < flow_rows) {
 		for (int x=0; x < flow_cols; ++x) {
-			if (rmat(alpha0, x, y) > kUpdateAlphaThreshold && rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+			if (rreal(alpha0, x, y) > kUpdateAlphaThreshold && rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 				float currErr = error_function(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
@@ -560,7 +632,7 @@ __kernel void sweep_from_left(
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow_rows, flow_cols,
-					x, y, rmat2(flow, x, y));
+					x, y, rreal2(flow, x, y));
 					
 				if (x > 0) {
 					propose_flow_update(
@@ -570,17 +642,17 @@ __kernel void sweep_from_left(
 						I1y, I1y_step, I1y_offset,
 						blurred, blurred_step, blurred_offset,
 						flow, flow_step, flow_offset, flow_rows, flow_cols,
-						x, y, rmat2(flow, x-1, y), &currErr);
+						x, y, rreal2(flow, x-1, y), &currErr);
 				}
 				
-				wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+				wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
 					I1x, I1x_step, I1x_offset,
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow, flow_step, flow_offset, flow_rows, flow_cols,
-					x, y, currErr);
+					x, y, currErr));
 			}
 		}
 	}
@@ -588,19 +660,19 @@ __kernel void sweep_from_left(
 
 
 __kernel void sweep_from_right(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
 {
 	int y = get_global_id(0);
 	if (y < flow_rows) {
 		for (int x=flow_cols-1; x >=0; --x) {
-			if (rmat(alpha0, x, y) > kUpdateAlphaThreshold && rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+			if (rreal(alpha0, x, y) > kUpdateAlphaThreshold && rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 				float currErr = error_function(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
@@ -608,7 +680,7 @@ __kernel void sweep_from_right(
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow_rows, flow_cols,
-					x, y, rmat2(flow, x, y));
+					x, y, rreal2(flow, x, y));
 					
 				if (x < flow_cols-1) {
 					propose_flow_update(
@@ -618,36 +690,36 @@ __kernel void sweep_from_right(
 						I1y, I1y_step, I1y_offset,
 						blurred, blurred_step, blurred_offset,
 						flow, flow_step, flow_offset, flow_rows, flow_cols,
-						x, y, rmat2(flow, x+1, y), &currErr);
+						x, y, rreal2(flow, x+1, y), &currErr);
 				}
 				
-				wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+				wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
 					I1x, I1x_step, I1x_offset,
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow, flow_step, flow_offset, flow_rows, flow_cols,
-					x, y, currErr);
+					x, y, currErr));
 			}
 		}
 	}
 }
 
 __kernel void sweep_from_top(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
 {
 	int x = get_global_id(0);
 	if (x < flow_cols) {
 		for (int y=0; y < flow_rows; ++y) {
-			if (rmat(alpha0, x, y) > kUpdateAlphaThreshold && rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+			if (rreal(alpha0, x, y) > kUpdateAlphaThreshold && rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 				float currErr = error_function(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
@@ -655,7 +727,7 @@ __kernel void sweep_from_top(
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow_rows, flow_cols,
-					x, y, rmat2(flow, x, y));
+					x, y, rreal2(flow, x, y));
 					
 				if (y > 0) {
 					propose_flow_update(
@@ -665,36 +737,36 @@ __kernel void sweep_from_top(
 						I1y, I1y_step, I1y_offset,
 						blurred, blurred_step, blurred_offset,
 						flow, flow_step, flow_offset, flow_rows, flow_cols,
-						x, y, rmat2(flow, x, y-1), &currErr);
+						x, y, rreal2(flow, x, y-1), &currErr);
 				}
 				
-				wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+				wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
 					I1x, I1x_step, I1x_offset,
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow, flow_step, flow_offset, flow_rows, flow_cols,
-					x, y, currErr);
+					x, y, currErr));
 			}
 		}
 	}
 }
 
 __kernel void sweep_from_bottom(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols)
 {
 	int x = get_global_id(0);
 	if (x < flow_cols) {		
 		for (int y=flow_rows-1; y >=0; --y) {
-			if (rmat(alpha0, x, y) > kUpdateAlphaThreshold && rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+			if (rreal(alpha0, x, y) > kUpdateAlphaThreshold && rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 				float currErr = error_function(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
@@ -702,7 +774,7 @@ __kernel void sweep_from_bottom(
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow_rows, flow_cols,
-					x, y, rmat2(flow, x, y));
+					x, y, rreal2(flow, x, y));
 					
 				if (y < flow_rows-1) {
 					propose_flow_update(
@@ -712,17 +784,17 @@ __kernel void sweep_from_bottom(
 						I1y, I1y_step, I1y_offset,
 						blurred, blurred_step, blurred_offset,
 						flow, flow_step, flow_offset, flow_rows, flow_cols,
-						x, y, rmat2(flow, x, y+1), &currErr);
+						x, y, rreal2(flow, x, y+1), &currErr);
 				}
 				
-				wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+				wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
 					I1x, I1x_step, I1x_offset,
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow, flow_step, flow_offset, flow_rows, flow_cols,
-					x, y, currErr);
+					x, y, currErr));
 			}
 		}
 	}
@@ -730,14 +802,14 @@ __kernel void sweep_from_bottom(
 
 
 __kernel void sweep_to(
-	__global const float* alpha0, int alpha0_step, int alpha0_offset,
-	__global const float* alpha1, int alpha1_step, int alpha1_offset,
-	__global const float* I0x, int I0x_step, int I0x_offset,
-	__global const float* I0y, int I0y_step, int I0y_offset,
-	__global const float* I1x, int I1x_step, int I1x_offset,
-	__global const float* I1y, int I1y_step, int I1y_offset,
-	__global const float2* blurred, int blurred_step, int blurred_offset,
-	__global float2* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
 	int dx, int dy)
 {
 	int k = get_global_id(0);
@@ -772,7 +844,7 @@ __kernel void sweep_to(
 		
 		for (int x=start_x, y=start_y; 0 <= x && x < flow_cols && 0 <= y && y < flow_rows; x += dx, y += dy) {
 			
-			if (rmat(alpha0, x, y) > kUpdateAlphaThreshold && rmat(alpha1, x, y) > kUpdateAlphaThreshold) {
+			if (rreal(alpha0, x, y) > kUpdateAlphaThreshold && rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
 				float currErr = error_function(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
@@ -780,7 +852,7 @@ __kernel void sweep_to(
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow_rows, flow_cols,
-					x, y, rmat2(flow, x, y));
+					x, y, rreal2(flow, x, y));
 					
 				if (0 <= x-dx && x-dx < flow_cols && 0 <= y-dy && y-dy < flow_rows) {
 					propose_flow_update(
@@ -790,17 +862,17 @@ __kernel void sweep_to(
 						I1y, I1y_step, I1y_offset,
 						blurred, blurred_step, blurred_offset,
 						flow, flow_step, flow_offset, flow_rows, flow_cols,
-						x, y, rmat2(flow, x-dx, y-dy), &currErr);
+						x, y, rreal2(flow, x-dx, y-dy), &currErr);
 				}
 				
-				wmat2(flow, x, y) -= kGradientStepSize * error_gradient(
+				wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
 					I0x, I0x_step, I0x_offset,
 					I0y, I0y_step, I0y_offset,
 					I1x, I1x_step, I1x_offset,
 					I1y, I1y_step, I1y_offset,
 					blurred, blurred_step, blurred_offset,
 					flow, flow_step, flow_offset, flow_rows, flow_cols,
-					x, y, currErr);
+					x, y, currErr));
 			}
 		}
 	}
@@ -809,3 +881,156 @@ __kernel void sweep_to(
 
 
 
+
+
+/**
+ * @brief tile size of the wavefront sweeps, must be same as the one defined in host program
+ */
+#define SWEEP_TILE 32
+
+/**
+ * @brief update flow(x, y) by the proposals from flow(x-d, y) and flow(x, y-d), then take a gradient step
+ */
+void wavefront_update(
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
+	int x, int y, int d)
+{
+	if (rreal(alpha0, x, y) > kUpdateAlphaThreshold && rreal(alpha1, x, y) > kUpdateAlphaThreshold) {
+		float currErr = error_function(
+			I0x, I0x_step, I0x_offset,
+			I0y, I0y_step, I0y_offset,
+			I1x, I1x_step, I1x_offset,
+			I1y, I1y_step, I1y_offset,
+			blurred, blurred_step, blurred_offset,
+			flow_rows, flow_cols,
+			x, y, rreal2(flow, x, y));
+
+		if (0 <= x-d && x-d < flow_cols) {
+			propose_flow_update(
+				I0x, I0x_step, I0x_offset,
+				I0y, I0y_step, I0y_offset,
+				I1x, I1x_step, I1x_offset,
+				I1y, I1y_step, I1y_offset,
+				blurred, blurred_step, blurred_offset,
+				flow, flow_step, flow_offset, flow_rows, flow_cols,
+				x, y, rreal2(flow, x-d, y), &currErr);
+		}
+		if (0 <= y-d && y-d < flow_rows) {
+			propose_flow_update(
+				I0x, I0x_step, I0x_offset,
+				I0y, I0y_step, I0y_offset,
+				I1x, I1x_step, I1x_offset,
+				I1y, I1y_step, I1y_offset,
+				blurred, blurred_step, blurred_offset,
+				flow, flow_step, flow_offset, flow_rows, flow_cols,
+				x, y, rreal2(flow, x, y-d), &currErr);
+		}
+
+		wreal2(flow, x, y, rreal2(flow, x, y) - kGradientStepSize * error_gradient(
+			I0x, I0x_step, I0x_offset,
+			I0y, I0y_step, I0y_offset,
+			I1x, I1x_step, I1x_offset,
+			I1y, I1y_step, I1y_offset,
+			blurred, blurred_step, blurred_offset,
+			flow, flow_step, flow_offset, flow_rows, flow_cols,
+			x, y, currErr));
+	}
+}
+
+/**
+ * @brief sweep the tiles on one tile anti-diagonal (tx + ty == tile_diagonal)
+ *
+ * Each work-group owns one SWEEP_TILE x SWEEP_TILE tile and walks its 2*SWEEP_TILE-1 inner
+ * anti-diagonals, work-item i updating column i. The tiles on its left/top (right/bottom) are
+ * done by the previous launch, so every pixel sees its already-updated neighbours exactly as
+ * in a serial raster sweep.
+ *
+ * reverse = 0: sweep from top left, reverse = 1: sweep from bottom right.
+ */
+__kernel void sweep_wavefront(
+	__global const real_t* alpha0, int alpha0_step, int alpha0_offset,
+	__global const real_t* alpha1, int alpha1_step, int alpha1_offset,
+	__global const real_t* I0x, int I0x_step, int I0x_offset,
+	__global const real_t* I0y, int I0y_step, int I0y_offset,
+	__global const real_t* I1x, int I1x_step, int I1x_offset,
+	__global const real_t* I1y, int I1y_step, int I1y_offset,
+	__global const real2_t* blurred, int blurred_step, int blurred_offset,
+	__global real2_t* flow, int flow_step, int flow_offset, int flow_rows, int flow_cols,
+	int tile_diagonal, int tile_start, int reverse)
+{
+	int i = get_local_id(0);
+	int tx = tile_start + get_group_id(0);
+	int ty = tile_diagonal - tx;
+	int rx = mad24(tx, SWEEP_TILE, i);
+	int d = reverse ? -1 : 1;
+	int x = reverse ? flow_cols - 1 - rx : rx;
+
+	for (int s = 0; s < 2*SWEEP_TILE - 1; ++s) {
+		int j = s - i;
+		int ry = mad24(ty, SWEEP_TILE, j);
+		if (0 <= j && j < SWEEP_TILE && rx < flow_cols && ry < flow_rows) {
+			wavefront_update(
+				alpha0, alpha0_step, alpha0_offset,
+				alpha1, alpha1_step, alpha1_offset,
+				I0x, I0x_step, I0x_offset,
+				I0y, I0y_step, I0y_offset,
+				I1x, I1x_step, I1x_offset,
+				I1y, I1y_step, I1y_offset,
+				blurred, blurred_step, blurred_offset,
+				flow, flow_step, flow_offset, flow_rows, flow_cols,
+				x, reverse ? flow_rows - 1 - ry : ry, d);
+		}
+		// the next inner anti-diagonal reads what this one wrote
+		barrier(CLK_GLOBAL_MEM_FENCE);
+	}
+}
+
+
+/**
+ * @brief 5x5 median of each flow component, the border is replicated as in cv::medianBlur
+ *
+ * cv::medianBlur can't filter the fp16 storage, it would sort the raw bits.
+ */
+__kernel void median_blur5_32FC2(
+	__global const real2_t* src, int src_step, int src_offset, int src_rows, int src_cols,
+	__global real2_t* dst, int dst_step, int dst_offset)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < src_cols && y < src_rows) {
+		float u[25];
+		float v[25];
+		int n = 0;
+		for (int dy = -2; dy <= 2; ++dy) {
+			int sy = min(max(y + dy, 0), src_rows - 1);
+			for (int dx = -2; dx <= 2; ++dx) {
+				int sx = min(max(x + dx, 0), src_cols - 1);
+				float2 f = rreal2(src, sx, sy);
+				u[n] = f.x;
+				v[n] = f.y;
+				++n;
+			}
+		}
+		// selection sort up to the middle element
+		for (int i = 0; i <= 12; ++i) {
+			for (int j = i + 1; j < 25; ++j) {
+				float a = u[i];
+				float b = u[j];
+				u[i] = min(a, b);
+				u[j] = max(a, b);
+				a = v[i];
+				b = v[j];
+				v[i] = min(a, b);
+				v[j] = max(a, b);
+			}
+		}
+		wreal2(dst, x, y, (float2)(u[12], v[12]));
+	}
+}
@@ -0,0 +1,102 @@
+/**
+ * @brief the following macros are used for accessing img(x, y)
+ */
+#define rmat32fc1(addr, x, y)   ((__global const float*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))[x]
+
+#define rmat(addr, x, y) 	rmat32fc1(addr, x, y)
+
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
+// work-group size of the reductions, must match the host side
+#define REDUCE_SIZE		256
+
+
+/**
+ * @brief tree reduction of the (lhs, rhs) sums of a work-group in local memory
+ */
+inline float2 group_sum(__local float2* sums, float2 value)
+{
+	int lid = get_local_id(0);
+	sums[lid] = value;
+	barrier(CLK_LOCAL_MEM_FENCE);
+	for (int n = REDUCE_SIZE >> 1; n > 0; n >>= 1) {
+		if (lid < n) {
+			sums[lid] += sums[lid + n];
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+	return sums[0];
+}
+
+
+/**
+ * @brief partial sums of alpha*lhs and alpha*rhs, where alpha = lhs_alpha*rhs_alpha
+ *
+ * 1-D NDRange of REDUCE_SIZE work-groups, every work-item strides over the image
+ * and every work-group writes its (lhs, rhs) sums to partial[group id].
+ */
+__kernel void intensity_sums_32FC1(
+	__global const real_t* lhs, int lhs_step, int lhs_offset, int rows, int cols,
+	__global const real_t* lhs_alpha, int lhs_alpha_step, int lhs_alpha_offset,
+	__global const real_t* rhs, int rhs_step, int rhs_offset,
+	__global const real_t* rhs_alpha, int rhs_alpha_step, int rhs_alpha_offset,
+	__global float2* partial)
+{
+	__local float2 sums[REDUCE_SIZE];
+
+	float2 sum = (float2)(0.0f, 0.0f);
+	int total = mul24(rows, cols);
+	for (int i = get_global_id(0); i < total; i += get_global_size(0)) {
+		int x = i % cols;
+		int y = i / cols;
+		float alpha = rreal(lhs_alpha, x, y)*rreal(rhs_alpha, x, y);
+		sum += alpha*(float2)(rreal(lhs, x, y), rreal(rhs, x, y));
+	}
+	sum = group_sum(sums, sum);
+	if (get_local_id(0) == 0) {
+		partial[get_group_id(0)] = sum;
+	}
+}
+
+
+/**
+ * @brief ratio[0] = sum of lhs/sum of rhs over the partial sums
+ *
+ * A single work-group of REDUCE_SIZE work-items.
+ */
+__kernel void intensity_ratio(
+	__global const float2* partial, int count,
+	__global float* ratio)
+{
+	__local float2 sums[REDUCE_SIZE];
+
+	float2 sum = (float2)(0.0f, 0.0f);
+	for (int i = get_local_id(0); i < count; i += REDUCE_SIZE) {
+		sum += partial[i];
+	}
+	sum = group_sum(sums, sum);
+	if (get_local_id(0) == 0) {
+		ratio[0] = sum.x/sum.y;
+	}
+}
@@ -17,6 +17,29 @@
 #define wmat2(addr, x, y) 	wmat32fc1(addr, x, y)
 #define wmat2(addr, x, y) 	wmat32fc2(addr, x, y)
 
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
 
 float4 get_bicubic_8uc4(float4 p0, float4 p1, float4 p2, float4 p3, float x)
 {
@@ -77,8 +100,8 @@ float2 get_bicubic_32fc2(float2 p0, float2 p1, float2 p2, float2 p3, float x)
 	return p0*w0 + p1*w1 + p2*w2 + p3*w3;
 }
 __kernel void remap_32FC2_32FC2(
-	__global const float2* src, int src_step, int src_offset, int src_rows, int src_cols,
-	__global float2* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real2_t* src, int src_step, int src_offset, int src_rows, int src_cols,
+	__global real2_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	__global const float2* map, int map_step, int map_offset)
 {
 	int x = get_global_id(0);
@@ -96,14 +119,14 @@ __kernel void remap_32FC2_32FC2(
 			if (y0 + dy < 0 || y0 + dy >= src_rows) {
 				v[dy+1] = (float2)(0.0f, 0.0f);
 			} else {
-				u[0] = (0 <= x0 - 1 && x0 - 1 < src_cols) ? rmat2(src, x0 - 1, y0 + dy) : (float2)(0.0f, 0.0f);
-				u[1] = (0 <= x0     && x0     < src_cols) ? rmat2(src, x0 	, y0 + dy) : (float2)(0.0f, 0.0f);
-				u[2] = (0 <= x0 + 1 && x0 + 1 < src_cols) ? rmat2(src, x0 + 1, y0 + dy) : (float2)(0.0f, 0.0f);
-				u[3] = (0 <= x0 + 2 && x0 + 2 < src_cols) ? rmat2(src, x0 + 2, y0 + dy) : (float2)(0.0f, 0.0f);
+				u[0] = (0 <= x0 - 1 && x0 - 1 < src_cols) ? rreal2(src, x0 - 1, y0 + dy) : (float2)(0.0f, 0.0f);
+				u[1] = (0 <= x0     && x0     < src_cols) ? rreal2(src, x0 	, y0 + dy) : (float2)(0.0f, 0.0f);
+				u[2] = (0 <= x0 + 1 && x0 + 1 < src_cols) ? rreal2(src, x0 + 1, y0 + dy) : (float2)(0.0f, 0.0f);
+				u[3] = (0 <= x0 + 2 && x0 + 2 < src_cols) ? rreal2(src, x0 + 2, y0 + dy) : (float2)(0.0f, 0.0f);
 				v[dy+1] = get_bicubic_32fc2(u[0], u[1], u[2], u[3], xR);
 			}				
 		}
-		wmat2(dst, x, y) = get_bicubic_32fc2(v[0], v[1], v[2], v[3], yR);;
+		wreal2(dst, x, y, get_bicubic_32fc2(v[0], v[1], v[2], v[3], yR));
 	}
 }
 
@@ -206,3 +229,119 @@ __kernel void cubic_remap_8UC3_32FC1(
 
 
 
+
+
+//
+// @added: the projection of all cameras of a rig in one launch
+//
+
+// src(x, y) of a CV_8UC3 (cn = 3, alpha 0) or CV_8UC4 image, as float4
+float4 read_8uc(__global const uchar* src, int src_step, int src_offset, int cn, int x, int y)
+{
+	__global const uchar* p = src + mad24(y, src_step, src_offset) + x*cn;
+	return cn == 3 ? (float4)(p[0], p[1], p[2], 0.0f) : convert_float4(vload4(0, p));
+}
+
+// as cubic_remap_8UC4_32FC1/cubic_remap_8UC3_32FC1 sample src at src_pos
+uchar4 cubic_sample_8uc(
+	__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols, int cn,
+	float2 src_pos)
+{
+	int x0 = convert_int_rtz(src_pos.x);
+	int y0 = convert_int_rtz(src_pos.y);
+	float xR = src_pos.x - x0;
+	float yR = src_pos.y - y0;
+
+	float4 u[4];
+	float4 v[4];
+	for (int dy=-1; dy < 3; ++dy) {
+		if (y0 + dy < 0 || y0 + dy >= src_rows) {
+			v[dy+1] = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+		} else {
+			for (int dx=-1; dx < 3; ++dx) {
+				u[dx+1] = (0 <= x0 + dx && x0 + dx < src_cols) ?
+					read_8uc(src, src_step, src_offset, cn, x0 + dx, y0 + dy) : (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+			}
+			v[dy+1] = get_bicubic_8uc4(u[0], u[1], u[2], u[3], xR);
+		}
+	}
+	return convert_uchar4_sat(get_bicubic_8uc4(v[0], v[1], v[2], v[3], yR));
+}
+
+/*
+Camera c = cam0 + get_global_id(2) is described by the ints table[c*8 .. c*8 + 7]:
+	src_offset, src_step, src_rows, src_cols	its image in src
+	row, rows, cols								its rows [row, row + rows) of map and dst, cols columns wide
+map holds the (x, y) maps of the cameras stacked vertically, dst gets the CV_8UC4 projections
+stacked the same way (alpha 255 for CV_8UC3 images, as cvtColor(COLOR_BGR2BGRA)).
+*/
+__kernel void batch_cubic_remap(
+	__global const uchar* src,
+	__global uchar4* dst, int dst_step, int dst_offset,
+	__global const float2* map, int map_step, int map_offset,
+	__global const int* table, int cam0, int cn)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	__global const int* d = table + (cam0 + (int)get_global_id(2))*8;
+	if (x < d[6] && y < d[5]) {
+		int row = d[4] + y;
+		uchar4 result = cubic_sample_8uc(src, d[1], d[0], d[2], d[3], cn, rmat2(map, x, row));
+		if (cn == 3) {
+			result.s3 = 255;
+		}
+		wmat8uc4(dst, x, row) = result;
+	}
+}
+
+
+
+//
+// @added: the projection with the maps compiled by oclCompileProjectionMaps()
+//
+
+#define rmat16uc3(addr, x, y) 	vload3((x), (__global const ushort*)(((__global const uchar*)addr) + addr##_offset + (y)*addr##_step))
+
+/*
+map(x, y) is the source position p in fixed point, q = (p + 3)*2^frac_bits rounded (positions outside
+[-3, size + 2] sample zeros only and are clamped), stored as the integer parts of q.x and q.y and
+their fractions in the high and low byte of the third channel (frac_bits <= 8).
+As convert_int_rtz() in cubic_remap_8UC4_32FC1 the integer part of p is truncated toward zero,
+so the fraction f has the sign of p and its bicubic weights (get_bicubic_8uc4()) are weights[f + 2^frac_bits].
+*/
+__kernel void fixed_cubic_remap(
+	__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols,
+	__global uchar4* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const ushort* map, int map_step, int map_offset,
+	__constant float4* weights, int frac_bits, int cn)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < dst_cols && y < dst_rows) {
+		int3 m = convert_int3(rmat16uc3(map, x, y));
+		int2 p = ((int2)(m.x, m.y) << frac_bits | (int2)(m.z >> 8, m.z & 0xff)) - (int2)(3 << frac_bits);
+		int2 p0 = select(p >> frac_bits, -((-p) >> frac_bits), p < 0);
+		int2 f = p - (p0 << frac_bits) + (int2)(1 << frac_bits);
+		float4 wx = weights[f.x];
+		float4 wy = weights[f.y];
+
+		float4 u[4];
+		float4 v[4];
+		for (int dy=-1; dy < 3; ++dy) {
+			if (p0.y + dy < 0 || p0.y + dy >= src_rows) {
+				v[dy+1] = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+			} else {
+				for (int dx=-1; dx < 3; ++dx) {
+					u[dx+1] = (0 <= p0.x + dx && p0.x + dx < src_cols) ?
+						read_8uc(src, src_step, src_offset, cn, p0.x + dx, p0.y + dy) : (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+				}
+				v[dy+1] = u[0]*wx.s0 + u[1]*wx.s1 + u[2]*wx.s2 + u[3]*wx.s3;
+			}
+		}
+		uchar4 result = convert_uchar4_sat(v[0]*wy.s0 + v[1]*wy.s1 + v[2]*wy.s2 + v[3]*wy.s3);
+		if (cn == 3) {
+			result.s3 = 255;
+		}
+		wmat8uc4(dst, x, y) = result;
+	}
+}
@@ -13,6 +13,29 @@
 #define wmat(addr, x, y) 	wmat32fc1(addr, x, y)
 #define wmat2(addr, x, y) 	wmat32fc2(addr, x, y)
 
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
 /**
  * @reference: opencv cpu implementation and https://en.wikipedia.org/wiki/Bicubic_interpolation
  */
@@ -28,8 +51,8 @@ float get_bicubic_32fc1(float p0, float p1, float p2, float p3, float x)
 }
 
 __kernel void resize_32FC1(
-	__global const float* src, int src_step, int src_offset, int src_rows, int src_cols, 
-	__global float* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	float factor_x, float factor_y)
 {
 	int dst_x = get_global_id(0);
@@ -49,14 +72,14 @@ __kernel void resize_32FC1(
 		float v[4];
 		
 		for (int dy=-1; dy < 3; ++dy) {
-			u[0] = rmat(src, min(max(x0 - 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
-			u[1] = rmat(src, min(max(x0,     0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));	
-			u[2] = rmat(src, min(max(x0 + 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
-			u[3] = rmat(src, min(max(x0 + 2, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
+			u[0] = rreal(src, min(max(x0 - 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
+			u[1] = rreal(src, min(max(x0,     0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));	
+			u[2] = rreal(src, min(max(x0 + 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
+			u[3] = rreal(src, min(max(x0 + 2, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
 			v[dy+1] = get_bicubic_32fc1(u[0], u[1], u[2], u[3], xR);
 		}
 		
-		wmat(dst, dst_x, dst_y) = get_bicubic_32fc1(v[0], v[1], v[2], v[3], yR);
+		wreal(dst, dst_x, dst_y, get_bicubic_32fc1(v[0], v[1], v[2], v[3], yR));
 	}
 }
 
@@ -73,8 +96,8 @@ float2 get_bicubic_32fc2(float2 p0, float2 p1, float2 p2, float2 p3, float x)
 }
 
 __kernel void resize_32FC2(
-	__global const float2* src, int src_step, int src_offset, int src_rows, int src_cols, 
-	__global float2* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real2_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real2_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	float factor_x, float factor_y)
 {
 	int dst_x = get_global_id(0);
@@ -94,14 +117,14 @@ __kernel void resize_32FC2(
 		float2 v[4];
 		
 		for (int dy=-1; dy < 3; ++dy) {
-			u[0] = rmat2(src, min(max(x0 - 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
-			u[1] = rmat2(src, min(max(x0,     0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));	
-			u[2] = rmat2(src, min(max(x0 + 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
-			u[3] = rmat2(src, min(max(x0 + 2, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
+			u[0] = rreal2(src, min(max(x0 - 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
+			u[1] = rreal2(src, min(max(x0,     0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));	
+			u[2] = rreal2(src, min(max(x0 + 1, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
+			u[3] = rreal2(src, min(max(x0 + 2, 0), src_cols-1), 	min(max(0, y0 + dy), src_rows - 1));
 			v[dy+1] = get_bicubic_32fc2(u[0], u[1], u[2], u[3], xR);
 		}
 		
-		wmat2(dst, dst_x, dst_y) = get_bicubic_32fc2(v[0], v[1], v[2], v[3], yR);
+		wreal2(dst, dst_x, dst_y, get_bicubic_32fc2(v[0], v[1], v[2], v[3], yR));
 	}
 }
 
@@ -155,4 +178,58 @@ __kernel void resize_8UC4(
 		//wmat8uc4(dst, dst_x, dst_y) = (uchar4)(convert_uchar_sat(s.x), convert_uchar_sat(s.y), convert_uchar_sat(s.z), convert_uchar_sat(s.w));
 		wmat8uc4(dst, dst_x, dst_y) = convert_uchar4_sat(get_bicubic_8uc4(v[0], v[1], v[2], v[3], yR));
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * @brief bilinear resize with the pixel centers of cv::resize(..., INTER_LINEAR)
+ *
+ * Used for the pyramids in the fp16 storage mode, where cv::resize would interpolate the raw bits.
+ */
+__kernel void resize_linear_32FC1(
+	__global const real_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	float factor_x, float factor_y)
+{
+	int dst_x = get_global_id(0);
+	int dst_y = get_global_id(1);
+	if (dst_x < dst_cols && dst_y < dst_rows) {
+		float src_x = (dst_x + 0.5f)*factor_x - 0.5f;
+		float src_y = (dst_y + 0.5f)*factor_y - 0.5f;
+		int x0 = convert_int_rtn(src_x);
+		int y0 = convert_int_rtn(src_y);
+		float xR = src_x - x0;
+		float yR = src_y - y0;
+		// clamping both taps is the same as the border handling of cv::resize
+		int x1 = min(max(x0 + 1, 0), src_cols - 1);
+		int y1 = min(max(y0 + 1, 0), src_rows - 1);
+		x0 = min(max(x0, 0), src_cols - 1);
+		y0 = min(max(y0, 0), src_rows - 1);
+		float v0 = rreal(src, x0, y0) + (rreal(src, x1, y0) - rreal(src, x0, y0))*xR;
+		float v1 = rreal(src, x0, y1) + (rreal(src, x1, y1) - rreal(src, x0, y1))*xR;
+		wreal(dst, dst_x, dst_y, v0 + (v1 - v0)*yR);
+	}
+}
+
+__kernel void resize_linear_32FC2(
+	__global const real2_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real2_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	float factor_x, float factor_y)
+{
+	int dst_x = get_global_id(0);
+	int dst_y = get_global_id(1);
+	if (dst_x < dst_cols && dst_y < dst_rows) {
+		float src_x = (dst_x + 0.5f)*factor_x - 0.5f;
+		float src_y = (dst_y + 0.5f)*factor_y - 0.5f;
+		int x0 = convert_int_rtn(src_x);
+		int y0 = convert_int_rtn(src_y);
+		float xR = src_x - x0;
+		float yR = src_y - y0;
+		int x1 = min(max(x0 + 1, 0), src_cols - 1);
+		int y1 = min(max(y0 + 1, 0), src_rows - 1);
+		x0 = min(max(x0, 0), src_cols - 1);
+		y0 = min(max(y0, 0), src_rows - 1);
+		float2 v0 = rreal2(src, x0, y0) + (rreal2(src, x1, y0) - rreal2(src, x0, y0))*xR;
+		float2 v1 = rreal2(src, x0, y1) + (rreal2(src, x1, y1) - rreal2(src, x0, y1))*xR;
+		wreal2(dst, dst_x, dst_y, v0 + (v1 - v0)*yR);
+	}
+}
@@ -15,30 +15,53 @@
 #define wmat2(addr, x, y) 	wmat32fc2(addr, x, y)
 #define wmat4(addr, x, y) 	wmat32fc4(addr, x, y)
 
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
 /**
  * @brief float umat scaling 
  */
 __kernel void scale_32FC1(
-	__global const float* src, int src_step, int src_offset, int src_rows, int src_cols, 
-	__global float* dst, int dst_step, int dst_offset,
+	__global const real_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real_t* dst, int dst_step, int dst_offset,
 	float factor)
 {
 	int x = get_global_id(0);
     int y = get_global_id(1);
 	if (x < src_cols && y < src_rows) {
-		wmat(dst, x, y) = factor * rmat(src, x, y);
+		wreal(dst, x, y, factor * rreal(src, x, y));
 	}
 	
 }
 __kernel void scale_32FC2(
-	__global const float2* src, int src_step, int src_offset, int src_rows, int src_cols,
-	__global float2* dst, int dst_step, int dst_offset,
+	__global const real2_t* src, int src_step, int src_offset, int src_rows, int src_cols,
+	__global real2_t* dst, int dst_step, int dst_offset,
 	float factor)
 {
 	int x = get_global_id(0);
     int y = get_global_id(1);
 	if (x < src_cols && y < src_rows) {
-		wmat2(dst, x, y) = factor * rmat2(src, x, y);
+		wreal2(dst, x, y, factor * rreal2(src, x, y));
 	}
 }
 __kernel void scale_32FC4(
@@ -58,24 +81,24 @@ __kernel void scale_32FC4(
  * @brief float umat scaling self
  */
 __kernel void scale_self_32FC1(
-	__global float* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
 	float factor)
 {
 	int x = get_global_id(0);
     int y = get_global_id(1);
 	if (x < src_cols && y < src_rows) {
-		wmat(src, x, y) *= factor;
+		wreal(src, x, y, rreal(src, x, y) * factor);
 	}
 	
 }
 __kernel void scale_self_32FC2(
-	__global float2* src, int src_step, int src_offset, int src_rows, int src_cols,
+	__global real2_t* src, int src_step, int src_offset, int src_rows, int src_cols,
 	float factor)
 {
 	int x = get_global_id(0);
     int y = get_global_id(1);
 	if (x < src_cols && y < src_rows) {
-		wmat2(src, x, y) *= factor;
+		wreal2(src, x, y, rreal2(src, x, y) * factor);
 	}
 }
 __kernel void scale_self_32FC4(
@@ -88,3 +111,35 @@ __kernel void scale_self_32FC4(
 		wmat4(src, x, y) *= factor;
 	}
 }
+
+
+/**
+ * @brief float umat scaling by a factor kept on the device, e.g. the result of intensity_ratio
+ */
+__kernel void scale_by_32FC1(
+	__global const real_t* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real_t* dst, int dst_step, int dst_offset,
+	__global const float* factor)
+{
+	int x = get_global_id(0);
+    int y = get_global_id(1);
+	if (x < src_cols && y < src_rows) {
+		wreal(dst, x, y, factor[0] * rreal(src, x, y));
+	}
+}
+
+
+/**
+ * @brief 8-bit to float conversion and scaling in one pass: dst = factor * src
+ */
+__kernel void convert_8UC1(
+	__global const uchar* src, int src_step, int src_offset, int src_rows, int src_cols, 
+	__global real_t* dst, int dst_step, int dst_offset,
+	float factor)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	if (x < src_cols && y < src_rows) {
+		wreal(dst, x, y, factor * (float)src[mad24(src_step, y, src_offset) + x]);
+	}
+}
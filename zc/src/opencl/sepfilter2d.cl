@@ -14,6 +14,29 @@
 #define wmat(addr, x, y) 		wmat32fc1(addr, x, y)
 #define wmat2(addr, x, y) 	wmat32fc2(addr, x, y)
 
+/**
+ * @brief storage of the flow, pyramid and gradient images
+ *
+ * With -D STORAGE_HALF they are fp16 in memory (CV_16SC1/CV_16SC2 UMats on the host),
+ * otherwise fp32. Values are always loaded to and computed in fp32.
+ * Pointers to half are allowed without cl_khr_fp16, so pairs are accessed by vload_half2/vstore_half2.
+ */
+#ifdef STORAGE_HALF
+#define real_t 		half
+#define real2_t 	half
+#define rreal(addr, x, y) 		vload_half((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define rreal2(addr, x, y) 		vload_half2((x), (__global const half*)(((__global const uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal(addr, x, y, v) 	vstore_half((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#define wreal2(addr, x, y, v) 	vstore_half2((v), (x), (__global half*)(((__global uchar*)addr) + mad24(addr##_step, (y), addr##_offset)))
+#else
+#define real_t 		float
+#define real2_t 	float2
+#define rreal(addr, x, y) 		rmat32fc1(addr, x, y)
+#define rreal2(addr, x, y) 		rmat32fc2(addr, x, y)
+#define wreal(addr, x, y, v) 	(wmat32fc1(addr, x, y) = (v))
+#define wreal2(addr, x, y, v) 	(wmat32fc2(addr, x, y) = (v))
+#endif
+
 #ifdef BORDER_REPLICATE
 // BORDER_REPLICATE: aaaaaa|abcdefgh|hhhhhhh
 #define EXTRAPOLATE(i, m)	 (i) < 0 ? 0 : ((i) > (m) ? (m) : (i))
@@ -31,8 +54,8 @@ __constant float kernel_y[] = { KERNEL_Y_DATA };
 
 
 __kernel void filter_row_32FC1(
-	__global const float* src, int src_step, int src_offset,
-	__global float* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real_t* src, int src_step, int src_offset,
+	__global real_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	int col_kernel_size)
 {
 	int x = get_global_id(0);
@@ -41,15 +64,15 @@ __kernel void filter_row_32FC1(
 		float sum = 0;
 		for (int dx=-col_kernel_size/2; dx <= col_kernel_size/2; ++dx) {
 			int src_x = EXTRAPOLATE(x + dx, dst_cols - 1);
-			sum += rmat(src, src_x, y)*kernel_x[dx+col_kernel_size/2];
+			sum += rreal(src, src_x, y)*kernel_x[dx+col_kernel_size/2];
 		}
-		wmat(dst, x, y) = sum;
+		wreal(dst, x, y, sum);
 	}
 }
 
 __kernel void filter_col_32FC1(
-	__global const float* src, int src_step, int src_offset,
-	__global float* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real_t* src, int src_step, int src_offset,
+	__global real_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	int row_kernel_size)
 {
 	int x = get_global_id(0);
@@ -58,15 +81,15 @@ __kernel void filter_col_32FC1(
 		float sum = 0;
 		for (int dy=-row_kernel_size/2; dy <= row_kernel_size/2; ++dy) {
 			int src_y = EXTRAPOLATE(y + dy, dst_rows - 1);
-			sum += rmat(src, x, src_y)*kernel_y[dy+row_kernel_size/2];
+			sum += rreal(src, x, src_y)*kernel_y[dy+row_kernel_size/2];
 		}
-		wmat(dst, x, y) = sum;
+		wreal(dst, x, y, sum);
 	}
 }
 
 __kernel void filter_row_32FC2(
-	__global const float2* src, int src_step, int src_offset,
-	__global float2* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real2_t* src, int src_step, int src_offset,
+	__global real2_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	int col_kernel_size)
 {
 	int x = get_global_id(0);
@@ -75,15 +98,15 @@ __kernel void filter_row_32FC2(
 		float2 sum = (float2)(0.0f, 0.0f);
 		for (int dx=-col_kernel_size/2; dx <= col_kernel_size/2; ++dx) {
 			int src_x = EXTRAPOLATE(x + dx, dst_cols - 1);
-			sum += rmat2(src, src_x, y)*kernel_x[dx+col_kernel_size/2];
+			sum += rreal2(src, src_x, y)*kernel_x[dx+col_kernel_size/2];
 		}
-		wmat2(dst, x, y) = sum;
+		wreal2(dst, x, y, sum);
 	}
 }
 
 __kernel void filter_col_32FC2(
-	__global const float2* src, int src_step, int src_offset,
-	__global float2* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real2_t* src, int src_step, int src_offset,
+	__global real2_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	int row_kernel_size)
 {
 	int x = get_global_id(0);
@@ -92,9 +115,9 @@ __kernel void filter_col_32FC2(
 		float2 sum = (float2)(0.0f, 0.0f);
 		for (int dy=-row_kernel_size/2; dy <= row_kernel_size/2; ++dy) {
 			int src_y = EXTRAPOLATE(y + dy, dst_rows - 1);
-			sum += rmat2(src, x, src_y)*kernel_y[dy+row_kernel_size/2];
+			sum += rreal2(src, x, src_y)*kernel_y[dy+row_kernel_size/2];
 		}
-		wmat2(dst, x, y) = sum;
+		wreal2(dst, x, y, sum);
 	}
 }
 
@@ -141,8 +164,8 @@ __kernel void filter_col_8UC4(
 #define MAX_LOCAL_COLS 32
 
 __kernel void filter_row_v2_32FC1(
-	__global const float* src, int src_step, int src_offset,
-	__global float* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real_t* src, int src_step, int src_offset,
+	__global real_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	int col_kernel_size)
 {
 	int x = get_global_id(0);
@@ -162,12 +185,12 @@ __kernel void filter_row_v2_32FC1(
 			group_size = dst_cols - group_start;
 		}
 		
-		ls[ly][lx + radus] = rmat(src, x, y);
+		ls[ly][lx + radus] = rreal(src, x, y);
 		if (lx < radus) {
 			int x1 = EXTRAPOLATE(x - radus, dst_cols - 1);
 			int x2 = EXTRAPOLATE(x + group_size, dst_cols - 1);
-			ls[ly][lx] = rmat(src, x1, y);
-			ls[ly][lx + group_size + radus] = rmat(src, x2, y);
+			ls[ly][lx] = rreal(src, x1, y);
+			ls[ly][lx + group_size + radus] = rreal(src, x2, y);
 		}
 	}
 	
@@ -178,13 +201,13 @@ __kernel void filter_row_v2_32FC1(
 		for (int k = 0; k < col_kernel_size; ++k) {
 			sum += kernel_x[k]*ls[ly][lx + k];
 		}
-		wmat(dst, x, y) = sum;
+		wreal(dst, x, y, sum);
 	}
 }
 
 __kernel void filter_col_v2_32FC1(
-	__global const float* src, int src_step, int src_offset,
-	__global float* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	__global const real_t* src, int src_step, int src_offset,
+	__global real_t* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
 	int col_kernel_size)
 {
 	int x = get_global_id(0);
@@ -204,12 +227,12 @@ __kernel void filter_col_v2_32FC1(
 			group_size = dst_rows - group_start;
 		}
 		
-		ls[ly + radus ][lx] = rmat(src, x, y);
+		ls[ly + radus ][lx] = rreal(src, x, y);
 		if (ly < radus) {
 			int y1 = EXTRAPOLATE(y - radus, dst_rows - 1);
 			int y2 = EXTRAPOLATE(y + group_size, dst_rows - 1);
-			ls[ly][lx] = rmat(src, x, y1);
-			ls[ly + group_size + radus][lx] = rmat(src, x, y2);
+			ls[ly][lx] = rreal(src, x, y1);
+			ls[ly + group_size + radus][lx] = rreal(src, x, y2);
 		}
 	}
 	
@@ -220,7 +243,7 @@ __kernel void filter_col_v2_32FC1(
 		for (int k = 0; k < col_kernel_size; ++k) {
 			sum += kernel_y[k]*ls[ly + k][lx];
 		}
-		wmat(dst, x, y) = sum;
+		wreal(dst, x, y, sum);
 	}
 }
 
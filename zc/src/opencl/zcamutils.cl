@@ -93,3 +93,123 @@ __kernel void remove_chunk_line(
 }
 
 
+
+
+
+//
+// @added: remove_chunk_line, oclSharpImage(), smooth_image and offset_horizontal_wrap in one pass
+//
+
+#ifdef KERNEL_X_DATA
+#define DIG(a) a,
+__constant float kernel_x[] = { KERNEL_X_DATA };
+__constant float kernel_y[] = { KERNEL_Y_DATA };
+
+#define POST_TILE 		16
+#define POST_TILE_EXT 	(POST_TILE + 2)
+
+// BORDER_REFLECT_101 as oclGaussianBlur()
+#define REFLECT_101(i, m)	((i) < 0 ? -(i) : ((i) > (m) ? ((m)<<1)-(i) : (i)))
+
+/*
+The work-group renders a POST_TILE x POST_TILE tile of the source pano (with a 1 pixel halo in local memory):
+	src = pano with the last column of every chunk_cols wide chunk replaced by the column before (chunk_cols > 0)
+	cur = sharp_factor != 0 ? src*(1 + sharp_factor) - gaussian3x3(src)*sharp_factor : src
+	cur = smooth_image(cur, previous) if thresh_hold > 0
+	dst((x + offset) % dst_cols, y) = cur
+previous is in dst coordinates (the previous result), each item reads previous before writing dst,
+so dst may be previous.
+Must be launched with a POST_TILE x POST_TILE local size.
+*/
+__kernel void post_process(
+	__global const uchar4* pano, int pano_step, int pano_offset,
+	__global const uchar4* previous, int previous_step, int previous_offset,
+	__global uchar4* dst, int dst_step, int dst_offset, int dst_rows, int dst_cols,
+	int chunk_cols, float sharp_factor, float thresh_hold, int is_pano, int offset)
+{
+	__local uchar4 tile[POST_TILE_EXT][POST_TILE_EXT];
+	__local uchar4 rows[POST_TILE_EXT][POST_TILE];
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int x0 = get_group_id(0)*POST_TILE - 1;
+	int y0 = get_group_id(1)*POST_TILE - 1;
+
+	// the tile with its halo, border and chunk lines resolved
+	for (int i = mad24(ly, POST_TILE, lx); i < POST_TILE_EXT*POST_TILE_EXT; i += POST_TILE*POST_TILE) {
+		int tx = i % POST_TILE_EXT;
+		int ty = i / POST_TILE_EXT;
+		int sx = min(REFLECT_101(x0 + tx, dst_cols - 1), dst_cols - 1);
+		int sy = min(REFLECT_101(y0 + ty, dst_rows - 1), dst_rows - 1);
+		if (chunk_cols > 1 && sx % chunk_cols == chunk_cols - 1) {
+			sx -= 1;
+		}
+		tile[ty][tx] = rmat8uc4(pano, sx, sy);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// row pass of the 3x3 gaussian as filter_row_8UC4
+	if (sharp_factor != 0.0f) {
+		for (int i = mad24(ly, POST_TILE, lx); i < POST_TILE_EXT*POST_TILE; i += POST_TILE*POST_TILE) {
+			int tx = i % POST_TILE;
+			int ty = i / POST_TILE;
+			float4 sum = convert_float4(tile[ty][tx])*kernel_x[0]
+				+ convert_float4(tile[ty][tx + 1])*kernel_x[1]
+				+ convert_float4(tile[ty][tx + 2])*kernel_x[2];
+			rows[ty][tx] = convert_uchar4_sat(sum);
+		}
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (x < dst_cols && y < dst_rows) {
+		uchar4 cur = tile[ly + 1][lx + 1];
+		if (sharp_factor != 0.0f) {
+			// col pass as filter_col_8UC4, then addWeighted(cur, 1 + sharp_factor, blured, -sharp_factor, 0)
+			float4 sum = convert_float4(rows[ly][lx])*kernel_y[0]
+				+ convert_float4(rows[ly + 1][lx])*kernel_y[1]
+				+ convert_float4(rows[ly + 2][lx])*kernel_y[2];
+			float4 blured = convert_float4(convert_uchar4_sat(sum));
+			cur = convert_uchar4_sat_rte(convert_float4(cur)*(1.0f + sharp_factor) - blured*sharp_factor);
+		}
+
+		int dx = x + offset;
+		dx = dx < dst_cols ? dx : dx - dst_cols;
+		if (thresh_hold > 0.0f) {
+			// as smooth_image
+			uchar4 pre = rmat8uc4(previous, dx, y);
+			float motion = (fabs((float)cur.s0 - (float)pre.s0)
+							+ fabs((float)cur.s1 - (float)pre.s1)
+							+ fabs((float)cur.s2 - (float)pre.s2)) / (255.0f*3.0f);
+
+			const float top_bottom_thresh = 0.3f;
+			float delta;
+			if (y > dst_rows*(1.0f - top_bottom_thresh) && is_pano) {
+				delta = (dst_rows - y) / (dst_rows * top_bottom_thresh);
+			} else if (y < dst_rows*top_bottom_thresh && is_pano) {
+				delta = y / (dst_rows * top_bottom_thresh);
+			} else {
+				delta = 1.01;
+			}
+			if (delta < 1.01) {
+				if (delta < 0.8) {
+					delta = 0.8;
+				}
+				motion *= delta;
+			}
+
+			if (motion < thresh_hold/2) {
+				cur = (uchar4)(pre.s0, pre.s1, pre.s2, cur.s3);
+			} else if (motion < thresh_hold) {
+				float factor = motion / thresh_hold / 2;
+				cur = (uchar4)(convert_uchar_sat(factor*cur.s0 + (1 - factor)*pre.s0),
+							   convert_uchar_sat(factor*cur.s1 + (1 - factor)*pre.s1),
+							   convert_uchar_sat(factor*cur.s2 + (1 - factor)*pre.s2),
+							   cur.s3);
+			}
+		}
+		wmat8uc4(dst, dx, y) = cur;
+	}
+}
+#endif
@@ -1,8 +1,16 @@
+#include <set>
 #include "precomp.hpp"
 #include "opencv2/core/opencl/runtime/opencl_core.hpp"
 #include "opencv2/core/opencl/runtime/opencl_core_wrappers.hpp"
 #include "opencl_kernels_oclrenderpano.hpp"
+#include "kernels.hpp"
+#include "profiler.hpp"
+#include "cpubackend.hpp"
+#include "memplan.hpp"
+#include "opencv2/oclrenderpano/trace.hpp"
 #include "opencv2/oclrenderpano/ocl_optflow.hpp"
+#include "opencv2/oclrenderpano/ocl_novelview.hpp"
+#include "opencv2/oclrenderpano/ocl_coloradjust.hpp"
 #include "opencv2/oclrenderpano.hpp"
 
 namespace cv {
@@ -16,7 +24,7 @@ CV_EXPORTS_W void oclSobleX(const UMat& src, UMat& dst) {
 	UMat s = src;
     dst.create(s.size(), s.type()); 
 	string kernelName = string("sobel_x_1_border_replicate");
-    ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::sobel_oclsrc);
+    OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::sobel_oclsrc);
     k.args(ocl::KernelArg::ReadOnlyNoSize(src), 
         ocl::KernelArg::WriteOnly(dst));
     size_t globalsize[] = {dst.cols, dst.rows};
@@ -29,7 +37,7 @@ CV_EXPORTS_W void oclSobleY(const UMat& src, UMat& dst) {
 	UMat s = src;
 	dst.create(s.size(), s.type());
 	string kernelName = string("sobel_y_1_border_replicate");
-	ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::sobel_oclsrc);
+	OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::sobel_oclsrc);
 	k.args(ocl::KernelArg::ReadOnlyNoSize(src),
 		ocl::KernelArg::WriteOnly(dst));
 	size_t globalsize[] = { dst.cols, dst.rows };
@@ -37,11 +45,21 @@ CV_EXPORTS_W void oclSobleY(const UMat& src, UMat& dst) {
 	k.run(2, globalsize, localsize, false);
 }
 
+// kernel suffix of a float buffer, a CV_16SC1/CV_16SC2 buffer is the fp16 storage of a CV_32FC1/CV_32FC2 one
+static const char* floatTypeStr(const UMat& m) {
+	return m.channels() == 1 ? "_32FC1" : m.channels() == 2 ? "_32FC2" : "_32FC4";
+}
+
+static bool isFloatType(const UMat& m) {
+	return m.depth() == CV_32F || (isHalfStorage(m) && m.channels() <= 2);
+}
+
 // scale operation: dst == src * ration 
 CV_EXPORTS_W void oclScale(const UMat& src, UMat& dst, float factor) {
 	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_32FC4 || src.type() == dst.type());
-    string kernelName = string("scale") + (src.type() == CV_32FC1 ? "_32FC1" : src.type() == CV_32FC2 ? "_32FC2" : "_32FC4");
-    ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::scale_oclsrc);
+	CV_Assert(isFloatType(src));
+    string kernelName = string("scale") + floatTypeStr(src);
+    OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::scale_oclsrc, storageOptions(src));
     k.args(ocl::KernelArg::ReadWrite(src), 
         ocl::KernelArg::ReadWriteNoSize(dst), 
         ocl::KernelArg::Constant(&factor, sizeof(factor)));
@@ -50,11 +68,57 @@ CV_EXPORTS_W void oclScale(const UMat& src, UMat& dst, float factor) {
     k.run(2, globalsize, localsize, false);
 }
 
+// scale operation: dst = src * factor[0], where factor is a 1x1 CV_32FC1 computed on the device
+CV_EXPORTS_W void oclScale(const UMat& src, UMat& dst, const UMat& factor) {
+	CV_Assert((src.type() == CV_32FC1 || src.type() == CV_16SC1) && factor.type() == CV_32FC1 && factor.total() == 1);
+	dst.create(src.size(), src.type());
+	OclKernel& k = oclKernel("scale_by_32FC1", ocl::oclrenderpano::scale_oclsrc, storageOptions(src));
+	k.args(ocl::KernelArg::ReadOnly(src),
+		ocl::KernelArg::WriteOnlyNoSize(dst),
+		ocl::KernelArg::PtrReadOnly(factor));
+	size_t globalsize[] = {src.cols, src.rows};
+	size_t localsize[] = {16, 16};
+	k.run(2, globalsize, localsize, false);
+}
+
+// intensity ratio: ratio = sum(alpha*lhs)/sum(alpha*rhs), alpha = lhsAlpha*rhsAlpha
+// the result stays on the device as a 1x1 CV_32FC1, so the host never waits for it
+CV_EXPORTS_W void oclIntensityRatio(const UMat& lhs, const UMat& lhsAlpha, const UMat& rhs, const UMat& rhsAlpha,
+	UMat& ratio, UMat& sums) {
+	CV_Assert(lhs.type() == CV_32FC1 || lhs.type() == CV_16SC1);
+	CV_Assert(lhsAlpha.type() == lhs.type() && rhs.type() == lhs.type() && rhsAlpha.type() == lhs.type());
+	CV_Assert(lhs.size() == lhsAlpha.size() && lhs.size() == rhs.size() && lhs.size() == rhsAlpha.size());
+	const int kReduceSize = 256;	// REDUCE_SIZE of reduce.cl
+	const int kMaxGroups = 64;
+	int groups = std::min(kMaxGroups, int((lhs.total() + kReduceSize - 1)/kReduceSize));
+	groups = std::max(groups, 1);
+	sums.create(1, kMaxGroups, CV_32FC2);
+	ratio.create(1, 1, CV_32FC1);
+
+	OclKernel& k1 = oclKernel("intensity_sums_32FC1", ocl::oclrenderpano::reduce_oclsrc, storageOptions(lhs));
+	k1.args(ocl::KernelArg::ReadOnly(lhs),
+		ocl::KernelArg::ReadOnlyNoSize(lhsAlpha),
+		ocl::KernelArg::ReadOnlyNoSize(rhs),
+		ocl::KernelArg::ReadOnlyNoSize(rhsAlpha),
+		ocl::KernelArg::PtrWriteOnly(sums));
+	size_t globalsize1[] = {size_t(groups*kReduceSize)};
+	size_t localsize1[] = {size_t(kReduceSize)};
+	k1.run(1, globalsize1, localsize1, false);
+
+	OclKernel& k2 = oclKernel("intensity_ratio", ocl::oclrenderpano::reduce_oclsrc);
+	k2.args(ocl::KernelArg::PtrReadOnly(sums),
+		groups,
+		ocl::KernelArg::PtrWriteOnly(ratio));
+	size_t globalsize2[] = {size_t(kReduceSize)};
+	size_t localsize2[] = {size_t(kReduceSize)};
+	k2.run(1, globalsize2, localsize2, false);
+}
+
 // scale operation: src *= ration 
 CV_EXPORTS_W void oclScale(UMat& src, float factor) {
-	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_32FC4);
-    string kernelName = string("scale_self") + (src.type() == CV_32FC1 ? "_32FC1" : src.type() == CV_32FC2 ? "_32FC2" : "_32FC4");
-    ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::scale_oclsrc);
+	CV_Assert(isFloatType(src));
+    string kernelName = string("scale_self") + floatTypeStr(src);
+    OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::scale_oclsrc, storageOptions(src));
     k.args(ocl::KernelArg::ReadWrite(src), 
         ocl::KernelArg::Constant(&factor, sizeof(factor)));
     size_t globalsize[] = {src.cols, src.rows};
@@ -65,13 +129,13 @@ CV_EXPORTS_W void oclScale(UMat& src, float factor) {
 
 // resize by using bicubic interpolation (https://en.wikipedia.org/wiki/Bicubic_interpolation)
 CV_EXPORTS_W void oclResize(const UMat& src, UMat& dst, Size dsize) {
-    CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_8UC4);
+    CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_16SC1 || src.type() == CV_16SC2 || src.type() == CV_8UC4);
 	UMat s = src;
     dst.create(dsize, s.type()); 
     float factor_x = float(double(s.cols) /double(dst.cols));
     float factor_y = float(double(s.rows) /double(dst.rows));
-    string kernelName = string("resize") + (s.type() == CV_32FC1 ? "_32FC1" : s.type() == CV_32FC2 ? "_32FC2" : "_8UC4");
-    ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::resize_oclsrc);
+    string kernelName = string("resize") + (s.type() == CV_8UC4 ? "_8UC4" : floatTypeStr(s));
+    OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::resize_oclsrc, storageOptions(s));
     k.args(ocl::KernelArg::ReadOnly(s),
         ocl::KernelArg::ReadWrite(dst), 
         ocl::KernelArg::Constant(&factor_x, sizeof(factor_x)),
@@ -82,9 +146,54 @@ CV_EXPORTS_W void oclResize(const UMat& src, UMat& dst, Size dsize) {
 }
 
 
+// bilinear resize, same sampling as cv::resize(..., INTER_LINEAR), which can't handle the fp16 storage
+CV_EXPORTS_W void oclResizeLinear(const UMat& src, UMat& dst, Size dsize) {
+	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_16SC1 || src.type() == CV_16SC2);
+	UMat s = src;
+	dst.create(dsize, s.type());
+	float factor_x = float(double(s.cols) /double(dst.cols));
+	float factor_y = float(double(s.rows) /double(dst.rows));
+	string kernelName = string("resize_linear") + floatTypeStr(s);
+	OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::resize_oclsrc, storageOptions(s));
+	k.args(ocl::KernelArg::ReadOnly(s),
+		ocl::KernelArg::WriteOnly(dst),
+		ocl::KernelArg::Constant(&factor_x, sizeof(factor_x)),
+		ocl::KernelArg::Constant(&factor_y, sizeof(factor_y)));
+	size_t globalsize[] = {dst.cols, dst.rows};
+	size_t localsize[] = {16, 16};
+	k.run(2, globalsize, localsize, false);
+}
+
+// convert operation: dst = src * factor, where src is CV_8UC1 and dst CV_32FC1 or its fp16 storage CV_16SC1
+CV_EXPORTS_W void oclConvert(const UMat& src, UMat& dst, int dtype, float factor) {
+	CV_Assert(src.type() == CV_8UC1 && (dtype == CV_32FC1 || dtype == CV_16SC1));
+	dst.create(src.size(), dtype);
+	OclKernel& k = oclKernel("convert_8UC1", ocl::oclrenderpano::scale_oclsrc, storageOptions(dst));
+	k.args(ocl::KernelArg::ReadOnly(src),
+		ocl::KernelArg::WriteOnlyNoSize(dst),
+		ocl::KernelArg::Constant(&factor, sizeof(factor)));
+	size_t globalsize[] = {src.cols, src.rows};
+	size_t localsize[] = {16, 16};
+	k.run(2, globalsize, localsize, false);
+}
+
+// 5x5 median of a flow, same as cv::medianBlur(src, dst, 5), which can't handle the fp16 storage
+CV_EXPORTS_W void oclMedianBlur5(const UMat& src, UMat& dst) {
+	CV_Assert(src.type() == CV_32FC2 || src.type() == CV_16SC2);
+	CV_Assert(src.u != dst.u);
+	dst.create(src.size(), src.type());
+	OclKernel& k = oclKernel("median_blur5_32FC2", ocl::oclrenderpano::optflow_oclsrc, storageOptions(src));
+	k.args(ocl::KernelArg::ReadOnly(src),
+		ocl::KernelArg::WriteOnlyNoSize(dst));
+	size_t globalsize[] = {src.cols, src.rows};
+	size_t localsize[] = {16, 16};
+	k.run(2, globalsize, localsize, false);
+}
+
+
 // do motion detection vs. previous frame's images
 CV_EXPORTS_W void oclMotionDetection(const UMat& cur, const UMat& pre, UMat& motion) {
-    ocl::Kernel k("motion_detection", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("motion_detection", ocl::oclrenderpano::optflow_oclsrc, storageOptions(motion));
     k.args(ocl::KernelArg::ReadOnly(cur),
         ocl::KernelArg::ReadOnlyNoSize(pre),
         ocl::KernelArg::WriteOnlyNoSize(motion));
@@ -93,7 +202,7 @@ CV_EXPORTS_W void oclMotionDetection(const UMat& cur, const UMat& pre, UMat& mot
     k.run(2, globalsize, localsize, false);
 }
 CV_EXPORTS_W void oclMotionDetectionV2(const UMat& cur, const UMat& pre, UMat& motion) {
-    ocl::Kernel k("motion_detection_v2", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("motion_detection_v2", ocl::oclrenderpano::optflow_oclsrc, storageOptions(motion));
     k.args(ocl::KernelArg::ReadOnly(cur),
         ocl::KernelArg::ReadOnlyNoSize(pre),
         ocl::KernelArg::WriteOnlyNoSize(motion));
@@ -102,9 +211,32 @@ CV_EXPORTS_W void oclMotionDetectionV2(const UMat& cur, const UMat& pre, UMat& m
     k.run(2, globalsize, localsize, false);
 }
 
+// @added: mean motion of each tileSize x tileSize tile of both image pairs, tiles is CV_32FC1
+CV_EXPORTS_W void oclMotionTiles(const UMat& cur0, const UMat& pre0, const UMat& cur1, const UMat& pre1, int tileSize, UMat& tiles) {
+	CV_Assert(cur0.type() == CV_8UC4 && pre0.type() == CV_8UC4 && cur1.type() == CV_8UC4 && pre1.type() == CV_8UC4);
+	CV_Assert(pre0.size() == cur0.size() && cur1.size() == cur0.size() && pre1.size() == cur0.size() && tileSize > 0);
+	tiles.create((cur0.rows + tileSize - 1)/tileSize, (cur0.cols + tileSize - 1)/tileSize, CV_32FC1);
+	if (cpuBackend()) {
+		Mat m = tiles.getMat(ACCESS_WRITE);
+		cpuMotionTiles(cur0.getMat(ACCESS_READ), pre0.getMat(ACCESS_READ),
+			cur1.getMat(ACCESS_READ), pre1.getMat(ACCESS_READ), tileSize, m);
+		return;
+	}
+	OclKernel& k = oclKernel("motion_tiles", ocl::oclrenderpano::optflow_oclsrc);
+	k.args(ocl::KernelArg::ReadOnly(cur0),
+		ocl::KernelArg::ReadOnlyNoSize(pre0),
+		ocl::KernelArg::ReadOnlyNoSize(cur1),
+		ocl::KernelArg::ReadOnlyNoSize(pre1),
+		tileSize,
+		ocl::KernelArg::WriteOnly(tiles));
+	size_t globalsize[] = {size_t(tiles.cols*16), size_t(tiles.rows*16)};
+	size_t localsize[] = {16, 16};
+	k.run(2, globalsize, localsize, false);
+}
+
 // adjust flow toward previous
 CV_EXPORTS_W void oclAdjustFlowTowardPrevious(const UMat& prevFlow, const UMat& motion, UMat& flow) {
-    ocl::Kernel k("adjust_flow_toward_previous", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("adjust_flow_toward_previous", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
     k.args(ocl::KernelArg::ReadWrite(flow),
         ocl::KernelArg::ReadOnlyNoSize(prevFlow),
         ocl::KernelArg::ReadOnlyNoSize(motion));
@@ -113,7 +245,7 @@ CV_EXPORTS_W void oclAdjustFlowTowardPrevious(const UMat& prevFlow, const UMat&
     k.run(2, globalsize, localsize, false);
 }
 CV_EXPORTS_W void oclAdjustFlowTowardPreviousV2(const UMat& prevFlow, const UMat& motion, UMat& flow, float motionThreshhold) {
-    ocl::Kernel k("adjust_flow_toward_previous_v2", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("adjust_flow_toward_previous_v2", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
     k.args(ocl::KernelArg::ReadWrite(flow),
         ocl::KernelArg::ReadOnlyNoSize(prevFlow),
         ocl::KernelArg::ReadOnlyNoSize(motion),
@@ -124,7 +256,7 @@ CV_EXPORTS_W void oclAdjustFlowTowardPreviousV2(const UMat& prevFlow, const UMat
 }
 
 CV_EXPORTS_W void oclAdjustFlowTowardPreviousV3(const UMat& prevFlow, const UMat& motion, UMat& flow, const OclOptFlowSmooth3Lines& factor) {
-	ocl::Kernel k("adjust_flow_toward_previous_v3", ocl::oclrenderpano::optflow_oclsrc);
+	OclKernel& k = oclKernel("adjust_flow_toward_previous_v3", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadWrite(flow),
 		ocl::KernelArg::ReadOnlyNoSize(prevFlow),
 		ocl::KernelArg::ReadOnlyNoSize(motion),
@@ -142,8 +274,14 @@ CV_EXPORTS_W void oclAdjustFlowTowardPreviousV3(const UMat& prevFlow, const UMat
 
 
 // estimate the flow of each pixel in I0 by searching a rectangle
-CV_EXPORTS_W void oclEstimateFlow(const UMat& I0, const UMat& I1, const UMat& alpha0, const UMat& alpha1, UMat& flow, const Rect& box) {
-    ocl::Kernel k("estimate_flow", ocl::oclrenderpano::optflow_oclsrc);
+// @changed: maxPercentage is kMaxPercentage of optflow.cl, the search distance the error is scaled by
+CV_EXPORTS_W void oclEstimateFlow(const UMat& I0, const UMat& I1, const UMat& alpha0, const UMat& alpha1, UMat& flow, const Rect& box,
+	int maxPercentage) {
+	String options = storageOptions(flow);
+	if (maxPercentage != 0) {
+		options += format(" -D MAX_PERCENTAGE=%d", maxPercentage);
+	}
+    OclKernel& k = oclKernel("estimate_flow", ocl::oclrenderpano::optflow_oclsrc, options);
     k.args(ocl::KernelArg::ReadOnly(I0), 
         ocl::KernelArg::ReadOnly(I1),
         ocl::KernelArg::ReadOnlyNoSize(alpha0), 
@@ -158,9 +296,18 @@ CV_EXPORTS_W void oclEstimateFlow(const UMat& I0, const UMat& I1, const UMat& al
     k.run(2, globalsize, localsize, false);
 }
 
+// @added: the initial flow search of OpticalFlow::adjustInitialFlow(), I1 scaled to the intensity of I0 on the device
+CV_EXPORTS_W void oclSearchInitialFlow(const UMat& I0, const UMat& I1, const UMat& alpha0, const UMat& alpha1, UMat& flow,
+	const Rect& box, int maxPercentage) {
+	UMat I1eq, ratio, ratioSums;
+	oclIntensityRatio(I0, alpha0, I1, alpha1, ratio, ratioSums);
+	oclScale(I1, I1eq, ratio);
+	oclEstimateFlow(I0, I1eq, alpha0, alpha1, flow, box, maxPercentage);
+}
+
 // low alpha flow diffusion
 CV_EXPORTS_W void oclAlphaFlowDiffusion(const UMat& alpha0, const UMat& alpha1, const UMat& blurredFlow, UMat& flow) {
-    ocl::Kernel k("alpha_flow_diffusion", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("alpha_flow_diffusion", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
     k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0), 
         ocl::KernelArg::ReadOnlyNoSize(alpha1),
         ocl::KernelArg::ReadOnlyNoSize(blurredFlow),
@@ -174,7 +321,7 @@ CV_EXPORTS_W void oclAlphaFlowDiffusion(const UMat& alpha0, const UMat& alpha1,
 CV_EXPORTS_W void oclSweepFromLeft(
     const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y, 
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
-    ocl::Kernel k("sweep_from_left", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("sweep_from_left", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -192,7 +339,7 @@ CV_EXPORTS_W void oclSweepFromLeft(
 CV_EXPORTS_W void oclSweepFromRight(
     const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
-    ocl::Kernel k("sweep_from_right", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("sweep_from_right", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -210,7 +357,7 @@ CV_EXPORTS_W void oclSweepFromRight(
 CV_EXPORTS_W void oclSweepFromTop(
 	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
-    ocl::Kernel k("sweep_from_top", ocl::oclrenderpano::optflow_oclsrc);
+    OclKernel& k = oclKernel("sweep_from_top", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -228,7 +375,7 @@ CV_EXPORTS_W void oclSweepFromBottom(
 	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y, 
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
 	
-	ocl::Kernel k("sweep_from_bottom", ocl::oclrenderpano::optflow_oclsrc);
+	OclKernel& k = oclKernel("sweep_from_bottom", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -244,27 +391,12 @@ CV_EXPORTS_W void oclSweepFromBottom(
 
 
 
-inline bool oclRunKernel(ocl::Kernel& k, int dims, size_t _globalsize[], size_t _localsize[]) {
-	size_t offset[CV_MAX_DIM] = { 0 };
-	size_t globalsize[CV_MAX_DIM] = { 1,1,1 };
-	for (int i = 0; i < dims; i++) {
-		size_t val = _localsize ? _localsize[i] :
-			dims == 1 ? 64 : dims == 2 ? (i == 0 ? 256 : 8) : dims == 3 ? (8 >> (int)(i>0)) : 1;
-		CV_Assert(val > 0);
-		globalsize[i] = ((_globalsize[i] + val - 1) / val)*val;
-	}
-	cl_command_queue q = (cl_command_queue)ocl::Queue::getDefault().ptr();
-	cl_int retval = clEnqueueNDRangeKernel(q, (cl_kernel)k.ptr(), (cl_uint)dims, 
-		offset, globalsize, _localsize, 0, 0, 0);
-	return retval == CL_SUCCESS;
-}
-
 // sweep from top/left
 CV_EXPORTS_W void oclSweepFromTopLeft(
 	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
 
-	ocl::Kernel k("sweep_from_top_left", ocl::oclrenderpano::optflow_oclsrc);
+	OclKernel& k = oclKernel("sweep_from_top_left", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -282,11 +414,7 @@ CV_EXPORTS_W void oclSweepFromTopLeft(
 		
 		size_t globalsize[] = { (i < minrc ? i + 1 : flow.rows + flow.cols - 1 - i < minrc ? flow.rows + flow.cols - 1 - i : minrc) };
 		size_t localsize[] = { 64 };
-		if (i < flow.rows + flow.cols - 2) {
-			oclRunKernel(k, 1, globalsize, localsize);
-		} else {
-			k.run(1, globalsize, localsize, false);
-		}
+		k.run(1, globalsize, localsize, false);
 	}
 }
 
@@ -296,7 +424,7 @@ CV_EXPORTS_W void oclSweepFromBottomRight(
 	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
 
-	ocl::Kernel k("sweep_from_bottom_right", ocl::oclrenderpano::optflow_oclsrc);
+	OclKernel& k = oclKernel("sweep_from_bottom_right", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -314,11 +442,7 @@ CV_EXPORTS_W void oclSweepFromBottomRight(
 
 		size_t globalsize[] = { (i < minrc ? i + 1 : flow.rows + flow.cols - 1 - i < minrc ? flow.rows + flow.cols - 1 - i : minrc) };
 		size_t localsize[] = { 64 };
-		if (i > 0) {
-			oclRunKernel(k, 1, globalsize, localsize);
-		} else {
-			k.run(1, globalsize, localsize, false);
-		}
+		k.run(1, globalsize, localsize, false);
 	}
 }
 
@@ -328,7 +452,7 @@ CV_EXPORTS_W void oclSweepTo(int dx, int dy,
 	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
 
 	CV_Assert(abs(dx) == 1 && abs(dy) == 1);
-	ocl::Kernel k("sweep_to", ocl::oclrenderpano::optflow_oclsrc);
+	OclKernel& k = oclKernel("sweep_to", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
 	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
 		ocl::KernelArg::ReadOnlyNoSize(alpha1),
 		ocl::KernelArg::ReadOnlyNoSize(I0x),
@@ -345,26 +469,68 @@ CV_EXPORTS_W void oclSweepTo(int dx, int dy,
 }
 
 
+// tile size of sweep_wavefront, must be same as SWEEP_TILE in optflow.cl
+static const int kSweepTile = 32;
+
+static void oclSweepWavefront(int reverse,
+	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
+	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
+
+	OclKernel& k = oclKernel("sweep_wavefront", ocl::oclrenderpano::optflow_oclsrc, storageOptions(flow));
+	k.args(ocl::KernelArg::ReadOnlyNoSize(alpha0),
+		ocl::KernelArg::ReadOnlyNoSize(alpha1),
+		ocl::KernelArg::ReadOnlyNoSize(I0x),
+		ocl::KernelArg::ReadOnlyNoSize(I0y),
+		ocl::KernelArg::ReadOnlyNoSize(I1x),
+		ocl::KernelArg::ReadOnlyNoSize(I1y),
+		ocl::KernelArg::ReadOnlyNoSize(blurredFlow),
+		ocl::KernelArg::ReadWrite(flow));
+	k.set(28, &reverse, sizeof(reverse));
+	int tilesX = (flow.cols + kSweepTile - 1) / kSweepTile;
+	int tilesY = (flow.rows + kSweepTile - 1) / kSweepTile;
+	for (int d = 0; d < tilesX + tilesY - 1; ++d) {
+		int start = d < tilesY ? 0 : d - tilesY + 1;
+		int end = d < tilesX ? d : tilesX - 1;
+		k.set(26, &d, sizeof(d));
+		k.set(27, &start, sizeof(start));
+		size_t globalsize[] = { (end - start + 1)*kSweepTile };
+		size_t localsize[] = { kSweepTile };
+		k.run(1, globalsize, localsize, false);
+	}
+}
+
+// sweep from top/left over anti-diagonal wavefronts
+CV_EXPORTS_W void oclSweepWavefrontFromTopLeft(
+	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
+	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
+	oclSweepWavefront(0, alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+}
+
+// sweep from bottom/right over anti-diagonal wavefronts
+CV_EXPORTS_W void oclSweepWavefrontFromBottomRight(
+	const UMat& alpha0, const UMat& alpha1, const UMat& I0x, const UMat& I0y,
+	const UMat& I1x, const UMat& I1y, const UMat&  blurredFlow, UMat& flow) {
+	oclSweepWavefront(1, alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+}
+
+
 CV_EXPORTS_W void oclGaussianBlur(const UMat& src, UMat& dst, Size ksize, double sigma) {
 
-	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_8UC4);
+	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_16SC1 || src.type() == CV_16SC2 || src.type() == CV_8UC4);
 
-	int depth = CV_MAT_DEPTH(src.type());
 	UMat s = src;
 	dst.create(s.size(), s.type());
 
 	int kernel_size = ksize.width;
-	Mat k = getGaussianKernel(kernel_size, sigma, std::max(depth, CV_32F));
-
-	String build_options = ocl::kernelToStr(k, CV_32F, "KERNEL_X_DATA") + ocl::kernelToStr(k, CV_32F, "KERNEL_Y_DATA");
-	string typeStr = src.type() == CV_32FC1 ? "_32FC1" : src.type() == CV_32FC2 ? "_32FC2" : "_8UC4";
+	const String& build_options = KernelRegistry::instance().gaussianOptions(kernel_size, sigma, isHalfStorage(s));
+	string typeStr = src.type() == CV_8UC4 ? "_8UC4" : floatTypeStr(src);
 	size_t globalsize[] = { dst.cols, dst.rows };
 	size_t localsize[] = { 16, 16 };
 
 	// row filter
 	UMat tmp(s.size(), s.type());
 	string rowKernelName = string("filter_row") + typeStr;
-	ocl::Kernel rowKernel(rowKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
+	OclKernel& rowKernel = oclKernel(rowKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
 	rowKernel.args(ocl::KernelArg::ReadOnlyNoSize(src),
 		ocl::KernelArg::WriteOnly(tmp),
 		ocl::KernelArg::Constant(&kernel_size, sizeof(kernel_size)));
@@ -372,7 +538,7 @@ CV_EXPORTS_W void oclGaussianBlur(const UMat& src, UMat& dst, Size ksize, double
 
 	// col filter
 	string colKernelName = string("filter_col") + typeStr;
-	ocl::Kernel colKernel(colKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
+	OclKernel& colKernel = oclKernel(colKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
 	colKernel.args(ocl::KernelArg::ReadOnlyNoSize(tmp),
 		ocl::KernelArg::WriteOnly(dst),
 		ocl::KernelArg::Constant(&kernel_size, sizeof(kernel_size)));
@@ -381,24 +547,21 @@ CV_EXPORTS_W void oclGaussianBlur(const UMat& src, UMat& dst, Size ksize, double
 
 CV_EXPORTS_W void oclGaussianBlurV2(const UMat& src, UMat& dst, Size ksize, double sigma, UMat& tmp) {
 
-	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_8UC4);
+	CV_Assert(src.type() == CV_32FC1 || src.type() == CV_32FC2 || src.type() == CV_16SC1 || src.type() == CV_16SC2 || src.type() == CV_8UC4);
 
-	int depth = CV_MAT_DEPTH(src.type());
 	UMat s = src;
 	dst.create(s.size(), s.type());
 
 	int kernel_size = ksize.width;
-	Mat k = getGaussianKernel(kernel_size, sigma, std::max(depth, CV_32F));
-
-	String build_options = ocl::kernelToStr(k, CV_32F, "KERNEL_X_DATA") + ocl::kernelToStr(k, CV_32F, "KERNEL_Y_DATA");
-	string typeStr = src.type() == CV_32FC1 ? "_32FC1" : src.type() == CV_32FC2 ? "_32FC2" : "_8UC4";
+	const String& build_options = KernelRegistry::instance().gaussianOptions(kernel_size, sigma, isHalfStorage(s));
+	string typeStr = src.type() == CV_8UC4 ? "_8UC4" : floatTypeStr(src);
 	size_t globalsize[] = { dst.cols, dst.rows };
 	size_t localsize[] = { 16, 16 };
 
 	// row filter
 	tmp.create(s.size(), s.type());
 	string rowKernelName = string("filter_row") + typeStr;
-	ocl::Kernel rowKernel(rowKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
+	OclKernel& rowKernel = oclKernel(rowKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
 	rowKernel.args(ocl::KernelArg::ReadOnlyNoSize(src),
 		ocl::KernelArg::WriteOnly(tmp),
 		ocl::KernelArg::Constant(&kernel_size, sizeof(kernel_size)));
@@ -406,7 +569,7 @@ CV_EXPORTS_W void oclGaussianBlurV2(const UMat& src, UMat& dst, Size ksize, doub
 
 	// col filter
 	string colKernelName = string("filter_col") + typeStr;
-	ocl::Kernel colKernel(colKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
+	OclKernel& colKernel = oclKernel(colKernelName.c_str(), ocl::oclrenderpano::sepfilter2d_oclsrc, build_options);
 	colKernel.args(ocl::KernelArg::ReadOnlyNoSize(tmp),
 		ocl::KernelArg::WriteOnly(dst),
 		ocl::KernelArg::Constant(&kernel_size, sizeof(kernel_size)));
@@ -414,6 +577,30 @@ CV_EXPORTS_W void oclGaussianBlurV2(const UMat& src, UMat& dst, Size ksize, doub
 }
 
 
+// blurred gradients of I0 and I1, same as oclSobleX/oclSobleY followed by oclGaussianBlur on each
+CV_EXPORTS_W void oclGradientBlur(const UMat& I0, const UMat& I1,
+	UMat& I0x, UMat& I0y, UMat& I1x, UMat& I1y, Size ksize, double sigma) {
+
+	CV_Assert((I0.type() == CV_32FC1 || I0.type() == CV_16SC1) && I1.type() == I0.type() && I0.size() == I1.size());
+	CV_Assert(ksize.width == ksize.height && ksize.width % 2 == 1);
+	I0x.create(I0.size(), I0.type());
+	I0y.create(I0.size(), I0.type());
+	I1x.create(I0.size(), I0.type());
+	I1y.create(I0.size(), I0.type());
+	const String& build_options = KernelRegistry::instance().gradientBlurOptions(ksize.width, sigma, isHalfStorage(I0));
+	OclKernel& k = oclKernel("gradient_blur_32FC1", ocl::oclrenderpano::gradblur_oclsrc, build_options);
+	k.args(ocl::KernelArg::ReadOnly(I0),
+		ocl::KernelArg::ReadOnlyNoSize(I1),
+		ocl::KernelArg::WriteOnlyNoSize(I0x),
+		ocl::KernelArg::WriteOnlyNoSize(I0y),
+		ocl::KernelArg::WriteOnlyNoSize(I1x),
+		ocl::KernelArg::WriteOnlyNoSize(I1y));
+	size_t globalsize[] = { I0.cols, I0.rows };
+	size_t localsize[] = { 16, 16 };
+	k.run(2, globalsize, localsize, false);
+}
+
+
 struct OpticalFlow {
 	static constexpr int   kPyrMinImageSize = 24;
 	static constexpr int   kPyrMaxLevels = 1000;
@@ -446,6 +633,19 @@ struct OpticalFlow {
 
 	// @added
 	bool useSlashSweeping = false;
+	int sweepEngine = SWEEP_ROWS_COLS;
+	bool halfStorage = false;
+	OclFlowWorkspace* ws = nullptr;
+	int traceLevel = -1;	// the pyramid level of the captured stages
+	OclFlowQuality quality;	// the knobs the governor may lower (see OclFlowQualityLevel)
+
+	// @added: the intermediates for MatTrace::record(), all of them in the storage of the flow
+	void trace(const char* stage, const UMat& m) const {
+		MatTrace& t = MatTrace::instance();
+		if (t.recording()) {
+			t.capture(traceLevel < 0 ? string(stage) : format("level%02d/%s", traceLevel, stage), m, halfStorage);
+		}
+	}
 
 	// compute the flow field that warps image I1 so that it becomes like image I0.
 	// I0 and I1 are 1 byte/channel BGRA format, i.e. they have an alpha channel.
@@ -465,15 +665,33 @@ struct OpticalFlow {
 		UMat& flow,
 		DirectionHint hint,
 		float motionThreshhold,
-		const OclInitParameters* params) {
+		const OclInitParameters* params,
+		OclFlowWorkspace* workspace,
+		const OclFlowQuality* flowQuality) {
 		
 		CV_Assert(params != nullptr);
 		CV_Assert(prevFlow.dims == 0 || prevFlow.size() == rgba0byte.size());
+		CV_Assert(prevFlow.dims == 0 || prevFlow.type() == storageType(2, params->halfStorage));
 
-		// @added
+		// all pyramid levels and temporaries live in the workspace
+		OclFlowWorkspace localWorkspace;
+		if (workspace == nullptr) {
+			workspace = &localWorkspace;
+		}
+		halfStorage = params->halfStorage;
+		if (flowQuality) {
+			quality = *flowQuality;
+		}
+		workspace->create(rgba0byte.size(), halfStorage, quality);
+		ws = workspace;
+
+		/* @changed: the quality may turn them off (or on)
 		if (rgba0byte.cols < 400) {
 			useSlashSweeping = true;
 		}
+		*/
+		useSlashSweeping = quality.slashSweeping < 0 ? rgba0byte.cols < 400 : quality.slashSweeping > 0;
+		sweepEngine = params->sweepEngine;
 
 		// pre-scale everything to a smaller size. this should be faster + more stable
 		/* @deleted
@@ -484,18 +702,26 @@ struct OpticalFlow {
 		resize(rgba0byte, rgba0byteDownscaled, downscaleSize, 0, 0, CV_INTER_CUBIC);
 		resize(rgba1byte, rgba1byteDownscaled, downscaleSize, 0, 0, CV_INTER_CUBIC);
 		*/
+		/* @deleted
 		UMat rgba0byteDownscaled, rgba1byteDownscaled;
 		UMat prevFlowDownscaled, prevI0BGRADownscaled, prevI1BGRADownscaled;
+		*/
+		UMat& rgba0byteDownscaled = ws->rgba0;
+		UMat& rgba1byteDownscaled = ws->rgba1;
+		UMat& prevFlowDownscaled = ws->levels[0].prevFlow;
+		UMat& prevI0BGRADownscaled = ws->prevRgba0;
+		UMat& prevI1BGRADownscaled = ws->prevRgba1;
 		cv::Size originalSize = rgba0byte.size();
-		cv::Size downscaleSize(rgba0byte.cols * kDownscaleFactor, rgba0byte.rows * kDownscaleFactor);
+		cv::Size downscaleSize(rgba0byte.cols * quality.downscaleFactor, rgba0byte.rows * quality.downscaleFactor);
+		ProfileStage prepareStage("prepare");
 		oclResize(rgba0byte, rgba0byteDownscaled, downscaleSize);
 		oclResize(rgba1byte, rgba1byteDownscaled, downscaleSize);
 
 		/* @deleted
 		UMat motion(downscaleSize, CV_32F);
 		*/
-		UMat motion;
-		if (prevFlow.dims > 0) {
+		UMat& motion = ws->levels[0].motion;
+		if (prevFlow.dims > 0 && quality.temporalRegularization) {
 			usePrevFlowTemporalRegularization = true;
 
 			/* @deleted
@@ -526,7 +752,7 @@ struct OpticalFlow {
 			*/
 
 			/* @changed */
-			motion.create(downscaleSize, CV_32F);
+			motion.create(downscaleSize, storageType(1, halfStorage));
 			if (params->computeMotionUsingLpair) {
 				oclMotionDetectionV2(rgba0byteDownscaled, prevI0BGRADownscaled, motion);
 			} else {
@@ -534,62 +760,97 @@ struct OpticalFlow {
 			}
 
 			
-			/* @optimized */
+			/* @deleted
 			prevI0BGRADownscaled = UMat();
 			prevI1BGRADownscaled = UMat();
+			*/
 		}
 
 		// convert to various color spaces
+		/* @deleted
 		UMat I0Grey, I1Grey, I0, I1, alpha0, alpha1;
+		*/
+		UMat& I0Grey = ws->grey0;
+		UMat& I1Grey = ws->grey1;
+		UMat& I0 = ws->levels[0].I0;
+		UMat& I1 = ws->levels[0].I1;
+		UMat& alpha0 = ws->levels[0].alpha0;
+		UMat& alpha1 = ws->levels[0].alpha1;
 		cvtColor(rgba0byteDownscaled, I0Grey, CV_BGRA2GRAY);
 		cvtColor(rgba1byteDownscaled, I1Grey, CV_BGRA2GRAY);
+		/* @deleted
 		I0Grey.convertTo(I0, CV_32F);
 		I1Grey.convertTo(I1, CV_32F);
+		*/
 
-		/* @optimized */
+		/* @deleted
 		I0Grey = UMat();
 		I1Grey = UMat();
+		*/
 
 		/* @deleted
 		I0 /= 255.0f;
 		I1 /= 255.0f;
 		*/
+		/* @deleted
         oclScale(I0, 1.0f/255.0f);
         oclScale(I1, 1.0f/255.0f);
+		*/
+		// @optimized: convert and scale in one pass, into the fp16 storage if enabled
+		oclConvert(I0Grey, I0, storageType(1, halfStorage), 1.0f/255.0f);
+		oclConvert(I1Grey, I1, storageType(1, halfStorage), 1.0f/255.0f);
   
+		/* @deleted
 		vector<UMat> channels0, channels1;
+		*/
+		vector<UMat>& channels0 = ws->channels0;
+		vector<UMat>& channels1 = ws->channels1;
 		split(rgba0byteDownscaled, channels0);
 		split(rgba1byteDownscaled, channels1);
+		/* @deleted
 		channels0[3].convertTo(alpha0, CV_32F);
 		channels1[3].convertTo(alpha1, CV_32F);
+		*/
 
-		/* @optimized */
+		/* @deleted
 		rgba0byteDownscaled = UMat();
 		rgba1byteDownscaled = UMat();
 		channels0.clear();
 		channels1.clear();
+		*/
 
 		/* @deleted
 		alpha0 /= 255.0f;
 		alpha1 /= 255.0f;
 		*/
+		/* @deleted
         oclScale(alpha0, 1.0f/255.0f);
 		oclScale(alpha1, 1.0f/255.0f);
+		*/
+		oclConvert(channels0[3], alpha0, storageType(1, halfStorage), 1.0f/255.0f);
+		oclConvert(channels1[3], alpha1, storageType(1, halfStorage), 1.0f/255.0f);
 
         /* @deleted
 		GaussianBlur(I0, I0, Size(kPreBlurKernelWidth, kPreBlurKernelWidth), kPreBlurSigma);
 		GaussianBlur(I1, I1, Size(kPreBlurKernelWidth, kPreBlurKernelWidth), kPreBlurSigma);
 		*/
-		{
-		UMat I0Tmp;
-		oclGaussianBlurV2(I0, I0, Size(kPreBlurKernelWidth, kPreBlurKernelWidth), kPreBlurSigma, I0Tmp);
-		oclGaussianBlurV2(I1, I1, Size(kPreBlurKernelWidth, kPreBlurKernelWidth), kPreBlurSigma, I0Tmp);
+		oclGaussianBlurV2(I0, I0, Size(kPreBlurKernelWidth, kPreBlurKernelWidth), kPreBlurSigma, ws->blurTmp);
+		oclGaussianBlurV2(I1, I1, Size(kPreBlurKernelWidth, kPreBlurKernelWidth), kPreBlurSigma, ws->blurTmp);
+
+		prepareStage.end();
+		if (usePrevFlowTemporalRegularization) {
+			trace("prepare/motion", motion);
 		}
+		trace("prepare/I0", I0);
+		trace("prepare/I1", I1);
+		trace("prepare/alpha0", alpha0);
+		trace("prepare/alpha1", alpha1);
 
-		vector<UMat> pyramidI0 = buildPyramid(I0);
-		vector<UMat> pyramidI1 = buildPyramid(I1);
-		vector<UMat> pyramidAlpha0 = buildPyramid(alpha0);
-		vector<UMat> pyramidAlpha1 = buildPyramid(alpha1);
+		ProfileStage pyramidStage("pyramid");
+		vector<UMat> pyramidI0 = buildPyramid(&OclFlowLevel::I0);
+		vector<UMat> pyramidI1 = buildPyramid(&OclFlowLevel::I1);
+		vector<UMat> pyramidAlpha0 = buildPyramid(&OclFlowLevel::alpha0);
+		vector<UMat> pyramidAlpha1 = buildPyramid(&OclFlowLevel::alpha1);
 
         /* @deleted
 		vector<UMat> prevFlowPyramid = buildPyramid(prevFlowDownscaled);
@@ -600,8 +861,8 @@ struct OpticalFlow {
        
 		if (usePrevFlowTemporalRegularization) {
             // @added
-            prevFlowPyramid = buildPyramid(prevFlowDownscaled);
-            motionPyramid = buildPyramid(motion);
+            prevFlowPyramid = buildPyramid(&OclFlowLevel::prevFlow);
+            motionPyramid = buildPyramid(&OclFlowLevel::motion);
             
 			// rescale the previous flow values at each level of the pyramid
 			for (int level = 0; level < prevFlowPyramid.size(); ++level) {
@@ -611,24 +872,33 @@ struct OpticalFlow {
 				oclScale(prevFlowPyramid[level], float(prevFlowPyramid[level].rows)/float(prevFlowPyramid[0].rows));
 			}
 		}
+		pyramidStage.end();
 
+		/* @deleted
 		UMat flowTmp;
 		flow = UMat();
+		*/
+		// flow of the current level, a header on one of the level's flow buffers
+		UMat levelFlow;
 		for (int level = pyramidI0.size() - 1; level >= 0; --level) {
+			traceLevel = level;
 			patchMatchPropagationAndSearch(
 				pyramidI0[level],
 				pyramidI1[level],
 				pyramidAlpha0[level],
 				pyramidAlpha1[level],
-				flow,
-				hint);
+				levelFlow,
+				hint,
+				ws->levels[level]);
 
 			if (usePrevFlowTemporalRegularization) {
 				/* @deleted
 				adjustFlowTowardPrevious(prevFlowPyramid[level], motionPyramid[level], flow);
 				*/
 				//oclAdjustFlowTowardPreviousV2(prevFlowPyramid[level], motionPyramid[level], flow, motionThreshhold);
-				oclAdjustFlowTowardPreviousV3(prevFlowPyramid[level], motionPyramid[level], flow, params->smooth3LinesFactor);
+				ProfileStage stage("temporal");
+				oclAdjustFlowTowardPreviousV3(prevFlowPyramid[level], motionPyramid[level], levelFlow, params->smooth3LinesFactor);
+				trace("temporal", levelFlow);
 
 				/* @optimized */ 
 				prevFlowPyramid[level] = UMat();
@@ -640,20 +910,33 @@ struct OpticalFlow {
 				resize(flow, flow, pyramidI0[level - 1].size(), 0, 0, CV_INTER_CUBIC);
 				flow *= (1.0f / kPyrScaleFactor);
 				*/  
+				/* @deleted
                 oclResize(flow, flowTmp, pyramidI0[level - 1].size());
 				swap(flow, flowTmp);
 				oclScale(flow, 1.0f/kPyrScaleFactor);
+				*/
+				ProfileStage stage("upscale");
+				UMat& upscaled = ws->levels[level - 1].flow;
+				oclResize(levelFlow, upscaled, pyramidI0[level - 1].size());
+				levelFlow = upscaled;
+				oclScale(levelFlow, 1.0f/quality.pyrScaleFactor);
+				trace("upscale", levelFlow);
 			}
 		}
+		traceLevel = -1;
 		
 		// scale the flow result back to full size
 		/* @deleted
 		resize(flow, flow, originalSize, 0, 0, CV_INTER_LINEAR);
 		flow *= (1.0f / kDownscaleFactor);
 		*/
+		/* @deleted
         resize(flow, flowTmp, originalSize, 0, 0, CV_INTER_LINEAR);
 		swap(flow, flowTmp);
-		oclScale(flow, 1.0f/kDownscaleFactor);
+		*/
+		ProfileStage finalStage("final flow");
+		resizeLinear(levelFlow, flow, originalSize);
+		oclScale(flow, 1.0f/quality.downscaleFactor);
 
         /* @deleted
 		GaussianBlur(
@@ -667,9 +950,11 @@ struct OpticalFlow {
 			flow,
 			Size(kFinalFlowBlurKernelWidth, kFinalFlowBlurKernelWidth),
 			kFinalFlowBlurSigma,
-			flowTmp);
+			ws->finalFlowTmp);
+		trace("final flow", flow);
 	}
 
+	/* @deleted
     vector<UMat> buildPyramid(const UMat& src) {
         vector<UMat> pyramid = {src};
         while (pyramid.size() < kPyrMaxLevels) {
@@ -683,6 +968,36 @@ struct OpticalFlow {
         }
         return pyramid;
     }
+	*/
+
+	// @changed: level l is resized into ws->levels[l].*member, the pyramid holds headers on them
+	vector<UMat> buildPyramid(UMat OclFlowLevel::* member) {
+		vector<UMat> pyramid = {ws->levels[0].*member};
+		for (size_t l = 1; l < ws->levels.size(); ++l) {
+			UMat& scaledImage = ws->levels[l].*member;
+			resizeLinear(pyramid.back(), scaledImage, ws->levels[l].size);
+			pyramid.push_back(scaledImage);
+		}
+		return pyramid;
+	}
+
+	// @added: cv::resize and cv::medianBlur would filter the raw bits of the fp16 storage,
+	// which is handled by the kernels instead. the fp32 path is unchanged.
+	void resizeLinear(const UMat& src, UMat& dst, Size dsize) {
+		if (isHalfStorage(src)) {
+			oclResizeLinear(src, dst, dsize);
+		} else {
+			resize(src, dst, dsize, 0, 0, CV_INTER_LINEAR);
+		}
+	}
+
+	void medianBlur5(const UMat& src, UMat& dst) {
+		if (isHalfStorage(src)) {
+			oclMedianBlur5(src, dst);
+		} else {
+			medianBlur(src, dst, kMedianBlurSize);
+		}
+	}
 
     // patch_index is used only for testing 
 	void patchMatchPropagationAndSearch(
@@ -691,12 +1006,17 @@ struct OpticalFlow {
 		UMat& alpha0,
 		UMat& alpha1,
 		UMat& flow,
-		DirectionHint hint) {
+		DirectionHint hint,
+		OclFlowLevel& buffers) {
 
 		/* @moved */
 		if (flow.empty()) {
 			// initialize to all zeros
+			/* @deleted
 			flow = UMat::zeros(I0.size(), CV_32FC2);
+			*/
+			flow = buffers.flow;
+			flow.setTo(Scalar::all(0));
 			// optionally look for a better flow
 			if (kMaxPercentage > 0 && hint != DirectionHint::UNKNOWN) {
 				adjustInitialFlow(I0, I1, alpha0, alpha1, flow, hint);
@@ -712,11 +1032,13 @@ struct OpticalFlow {
 		Sobel(I1, I1x, kSameDepth, 1, 0, kKernelSize, 1, 0.0f, BORDER_REPLICATE);
 		Sobel(I1, I1y, kSameDepth, 0, 1, kKernelSize, 1, 0.0f, BORDER_REPLICATE);
 		*/
+		/* @deleted
 		UMat I0x, I0y, I1x, I1y;
 		oclSobleX(I0, I0x);
 		oclSobleY(I0, I0y);
 		oclSobleX(I1, I1x);
 		oclSobleY(I1, I1y);
+		*/
 
 		// blur gradients
 		const cv::Size kGradientBlurSize(kGradientBlurKernelWidth, kGradientBlurKernelWidth);
@@ -727,7 +1049,7 @@ struct OpticalFlow {
 		GaussianBlur(I1y, I1y, kGradientBlurSize, kGradientBlurSigma);
 		*/
 
-		/* @optimized */
+		/* @deleted
 		{
 		UMat I0Tmp;
 		UMat I1Tmp;
@@ -738,6 +1060,22 @@ struct OpticalFlow {
 		oclGaussianBlurV2(I1x, I1x, kGradientBlurSize, kGradientBlurSigma, I0Tmp);
 		oclGaussianBlurV2(I1y, I1y, kGradientBlurSize, kGradientBlurSigma, I0Tmp);
 		}
+		*/
+
+		/* @optimized */
+		UMat& I0x = buffers.I0x;
+		UMat& I0y = buffers.I0y;
+		UMat& I1x = buffers.I1x;
+		UMat& I1y = buffers.I1y;
+		ProfileStage gradientStage("gradient");
+		oclGradientBlur(I0, I1, I0x, I0y, I1x, I1y, kGradientBlurSize, kGradientBlurSigma);
+		gradientStage.end();
+		trace("gradient/I0x", I0x);
+		trace("gradient/I0y", I0y);
+		trace("gradient/I1x", I1x);
+		trace("gradient/I1y", I1y);
+		I0 = UMat();
+		I1 = UMat();
 
 		/* @deleted
 		if (flow.empty()) {
@@ -751,14 +1089,21 @@ struct OpticalFlow {
 		*/
         
 		// blur flow. we will regularize against this
+		/* @deleted
 		UMat flowTmp;
 		UMat blurredFlow;
+		*/
+		UMat& flowTmp = buffers.flowTmp;
+		UMat& blurredFlow = buffers.blurredFlow;
+		ProfileStage blurStage("flow blur");
 		oclGaussianBlurV2(
 			flow,
 			blurredFlow,
 			cv::Size(kBlurredFlowKernelWidth, kBlurredFlowKernelWidth),
 			kBlurredFlowSigma,
 			flowTmp);
+		blurStage.end();
+		trace("blurred flow", blurredFlow);
 
 		/* @deleted
 		// sweep from top/left
@@ -774,19 +1119,33 @@ struct OpticalFlow {
 			}
 		}
 		*/
-		oclSweepFromLeft(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
-        oclSweepFromTop(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+		ProfileStage sweepStage("sweeps");
+		if (sweepEngine == SWEEP_WAVEFRONT) {
+			oclSweepWavefrontFromTopLeft(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+		} else {
+			oclSweepFromLeft(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+			oclSweepFromTop(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+		}
 		if (useSlashSweeping) {
 			oclSweepTo(1, 1, alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
 			oclSweepTo(-1, 1, alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
 		}
+		sweepStage.end();
+		trace("sweeps 1", flow);
 
 		
         /* @deleted
         medianBlur(flow, flow, kMedianBlurSize);
         */
-        medianBlur(flow, flowTmp, kMedianBlurSize);
-		swap(flow, flowTmp);
+		if (quality.medianPasses >= 2) {
+			ProfileStage stage("median");
+			medianBlur5(flow, flowTmp);
+			// ping-pong the level buffers, flow stays a header on buffers.flow
+			swap(buffers.flow, buffers.flowTmp);
+			flow = buffers.flow;
+			stage.end();
+			trace("median 1", flow);
+		}
 		
 		/* @deleted
 		// sweep from bottom/right
@@ -801,20 +1160,37 @@ struct OpticalFlow {
 			}
 		}
 		*/
-        oclSweepFromRight(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
-        oclSweepFromBottom(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+		ProfileStage sweepStage2("sweeps");
+		if (sweepEngine == SWEEP_WAVEFRONT) {
+			oclSweepWavefrontFromBottomRight(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+		} else {
+			oclSweepFromRight(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+			oclSweepFromBottom(alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
+		}
 		if (useSlashSweeping) {
 			oclSweepTo(-1, -1, alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
 			oclSweepTo(1, -1, alpha0, alpha1, I0x, I0y, I1x, I1y, blurredFlow, flow);
 		}
+		sweepStage2.end();
+		trace("sweeps 2", flow);
 	
         /* @deleted
 		medianBlur(flow, flow, kMedianBlurSize);
 		*/
-        medianBlur(flow, flowTmp, kMedianBlurSize);
-		swap(flow, flowTmp);
+		if (quality.medianPasses >= 1) {
+			ProfileStage stage("median");
+			medianBlur5(flow, flowTmp);
+			// ping-pong the level buffers, flow stays a header on buffers.flow
+			swap(buffers.flow, buffers.flowTmp);
+			flow = buffers.flow;
+			stage.end();
+			trace("median 2", flow);
+		}
         
+		ProfileStage diffusionStage("diffusion");
 		lowAlphaFlowDiffusion(alpha0, alpha1, flow, blurredFlow, flowTmp);
+		diffusionStage.end();
+		trace("diffusion", flow);
 
 		/* @optimized */
 		alpha0 = UMat();
@@ -834,10 +1210,15 @@ struct OpticalFlow {
         /* @deleted
         Mat I1eq = I1 * computeIntensityRatio(I0, alpha0, I1, alpha1);
         */
+		/* @deleted
 		float ratio = computeIntensityRatio(I0.getMat(ACCESS_READ), alpha0.getMat(ACCESS_READ), 
 			I1.getMat(ACCESS_READ), alpha1.getMat(ACCESS_READ));
 		UMat I1eq = UMat::zeros(I1.size(), I1.type());
 		oclScale(I1, I1eq, ratio);
+		*/
+		// @optimized: the ratio is reduced and consumed on the device, no host readback (see oclSearchInitialFlow()).
+		// Unreachable while kMaxPercentage is 0, so the workspace keeps no buffers for it.
+		ProfileStage stage("initial flow");
         
         // estimate the flow of each pixel in I0 by searching a rectangle
         Rect box = computeSearchBox(hint);
@@ -870,7 +1251,10 @@ struct OpticalFlow {
             }
         }
         */
+        /* @changed: the search is on I1eq, as the loop above
         oclEstimateFlow(I0, I1, alpha0, alpha1, flow, box);
+        */
+        oclSearchInitialFlow(I0, I1, alpha0, alpha1, flow, box, kMaxPercentage);
         
     }
 
@@ -942,6 +1326,249 @@ struct OpticalFlow {
 
 
 // OpenCL version
+// the diffusion blur (as lowAlphaFlowDiffusion) of source on strip of flow, read from context around it,
+// half rounds the CPU backend through fp16 (the OpenCL storage is the type of flow)
+static void blurFlowStrip(const UMat& source, UMat& flow, Rect strip, Rect context, UMat& blurred, UMat& tmp, bool half) {
+	const Size ksize(OpticalFlow::kBlurredFlowKernelWidth, OpticalFlow::kBlurredFlowKernelWidth);
+	const float sigma = OpticalFlow::kBlurredFlowSigma;
+	if (cpuBackend()) {
+		Mat s = source.getMat(ACCESS_READ);
+		Mat f = flow.getMat(ACCESS_RW);
+		Mat b = blurred.getMat(ACCESS_RW);
+		Mat t = tmp.getMat(ACCESS_RW);
+		Mat dst = b(context);
+		Mat dstTmp = t(context);
+		cpuGaussianBlur(s(context), dst, ksize.width, sigma, dstTmp, half);
+		b(strip).copyTo(f(strip));
+		return;
+	}
+	UMat dst = blurred(context);
+	UMat dstTmp = tmp(context);
+	oclGaussianBlurV2(source(context), dst, ksize, sigma, dstTmp);
+	blurred(strip).copyTo(flow(strip));
+}
+
+// the tile motion read back behind the copy of the previous flow into the static tiles: the host waits
+// for the read only, the copy (and the rest of the queue) runs on while the bands are planned
+static void readTileMotion(const UMat& tileMotion, const UMat& prevFlow, UMat& flow, Mat& motion) {
+	motion.create(tileMotion.size(), tileMotion.type());
+	cl_event event = nullptr;
+	cl_int retval = CL_INVALID_VALUE;
+	if (!cpuBackend()) {
+		cl_command_queue queue = (cl_command_queue)ocl::Queue::getDefault().ptr();
+		retval = clEnqueueReadBuffer(queue, (cl_mem)tileMotion.handle(ACCESS_READ), CL_FALSE, tileMotion.offset,
+			motion.total()*motion.elemSize(), motion.data, 0, nullptr, &event);
+	}
+	prevFlow.copyTo(flow);
+	if (retval == CL_SUCCESS) {
+		retval = clWaitForEvents(1, &event);
+		clReleaseEvent(event);
+	}
+	// the CPU backend, or a blocking read if the non-blocking one failed
+	if (retval != CL_SUCCESS) {
+		tileMotion.copyTo(motion);
+	}
+}
+
+/**
+* @brief The incremental flow of OclIncrementalFlow, false if the whole flow is to be computed.
+*
+* The read of the tile motion is the only wait, the flow of each band is computed by oclComputeOpticalFlow()
+* with the incremental flow off, in a workspace of its own. A band is at least kMinBandSize and
+* is rounded up to kBandBucket (never smaller than its workspace), so the band workspaces only
+* grow a few times before they are reused every frame. The borders between the copied tiles and
+* the previous flow are blurred as the diffusion of the whole flow does, every strip from the
+* stitched flow, so the overlapping strips of a corner give the same result in any order.
+*/
+static bool incrementalFlow(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	const UMat& prevFlow,
+	const UMat& prevI0BGRA,
+	const UMat& prevI1BGRA,
+	UMat& flow,
+	DirectionHint hint,
+	float motionThreshhold,
+	const OclInitParameters* params,
+	OclFlowWorkspace* workspace,
+	const OclFlowQuality* quality) {
+	const int kMinBandSize = 128;	// the band pyramids need a few levels above kPyrMinImageSize
+	const int kBandBucket = 128;	// the band sizes are multiples of it (or the image size)
+	if (workspace) {
+		workspace->recomputed = 1.0f;
+	}
+	if (params == nullptr || params->incrementalFlow.motionThreshold <= 0
+		|| prevFlow.empty() || prevI0BGRA.empty() || prevI1BGRA.empty()
+		|| (quality && !quality->temporalRegularization)) {
+		return false;
+	}
+	const OclIncrementalFlow& inc = params->incrementalFlow;
+	CV_Assert(inc.tileSize > 0 && inc.haloTiles >= 0);
+	if (workspace && inc.refreshFrames > 0 && workspace->incrementalFlows >= inc.refreshFrames) {
+		workspace->incrementalFlows = 0;
+		return false;
+	}
+
+	// the static tiles keep the previous flow (the whole flow overwrites it if too many tiles move)
+	UMat tileMotion;
+	Mat motion;
+	oclMotionTiles(I0BGRA, prevI0BGRA, I1BGRA, prevI1BGRA, inc.tileSize, tileMotion);
+	readTileMotion(tileMotion, prevFlow, flow, motion);
+	int tileRows = motion.rows;
+	int tileCols = motion.cols;
+	auto active = [&](int y, int x) { return motion.at<float>(y, x) > inc.motionThreshold; };
+
+	// the tile rows of the bands: the rows with an active tile, grown by the halo
+	vector<uchar> bandRow(tileRows, 0);
+	for (int y = 0; y < tileRows; ++y) {
+		for (int x = 0; x < tileCols; ++x) {
+			if (active(y, x)) {
+				for (int r = std::max(0, y - inc.haloTiles); r <= std::min(tileRows - 1, y + inc.haloTiles); ++r) {
+					bandRow[r] = 1;
+				}
+				break;
+			}
+		}
+	}
+	// the tile columns of a band: the ones of its active tiles, grown by the halo
+	vector<Rect> bands;
+	int computed = 0;
+	for (int y = 0; y < tileRows; ) {
+		if (!bandRow[y]) {
+			++y;
+			continue;
+		}
+		int y0 = y;
+		int x0 = tileCols;
+		int x1 = 0;
+		for (; y < tileRows && bandRow[y]; ++y) {
+			for (int x = 0; x < tileCols; ++x) {
+				if (active(y, x)) {
+					x0 = std::min(x0, x);
+					x1 = std::max(x1, x + 1);
+				}
+			}
+		}
+		x0 = std::max(0, x0 - inc.haloTiles);
+		x1 = std::min(tileCols, x1 + inc.haloTiles);
+		bands.push_back(Rect(x0, y0, x1 - x0, y - y0));
+		computed += (x1 - x0)*(y - y0);
+	}
+	float fraction = float(computed)/float(tileRows*tileCols);
+	if (fraction > inc.maxActive) {
+		if (workspace) {
+			workspace->incrementalFlows = 0;
+		}
+		return false;
+	}
+
+	ProfileStage stage("incremental flow");
+	OclInitParameters bandParams = *params;
+	bandParams.incrementalFlow.motionThreshold = 0.0f;
+	Rect imageRect(0, 0, I0BGRA.cols, I0BGRA.rows);
+	// the band length: the tiles grown to kMinBandSize, rounded up to kBandBucket and to the workspace
+	auto bandLength = [&](int tiles, int reused, int image) {
+		int length = (std::max(tiles, kMinBandSize) + kBandBucket - 1)/kBandBucket*kBandBucket;
+		return std::min(std::max(length, reused), image);
+	};
+	// the band start: centered on the tiles, shifted inside the image
+	auto bandStart = [](int tiles, int tilesLength, int length, int image) {
+		return std::min(std::max(tiles + tilesLength/2 - length/2, 0), image - length);
+	};
+	for (size_t b = 0; b < bands.size(); ++b) {
+		const Rect& tiles = bands[b];
+		Rect tilesRect = Rect(tiles.x*inc.tileSize, tiles.y*inc.tileSize, tiles.width*inc.tileSize, tiles.height*inc.tileSize) & imageRect;
+
+		OclFlowWorkspace* bandWorkspace = nullptr;
+		Size reused;
+		if (workspace) {
+			if (workspace->bands.size() <= b) {
+				workspace->bands.push_back(std::make_shared<OclFlowWorkspace>());
+			}
+			bandWorkspace = workspace->bands[b].get();
+			reused = bandWorkspace->imageSize;
+		}
+		int width = bandLength(tilesRect.width, reused.width, imageRect.width);
+		int height = bandLength(tilesRect.height, reused.height, imageRect.height);
+		Rect band(bandStart(tilesRect.x, tilesRect.width, width, imageRect.width),
+			bandStart(tilesRect.y, tilesRect.height, height, imageRect.height), width, height);
+		UMat bandFlow;
+		oclComputeOpticalFlow(I0BGRA(band), I1BGRA(band), prevFlow(band), prevI0BGRA(band), prevI1BGRA(band),
+			bandFlow, hint, motionThreshhold, &bandParams, bandWorkspace, quality);
+
+		// copy the runs of active tiles of each tile row
+		for (int y = tiles.y; y < tiles.y + tiles.height; ++y) {
+			for (int x = tiles.x; x < tiles.x + tiles.width; ) {
+				if (!active(y, x)) {
+					++x;
+					continue;
+				}
+				int x0 = x;
+				while (x < tiles.x + tiles.width && active(y, x)) {
+					++x;
+				}
+				Rect run = Rect(x0*inc.tileSize, y*inc.tileSize, (x - x0)*inc.tileSize, inc.tileSize) & imageRect;
+				bandFlow(run - band.tl()).copyTo(flow(run));
+			}
+		}
+	}
+
+	// blur a strip across each border of an active tile with a static one, from the stitched flow
+	const int r = OpticalFlow::kBlurredFlowKernelWidth/2;
+	UMat stitched = flow.clone();
+	UMat blurred(flow.size(), flow.type());
+	UMat blurTmp(flow.size(), flow.type());
+	auto blurSeam = [&](Rect strip) {
+		strip = strip & imageRect;
+		if (strip.area() > 0) {
+			Rect context = Rect(strip.x - r, strip.y - r, strip.width + 2*r, strip.height + 2*r) & imageRect;
+			blurFlowStrip(stitched, flow, strip, context, blurred, blurTmp, params->halfStorage);
+		}
+	};
+	for (int y = 0; y < tileRows; ++y) {
+		for (int x = 0; x < tileCols; ) {
+			if (!active(y, x)) {
+				++x;
+				continue;
+			}
+			int x0 = x;
+			while (x < tileCols && active(y, x)) {
+				++x;
+			}
+			// the left and right ends of the run
+			if (x0 > 0) {
+				blurSeam(Rect(x0*inc.tileSize - r, y*inc.tileSize, 2*r, inc.tileSize));
+			}
+			if (x < tileCols) {
+				blurSeam(Rect(x*inc.tileSize - r, y*inc.tileSize, 2*r, inc.tileSize));
+			}
+			// the parts of the run above and below static tiles
+			for (int neighbor = y - 1; neighbor <= y + 1; neighbor += 2) {
+				if (neighbor < 0 || neighbor >= tileRows) {
+					continue;
+				}
+				int edge = std::max(y, neighbor)*inc.tileSize;
+				for (int s = x0; s < x; ) {
+					if (active(neighbor, s)) {
+						++s;
+						continue;
+					}
+					int s0 = s;
+					while (s < x && !active(neighbor, s)) {
+						++s;
+					}
+					blurSeam(Rect(s0*inc.tileSize - r, edge - r, (s - s0)*inc.tileSize + 2*r, 2*r));
+				}
+			}
+		}
+	}
+	if (workspace) {
+		workspace->recomputed = fraction;
+		workspace->incrementalFlows++;
+	}
+	return true;
+}
+
 CV_EXPORTS_W void oclComputeOpticalFlow(
     const UMat& I0BGRA,
     const UMat& I1BGRA,
@@ -951,9 +1578,359 @@ CV_EXPORTS_W void oclComputeOpticalFlow(
     UMat& flow,
     DirectionHint hint,
 	float motionThreshhold,
+	const OclInitParameters* params,
+	OclFlowWorkspace* workspace,
+	const OclFlowQuality* quality) {
+	// @added
+	if (incrementalFlow(I0BGRA, I1BGRA, prevFlow, prevI0BGRA, prevI1BGRA, flow, hint, motionThreshhold, params, workspace, quality)) {
+		return;
+	}
+	// @added
+	if (cpuBackend()) {
+		flow.create(I0BGRA.size(), CV_32FC2);
+		Mat out = flow.getMat(ACCESS_WRITE);
+		cpuComputeOpticalFlow(I0BGRA.getMat(ACCESS_READ), I1BGRA.getMat(ACCESS_READ), prevFlow.getMat(ACCESS_READ),
+			prevI0BGRA.getMat(ACCESS_READ), prevI1BGRA.getMat(ACCESS_READ), out, params, workspace, quality);
+		return;
+	}
+	OpticalFlow().computeOpticalFlow(I0BGRA, I1BGRA, prevFlow, prevI0BGRA, prevI1BGRA, flow, hint, motionThreshhold, params, workspace, quality);
+	ocl::finish();
+}
+
+
+// @added
+CV_EXPORTS_W OclFlowQuality oclFlowQualityLevel(int level) {
+	CV_Assert(level >= 0 && level < FLOW_QUALITY_LEVELS);
+	OclFlowQuality q;
+	if (level >= FLOW_QUALITY_NO_SLASH) {
+		q.slashSweeping = 0;
+	}
+	if (level >= FLOW_QUALITY_SHALLOW) {
+		q.pyrScaleFactor = 0.8f;
+		q.medianPasses = 1;
+	}
+	if (level >= FLOW_QUALITY_REDUCED) {
+		q.downscaleFactor = 0.375f;
+	}
+	if (level >= FLOW_QUALITY_LOWEST) {
+		q.downscaleFactor = 0.25f;
+		q.pyrScaleFactor = 0.75f;
+	}
+	return q;
+}
+
+
+void OclFlowWorkspace::create(Size size, bool half, const OclFlowQuality& q) {
+	// the other knobs don't change the buffers
+	bool sameLevels = q.downscaleFactor == quality.downscaleFactor
+		&& q.pyrScaleFactor == quality.pyrScaleFactor && q.pyrMaxLevels == quality.pyrMaxLevels;
+	if (size == imageSize && half == halfStorage && sameLevels && !levels.empty()) {
+		return;
+	}
+	release();
+	imageSize = size;
+	halfStorage = half;
+	quality = q;
+	// the buffers whose lifetimes don't overlap share a slot (see MemoryLayout)
+	MemoryLayout layout;
+	describeFlowWorkspace(*this, size, half, q, layout);
+	layout.assign();
+	layout.allocate();
+}
+
+// @added
+void describeFlowWorkspace(OclFlowWorkspace& ws, Size size, bool half, const OclFlowQuality& q, MemoryLayout& layout) {
+	const int realType = storageType(1, half);
+	const int real2Type = storageType(2, half);
+
+	// same sizes as OpticalFlow::computeOpticalFlow and OpticalFlow::buildPyramid
+	Size downscaleSize(size.width * q.downscaleFactor, size.height * q.downscaleFactor);
+	ws.levels.clear();
+	Size levelSize = downscaleSize;
+	const int maxLevels = std::max(q.pyrMaxLevels, 1);
+	while (ws.levels.size() < OpticalFlow::kPyrMaxLevels && (int)ws.levels.size() < maxLevels) {
+		ws.levels.push_back(OclFlowLevel());
+		ws.levels.back().size = levelSize;
+		Size newSize(levelSize.width * q.pyrScaleFactor + 0.5f, levelSize.height * q.pyrScaleFactor + 0.5f);
+		if (newSize.height <= OpticalFlow::kPyrMinImageSize || newSize.width <= OpticalFlow::kPyrMinImageSize) {
+			break;
+		}
+		levelSize = newSize;
+	}
+
+	// the steps: prepare, pyramids, the levels from the coarsest, final flow
+	const int numLevels = (int)ws.levels.size();
+	const int prepare = 0;
+	const int pyramids = 1;
+	const int finalStep = 2 + numLevels;
+	auto step = [numLevels](int level) { return 2 + numLevels - 1 - level; };
+
+	layout.add(&ws.rgba0, "rgba0", downscaleSize, CV_8UC4, prepare, prepare);
+	layout.add(&ws.rgba1, "rgba1", downscaleSize, CV_8UC4, prepare, prepare);
+	layout.add(&ws.prevRgba0, "prevRgba0", downscaleSize, CV_8UC4, prepare, prepare);
+	layout.add(&ws.prevRgba1, "prevRgba1", downscaleSize, CV_8UC4, prepare, prepare);
+	layout.add(&ws.grey0, "grey0", downscaleSize, CV_8UC1, prepare, prepare);
+	layout.add(&ws.grey1, "grey1", downscaleSize, CV_8UC1, prepare, prepare);
+	layout.add(&ws.blurTmp, "blurTmp", downscaleSize, realType, prepare, prepare);
+	ws.channels0.resize(4);
+	ws.channels1.resize(4);
+	for (int i = 0; i < 4; ++i) {
+		layout.add(&ws.channels0[i], format("channels0[%d]", i), downscaleSize, CV_8UC1, prepare, prepare);
+		layout.add(&ws.channels1[i], format("channels1[%d]", i), downscaleSize, CV_8UC1, prepare, prepare);
+	}
+	layout.add(&ws.finalFlowTmp, "finalFlowTmp", size, real2Type, finalStep, finalStep);
+
+	for (int level = 0; level < numLevels; ++level) {
+		OclFlowLevel& l = ws.levels[level];
+		Size s = l.size;
+		// level 0 is written when preparing, the others when building the pyramids
+		int first = level == 0 ? prepare : pyramids;
+		int own = step(level);
+		string name = format("levels[%d].", level);
+		layout.add(&l.I0, name + "I0", s, realType, first, own);
+		layout.add(&l.I1, name + "I1", s, realType, first, own);
+		layout.add(&l.alpha0, name + "alpha0", s, realType, first, own);
+		layout.add(&l.alpha1, name + "alpha1", s, realType, first, own);
+		layout.add(&l.prevFlow, name + "prevFlow", s, real2Type, first, own);
+		layout.add(&l.motion, name + "motion", s, realType, first, own);
+		layout.add(&l.I0x, name + "I0x", s, realType, own, own);
+		layout.add(&l.I0y, name + "I0y", s, realType, own, own);
+		layout.add(&l.I1x, name + "I1x", s, realType, own, own);
+		layout.add(&l.I1y, name + "I1y", s, realType, own, own);
+		layout.add(&l.blurredFlow, name + "blurredFlow", s, real2Type, own, own);
+		// the level flow is upscaled into from the coarser level, and swapped with flowTmp
+		int upscaled = level == numLevels - 1 ? own : step(level + 1);
+		int consumed = level == 0 ? finalStep : own;
+		layout.add(&l.flow, name + "flow", s, real2Type, upscaled, consumed);
+		layout.add(&l.flowTmp, name + "flowTmp", s, real2Type, upscaled, consumed);
+	}
+}
+
+void OclFlowWorkspace::release() {
+	imageSize = Size();
+	halfStorage = false;
+	rgba0.release();
+	rgba1.release();
+	prevRgba0.release();
+	prevRgba1.release();
+	grey0.release();
+	grey1.release();
+	blurTmp.release();
+	channels0.clear();
+	channels1.clear();
+	levels.clear();
+	finalFlowTmp.release();
+	bands.clear();
+	incrementalFlows = 0;
+}
+
+bool OclFlowWorkspace::empty() const {
+	return levels.empty();
+}
+
+size_t OclFlowWorkspace::byteSize() const {
+	size_t bytes = 0;
+	// the buffers of a slot are counted once
+	std::set<const UMatData*> slots;
+	auto add = [&bytes, &slots](const UMat& m) {
+		if (m.u && slots.insert(m.u).second) {
+			bytes += m.u->size;
+		}
+	};
+	add(rgba0); add(rgba1); add(prevRgba0); add(prevRgba1);
+	add(grey0); add(grey1); add(blurTmp); add(finalFlowTmp);
+	for (const UMat& m : channels0) add(m);
+	for (const UMat& m : channels1) add(m);
+	for (const OclFlowLevel& l : levels) {
+		add(l.I0); add(l.I1); add(l.alpha0); add(l.alpha1);
+		add(l.prevFlow); add(l.motion);
+		add(l.I0x); add(l.I0y); add(l.I1x); add(l.I1y);
+		add(l.flow); add(l.flowTmp); add(l.blurredFlow);
+	}
+	for (const std::shared_ptr<OclFlowWorkspace>& b : bands) {
+		bytes += b->byteSize();
+	}
+	return bytes;
+}
+
+
+// a CV_32FC2 copy of a flow in either storage (CV_16SC2 holds the fp16 bits)
+static Mat floatFlow(const UMat& flow) {
+	Mat f;
+	if (isHalfStorage(flow)) {
+		convertFp16(flow.getMat(ACCESS_READ), f);
+	} else {
+		flow.copyTo(f);
+	}
+	return f;
+}
+
+// mean grey difference between I0 and I1 warped by flow
+static double meanWarpError(const UMat& I0BGRA, const UMat& I1BGRA, const UMat& flow) {
+	UMat warpMap;
+	{
+	Mat f = floatFlow(flow);
+	Mat m(f.size(), CV_32FC2);
+	for (int y = 0; y < f.rows; ++y) {
+		for (int x = 0; x < f.cols; ++x) {
+			m.at<Point2f>(y, x) = Point2f(float(x), float(y)) + f.at<Point2f>(y, x);
+		}
+	}
+	m.copyTo(warpMap);
+	}
+	UMat warped;
+	remap(I1BGRA, warped, warpMap, UMat(), INTER_LINEAR, BORDER_CONSTANT);
+
+	UMat grey0, grey1, diff;
+	cvtColor(I0BGRA, grey0, CV_BGRA2GRAY);
+	cvtColor(warped, grey1, CV_BGRA2GRAY);
+	absdiff(grey0, grey1, diff);
+
+	UMat alpha0, alpha1, mask;
+	extractChannel(I0BGRA, alpha0, 3);
+	extractChannel(warped, alpha1, 3);
+	cv::min(alpha0, alpha1, mask);
+	return mean(diff, mask)[0] / 255.0;
+}
+
+static OclFlowComparison compareFlows(const UMat& I0BGRA, const UMat& I1BGRA, const UMat& flowA, const UMat& flowB) {
+	OclFlowComparison result;
+	Mat diff, endpoint;
+	vector<Mat> channels;
+	subtract(floatFlow(flowA), floatFlow(flowB), diff);
+	split(diff, channels);
+	magnitude(channels[0], channels[1], endpoint);
+	result.meanEndpointDiff = mean(endpoint)[0];
+	minMaxLoc(endpoint, nullptr, &result.maxEndpointDiff);
+	result.meanWarpErrorA = meanWarpError(I0BGRA, I1BGRA, flowA);
+	result.meanWarpErrorB = meanWarpError(I0BGRA, I1BGRA, flowB);
+	ocl::finish();
+	return result;
+}
+
+CV_EXPORTS_W OclFlowComparison oclCompareSweepEngines(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	DirectionHint hint,
+	const OclInitParameters* params,
+	int engineA,
+	int engineB) {
+	CV_Assert(params != nullptr);
+	CV_Assert(I0BGRA.type() == CV_8UC4 && I1BGRA.type() == CV_8UC4 && I0BGRA.size() == I1BGRA.size());
+
+	OclInitParameters paramsA = *params;
+	OclInitParameters paramsB = *params;
+	paramsA.sweepEngine = engineA;
+	paramsB.sweepEngine = engineB;
+	UMat flowA, flowB;
+	oclComputeOpticalFlow(I0BGRA, I1BGRA, UMat(), UMat(), UMat(), flowA, hint, 1.0f, &paramsA);
+	oclComputeOpticalFlow(I0BGRA, I1BGRA, UMat(), UMat(), UMat(), flowB, hint, 1.0f, &paramsB);
+	return compareFlows(I0BGRA, I1BGRA, flowA, flowB);
+}
+
+CV_EXPORTS_W OclFlowComparison oclCompareStoragePrecisions(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	DirectionHint hint,
 	const OclInitParameters* params) {
-	OpticalFlow().computeOpticalFlow(I0BGRA, I1BGRA, prevFlow, prevI0BGRA, prevI1BGRA, flow, hint, motionThreshhold, params);
+	CV_Assert(params != nullptr);
+	CV_Assert(I0BGRA.type() == CV_8UC4 && I1BGRA.type() == CV_8UC4 && I0BGRA.size() == I1BGRA.size());
+
+	OclInitParameters paramsA = *params;
+	OclInitParameters paramsB = *params;
+	paramsA.halfStorage = false;
+	paramsB.halfStorage = true;
+	UMat flowA, flowB;
+	oclComputeOpticalFlow(I0BGRA, I1BGRA, UMat(), UMat(), UMat(), flowA, hint, 1.0f, &paramsA);
+	oclComputeOpticalFlow(I0BGRA, I1BGRA, UMat(), UMat(), UMat(), flowB, hint, 1.0f, &paramsB);
+	return compareFlows(I0BGRA, I1BGRA, flowA, flowB);
+}
+
+// @added
+static double maxDiff(const UMat& a, const Mat& b) {
+	Mat m;
+	a.copyTo(m);
+	return norm(m, b, NORM_INF);
+}
+
+CV_EXPORTS_W OclBackendComparison oclCompareBackends(
+	const UMat& I0BGRA,
+	const UMat& I1BGRA,
+	DirectionHint hint,
+	const OclInitParameters* params) {
+	CV_Assert(params != nullptr);
+	CV_Assert(I0BGRA.type() == CV_8UC4 && I1BGRA.type() == CV_8UC4 && I0BGRA.size() == I1BGRA.size());
+	CV_Assert(!cpuBackend() && ocl::useOpenCL());
+
+	Mat I0, I1;
+	I0BGRA.copyTo(I0);
+	I1BGRA.copyTo(I1);
+	OclBackendComparison result;
+
+	// flow in the storage of params, the OpenCL flows of both directions are the input of the novel views
+	UMat flowLtoR, flowRtoL, cpuFlow;
+	Mat flow;
+	oclComputeOpticalFlow(I0BGRA, I1BGRA, UMat(), UMat(), UMat(), flowLtoR, hint, 1.0f, params);
+	oclComputeOpticalFlow(I1BGRA, I0BGRA, UMat(), UMat(), UMat(), flowRtoL, hint, 1.0f, params);
+	cpuComputeOpticalFlow(I0, I1, Mat(), Mat(), Mat(), flow, params);
+	flow.copyTo(cpuFlow);
+	result.flow = compareFlows(I0BGRA, I1BGRA, flowLtoR, cpuFlow);
+
+	// projection, a slightly scaled and shifted map so every pixel is interpolated
+	Mat xmap(I0.size(), CV_32FC1), ymap(I0.size(), CV_32FC1);
+	for (int y = 0; y < I0.rows; ++y) {
+		for (int x = 0; x < I0.cols; ++x) {
+			xmap.at<float>(y, x) = x*0.95f + 0.3f;
+			ymap.at<float>(y, x) = y*0.95f + 0.6f;
+		}
+	}
+	vector<UMat> srcs(1, I0BGRA), xmaps(1), ymaps(1), dsts;
+	xmap.copyTo(xmaps[0]);
+	ymap.copyTo(ymaps[0]);
+	oclProjection(srcs, xmaps, ymaps, dsts);
+	Mat projected;
+	cpuProjection(I0, xmap, ymap, projected);
+	result.maxProjectionDiff = maxDiff(dsts[0], projected);
+
+	// novel view, as a chunk of the render path
+	OclLazyWarp warp;
+	warp.size = Size(params->numNovelViews > 0 ? params->numNovelViews : I0.cols, I0.rows);
+	warp.camImageWidth = params->camImageWidth > 0 ? params->camImageWidth : I0.cols;
+	warp.slabDisplacement = params->isMonoMode ? 0.0f : params->vergeAtInfinitySlabDisplacement;
+	UMat view(warp.size, CV_8UC4);
+	oclRenderLazyNovelView(warp, I0BGRA, I1BGRA, flowLtoR, flowRtoL, view, 0, true);
+	Mat cpuView(warp.size, CV_8UC4);
+	cpuRenderLazyNovelView(Mat(), warp, I0, I1, floatFlow(flowLtoR), floatFlow(flowRtoL), cpuView, 0, true);
+	result.maxNovelViewDiff = maxDiff(view, cpuView);
+
+	// post-process with every step enabled
+	OclPostProcessParameters post;
+	post.chunkWidth = warp.size.width;
+	post.sharpFactor = 0.5f;
+	post.smoothThreshold = 0.2f;
+	post.wrapOffset = I0.cols/3;
+	UMat processed;
+	oclPostProcess(I0BGRA, I1BGRA, processed, post);
+	Mat cpuProcessed(I0.size(), CV_8UC4);
+	cpuPostProcess(I0, I1, cpuProcessed, post);
+	result.maxPostProcessDiff = maxDiff(processed, cpuProcessed);
+
+	// color adjustment in 16 bits
+	Mat image16;
+	I0.convertTo(image16, CV_16U, 256.0);
+	UMat lut = oclAntiGammaLUT();
+	UMat adjusted;
+	image16.copyTo(adjusted);
+	oclAntiGammaAdjust(lut, adjusted);
+	oclAddBrightnessAndClampMulti(adjusted, 1.1f);
+	{
+	Mat l = lut.getMat(ACCESS_READ);
+	cpuLutAdjust(l, image16);
+	}
+	cpuAddBrightnessAndClampMulti(image16, 1.1f);
+	result.maxColorAdjustDiff = maxDiff(adjusted, image16);
 	ocl::finish();
+	return result;
 }
 
 }   // end namespace imvt
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "precomp.hpp"
+#include "profiler.hpp"
+#include "cpubackend.hpp"
+#include "opencv2/oclrenderpano/ocl_profiler.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+using namespace std;
+
+std::atomic<bool> Profiler::active(false);
+
+// records are kept until oclGetProfileRecords(), at most this many
+static const size_t kMaxPendingRecords = 1 << 18;
+
+namespace {
+
+struct Pending {
+	string name;
+	string stage;
+	bool isStage;
+	int camera;
+	int64 frame;
+	int thread;
+	cl_event begin;
+	cl_event end;
+};
+
+struct ThreadState {
+	bool profilingQueue = false;
+	int thread = -1;
+	int camera = -1;
+	int64 frame = -1;
+	vector<pair<const char*, cl_event>> stages;
+};
+
+mutex pendingMutex;
+vector<Pending> pending;
+
+ThreadState& threadState() {
+	static thread_local ThreadState state;
+	return state;
+}
+
+void addPending(const Pending& p) {
+	lock_guard<mutex> lock(pendingMutex);
+	if (pending.size() >= kMaxPendingRecords) {
+		clReleaseEvent(p.begin);
+		if (p.end != p.begin) {
+			clReleaseEvent(p.end);
+		}
+		return;
+	}
+	pending.push_back(p);
+}
+
+bool profilingInfo(cl_event event, cl_profiling_info param, cl_ulong& value) {
+	return clGetEventProfilingInfo(event, param, sizeof(value), &value, 0) == CL_SUCCESS;
+}
+
+}	// namespace
+
+
+void Profiler::enable(bool enable) {
+	active = enable;
+}
+
+void Profiler::prepareQueue() {
+	ThreadState& s = threadState();
+	if (s.profilingQueue) {
+		return;
+	}
+	// commands already enqueued stay in order with the new queue
+	ocl::Queue& q = ocl::Queue::getDefault();
+	q.finish();
+	q = q.getProfilingQueue();
+	s.profilingQueue = true;
+}
+
+void Profiler::kernel(const char* name, cl_event event) {
+	ThreadState& s = threadState();
+	if (!s.profilingQueue) {
+		return;
+	}
+	clRetainEvent(event);
+	Pending p = { name, s.stages.empty() ? "" : s.stages.back().first, false, s.camera, s.frame, s.thread, event, event };
+	addPending(p);
+}
+
+cl_event Profiler::beginStage(const char* name) {
+	prepareQueue();
+	cl_event event = 0;
+	cl_command_queue q = (cl_command_queue)ocl::Queue::getDefault().ptr();
+	if (clEnqueueMarkerWithWaitList(q, 0, 0, &event) != CL_SUCCESS) {
+		return 0;
+	}
+	threadState().stages.push_back(make_pair(name, event));
+	return event;
+}
+
+void Profiler::endStage(cl_event begin) {
+	ThreadState& s = threadState();
+	CV_Assert(!s.stages.empty() && s.stages.back().second == begin);
+	const char* name = s.stages.back().first;
+	s.stages.pop_back();
+
+	cl_event end = 0;
+	cl_command_queue q = (cl_command_queue)ocl::Queue::getDefault().ptr();
+	if (clEnqueueMarkerWithWaitList(q, 0, 0, &end) != CL_SUCCESS) {
+		clReleaseEvent(begin);
+		return;
+	}
+	Pending p = { name, s.stages.empty() ? "" : s.stages.back().first, true, s.camera, s.frame, s.thread, begin, end };
+	addPending(p);
+}
+
+void Profiler::setTask(int64 frame, int camera) {
+	ThreadState& s = threadState();
+	s.frame = frame;
+	s.camera = camera;
+}
+
+void Profiler::setThread(int thread) {
+	threadState().thread = thread;
+}
+
+
+CV_EXPORTS_W void oclEnableProfiling(bool enable) {
+	Profiler::enable(enable && !cpuBackend());
+}
+
+CV_EXPORTS_W bool oclProfilingEnabled() {
+	return Profiler::enabled();
+}
+
+CV_EXPORTS_W void oclGetProfileRecords(std::vector<OclProfileRecord>& records) {
+	vector<Pending> done;
+	{
+		lock_guard<mutex> lock(pendingMutex);
+		swap(done, pending);
+	}
+
+	struct Times { cl_ulong queued, submit, start, end; };
+	vector<Times> times(done.size());
+	vector<bool> valid(done.size(), false);
+	cl_ulong base = ~cl_ulong(0);
+	for (size_t i = 0; i < done.size(); ++i) {
+		Pending& p = done[i];
+		clWaitForEvents(1, &p.end);
+		Times& t = times[i];
+		valid[i] = profilingInfo(p.begin, CL_PROFILING_COMMAND_QUEUED, t.queued) &&
+			profilingInfo(p.begin, CL_PROFILING_COMMAND_SUBMIT, t.submit) &&
+			// a stage starts when its begin marker (i.e. the preceding commands) completes
+			profilingInfo(p.begin, p.isStage ? CL_PROFILING_COMMAND_END : CL_PROFILING_COMMAND_START, t.start) &&
+			profilingInfo(p.end, CL_PROFILING_COMMAND_END, t.end);
+		if (valid[i]) {
+			base = std::min(base, t.queued);
+		}
+		clReleaseEvent(p.begin);
+		if (p.end != p.begin) {
+			clReleaseEvent(p.end);
+		}
+	}
+
+	records.clear();
+	for (size_t i = 0; i < done.size(); ++i) {
+		if (!valid[i]) {
+			continue;
+		}
+		const Pending& p = done[i];
+		const Times& t = times[i];
+		OclProfileRecord r = { p.name, p.stage, p.isStage, p.camera, p.frame, p.thread,
+			(t.queued - base)*1e-6, (t.submit - base)*1e-6, (t.start - base)*1e-6, (t.end - base)*1e-6 };
+		records.push_back(r);
+	}
+}
+
+CV_EXPORTS_W std::string oclProfileSummary(const std::vector<OclProfileRecord>& records) {
+	struct Row { int count = 0; double total = 0; double max = 0; double wait = 0; };
+	map<string, Row> stages, kernels;
+	map<int, Row> cameras;
+	map<int64, Row> frames;
+	for (const OclProfileRecord& r : records) {
+		double ms = r.endMs - r.startMs;
+		Row& row = r.isStage ? stages[r.name] : kernels[r.name];
+		row.count++;
+		row.total += ms;
+		row.max = std::max(row.max, ms);
+		row.wait += r.startMs - r.queuedMs;
+		if (!r.isStage) {
+			Row& c = cameras[r.camera];
+			c.count++;
+			c.total += ms;
+			Row& f = frames[r.frame];
+			f.count++;
+			f.total += ms;
+		}
+	}
+
+	string s;
+	auto table = [&s](const char* title, const map<string, Row>& rows) {
+		s += cv::format("%-32s %8s %12s %10s %10s %12s\n", title, "count", "total(ms)", "mean(ms)", "max(ms)", "queued(ms)");
+		for (auto& it : rows) {
+			const Row& r = it.second;
+			s += cv::format("%-32s %8d %12.3f %10.3f %10.3f %12.3f\n",
+				it.first.c_str(), r.count, r.total, r.total / r.count, r.max, r.wait / r.count);
+		}
+		s += "\n";
+	};
+	table("stage", stages);
+	table("kernel", kernels);
+
+	s += cv::format("%-32s %8s %12s\n", "camera", "kernels", "total(ms)");
+	for (auto& it : cameras) {
+		s += cv::format("%-32d %8d %12.3f\n", it.first, it.second.count, it.second.total);
+	}
+	s += "\n";
+	s += cv::format("%-32s %8s %12s\n", "frame", "kernels", "total(ms)");
+	for (auto& it : frames) {
+		s += cv::format("%-32lld %8d %12.3f\n", (long long)it.first, it.second.count, it.second.total);
+	}
+	return s;
+}
+
+CV_EXPORTS_W bool oclWriteChromeTrace(const std::string& path, const std::vector<OclProfileRecord>& records) {
+	FILE* fp = fopen(path.c_str(), "w");
+	if (!fp) {
+		return false;
+	}
+	fprintf(fp, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < records.size(); ++i) {
+		const OclProfileRecord& r = records[i];
+		// the caller thread is track 0, render thread i is track i + 1
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+			"\"args\":{\"stage\":\"%s\",\"camera\":%d,\"frame\":%lld,\"queued\":%.3f,\"submit\":%.3f}}%s\n",
+			r.name.c_str(), r.isStage ? "stage" : "kernel", r.thread + 1, r.startMs*1000.0, (r.endMs - r.startMs)*1000.0,
+			r.stage.c_str(), r.camera, (long long)r.frame, r.queuedMs*1000.0, r.submitMs*1000.0,
+			i + 1 < records.size() ? "," : "");
+	}
+	fprintf(fp, "],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(fp) == 0;
+}
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
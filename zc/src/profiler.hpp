@@ -0,0 +1,87 @@
+#ifndef _OPENCV_IMVT_PROFILER_HPP_
+#define _OPENCV_IMVT_PROFILER_HPP_
+
+#include <atomic>
+
+#include "precomp.hpp"
+#include "opencv2/core/opencl/runtime/opencl_core.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief Collects the cl_events of the profiled launches and stages (see ocl_profiler.hpp).
+*
+* Everything is a no-op unless oclEnableProfiling(true) was called.
+*/
+class Profiler {
+public:
+	static bool enabled() {
+		return active.load(std::memory_order_relaxed);
+	}
+	static void enable(bool enable);
+
+	// switch the default queue of the calling thread to a profiling one, if not done yet
+	static void prepareQueue();
+
+	// record a kernel launch, the event is retained
+	static void kernel(const char* name, cl_event event);
+
+	// enqueue the begin/end markers of a stage on the default queue of the calling thread
+	static cl_event beginStage(const char* name);
+	static void endStage(cl_event begin);
+
+	// camera/frame/thread of the calling thread
+	static void setTask(int64 frame, int camera);
+	static void setThread(int thread);
+
+private:
+	static std::atomic<bool> active;
+};
+
+
+/**
+* @brief Profiles the device commands enqueued in the scope as a named stage.
+*/
+class ProfileStage {
+public:
+	explicit ProfileStage(const char* name) : begin(0) {
+		if (Profiler::enabled()) {
+			begin = Profiler::beginStage(name);
+		}
+	}
+	~ProfileStage() {
+		end();
+	}
+	// end the stage before the end of the scope
+	void end() {
+		if (begin) {
+			Profiler::endStage(begin);
+			begin = 0;
+		}
+	}
+
+private:
+	cl_event begin;
+};
+
+
+/**
+* @brief Attributes the launches in the scope to a frame and camera.
+*/
+class ProfileTask {
+public:
+	ProfileTask(int64 frame, int camera) {
+		Profiler::setTask(frame, camera);
+	}
+	~ProfileTask() {
+		Profiler::setTask(-1, -1);
+	}
+};
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// _OPENCV_IMVT_PROFILER_HPP_
@@ -11,17 +11,26 @@
 #include <string>
 #include <vector>
 #include <queue>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 
 #include "precomp.hpp"
 #include "opencv2/core/opencl/runtime/opencl_core.hpp"
 #include "opencv2/core/opencl/runtime/opencl_core_wrappers.hpp"
+#include "kernels.hpp"
+#include "scheduler.hpp"
+#include "profiler.hpp"
+#include "cpubackend.hpp"
 
 #include "opencv2/oclrenderpano/ocl_optflow.hpp"
 #include "opencv2/oclrenderpano/ocl_novelview.hpp"
 #include "opencv2/oclrenderpano/ocl_coloradjust.hpp"
 #include "opencv2/oclrenderpano/ocl_buffer.hpp"
+#include "opencv2/oclrenderpano/ocl_kernels.hpp"
 #include "opencv2/oclrenderpano.hpp"
 
 #if 0
@@ -58,6 +67,17 @@ T dequeue() {
     return val;
 }
 
+// @added
+bool tryDequeue(T& val) {
+    std::lock_guard<std::mutex> lock(m);
+    if (q.empty()) {
+        return false;
+    }
+    val = q.front();
+    q.pop();
+    return true;
+}
+
 private:
     std::queue<T> q;
     mutable std::mutex m;
@@ -65,37 +85,240 @@ private:
 };
 
 
+static const int kRenderStages = 4;	// see OclRenderStage
+
+/**
+* @brief One stage (OclRenderStage) of a chunk of a frame.
+*
+* Both flows of a chunk run in parallel, the novel views run when both flows are done.
+*/
 struct RenderTask {
     int index;
+	/* @deleted
     const UMat* imageL;
     const UMat* imageR;
     UMat* chunkL;
 	UMat* chunkR;
+	*/
+	int stage;
+	int64 frame;
     float motionThreshold;
+	// @added: the OclFlowQualityLevel of the flows, and when the task ran (see QualityGovernor)
+	int quality;
+	int64 startTick;
+	int64 endTick;
+	// @added: the fraction of the flow tiles a flow task computed (see OclIncrementalFlow)
+	float recomputed;
+};
+
+
+/**
+* @brief A frame submitted to the render threads, one slot of the in-flight ring.
+*
+* The submitted images are referenced, the chunks are rendered into the slot's own buffers.
+*/
+struct RenderFrame {
+	int64 id = -1;		// -1 if the slot is free
+	int remaining = 0;	// chunks not rendered yet
+	vector<UMat> imageLs;
+	vector<UMat> imageRs;
+	vector<UMat> chunkLs;
+	vector<UMat> chunkRs;
+	// @added: if not empty, the chunks are rendered into their columns of these panoramas
+	// instead of chunkLs/chunkRs, chunk 0 starts at column panoOffset. On several devices the chunks
+	// are rendered into chunkLs/chunkRs and copied into them by pollFrame() (see gatherPanoramas())
+	UMat panoL;
+	UMat panoR;
+	int panoOffset = 0;
+	// @added: kRenderStages tasks and the flows/views left per chunk
+	vector<RenderTask> tasks;
+	vector<atomic<int>> flowsLeft;
+	vector<atomic<int>> viewsLeft;
+};
+
+
+/**
+* @brief A render thread: its own work-stealing deque and task timings.
+*
+* Every thread renders with its own default OpenCL queue.
+*/
+struct RenderWorker {
+	thread handle;
+	int device = 0;		// @added: its RenderDevice
+	WorkStealingDeque<RenderTask> tasks;
+	mutex timingMutex;
+	vector<OclRenderTaskTiming> timings;
+	// @added: the flow workspace of each OclFlowQualityLevel, created on first use (see OclMemoryPlan)
+	vector<OclFlowWorkspace> workspaces;
+};
+
+
+/**
+* @brief The incremental flow state of a camera pair in a direction, kept out of the workspaces
+* since they belong to the render threads (see OclIncrementalFlow).
+*/
+struct FlowState {
+	int incrementalFlows = 0;
+	float recomputed = 1.0f;
+};
+
+/**
+* @brief Holds the render time of a frame within OclInitParameters::targetFrameMs by the flow
+* quality of each chunk (see OclFrameQuality).
+*
+* A level applies from the next submitted frame on, so the frames in flight at a change
+* (rendered with the old levels) are not counted.
+*/
+struct QualityGovernor {
+	static const int kOverFrames = 2;		// frames over the target before a level is lowered
+	static const int kUnderFrames = 10;		// frames under kUnderRatio of it before one is raised
+	static constexpr double kUnderRatio = 0.7;
+
+	double targetMs = 0;
+	int inFlight = 1;
+	int skip = 0;
+	int over = 0;
+	int under = 0;
+	vector<int> levels;		// OclFlowQualityLevel of each chunk
+
+	void init(int numChunks, double target, int framesInFlight) {
+		targetMs = target;
+		inFlight = framesInFlight;
+		skip = over = under = 0;
+		levels.assign(numChunks, FLOW_QUALITY_FULL);
+	}
+
+	// the render time of a frame and the time each of its chunks took
+	void update(double frameMs, const vector<double>& chunkMs) {
+		if (targetMs <= 0) {
+			return;
+		}
+		if (skip > 0) {
+			skip--;
+			return;
+		}
+		if (frameMs > targetMs) {
+			over++;
+			under = 0;
+		} else if (frameMs < targetMs*kUnderRatio) {
+			under++;
+			over = 0;
+		} else {
+			over = under = 0;
+		}
+
+		if (over >= kOverFrames) {
+			// the slowest chunk that can go lower
+			int slowest = -1;
+			for (int i = 0; i < (int)chunkMs.size(); ++i) {
+				if (levels[i] < FLOW_QUALITY_LEVELS - 1 && (slowest < 0 || chunkMs[i] > chunkMs[slowest])) {
+					slowest = i;
+				}
+			}
+			if (slowest >= 0) {
+				levels[slowest]++;
+				changed();
+			}
+			over = 0;
+		} else if (under >= kUnderFrames) {
+			// the lowest chunk, the fastest of them first
+			int lowest = -1;
+			for (int i = 0; i < (int)chunkMs.size(); ++i) {
+				if (levels[i] > FLOW_QUALITY_FULL && (lowest < 0 || levels[i] > levels[lowest]
+					|| (levels[i] == levels[lowest] && chunkMs[i] < chunkMs[lowest]))) {
+					lowest = i;
+				}
+			}
+			if (lowest >= 0) {
+				levels[lowest]--;
+				changed();
+			}
+			under = 0;
+		}
+	}
+
+	void changed() {
+		skip = inFlight;
+		over = under = 0;
+	}
 };
 
+
+/**
+* @brief The render threads of a device and the tasks queued for them (see OclRenderDevice).
+*
+* The tasks of a camera pair only run on the threads of its device, which steal from each other.
+*/
+struct RenderDevice {
+	int index = 0;		// in the OpenCL context
+	OclRenderDevice info;
+	SafeQueue<RenderTask*> inQueue;
+	atomic<int> queuedTasks{0};
+	vector<int> workers;
+};
+
+
 struct RenderContext {
 
 	// render tasks/threads
+	/* @deleted
 	SafeQueue<RenderTask> inQueue;
 	SafeQueue<RenderTask> outQueue;
     vector<thread> threads;
+	*/
+	// @changed: tasks are pushed to the deque of a worker (or to the inQueue of its device if
+	// submitted by the caller), idle workers steal from the others of their device
+	vector<unique_ptr<RenderWorker>> workers;
+	// @added: the devices, and the device of each camera pair
+	vector<unique_ptr<RenderDevice>> devices;
+	vector<int> pairDevice;
+	bool stopping = false;
+	mutex idleMutex;
+	condition_variable idleCond;
+	int64 startTick = 0;
+
+	// in-flight frames, frames[id % frames.size()] holds frame id
+	vector<RenderFrame> frames;
+	int64 nextFrame = 0;
+	// per camera pair, the last submitted frame and the last rendered frame
+	vector<int64> pairSubmitted;
+	vector<int64> pairRendered;
+	// per camera pair, the frames waiting for the previous frame of the pair
+	vector<deque<int64>> pairParked;
+	mutex frameMutex;
+	condition_variable frameCond;
     
 	// previous images/flows
 	vector<UMat> preImageLs;
 	vector<UMat> preImageRs;
 	vector<UMat> preFlowLtoRs;
 	vector<UMat> preFlowRtoLs;
+
+	// current flows, swapped with the previous ones after each frame
+	vector<UMat> flowLtoRs;
+	vector<UMat> flowRtoLs;
+
+	// optical flow buffers: the workspaces of the caller (the render threads have their own), a flow state per pair and direction
+	vector<OclFlowWorkspace> callerWorkspaces;
+	vector<FlowState> flowStateLtoRs;
+	vector<FlowState> flowStateRtoLs;
+
+	// @added: the flow quality of each chunk, and of the rendered frames (guarded by frameMutex)
+	QualityGovernor governor;
+	vector<OclFlowQuality> flowQualities;	// of each OclFlowQualityLevel
+	vector<OclFrameQuality> frameQualities;
 	
 	// init params
 	const OclInitParameters* params = nullptr;
 
+	/* @deleted: the lazy warps are evaluated in render_procedural_novel_view (see lazyWarp())
 	// for stereo
 	vector<UMat> warpLs;
 	vector<UMat> warpRs;
 
 	// for mono
 	vector<UMat> warps;
+	*/
 
 	static RenderContext& instance() {
 		static RenderContext context;
@@ -106,6 +329,7 @@ struct RenderContext {
 		return params != nullptr;
 	}
 
+	/* @deleted: see lazyWarp()
 	void initMonoWarps(
 		int numSideCams,
 		int camImageWidth,
@@ -150,10 +374,27 @@ struct RenderContext {
 		warpLs.assign(numSideCams, uwarpL);
 		warpRs.assign(numSideCams, uwarpR);
 	}
+	*/
+
+	// @added: the lazy warp of an eye, the same for all side cameras
+	OclLazyWarp lazyWarp(int stage) const {
+		OclLazyWarp warp;
+		warp.size = Size(params->numNovelViews, params->opticalFlowSize.height);
+		warp.camImageWidth = params->camImageWidth;
+		if (!params->isMonoMode) {
+			warp.slabDisplacement = stage == RENDER_NOVEL_VIEW_L ?
+				params->vergeAtInfinitySlabDisplacement : -params->vergeAtInfinitySlabDisplacement;
+		}
+		return warp;
+	}
 
 	void init(const OclInitParameters* initParams) {
+		/* @changed: OclInitParameters holds a std::string (programCacheDir), it is copied, not memcpy'd
 		params = new OclInitParameters;
 		memcpy((void*)params, initParams, sizeof(OclInitParameters));
+		*/
+		params = new OclInitParameters(*initParams);
+		/* @deleted: see lazyWarp()
 		if (params->isMonoMode) {
 			initMonoWarps(
 				params->numSideCams, 
@@ -168,10 +409,89 @@ struct RenderContext {
 				params->numNovelViews,
 				params->vergeAtInfinitySlabDisplacement);
 		}
+		*/
 		preImageLs.assign(params->numSideCams, UMat());
 		preImageRs.assign(params->numSideCams, UMat());
 		preFlowLtoRs.assign(params->numSideCams, UMat());
 		preFlowRtoLs.assign(params->numSideCams, UMat());
+		flowLtoRs.assign(params->numSideCams, UMat());
+		flowRtoLs.assign(params->numSideCams, UMat());
+		callerWorkspaces.assign(FLOW_QUALITY_LEVELS, OclFlowWorkspace());
+		flowStateLtoRs.assign(params->numSideCams, FlowState());
+		flowStateRtoLs.assign(params->numSideCams, FlowState());
+		frames.clear();
+		frames.resize(std::max(params->maxFramesInFlight, 1));
+		for (RenderFrame& f : frames) {
+			f.tasks.resize(params->numSideCams*kRenderStages);
+			f.flowsLeft = vector<atomic<int>>(params->numSideCams);
+			f.viewsLeft = vector<atomic<int>>(params->numSideCams);
+		}
+		nextFrame = 0;
+		pairSubmitted.assign(params->numSideCams, -1);
+		pairRendered.assign(params->numSideCams, -1);
+		pairParked.assign(params->numSideCams, deque<int64>());
+		governor.init(params->numSideCams, params->targetFrameMs, int(frames.size()));
+		flowQualities.clear();
+		for (int level = 0; level < FLOW_QUALITY_LEVELS; ++level) {
+			flowQualities.push_back(oclFlowQualityLevel(level));
+		}
+		frameQualities.clear();
+		startTick = getTickCount();
+
+		// @added: all pairs on the default device until partition()
+		devices.clear();
+		devices.push_back(unique_ptr<RenderDevice>(new RenderDevice));
+		devices[0]->info.name = cpuBackend() ? "cpu" : ocl::Device::getDefault().name();
+		devices[0]->info.flowMs = 0;
+		devices[0]->info.threads = 0;
+		for (int i = 0; i < params->numSideCams; ++i) {
+			devices[0]->info.pairs.push_back(i);
+		}
+		pairDevice.assign(params->numSideCams, 0);
+	}
+
+	/**
+	* @brief Spread the camera pairs over the devices (indices in the OpenCL context) in proportion
+	* to 1/flowMs, before startThreads().
+	*
+	* Every device gets a range of adjacent pairs (they share the images of a camera), by the
+	* largest remainders, the first device first on a tie. A device may be left without pairs.
+	*/
+	void partition(const vector<int>& indices, const vector<double>& flowMs) {
+		int n = params->numSideCams;
+		int d = int(indices.size());
+		double total = 0;
+		for (double ms : flowMs) {
+			total += 1.0/ms;
+		}
+		vector<int> counts(d);
+		vector<pair<double, int>> remainders;
+		int assigned = 0;
+		for (int i = 0; i < d; ++i) {
+			double share = n*(1.0/flowMs[i])/total;
+			counts[i] = int(share);
+			assigned += counts[i];
+			remainders.push_back(make_pair(-(share - counts[i]), i));
+		}
+		sort(remainders.begin(), remainders.end());
+		for (int i = 0; assigned < n; ++i, ++assigned) {
+			counts[remainders[i % d].second]++;
+		}
+
+		devices.clear();
+		int pair = 0;
+		for (int i = 0; i < d; ++i) {
+			unique_ptr<RenderDevice> device(new RenderDevice);
+			device->index = indices[i];
+			device->info.name = ocl::Context::getDefault().device(indices[i]).name();
+			device->info.flowMs = flowMs[i];
+			device->info.threads = 0;
+			for (int j = 0; j < counts[i]; ++j, ++pair) {
+				device->info.pairs.push_back(pair);
+				pairDevice[pair] = i;
+			}
+			devices.push_back(std::move(device));
+		}
 	}
 
 
@@ -180,176 +500,367 @@ struct RenderContext {
 		preImageRs.clear();
 		preFlowLtoRs.clear();
 		preFlowRtoLs.clear();
-
+		flowLtoRs.clear();
+		flowRtoLs.clear();
+		callerWorkspaces.clear();
+		flowStateLtoRs.clear();
+		flowStateRtoLs.clear();
+		frames.clear();
+		pairSubmitted.clear();
+		pairRendered.clear();
+		pairParked.clear();
+		frameQualities.clear();
+		devices.clear();
+		pairDevice.clear();
+
+		/* @deleted
 		warps.clear();
 		warpLs.clear();
 		warpRs.clear();
+		*/
 
 		delete params;
 		params = nullptr;
 	}
 
 	void resetPrevious() {
+		// the submitted frames still use the previous images/flows
+		waitFrames();
 		preImageLs.assign(params->numSideCams, UMat());
 		preImageRs.assign(params->numSideCams, UMat());
 		preFlowLtoRs.assign(params->numSideCams, UMat());
 		preFlowRtoLs.assign(params->numSideCams, UMat());
 	}
 
+	// @changed: the threads are spread over the devices that have pairs, at least one each
     void startThreads(int numThreads = 4) {
+		stopping = false;
+		vector<int> active;
+		for (size_t d = 0; d < devices.size(); ++d) {
+			if (!devices[d]->info.pairs.empty()) {
+				active.push_back(int(d));
+			}
+		}
+		// oclInitialize() renders on at most numThreads devices, so the plan holds every thread
+		CV_Assert(numThreads <= 0 || numThreads >= int(active.size()));
+        for (int i=0; i < numThreads; i++) {
+			workers.push_back(unique_ptr<RenderWorker>(new RenderWorker));
+			RenderDevice& device = *devices[active[i % active.size()]];
+			workers[i]->device = active[i % active.size()];
+			device.workers.push_back(i);
+			device.info.threads++;
+			// @added: the full quality workspace up front, the lower ones if the governor lowers a flow
+			workers[i]->workspaces.assign(FLOW_QUALITY_LEVELS, OclFlowWorkspace());
+			// the CPU backend keeps its workspaces in fp32 (see cpuComputeOpticalFlow())
+			workers[i]->workspaces[FLOW_QUALITY_FULL].create(params->opticalFlowSize, params->halfStorage && !cpuBackend(),
+				flowQualities[FLOW_QUALITY_FULL]);
+		}
         for (int i=0; i < numThreads; i++) {
-            threads.push_back(thread(renderChunkThread, this));
+            workers[i]->handle = thread(renderChunkThread, this, i);
         }
     }
 
     void stopThreads() {
-		for (thread& t : threads) {
-			RenderTask stopTask = { -1 };
-			inQueue.enqueue(stopTask);
+		waitFrames();
+		{
+			lock_guard<mutex> lock(idleMutex);
+			stopping = true;
 		}
-        for (thread& t : threads) {
-            t.join();
+		idleCond.notify_all();
+        for (unique_ptr<RenderWorker>& w : workers) {
+            w->handle.join();
         }
-		threads.clear();
+		workers.clear();
+		for (unique_ptr<RenderDevice>& d : devices) {
+			d->workers.clear();
+			d->info.threads = 0;
+		}
     }
 
-	static void renderChunkThread(RenderContext* c) {
-		// initialize OpenCL and SVM if necessary
-		ocl::useOpenCL();
-		if (ocl::haveSVM()) {
-			ocl::Context::getDefault().useSVM();
+	static void renderChunkThread(RenderContext* c, int self) {
+		bool cpu = cpuBackend();
+		if (cpu) {
+			// @added: the UMats of this thread stay in host memory
+			ocl::setUseOpenCL(false);
+		} else {
+			// initialize OpenCL and SVM if necessary
+			ocl::useOpenCL();
+			if (ocl::haveSVM()) {
+				ocl::Context::getDefault().useSVM();
+			}
+			// @added: the default queue of this thread is on its device
+			if (c->devices.size() > 1) {
+				ocl::Context& context = ocl::Context::getDefault();
+				ocl::Queue::getDefault().create(context, context.device(c->devices[c->workers[self]->device]->index));
+			}
+			// build all kernels of this thread before the first task
+			oclPreloadKernels(c->params->halfStorage);
 		}
+		Profiler::setThread(self);
 
-		LOGD("render thread %u is started\n", this_thread::get_id());
+		LOGD("render thread %d is started\n", self);
+		RenderDevice& device = *c->devices[c->workers[self]->device];
 		while (1) {
-			// get render task from input queue
-			LOGD("render thread %u is waiting input task\n", this_thread::get_id());
-			RenderTask t = c->inQueue.dequeue();
-
-			LOGD("render thread %u got input task: %d\n", this_thread::get_id(), t.index);
-			// exit this thread if stop task received
-			if (t.index == -1) {
-				break;
+			RenderTask* t = c->takeTask(self);
+			if (t == nullptr) {
+				// exit this thread if stopped and no task left
+				unique_lock<mutex> lock(c->idleMutex);
+				c->idleCond.wait(lock, [&] { return device.queuedTasks > 0 || c->stopping; });
+				if (c->stopping && device.queuedTasks == 0) {
+					break;
+				}
+				continue;
 			}
+			LOGD("render thread %d got task: frame %lld chunk %d stage %d\n", self, t->frame, t->index, t->stage);
+			c->runTask(self, *t);
+		}
 
-			// compute optical flows
-			UMat flowLtoR;
-			UMat flowRtoL;
-			oclComputeOpticalFlow(
-				*(t.imageL),
-				*(t.imageR),
-				c->preFlowLtoRs[t.index],
-				c->preImageLs[t.index],
-				c->preImageRs[t.index],
-				flowLtoR,
-				DirectionHint::LEFT,
-				t.motionThreshold,
-				c->params);
-			oclComputeOpticalFlow(
-				*(t.imageR),
-				*(t.imageL),
-				c->preFlowRtoLs[t.index],
-				c->preImageRs[t.index],
-				c->preImageLs[t.index],
-				flowRtoL,
-				DirectionHint::RIGHT,
-				t.motionThreshold,
-				c->params);
-
-			// combine novel views
-			if (c->params->isMonoMode) {
-				oclCombineNovelViews(
-					c->warps[t.index],
-					*(t.imageL),
-					*(t.imageR),
-					flowLtoR,
-					flowRtoL,
-					*(t.chunkL));
-			} else {
-				oclCombineNovelViews(
-					c->warpLs[t.index],
-					c->warpRs[t.index],
-					*(t.imageL),
-					*(t.imageR),
-					flowLtoR,
-					flowRtoL,
-					*(t.chunkL),
-					*(t.chunkR));
-			}
+		KernelRegistry::instance().release();
+		if (!cpu) {
+			ocl::Queue::getDefault().~Queue();
+		}
+		LOGD("render thread %d is exited\n", self);
+	}
 
-			// save previous images/flows
-			t.imageL->copyTo(c->preImageLs[t.index]);
-			t.imageR->copyTo(c->preImageRs[t.index]);
-			c->preFlowLtoRs[t.index] = flowLtoR;
-			c->preFlowRtoLs[t.index] = flowRtoL;
+	// push to the deque of the calling worker, or to inQueue if called by the caller thread
+	// @changed: or of another device, the device of the task's pair
+	void pushTask(RenderTask* task, int self) {
+		RenderDevice& device = *devices[pairDevice[task->index]];
+		if (self < 0 || &device != devices[workers[self]->device].get() || !workers[self]->tasks.push(task)) {
+			device.inQueue.enqueue(task);
+		}
+		{
+			lock_guard<mutex> lock(idleMutex);
+			device.queuedTasks++;
+		}
+		// any thread of a single device, otherwise one of the task's device
+		if (devices.size() == 1) {
+			idleCond.notify_one();
+		} else {
+			idleCond.notify_all();
+		}
+	}
+
+	// own deque first (newest), then steal from the others of its device (oldest), then its inQueue
+	RenderTask* takeTask(int self) {
+		RenderDevice& device = *devices[workers[self]->device];
+		RenderTask* task = workers[self]->tasks.pop();
+		size_t n = device.workers.size();
+		size_t own = find(device.workers.begin(), device.workers.end(), self) - device.workers.begin();
+		for (size_t i = 1; task == nullptr && i < n; ++i) {
+			task = workers[device.workers[(own + i) % n]]->tasks.steal();
+		}
+		if (task == nullptr) {
+			device.inQueue.tryDequeue(task);
+		}
+		if (task != nullptr) {
+			device.queuedTasks--;
+		}
+		return task;
+	}
 
-			// wait for opencl completed
+	void runTask(int self, const RenderTask& t) {
+		RenderFrame& f = frames[t.frame % frames.size()];
+		ProfileTask profile(t.frame, t.index);
+		int64 start = getTickCount();
+		float recomputed = 0.0f;
+		if (t.stage == RENDER_FLOW_LTOR || t.stage == RENDER_FLOW_RTOL) {
+			recomputed = renderFlow(self, t.index, t.stage, f.imageLs[t.index], f.imageRs[t.index], t.motionThreshold, t.quality);
+		} else {
+			renderFrameView(f, t.index, t.stage);
+		}
+		// the next stage may run on the queue of another thread
+		ocl::finish();
+		KernelRegistry::instance().collect();
+		int64 end = getTickCount();
+		// @added: read when the frame is rendered, the last chunk sees them through frameMutex
+		RenderTask& task = f.tasks[t.index*kRenderStages + t.stage];
+		task.startTick = start;
+		task.endTick = end;
+		task.recomputed = recomputed;
+
+		{
+			RenderWorker& w = *workers[self];
+			lock_guard<mutex> lock(w.timingMutex);
+			if (w.timings.size() >= 4096) {
+				w.timings.erase(w.timings.begin(), w.timings.begin() + w.timings.size()/2);
+			}
+			double ms = 1000.0/getTickFrequency();
+			OclRenderTaskTiming timing = { t.frame, t.index, t.stage, self, (start - startTick)*ms, (end - startTick)*ms };
+			w.timings.push_back(timing);
+		}
+
+		if (t.stage == RENDER_FLOW_LTOR || t.stage == RENDER_FLOW_RTOL) {
+			// the last flow of the chunk releases its novel views
+			if (f.flowsLeft[t.index].fetch_sub(1) == 1) {
+				RenderTask* views = &f.tasks[t.index*kRenderStages];
+				pushTask(&views[RENDER_NOVEL_VIEW_L], self);
+				if (!params->isMonoMode) {
+					pushTask(&views[RENDER_NOVEL_VIEW_R], self);
+				}
+			}
+		} else if (f.viewsLeft[t.index].fetch_sub(1) == 1) {
+			// the last novel view of the chunk
+			savePrevious(t.index, f.imageLs[t.index], f.imageRs[t.index]);
 			ocl::finish();
-			LOGD("render thread %u finished input task: %d\n", this_thread::get_id(), t.index);
- 
-			// put render result to output queue
-			c->outQueue.enqueue(t);
-			LOGD("render thread %u enqueued output result: %d\n", this_thread::get_id(), t.index);
-        }
+			finishChunk(self, t);
+		}
+	}
 
-		ocl::Queue::getDefault().~Queue();
-		LOGD("render thread %u is exited\n", this_thread::get_id());
+	// the chunk of frame t.frame is rendered, start the same chunk of the next frame if parked
+	void finishChunk(int self, const RenderTask& t) {
+		RenderTask* next = nullptr;
+		{
+			lock_guard<mutex> lock(frameMutex);
+			pairRendered[t.index] = t.frame;
+			RenderFrame& f = frames[t.frame % frames.size()];
+			if (--f.remaining == 0) {
+				frameRendered(f);
+			}
+			if (!pairParked[t.index].empty()) {
+				RenderFrame& n = frames[pairParked[t.index].front() % frames.size()];
+				pairParked[t.index].pop_front();
+				next = &n.tasks[t.index*kRenderStages];
+			}
+		}
+		frameCond.notify_all();
+		if (next) {
+			pushTask(&next[RENDER_FLOW_LTOR], self);
+			pushTask(&next[RENDER_FLOW_RTOL], self);
+		}
 	}
 
 
-	void renderChunk(int index, const UMat& imageL, const UMat& imageR, UMat& chunkL, UMat& chunkR, float motionThreshold) {
+	// @added: the tasks of a rendered frame give its render time and the time of each chunk
+	void frameRendered(const RenderFrame& f) {
+		int n = int(f.imageLs.size());
+		int64 first = 0;
+		int64 last = 0;
+		vector<double> chunkMs(n, 0.0);
+		vector<int> levels(n);
+		float recomputed = 0.0f;
+		double ms = 1000.0/getTickFrequency();
+		for (int i = 0; i < n; ++i) {
+			const RenderTask* tasks = &f.tasks[i*kRenderStages];
+			levels[i] = tasks[RENDER_FLOW_LTOR].quality;
+			recomputed += (tasks[RENDER_FLOW_LTOR].recomputed + tasks[RENDER_FLOW_RTOL].recomputed)/(2*n);
+			for (int stage = 0; stage < kRenderStages; ++stage) {
+				const RenderTask& t = tasks[stage];
+				if (t.endTick == 0) {
+					continue;	// RENDER_NOVEL_VIEW_R in mono mode
+				}
+				first = first == 0 ? t.startTick : std::min(first, t.startTick);
+				last = std::max(last, t.endTick);
+				chunkMs[i] += (t.endTick - t.startTick)*ms;
+			}
+		}
+		recordFrame(f.id, (last - first)*ms, chunkMs, levels, recomputed);
+	}
 
-		// compute optical flows
-		UMat flowLtoR;
-		UMat flowRtoL;
-		oclComputeOpticalFlow(
-			imageL,
-			imageR,
-			preFlowLtoRs[index],
-			preImageLs[index],
-			preImageRs[index],
-			flowLtoR,
-			DirectionHint::LEFT,
-			motionThreshold,
-			params);
-
-		oclComputeOpticalFlow(
-			imageR,
-			imageL,
-			preFlowRtoLs[index],
-			preImageRs[index],
-			preImageLs[index],
-			flowRtoL,
-			DirectionHint::RIGHT,
-			motionThreshold,
-			params);
-
-		// combine novel views
-		if (params->isMonoMode) {
-			oclCombineNovelViews(
-				warps[index],
+	// called with frameMutex held
+	void recordFrame(int64 frame, double renderMs, const vector<double>& chunkMs, const vector<int>& levels, float recomputed) {
+		governor.update(renderMs, chunkMs);
+		if (frameQualities.size() >= 4096) {
+			frameQualities.erase(frameQualities.begin(), frameQualities.begin() + frameQualities.size()/2);
+		}
+		OclFrameQuality quality = { frame, renderMs, levels, recomputed };
+		frameQualities.push_back(quality);
+	}
+
+	// @added
+	// @changed: the flows at the OclFlowQualityLevel quality
+	// @changed: returns the fraction of the flow tiles computed (see OclIncrementalFlow)
+	// @changed: in the workspace of the render thread self (of the caller if < 0)
+	float renderFlow(int self, int index, int stage, const UMat& imageL, const UMat& imageR, float motionThreshold, int quality) {
+		ProfileStage profile("optical flow");
+		OclFlowWorkspace& workspace = self < 0 ? callerWorkspaces[quality] : workers[self]->workspaces[quality];
+		FlowState& state = stage == RENDER_FLOW_LTOR ? flowStateLtoRs[index] : flowStateRtoLs[index];
+		workspace.incrementalFlows = state.incrementalFlows;
+		if (stage == RENDER_FLOW_LTOR) {
+			oclComputeOpticalFlow(
 				imageL,
 				imageR,
-				flowLtoR,
-				flowRtoL,
-				chunkL);
+				preFlowLtoRs[index],
+				preImageLs[index],
+				preImageRs[index],
+				flowLtoRs[index],
+				DirectionHint::LEFT,
+				motionThreshold,
+				params,
+				&workspace,
+				&flowQualities[quality]);
 		} else {
-			oclCombineNovelViews(
-				warpLs[index],
-				warpRs[index],
-				imageL,
+			oclComputeOpticalFlow(
 				imageR,
-				flowLtoR,
-				flowRtoL,
-				chunkL,
-				chunkR);
+				imageL,
+				preFlowRtoLs[index],
+				preImageRs[index],
+				preImageLs[index],
+				flowRtoLs[index],
+				DirectionHint::RIGHT,
+				motionThreshold,
+				params,
+				&workspace,
+				&flowQualities[quality]);
 		}
+		state.incrementalFlows = workspace.incrementalFlows;
+		state.recomputed = workspace.recomputed;
+		return state.recomputed;
+	}
+
+	// @added: one eye, the stereo eyes only differ in their warp
+	// @changed: with panoCol >= 0, rendered into the columns of the panorama from panoCol on
+	void renderNovelView(int index, int stage, const UMat& imageL, const UMat& imageR, UMat& chunk, int panoCol = -1) {
+		ProfileStage profile("novel view");
 
-		// save previous images/flows
+		OclLazyWarp warp = lazyWarp(stage);
+		if (panoCol < 0) {
+			chunk.create(warp.size, CV_8UC4);
+		}
+		oclRenderLazyNovelView(
+			warp,
+			imageL,
+			imageR,
+			flowLtoRs[index],
+			flowRtoLs[index],
+			chunk,
+			std::max(panoCol, 0),
+			panoCol >= 0);
+	}
+
+	// @added: one eye of a chunk of a frame, into its chunk or into its columns of the frame's panorama
+	// the devices never write the same panorama buffer, their chunks are gathered by pollFrame()
+	void renderFrameView(RenderFrame& f, int index, int stage) {
+		if (f.panoL.empty() || devices.size() > 1) {
+			UMat& chunk = stage == RENDER_NOVEL_VIEW_L ? f.chunkLs[index] : f.chunkRs[index];
+			renderNovelView(index, stage, f.imageLs[index], f.imageRs[index], chunk);
+		} else {
+			UMat& pano = stage == RENDER_NOVEL_VIEW_L ? f.panoL : f.panoR;
+			int panoCol = (f.panoOffset + index*params->numNovelViews) % pano.cols;
+			renderNovelView(index, stage, f.imageLs[index], f.imageRs[index], pano, panoCol);
+		}
+	}
+
+	// @added
+	void savePrevious(int index, const UMat& imageL, const UMat& imageR) {
+		ProfileStage profile("save previous");
 		imageL.copyTo(preImageLs[index]);
 		imageR.copyTo(preImageRs[index]);
-		preFlowLtoRs[index] = flowLtoR;
-		preFlowRtoLs[index] = flowRtoL;
+		// ping-pong, the next frame writes its flows into the previous buffers
+		swap(preFlowLtoRs[index], flowLtoRs[index]);
+		swap(preFlowRtoLs[index], flowRtoLs[index]);
+	}
+
+
+	// the same stages as the render threads run
+	void renderChunk(RenderFrame& f, int index, float motionThreshold, int quality) {
+		renderFlow(-1, index, RENDER_FLOW_LTOR, f.imageLs[index], f.imageRs[index], motionThreshold, quality);
+		renderFlow(-1, index, RENDER_FLOW_RTOL, f.imageLs[index], f.imageRs[index], motionThreshold, quality);
+		renderFrameView(f, index, RENDER_NOVEL_VIEW_L);
+		if (!params->isMonoMode) {
+			renderFrameView(f, index, RENDER_NOVEL_VIEW_R);
+		}
+		savePrevious(index, f.imageLs[index], f.imageRs[index]);
 	}
 
 
@@ -363,15 +874,18 @@ struct RenderContext {
 			chunkRs.assign(imgRs.size(), UMat());
 		}
 
+		/* @deleted: submitFrame() renders on the caller thread if there are no render threads
 		// no render threads
-		if (threads.size() == 0) {
+		if (workers.size() == 0) {
 			for (int index = 0; index < imgLs.size(); ++index) {
 				renderChunk(index, imgLs[index], imgRs[index], chunkLs[index], chunkRs[index], motionThreshold);
 				ocl::finish();
 			}
 			return;
 		}
+		*/
 
+		/* @deleted
 		// put task to input queue
 		for (int index = 0; index < imgLs.size(); ++index) {
 			RenderTask task = { index, &imgLs[index], &imgRs[index], &chunkLs[index], &chunkRs[index], motionThreshold };
@@ -384,6 +898,175 @@ struct RenderContext {
 			chunkLs[out.index] = *(out.chunkL);
 			chunkRs[out.index] = *(out.chunkR);
 		}
+		*/
+		// @changed: a synchronous render is a submit immediately followed by a blocking poll
+		int64 frame = submitFrame(imgLs, imgRs, motionThreshold);
+		if (frame < 0) {
+			CV_Error(Error::StsError, "too many frames in flight, poll the submitted frames first");
+		}
+		pollFrame(frame, chunkLs, chunkRs, true);
+	}
+
+	// @added: the chunks rendered straight into the panoramas, chunk 0 starts at column panoOffset
+	void renderPanoramas(const vector<UMat>& imgLs, const vector<UMat>& imgRs, UMat& panoL, UMat& panoR, int panoOffset, float motionThreshold) {
+		CV_Assert(!imgLs.empty());
+		Size panoSize(params->numNovelViews*int(imgLs.size()), params->opticalFlowSize.height);
+		panoL.create(panoSize, CV_8UC4);
+		if (!params->isMonoMode) {
+			panoR.create(panoSize, CV_8UC4);
+		}
+		panoOffset %= panoSize.width;
+		panoOffset += panoOffset < 0 ? panoSize.width : 0;
+		int64 frame = submitFrame(imgLs, imgRs, motionThreshold, panoL, panoR, panoOffset);
+		if (frame < 0) {
+			CV_Error(Error::StsError, "too many frames in flight, poll the submitted frames first");
+		}
+		vector<UMat> chunkLs, chunkRs;
+		pollFrame(frame, chunkLs, chunkRs, true);
+	}
+
+
+	// @added
+	// @changed: panoL/panoR (and panoOffset) select the panoramas the chunks are rendered into
+	int64 submitFrame(const vector<UMat>& imgLs, const vector<UMat>& imgRs, float motionThreshold,
+		const UMat& panoL = UMat(), const UMat& panoR = UMat(), int panoOffset = 0) {
+		CV_Assert(imgLs.size() == imgRs.size() && imgLs.size() <= params->numSideCams);
+		unique_lock<mutex> lock(frameMutex);
+		RenderFrame& f = frames[nextFrame % frames.size()];
+		if (f.id >= 0) {
+			return -1;
+		}
+		f.id = nextFrame++;
+		f.imageLs = imgLs;
+		f.imageRs = imgRs;
+		f.chunkLs.resize(imgLs.size());
+		f.chunkRs.resize(imgRs.size());
+		f.panoL = panoL;
+		f.panoR = panoR;
+		f.panoOffset = panoOffset;
+		f.remaining = int(imgLs.size());
+
+		// no render threads
+		if (workers.size() == 0) {
+			vector<int> levels(governor.levels.begin(), governor.levels.begin() + f.imageLs.size());
+			vector<double> chunkMs(levels.size());
+			float recomputed = 0.0f;
+			int64 first = getTickCount();
+			lock.unlock();
+			for (int index = 0; index < f.imageLs.size(); ++index) {
+				ProfileTask profile(f.id, index);
+				int64 start = getTickCount();
+				renderChunk(f, index, motionThreshold, levels[index]);
+				ocl::finish();
+				recomputed += (flowStateLtoRs[index].recomputed + flowStateRtoLs[index].recomputed)/(2*levels.size());
+				chunkMs[index] = (getTickCount() - start)*1000.0/getTickFrequency();
+			}
+			lock.lock();
+			f.remaining = 0;
+			recordFrame(f.id, (getTickCount() - first)*1000.0/getTickFrequency(), chunkMs, levels, recomputed);
+			return f.id;
+		}
+
+		for (int index = 0; index < f.imageLs.size(); ++index) {
+			RenderTask* tasks = &f.tasks[index*kRenderStages];
+			for (int stage = 0; stage < kRenderStages; ++stage) {
+				RenderTask task = { index, stage, f.id, motionThreshold, governor.levels[index], 0, 0 };
+				tasks[stage] = task;
+			}
+			f.flowsLeft[index] = 2;
+			f.viewsLeft[index] = params->isMonoMode ? 1 : 2;
+			// the chunk waits for the same chunk of the previous frame
+			bool busy = pairSubmitted[index] != pairRendered[index];
+			pairSubmitted[index] = f.id;
+			if (busy) {
+				pairParked[index].push_back(f.id);
+			} else {
+				pushTask(&tasks[RENDER_FLOW_LTOR], -1);
+				pushTask(&tasks[RENDER_FLOW_RTOL], -1);
+			}
+		}
+		return f.id;
+	}
+
+	bool pollFrame(int64 frame, vector<UMat>& chunkLs, vector<UMat>& chunkRs, bool wait) {
+		CV_Assert(frame >= 0);
+		unique_lock<mutex> lock(frameMutex);
+		RenderFrame& f = frames[frame % frames.size()];
+		CV_Assert(f.id == frame);
+		if (wait) {
+			frameCond.wait(lock, [&] { return f.remaining == 0; });
+		} else if (f.remaining > 0) {
+			return false;
+		}
+		// hand over the chunks, the caller's old buffers are recycled by later frames
+		// @changed: the chunks of several devices are copied into the panoramas, and kept for the next frames
+		if (f.panoL.empty()) {
+			swap(chunkLs, f.chunkLs);
+			swap(chunkRs, f.chunkRs);
+		} else if (devices.size() > 1) {
+			gatherPanoramas(f);
+		}
+		f.imageLs.clear();
+		f.imageRs.clear();
+		f.panoL.release();
+		f.panoR.release();
+		f.id = -1;
+		return true;
+	}
+
+	// @added: the chunks into their columns of the panoramas on the queue of the caller, after all
+	// devices rendered them. A chunk wraps around the right edge of the panorama.
+	void gatherPanoramas(RenderFrame& f) {
+		for (int eye = 0; eye < (params->isMonoMode ? 1 : 2); ++eye) {
+			UMat& pano = eye == 0 ? f.panoL : f.panoR;
+			const vector<UMat>& chunks = eye == 0 ? f.chunkLs : f.chunkRs;
+			for (size_t index = 0; index < chunks.size(); ++index) {
+				const UMat& chunk = chunks[index];
+				int col = (f.panoOffset + int(index)*params->numNovelViews) % pano.cols;
+				int width = std::min(chunk.cols, pano.cols - col);
+				chunk.colRange(0, width).copyTo(pano.colRange(col, col + width));
+				if (width < chunk.cols) {
+					chunk.colRange(width, chunk.cols).copyTo(pano.colRange(0, chunk.cols - width));
+				}
+			}
+		}
+		ocl::finish();
+	}
+
+	// @added
+	void getDevices(vector<OclRenderDevice>& infos) {
+		infos.clear();
+		for (unique_ptr<RenderDevice>& d : devices) {
+			infos.push_back(d->info);
+		}
+	}
+
+	// @added
+	void getFrameQualities(vector<OclFrameQuality>& qualities) {
+		lock_guard<mutex> lock(frameMutex);
+		qualities.clear();
+		swap(qualities, frameQualities);
+	}
+
+	void getTimings(vector<OclRenderTaskTiming>& timings) {
+		timings.clear();
+		for (unique_ptr<RenderWorker>& w : workers) {
+			lock_guard<mutex> lock(w->timingMutex);
+			timings.insert(timings.end(), w->timings.begin(), w->timings.end());
+			w->timings.clear();
+		}
+	}
+
+	void waitFrames() {
+		unique_lock<mutex> lock(frameMutex);
+		frameCond.wait(lock, [&] {
+			for (RenderFrame& f : frames) {
+				if (f.id >= 0 && f.remaining > 0) {
+					return false;
+				}
+			}
+			return true;
+		});
 	}
 };
 
@@ -426,7 +1109,8 @@ CV_EXPORTS_W void oclRenderStereoPanoramaChunks(
 	vector<UMat>& chunks,
 	float motionThreshold) {
 	RenderContext& context = RenderContext::instance();
-	CV_Assert(context.params->isMonoMode && context.isInit());
+	// @changed: isInit() first, params is null before oclInitialize()
+	CV_Assert(context.isInit() && context.params->isMonoMode);
 	vector<UMat> chunkDummys;
 	context.renderChunks(imageLs, imageRs, chunks, chunkDummys, motionThreshold);
 	ocl::finish();
@@ -441,12 +1125,94 @@ CV_EXPORTS_W void oclRenderStereoPanoramaChunks(
 	std::vector<UMat>& chunkRs,
 	float motionThreshold) {
 	RenderContext& context = RenderContext::instance();
-	CV_Assert(!context.params->isMonoMode && context.isInit());
+	// @changed: isInit() first, params is null before oclInitialize()
+	CV_Assert(context.isInit() && !context.params->isMonoMode);
 	context.renderChunks(imageLs, imageRs, chunkLs, chunkRs, motionThreshold);
 	ocl::finish();
 }
 
 
+CV_EXPORTS_W void oclRenderStereoPanorama(
+	const std::vector<UMat>& imageLs,
+	const std::vector<UMat>& imageRs,
+	UMat& pano,
+	int wrapOffset,
+	float motionThreshold) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit() && context.params->isMonoMode);
+	UMat panoDummy;
+	context.renderPanoramas(imageLs, imageRs, pano, panoDummy, wrapOffset, motionThreshold);
+	ocl::finish();
+}
+
+
+CV_EXPORTS_W void oclRenderStereoPanorama(
+	const std::vector<UMat>& imageLs,
+	const std::vector<UMat>& imageRs,
+	UMat& panoL,
+	UMat& panoR,
+	int wrapOffset,
+	float motionThreshold) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit() && !context.params->isMonoMode);
+	context.renderPanoramas(imageLs, imageRs, panoL, panoR, wrapOffset, motionThreshold);
+	ocl::finish();
+}
+
+
+CV_EXPORTS_W int64 oclSubmitStereoPanoramaChunks(
+	const std::vector<UMat>& imageLs,
+	const std::vector<UMat>& imageRs,
+	float motionThreshold) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit());
+	return context.submitFrame(imageLs, imageRs, motionThreshold);
+}
+
+
+CV_EXPORTS_W bool oclPollStereoPanoramaChunks(
+	int64 frame,
+	std::vector<UMat>& chunks,
+	bool wait) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit() && context.params->isMonoMode);
+	vector<UMat> chunkDummys;
+	return context.pollFrame(frame, chunks, chunkDummys, wait);
+}
+
+
+CV_EXPORTS_W bool oclPollStereoPanoramaChunks(
+	int64 frame,
+	std::vector<UMat>& chunkLs,
+	std::vector<UMat>& chunkRs,
+	bool wait) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit() && !context.params->isMonoMode);
+	return context.pollFrame(frame, chunkLs, chunkRs, wait);
+}
+
+
+CV_EXPORTS_W void oclGetRenderTaskTimings(std::vector<OclRenderTaskTiming>& timings) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit());
+	context.getTimings(timings);
+}
+
+
+// @added
+CV_EXPORTS_W void oclGetRenderDevices(std::vector<OclRenderDevice>& devices) {
+	RenderContext& context = RenderContext::instance();
+	context.getDevices(devices);
+}
+
+// @added
+CV_EXPORTS_W void oclGetFrameQualities(std::vector<OclFrameQuality>& qualities) {
+	RenderContext& context = RenderContext::instance();
+	CV_Assert(context.isInit());
+	context.getFrameQualities(qualities);
+}
+
+
 CV_EXPORTS_W void oclClearPreviousFrames() {
 	RenderContext& context = RenderContext::instance();
 	context.resetPrevious();
@@ -454,6 +1220,13 @@ CV_EXPORTS_W void oclClearPreviousFrames() {
 }
 
 static bool oclSelectDevice(string& device) {
+	// a device configured by the caller (e.g. ":CPU:" for PoCL) is used as is
+	const char* configured = getenv("OPENCV_OPENCL_DEVICE");
+	if (configured && *configured) {
+		device = configured;
+		return ocl::haveOpenCL();
+	}
+
 	// no platforms
 	vector<ocl::PlatformInfo> platformInfos;
 	ocl::getPlatfomsInfo(platformInfos);
@@ -488,6 +1261,7 @@ static bool oclSelectDevice(string& device) {
 		}
 	}
 	device = ":GPU:" + deviceName;
+	return true;
 }
 
 
@@ -498,11 +1272,121 @@ CV_EXPORTS_W bool oclDeviceAvailable() {
 }
 
 
+// @added: devices of the same model, the programs and the flow timings of one fit the other
+static bool oclSameDevice(const ocl::Device& a, const ocl::Device& b) {
+	return a.type() == b.type() && a.vendorName() == b.vendorName() && a.name() == b.name();
+}
+
+// @added: the devices of OclInitParameters::maxDevices (indices in the default context), before any UMat
+// is allocated. The default context is replaced by one with all the devices of the type of the selected
+// one, the devices of another name or vendor in it are left out. Fewer than two: the selected one only.
+static vector<int> oclSelectRenderDevices(int maxDevices) {
+	ocl::Context& context = ocl::Context::getDefault();
+	vector<int> indices(1, 0);
+	if (maxDevices <= 1 || context.ndevices() == 0) {
+		return indices;
+	}
+	ocl::Device selected = context.device(0);
+	ocl::Context multi = context;
+	if (context.ndevices() < 2) {
+		multi = ocl::Context();
+		if (!multi.create(selected.type()) || multi.ndevices() < 2 || !oclSameDevice(multi.device(0), selected)) {
+			LOGD("single device render: no other device like %s\n", selected.name().c_str());
+			return indices;
+		}
+	}
+	vector<int> like;
+	for (int i = 0; i < int(multi.ndevices()) && int(like.size()) < maxDevices; ++i) {
+		if (oclSameDevice(multi.device(i), selected)) {
+			like.push_back(i);
+		}
+	}
+	if (like.size() < 2) {
+		LOGD("single device render: no other device like %s\n", selected.name().c_str());
+		return indices;
+	}
+	if (context.ndevices() < 2) {
+		context = multi;
+		ocl::Queue::getDefault().create(context, context.device(0));
+	}
+	return like;
+}
+
+// @added: the time of a flow of opticalFlowSize on a device of the default context
+static double oclMeasureFlowMs(const OclInitParameters* params, int index) {
+	ocl::Context& context = ocl::Context::getDefault();
+	ocl::Queue& queue = ocl::Queue::getDefault();
+	ocl::Queue saved = queue;
+	// the kernels of this thread are the ones of its device (see ProgramCache)
+	KernelRegistry::instance().release();
+	queue.create(context, context.device(index));
+	double ms = 0;
+	{
+		Mat host(params->opticalFlowSize, CV_8UC4);
+		RNG rng(0x5a17);
+		rng.fill(host, RNG::UNIFORM, Scalar::all(0), Scalar::all(256));
+		UMat I0, I1, flow;
+		host.copyTo(I0);
+		host.copyTo(I1);
+		OclFlowWorkspace workspace;
+		// the first flow builds the programs for the device and fills the workspace
+		oclComputeOpticalFlow(I0, I1, UMat(), UMat(), UMat(), flow, DirectionHint::LEFT, 1.0f, params, &workspace);
+		int64 start = getTickCount();
+		oclComputeOpticalFlow(I0, I1, UMat(), UMat(), UMat(), flow, DirectionHint::LEFT, 1.0f, params, &workspace);
+		ms = (getTickCount() - start)*1000.0/getTickFrequency();
+	}
+	queue.finish();
+	KernelRegistry::instance().release();
+	queue = saved;
+	return std::max(ms, 1e-3);
+}
+
+
+// @added: the startup report of the last oclInitialize(), the program counters are the ProgramCache ones
+static OclStartupReport startupReport;
+static int64 startupTick = 0;
+static OclMemoryPlan memoryPlan;	// @added: of the last oclInitialize()
+
+
+// @added: the render threads on the CPU backend, the flows in fp32 buffers (rounded through fp16 with halfStorage)
+static bool oclInitializeCpu(const OclInitParameters* params) {
+	setCpuBackend(true);
+	ocl::setUseOpenCL(false);
+	Profiler::enable(false);
+
+	int numThreads = params->numRenderThreads > 0 ? params->numRenderThreads : 2;
+
+	// start render
+	RenderContext& context = RenderContext::instance();
+	context.init(params);
+	context.startThreads(numThreads);
+	oclInitGammaLUT();
+	startupReport.totalMs = (getTickCount() - startupTick)*1000.0/getTickFrequency();	// @added
+	return true;
+}
+
 CV_EXPORTS_W bool oclInitialize(const OclInitParameters* params) {
+	/* @changed: falls back to the CPU backend without a device (see OclBackend)
 	string device;
 	if (!oclSelectDevice(device)) {
 		return false;
 	}
+	*/
+	CV_Assert(params != nullptr);
+	// @added
+	startupTick = getTickCount();
+	startupReport = OclStartupReport();
+	memoryPlan = OclMemoryPlan();
+	ProgramCache::instance().resetReport();
+	ProgramCache::instance().setDirectory(params->programCacheDir);
+	string device;
+	if (params->backend == BACKEND_CPU || (params->backend == BACKEND_AUTO && !oclSelectDevice(device))) {
+		return oclInitializeCpu(params);
+	}
+	setCpuBackend(false);
+	if (params->backend == BACKEND_OPENCL && !oclSelectDevice(device)) {
+		return false;
+	}
 
 	char value[64];
 	if (!getenv("OPENCV_OPENCL_DEVICE")) {
@@ -510,8 +1394,10 @@ CV_EXPORTS_W bool oclInitialize(const OclInitParameters* params) {
 		putenv(value);
 	}
 
+	vector<int> renderDevices(1, 0);	// @added
 	if (ocl::haveOpenCL()) {
 		ocl::setUseOpenCL(true);
+		renderDevices = oclSelectRenderDevices(params->maxDevices);	// @added
 		if (ocl::haveSVM()) {
 			ocl::Context::getDefault().useSVM();
 		}
@@ -521,30 +1407,54 @@ CV_EXPORTS_W bool oclInitialize(const OclInitParameters* params) {
     }
 	
 	size_t maxBufferPoolSize = ocl::Device::getDefault().globalMemSize();
+	// @added: the pools never keep more than the budget
+	if (params->memoryBudget > 0) {
+		maxBufferPoolSize = std::min(maxBufferPoolSize, params->memoryBudget);
+	}
 	setBufferPoolSize(maxBufferPoolSize);
+	int64 start = getTickCount();	// @added
+	oclPreloadKernels(params->halfStorage);
+	startupReport.preloadMs = (getTickCount() - start)*1000.0/getTickFrequency();	// @added
 
-	CV_Assert(params != nullptr);
 	//
 	// TODO: check params validation
 	//
-	// pre-alloc buffers and warm up
-	int numThreads = 4;
-	bool succeed = oclInitBuffers(
-		params->numSideCams,
-		params->opticalFlowSize,
-		Size(params->numNovelViews, params->opticalFlowSize.height),
-		numThreads);
-	if (!succeed) {
+	// the threads the device memory allows, planned from the buffer lifetimes (see oclPlanMemory())
+	start = getTickCount();
+	if (!oclPlanMemory(*params, memoryPlan)) {
 		return false;
 	}
+	LOGD("%s\n", oclMemoryPlanSummary(memoryPlan).c_str());
+	int numThreads = memoryPlan.numThreads;
+	startupReport.buffersMs = (getTickCount() - start)*1000.0/getTickFrequency();	// @added
+	if (params->numRenderThreads > 0) {
+		numThreads = params->numRenderThreads;
+	}
 	releaseBufferPool();
 
+	// @added: every device needs a render thread, no more devices than the planned threads
+	if (int(renderDevices.size()) > numThreads) {
+		LOGD("render on %d of %d devices, the threads of the memory plan\n", numThreads, int(renderDevices.size()));
+		renderDevices.resize(std::max(numThreads, 1));
+	}
+
 	// start render
 	RenderContext& context = RenderContext::instance();
 	context.init(params);
+	// @added: the camera pairs in proportion to the flow throughput of each device
+	if (renderDevices.size() > 1) {
+		vector<double> flowMs;
+		for (int index : renderDevices) {
+			flowMs.push_back(oclMeasureFlowMs(params, index));
+			LOGD("device %d (%s): %.2f ms per flow\n", index,
+				ocl::Context::getDefault().device(index).name().c_str(), flowMs.back());
+		}
+		context.partition(renderDevices, flowMs);
+	}
 	context.startThreads(numThreads);
 	oclInitGammaLUT();
 	ocl::finish();
+	startupReport.totalMs = (getTickCount() - startupTick)*1000.0/getTickFrequency();	// @added
     return true;
 }
 
@@ -553,8 +1463,29 @@ CV_EXPORTS_W void oclRelease() {
 	context.stopThreads();
 	context.release();
 	oclReleaseGammaLUT();
+	oclReleaseProjectionBatch();	// @added
 	releaseBufferPool();
 	ocl::finish();
+	KernelRegistry::instance().release();
+	ProgramCache::instance().release();	// @added
+	setCpuBackend(false);	// @added
+}
+
+// @added
+CV_EXPORTS_W int oclActiveBackend() {
+	return cpuBackend() ? BACKEND_CPU : BACKEND_OPENCL;
+}
+
+// @added
+CV_EXPORTS_W OclStartupReport oclGetStartupReport() {
+	OclStartupReport report = startupReport;
+	ProgramCache::instance().getReport(report);
+	return report;
+}
+
+// @added
+CV_EXPORTS_W void oclGetMemoryPlan(OclMemoryPlan& plan) {
+	plan = memoryPlan;
 }
 
 
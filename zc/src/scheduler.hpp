@@ -0,0 +1,86 @@
+#ifndef _OPENCV_IMVT_SCHEDULER_HPP_
+#define _OPENCV_IMVT_SCHEDULER_HPP_
+
+#include <atomic>
+#include <vector>
+
+#include "precomp.hpp"
+
+namespace cv {
+namespace ocl {
+namespace imvt {
+
+/**
+* @brief Lock-free work-stealing deque of task pointers (Chase-Lev, fixed capacity).
+*
+* Only the owner thread may push() and pop() at the bottom, any thread may steal() from the top.
+* The tasks are owned by the caller and must outlive their stay in the deque.
+*/
+template<typename T>
+class WorkStealingDeque {
+public:
+	explicit WorkStealingDeque(int capacity = 1024) : buffer(capacity), mask(capacity - 1), top(0), bottom(0) {
+		CV_Assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+	}
+
+	// owner only, false if the deque is full
+	bool push(T* task) {
+		long long b = bottom.load(std::memory_order_relaxed);
+		long long t = top.load(std::memory_order_acquire);
+		if (b - t > mask) {
+			return false;
+		}
+		buffer[b & mask].store(task, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// owner only, the most recently pushed task or nullptr
+	T* pop() {
+		long long b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long t = top.load(std::memory_order_relaxed);
+		T* task = nullptr;
+		if (t <= b) {
+			task = buffer[b & mask].load(std::memory_order_relaxed);
+			if (t == b) {
+				// the last task, race against the thieves
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					task = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+		} else {
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return task;
+	}
+
+	// any thread, the oldest task or nullptr (empty or lost the race)
+	T* steal() {
+		long long t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		long long b = bottom.load(std::memory_order_acquire);
+		if (t < b) {
+			T* task = buffer[t & mask].load(std::memory_order_relaxed);
+			if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return task;
+			}
+		}
+		return nullptr;
+	}
+
+private:
+	std::vector<std::atomic<T*>> buffer;
+	long long mask;
+	std::atomic<long long> top;
+	std::atomic<long long> bottom;
+};
+
+}	// namespace imvt
+}	// namespace ocl
+}	// namespace cv
+
+#endif	// _OPENCV_IMVT_SCHEDULER_HPP_
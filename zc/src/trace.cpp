@@ -1,5 +1,8 @@
 #include <cstdarg>
+#include <stdio.h>
+#include <string.h>
 #include <iostream>
+#include "opencv2/core/ocl.hpp"
 #include "opencv2/oclrenderpano/trace.hpp"
 
 namespace cv {
@@ -8,6 +11,15 @@ namespace imvt {
 
 using namespace std;
 
+// @added: the recording state of a thread, see MatTrace::record()
+struct TraceThread {
+	bool active = false;
+	string kind;
+	string prefix;
+	int64 lastTick = 0;
+};
+static thread_local TraceThread traceThread;
+
 MatTrace& MatTrace::instance() {
 	static MatTrace mt;
 	return mt;
@@ -16,13 +28,21 @@ MatTrace& MatTrace::instance() {
 void MatTrace::add(const string& kind, const string& key, const Mat& value) {
 	//std::cout << "add mat " << kind  << " " << key << " cols=" << value.cols << " rows=" << value.rows 
 	//	<< " channels=" << value.channels() << " type=" << value.type() << std::endl;
+	/* @changed
 	value.copyTo(mats[kind][key]);
+	*/
+	lock_guard<std::mutex> lock(mutex);
+	put(kind, key, value, 0);
 }
 
 void MatTrace::add(const string& kind, const string& key, const UMat& value) {
 	//std::cout << "add umat " << kind << " " << key << " cols=" << value.cols << " rows=" << value.rows
 	//	<< " channels=" << value.channels() << " type=" << value.type() << std::endl;
+	/* @changed
 	value.copyTo(mats[kind][key]);
+	*/
+	lock_guard<std::mutex> lock(mutex);
+	put(kind, key, value.getMat(ACCESS_READ), 0);
 }
 
 map<string, Mat> MatTrace::get(const string& kind) {
@@ -57,6 +77,189 @@ map<string, Mat> MatTrace::diff(const string& kind1, const string& kind2) {
 }
 
 
+// @added
+void MatTrace::put(const string& kind, const string& key, const Mat& value, double ms) {
+	if (mats[kind].count(key) == 0) {
+		order[kind].push_back(key);
+	}
+	value.copyTo(mats[kind][key]);
+	times[kind][key] = ms;
+}
+
+void MatTrace::record(const string& kind) {
+	lock_guard<std::mutex> lock(mutex);
+	mats.erase(kind);
+	order.erase(kind);
+	times.erase(kind);
+	traceThread.kind = kind;
+	traceThread.prefix.clear();
+	traceThread.lastTick = getTickCount();
+	traceThread.active = true;
+}
+
+void MatTrace::stop() {
+	traceThread.active = false;
+}
+
+bool MatTrace::recording() const {
+	return traceThread.active;
+}
+
+void MatTrace::scope(const string& name) {
+	ocl::finish();
+	traceThread.prefix = name;
+	traceThread.lastTick = getTickCount();
+}
+
+void MatTrace::capture(const string& key, const Mat& value, bool half) {
+	if (!recording()) {
+		return;
+	}
+	double ms = (getTickCount() - traceThread.lastTick)*1000.0/getTickFrequency();
+	Mat m = value;
+	if (half) {
+		CV_Assert(value.depth() == CV_16S);
+		convertFp16(value, m);
+	}
+	{
+	lock_guard<std::mutex> lock(mutex);
+	put(traceThread.kind, traceThread.prefix.empty() ? key : traceThread.prefix + "/" + key, m, ms);
+	}
+	// the copy is not part of the next stage
+	traceThread.lastTick = getTickCount();
+}
+
+void MatTrace::capture(const string& key, const UMat& value, bool half) {
+	if (!recording()) {
+		return;
+	}
+	ocl::finish();
+	Mat m;
+	{
+	Mat v = value.getMat(ACCESS_READ);
+	v.copyTo(m);
+	}
+	capture(key, m, half);
+}
+
+vector<string> MatTrace::keys(const string& kind) {
+	lock_guard<std::mutex> lock(mutex);
+	return order.count(kind) > 0 ? order[kind] : vector<string>();
+}
+
+double MatTrace::time(const string& kind, const string& key) {
+	lock_guard<std::mutex> lock(mutex);
+	return times.count(kind) > 0 && times[kind].count(key) > 0 ? times[kind][key] : 0.0;
+}
+
+// a trace bundle: the header, then each key as its header, its name and its rows
+static const int kTraceMagic = 0x5254435a;	// "ZCTR"
+static const int kTraceVersion = 1;
+
+struct TraceHeader {
+	int magic;
+	int version;
+	int count;
+	int pad;
+};
+
+struct TraceEntryHeader {
+	int keyLength;
+	int rows;
+	int cols;
+	int type;
+	double ms;
+};
+
+bool MatTrace::save(const string& kind, const string& path) {
+	lock_guard<std::mutex> lock(mutex);
+	CV_Assert(mats.count(kind) > 0);
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	const vector<string>& keys = order[kind];
+	TraceHeader header = { kTraceMagic, kTraceVersion, (int)keys.size(), 0 };
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (size_t i = 0; i < keys.size() && ok; ++i) {
+		const Mat& m = mats[kind][keys[i]];
+		CV_Assert(m.dims <= 2);
+		TraceEntryHeader entry = { (int)keys[i].size(), m.rows, m.cols, m.type(), times[kind][keys[i]] };
+		ok = fwrite(&entry, sizeof(entry), 1, fp) == 1 && fwrite(keys[i].data(), 1, keys[i].size(), fp) == keys[i].size();
+		for (int y = 0; y < m.rows && ok; ++y) {
+			ok = fwrite(m.ptr(y), m.elemSize(), m.cols, fp) == size_t(m.cols);
+		}
+	}
+	return fclose(fp) == 0 && ok;
+}
+
+bool MatTrace::load(const string& path, const string& kind) {
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (!fp) {
+		return false;
+	}
+	TraceHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 && header.magic == kTraceMagic && header.version == kTraceVersion;
+	lock_guard<std::mutex> lock(mutex);
+	mats.erase(kind);
+	order.erase(kind);
+	times.erase(kind);
+	for (int i = 0; i < header.count && ok; ++i) {
+		TraceEntryHeader entry;
+		ok = fread(&entry, sizeof(entry), 1, fp) == 1 && entry.keyLength > 0 && entry.keyLength < 4096;
+		string key(ok ? entry.keyLength : 0, ' ');
+		ok = ok && fread(&key[0], 1, key.size(), fp) == key.size();
+		Mat m;
+		if (ok) {
+			m.create(entry.rows, entry.cols, entry.type);
+		}
+		for (int y = 0; y < m.rows && ok; ++y) {
+			ok = fread(m.ptr(y), m.elemSize(), m.cols, fp) == size_t(m.cols);
+		}
+		if (ok) {
+			put(kind, key, m, entry.ms);
+		}
+	}
+	fclose(fp);
+	return ok;
+}
+
+vector<MatTraceDiff> MatTrace::compare(const string& kindA, const string& kindB) {
+	lock_guard<std::mutex> lock(mutex);
+	vector<string> keys = order[kindA];
+	for (const string& key : order[kindB]) {
+		if (mats[kindA].count(key) == 0) {
+			keys.push_back(key);
+		}
+	}
+	vector<MatTraceDiff> results;
+	for (const string& key : keys) {
+		MatTraceDiff d;
+		d.key = key;
+		d.inA = mats[kindA].count(key) > 0;
+		d.inB = mats[kindB].count(key) > 0;
+		d.msA = d.inA ? times[kindA][key] : 0.0;
+		d.msB = d.inB ? times[kindB][key] : 0.0;
+		if (d.inA && d.inB) {
+			const Mat& a = mats[kindA][key];
+			const Mat& b = mats[kindB][key];
+			d.sameShape = a.size() == b.size() && a.type() == b.type();
+			if (d.sameShape && !a.empty()) {
+				Mat fa, fb, error;
+				a.convertTo(fa, CV_64F);
+				b.convertTo(fb, CV_64F);
+				absdiff(fa, fb, error);
+				error = error.reshape(1);
+				minMaxLoc(error, nullptr, &d.maxError);
+				d.meanError = mean(error)[0];
+			}
+		}
+		results.push_back(d);
+	}
+	return results;
+}
+
+
 CV_EXPORTS_W string format(const char* fmt, ...) {
 	char buf[1024];
 	va_list ap;
@@ -11,9 +11,19 @@
 #include <iostream>
 #include "precomp.hpp"
 #include "opencl_kernels_oclrenderpano.hpp"
+#include "kernels.hpp"
+#include "profiler.hpp"
+#include "cpubackend.hpp"
 #include "opencv2/oclrenderpano/ocl_optflow.hpp"
 
 
+#if 0
+#define LOGD printf
+#else
+#define LOGD(...)
+#endif
+
+
 namespace cv {
 namespace ocl {
 namespace imvt {
@@ -30,7 +40,7 @@ static void oclCubicRemap(const UMat& src, UMat& dst, const UMat& mapx, const UM
 	string srcType = s.type() == CV_8UC4 ? "_8UC4" : "_8UC3";
 	string mapType = "_32FC1";
 	string kernelName = string("cubic_remap") + srcType + mapType;
-	ocl::Kernel k(kernelName.c_str(), ocl::oclrenderpano::remap_oclsrc);
+	OclKernel& k = oclKernel(kernelName.c_str(), ocl::oclrenderpano::remap_oclsrc);
 	k.args(ocl::KernelArg::ReadOnly(src),
 		ocl::KernelArg::WriteOnly(dst),
 		ocl::KernelArg::ReadOnlyNoSize(mapx),
@@ -45,6 +55,7 @@ CV_EXPORTS_W void oclProjection(
 	const vector<UMat>& xmap,
 	const vector<UMat>& ymap,
 	vector<UMat>& dstImages) {
+	ProfileStage stage("projection");
 
 
 	vector<UMat> outImages(srcImages.size());
@@ -52,6 +63,16 @@ CV_EXPORTS_W void oclProjection(
 		dstImages = outImages;
 	}
 
+	// @added
+	if (cpuBackend()) {
+		for (int i = 0; i < srcImages.size(); ++i) {
+			dstImages[i].create(xmap[i].size(), CV_8UC4);
+			Mat dst = dstImages[i].getMat(ACCESS_WRITE);
+			cpuProjection(srcImages[i].getMat(ACCESS_READ), xmap[i].getMat(ACCESS_READ), ymap[i].getMat(ACCESS_READ), dst);
+		}
+		return;
+	}
+
 	for (int i = 0; i < srcImages.size(); ++i) {
 		if (srcImages[i].type() == CV_8UC3) {
 			UMat dstImage;
@@ -65,14 +86,324 @@ CV_EXPORTS_W void oclProjection(
 }
 
 
+// @added: the packed maps and the camera table of oclProjectionBatched(), per calling thread
+struct ProjectionBatch {
+	static const int kTableInts = 8;	// see batch_cubic_remap
+	vector<UMat> xmaps;		// the maps packed into maps, referenced so their buffers stay unique
+	vector<UMat> ymaps;
+	UMat maps;				// CV_32FC2, the maps of the cameras stacked vertically
+	Mat table;				// kTableInts ints per camera
+	UMat utable;
+
+	static ProjectionBatch& instance() {
+		static thread_local ProjectionBatch batch;
+		return batch;
+	}
+
+	static bool sameBuffers(const vector<UMat>& a, const vector<UMat>& b) {
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); ++i) {
+			if (a[i].u != b[i].u || a[i].offset != b[i].offset || a[i].size() != b[i].size()) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+CV_EXPORTS_W void oclProjectionBatched(
+	const vector<UMat>& srcImages,
+	const vector<UMat>& xmap,
+	const vector<UMat>& ymap,
+	vector<UMat>& dstImages) {
+	ProfileStage stage("projection");
+	int n = (int)srcImages.size();
+	CV_Assert(n > 0 && xmap.size() == srcImages.size() && ymap.size() == srcImages.size());
+	int type = srcImages[0].type();
+	CV_Assert(type == CV_8UC3 || type == CV_8UC4);
+
+	// @added: no batching on the CPU backend, the cameras of one call run one after the other
+	if (cpuBackend()) {
+		oclProjection(srcImages, xmap, ymap, dstImages);
+		return;
+	}
+
+	// the rows of camera i in the packed maps and dst start at firstRow[i]
+	vector<int> firstRow(n + 1, 0);
+	int cols = 0;
+	int rows = 0;
+	bool oneBuffer = true;
+	for (int i = 0; i < n; ++i) {
+		CV_Assert(srcImages[i].type() == type && srcImages[i].dims <= 2);
+		CV_Assert(xmap[i].type() == CV_32FC1 && ymap[i].type() == CV_32FC1 && xmap[i].size() == ymap[i].size());
+		firstRow[i + 1] = firstRow[i] + xmap[i].rows;
+		cols = std::max(cols, xmap[i].cols);
+		rows = std::max(rows, xmap[i].rows);
+		oneBuffer = oneBuffer && srcImages[i].u == srcImages[0].u;
+	}
+	Size batchSize(cols, firstRow[n]);
+
+	// the maps are packed again only if their buffers change
+	ProjectionBatch& batch = ProjectionBatch::instance();
+	if (!ProjectionBatch::sameBuffers(xmap, batch.xmaps) || !ProjectionBatch::sameBuffers(ymap, batch.ymaps)) {
+		batch.maps.create(batchSize, CV_32FC2);
+		for (int i = 0; i < n; ++i) {
+			UMat part = batch.maps(Rect(0, firstRow[i], xmap[i].cols, xmap[i].rows));
+			vector<UMat> xy = { xmap[i], ymap[i] };
+			merge(xy, part);
+		}
+		batch.xmaps = xmap;
+		batch.ymaps = ymap;
+	}
+
+	// the camera table, uploaded only if the images moved
+	Mat table(1, n*ProjectionBatch::kTableInts, CV_32SC1, Scalar(0));
+	for (int i = 0; i < n; ++i) {
+		int* t = table.ptr<int>() + i*ProjectionBatch::kTableInts;
+		t[0] = (int)srcImages[i].offset;
+		t[1] = (int)srcImages[i].step[0];
+		t[2] = srcImages[i].rows;
+		t[3] = srcImages[i].cols;
+		t[4] = firstRow[i];
+		t[5] = xmap[i].rows;
+		t[6] = xmap[i].cols;
+	}
+	if (batch.table.size() != table.size() ||
+		memcmp(batch.table.ptr(), table.ptr(), table.total()*table.elemSize()) != 0) {
+		table.copyTo(batch.table);
+		table.copyTo(batch.utable);
+	}
+
+	// reuse dstImages if they are the rows of a batch of this size already
+	bool reuse = (int)dstImages.size() == n && dstImages[0].type() == CV_8UC4;
+	for (int i = 0; i < n && reuse; ++i) {
+		reuse = dstImages[i].u == dstImages[0].u && dstImages[i].size() == xmap[i].size() &&
+			dstImages[i].step[0] == dstImages[0].step[0] && dstImages[0].step[0] >= size_t(cols)*4 &&
+			dstImages[i].offset == dstImages[0].offset + firstRow[i]*dstImages[0].step[0];
+	}
+	if (!reuse) {
+		UMat dst(batchSize, CV_8UC4);
+		dstImages.assign(n, UMat());
+		for (int i = 0; i < n; ++i) {
+			dstImages[i] = dst(Rect(0, firstRow[i], xmap[i].cols, xmap[i].rows));
+		}
+	}
+
+	int cn = CV_MAT_CN(type);
+	OclKernel& k = oclKernel("batch_cubic_remap", ocl::oclrenderpano::remap_oclsrc);
+	size_t localsize[] = { 16, 16, 1 };
+	// one launch if the images are in one buffer (e.g. uploaded into the rows of one UMat)
+	for (int i = 0; i < n; i = oneBuffer ? n : i + 1) {
+		int cam0 = i;
+		k.args(ocl::KernelArg::PtrReadOnly(srcImages[i]),
+			ocl::KernelArg::WriteOnlyNoSize(dstImages[0]),
+			ocl::KernelArg::ReadOnlyNoSize(batch.maps),
+			ocl::KernelArg::PtrReadOnly(batch.utable),
+			ocl::KernelArg::Constant(&cam0, sizeof(cam0)),
+			ocl::KernelArg::Constant(&cn, sizeof(cn)));
+		size_t globalsize[] = { size_t(oneBuffer ? cols : xmap[i].cols), size_t(oneBuffer ? rows : xmap[i].rows), size_t(oneBuffer ? n : 1) };
+		k.run(3, globalsize, localsize, false);
+	}
+}
+
+CV_EXPORTS_W void oclReleaseProjectionBatch() {
+	ProjectionBatch::instance() = ProjectionBatch();
+}
+
+
+// @added: the fixed-point projection maps (see fixed_cubic_remap)
+static const int kProjectionMapMagic = 0x4d50435a;	// "ZCPM"
+static const int kProjectionMapVersion = 2;
+static const int kFracBits = 8;
+static const int kMaxProjectionSize = 65535 - 5;	// the integer part of p + 3 in 16 bits
+
+// the header of a cached map, followed by its rows of ushort3
+struct ProjectionMapHeader {
+	int magic;
+	int version;
+	int cols;
+	int rows;
+	int fracBits;
+	int srcCols;
+	int srcRows;
+	int pad;
+};
+
+// FNV-1a of the cache key of the rig, the camera, the sizes and the format, never reads the maps
+static uint64 hashProjectionMap(const string& cacheKey, int camera, Size mapSize, Size srcSize) {
+	uint64 h = 14695981039346656037ULL;
+	auto add = [&h](const void* data, size_t size) {
+		const uchar* p = (const uchar*)data;
+		for (size_t i = 0; i < size; ++i) {
+			h = (h ^ p[i]) * 1099511628211ULL;
+		}
+	};
+	int key[] = { kProjectionMapVersion, kFracBits, camera, mapSize.width, mapSize.height, srcSize.width, srcSize.height };
+	add(key, sizeof(key));
+	add(cacheKey.data(), cacheKey.size());
+	return h;
+}
+
+// q = (p + 3)*2^kFracBits as (q >> kFracBits, q >> kFracBits, the two fractions in 8 bits each)
+static void compileProjectionMap(const Mat& xmap, const Mat& ymap, Size srcSize, Mat& packed) {
+	packed.create(xmap.size(), CV_16UC3);
+	const float scale = float(1 << kFracBits);
+	const int mask = (1 << kFracBits) - 1;
+	for (int y = 0; y < xmap.rows; ++y) {
+		const float* xs = xmap.ptr<float>(y);
+		const float* ys = ymap.ptr<float>(y);
+		ushort* d = packed.ptr<ushort>(y);
+		for (int x = 0; x < xmap.cols; ++x) {
+			// NaN samples zeros as any position out of the image
+			float px = xs[x] == xs[x] ? std::min(std::max(xs[x], -3.0f), srcSize.width + 2.0f) : -3.0f;
+			float py = ys[x] == ys[x] ? std::min(std::max(ys[x], -3.0f), srcSize.height + 2.0f) : -3.0f;
+			int qx = cvRound((px + 3.0f)*scale);
+			int qy = cvRound((py + 3.0f)*scale);
+			d[3*x] = ushort(qx >> kFracBits);
+			d[3*x + 1] = ushort(qy >> kFracBits);
+			d[3*x + 2] = ushort(((qx & mask) << 8) | (qy & mask));
+		}
+	}
+}
+
+// the weights of get_bicubic_8uc4() for the fractions f/2^fracBits, f in [-2^fracBits, 2^fracBits)
+static void projectionWeights(int fracBits, Mat& weights) {
+	int n = 1 << fracBits;
+	weights.create(1, 2*n, CV_32FC4);
+	const float A = -0.75f;
+	for (int i = 0; i < 2*n; ++i) {
+		float x = float(i - n) / n;
+		float* w = weights.ptr<float>() + 4*i;
+		w[0] = ((A*(x + 1) - 5*A)*(x + 1) + 8*A)*(x + 1) - 4*A;
+		w[1] = ((A + 2)*x - (A + 3))*x*x + 1;
+		w[2] = ((A + 2)*(1 - x) - (A + 3))*(1 - x)*(1 - x) + 1;
+		w[3] = 1.f - w[0] - w[1] - w[2];
+	}
+}
+
+static string projectionMapPath(const string& cacheDir, uint64 hash) {
+	return cacheDir + format("/projmap_%016llx.bin", (unsigned long long)hash);
+}
+
+static bool loadProjectionMap(const string& path, const ProjectionMapHeader& expected, Mat& packed) {
+	FILE* fp = fopen(path.c_str(), "rb");
+	if (!fp) {
+		return false;
+	}
+	ProjectionMapHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(&header, &expected, sizeof(header)) == 0;
+	if (ok) {
+		packed.create(header.rows, header.cols, CV_16UC3);
+		for (int y = 0; y < header.rows && ok; ++y) {
+			ok = fread(packed.ptr(y), packed.elemSize(), header.cols, fp) == size_t(header.cols);
+		}
+	}
+	fclose(fp);
+	return ok;
+}
+
+static bool saveProjectionMap(const string& path, const ProjectionMapHeader& header, const Mat& packed) {
+	FILE* fp = fopen(path.c_str(), "wb");
+	if (!fp) {
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (int y = 0; y < packed.rows && ok; ++y) {
+		ok = fwrite(packed.ptr(y), packed.elemSize(), packed.cols, fp) == size_t(packed.cols);
+	}
+	return fclose(fp) == 0 && ok;
+}
+
+CV_EXPORTS_W void oclCompileProjectionMaps(
+	const vector<UMat>& xmap,
+	const vector<UMat>& ymap,
+	const vector<Size>& srcSizes,
+	vector<OclProjectionMap>& maps,
+	const string& cacheDir,
+	const string& cacheKey) {
+	CV_Assert(xmap.size() == ymap.size() && xmap.size() == srcSizes.size());
+	maps.assign(xmap.size(), OclProjectionMap());
+	Mat weights;
+	projectionWeights(kFracBits, weights);
+	for (size_t i = 0; i < xmap.size(); ++i) {
+		CV_Assert(xmap[i].type() == CV_32FC1 && ymap[i].type() == CV_32FC1 && xmap[i].size() == ymap[i].size());
+		CV_Assert(srcSizes[i].width <= kMaxProjectionSize && srcSizes[i].height <= kMaxProjectionSize);
+		Size mapSize = xmap[i].size();
+		OclProjectionMap& m = maps[i];
+		m.fracBits = kFracBits;
+		m.srcSize = srcSizes[i];
+		bool cached = !cacheDir.empty() && !cacheKey.empty();
+		m.hash = cached ? hashProjectionMap(cacheKey, (int)i, mapSize, srcSizes[i]) : 0;
+
+		// a cache hit reads neither the float maps nor the device
+		ProjectionMapHeader header = { kProjectionMapMagic, kProjectionMapVersion, mapSize.width, mapSize.height,
+			kFracBits, srcSizes[i].width, srcSizes[i].height, 0 };
+		string path = cached ? projectionMapPath(cacheDir, m.hash) : string();
+		Mat packed;
+		if (path.empty() || !loadProjectionMap(path, header, packed)) {
+			compileProjectionMap(xmap[i].getMat(ACCESS_READ), ymap[i].getMat(ACCESS_READ), srcSizes[i], packed);
+			if (!path.empty() && !saveProjectionMap(path, header, packed)) {
+				LOGD("failed to save projection map %s\n", path.c_str());
+			}
+		}
+		packed.copyTo(m.map);
+		weights.copyTo(m.weights);
+	}
+}
+
+CV_EXPORTS_W void oclProjection(
+	const vector<UMat>& srcImages,
+	const vector<OclProjectionMap>& maps,
+	vector<UMat>& dstImages) {
+	ProfileStage stage("projection");
+	CV_Assert(maps.size() == srcImages.size());
+	if (dstImages.size() != srcImages.size()) {
+		dstImages.assign(srcImages.size(), UMat());
+	}
+	for (size_t i = 0; i < srcImages.size(); ++i) {
+		const UMat& src = srcImages[i];
+		const OclProjectionMap& m = maps[i];
+		CV_Assert(src.type() == CV_8UC3 || src.type() == CV_8UC4);
+		CV_Assert(src.size() == m.srcSize && m.map.type() == CV_16UC3);
+		dstImages[i].create(m.map.size(), CV_8UC4);
+		// @added
+		if (cpuBackend()) {
+			Mat dst = dstImages[i].getMat(ACCESS_WRITE);
+			cpuProjection(src.getMat(ACCESS_READ), m.map.getMat(ACCESS_READ), m.weights.getMat(ACCESS_READ), m.fracBits, dst);
+			continue;
+		}
+		int cn = src.channels();
+		OclKernel& k = oclKernel("fixed_cubic_remap", ocl::oclrenderpano::remap_oclsrc);
+		k.args(ocl::KernelArg::ReadOnly(src),
+			ocl::KernelArg::WriteOnly(dstImages[i]),
+			ocl::KernelArg::ReadOnlyNoSize(m.map),
+			ocl::KernelArg::PtrReadOnly(m.weights),
+			ocl::KernelArg::Constant(&m.fracBits, sizeof(m.fracBits)),
+			ocl::KernelArg::Constant(&cn, sizeof(cn)));
+		size_t globalsize[] = { size_t(m.map.cols), size_t(m.map.rows) };
+		size_t localsize[] = { 16, 16 };
+		k.run(2, globalsize, localsize, false);
+	}
+}
+
+
 CV_EXPORTS_W void oclSmoothImage(UMat& pano, const UMat& previous, float thresh_hold, bool isPano) {
+	ProfileStage stage("post-process");
 	if (pano.dims != previous.dims) {
 		return;
 	}
 	if (previous.cols != 0) {
 		CV_Assert(pano.type() == CV_8UC4 || pano.type() == previous.type());
+		// @added
+		if (cpuBackend()) {
+			Mat image = pano.getMat(ACCESS_RW);
+			cpuSmoothImage(image, previous.getMat(ACCESS_READ), thresh_hold, isPano);
+			return;
+		}
 		int is_pano = isPano ? 1 : 0;
-		ocl::Kernel k("smooth_image", ocl::oclrenderpano::zcamutils_oclsrc);
+		OclKernel& k = oclKernel("smooth_image", ocl::oclrenderpano::zcamutils_oclsrc);
 		k.args(ocl::KernelArg::ReadWrite(pano),
 			ocl::KernelArg::ReadOnlyNoSize(previous),
 			ocl::KernelArg::Constant(&thresh_hold, sizeof(thresh_hold)),
@@ -90,8 +421,14 @@ CV_EXPORTS_W void oclSmoothImageV2(UMat& pano, const UMat& previous, float thres
 	}
 	if (previous.cols != 0) {
 		CV_Assert(pano.type() == CV_8UC4 || pano.type() == previous.type());
+		// @added
+		if (cpuBackend()) {
+			Mat image = pano.getMat(ACCESS_RW);
+			cpuSmoothImage(image, previous.getMat(ACCESS_READ), thresh_hold, isPano);
+			return;
+		}
 		int is_pano = isPano ? 1 : 0;
-		ocl::Kernel k("smooth_image", ocl::oclrenderpano::zcamutils_oclsrc);
+		OclKernel& k = oclKernel("smooth_image", ocl::oclrenderpano::zcamutils_oclsrc);
 		k.args(ocl::KernelArg::ReadWrite(pano),
 			ocl::KernelArg::ReadOnlyNoSize(previous),
 			ocl::KernelArg::Constant(&thresh_hold, sizeof(thresh_hold)),
@@ -104,6 +441,17 @@ CV_EXPORTS_W void oclSmoothImageV2(UMat& pano, const UMat& previous, float thres
 
 
 CV_EXPORTS_W void oclSharpImage(UMat& sphericalImage, float factor) {
+	ProfileStage stage("post-process");
+	// @added: post_process with the sharpening only (no chunk lines, no smoothing, no offset)
+	if (factor != 0.0 && cpuBackend()) {
+		OclPostProcessParameters params;
+		params.sharpFactor = factor;
+		Mat image = sphericalImage.getMat(ACCESS_RW);
+		Mat sharp(image.size(), image.type());
+		cpuPostProcess(image, Mat(), sharp, params);
+		sharp.copyTo(image);
+		return;
+	}
 	if (factor != 0.0) {
 		UMat blured;
 		oclGaussianBlur(sphericalImage, blured, Size(3, 3), 3);
@@ -114,6 +462,7 @@ CV_EXPORTS_W void oclSharpImage(UMat& sphericalImage, float factor) {
 
 
 CV_EXPORTS_W void oclStackHorizontal(const std::vector<UMat>& srcImages, UMat& dstImage) {
+	ProfileStage stage("stack");
 	int totalCols = 0;
 	for (size_t i = 0; i < srcImages.size(); i++) {
 		CV_Assert(srcImages[i].dims <= 2 && srcImages[i].rows == srcImages[0].rows && srcImages[i].type() == srcImages[0].type());
@@ -131,6 +480,7 @@ CV_EXPORTS_W void oclStackHorizontal(const std::vector<UMat>& srcImages, UMat& d
 }
 
 CV_EXPORTS_W void oclStackVertical(const std::vector<UMat>& srcImages, UMat& dstImage) {
+	ProfileStage stage("stack");
 	int totalRows = 0;
 	for (size_t i = 0; i < srcImages.size(); i++) {
 		CV_Assert(srcImages[i].dims <= 2 && srcImages[i].cols == srcImages[0].cols && srcImages[i].type() == srcImages[0].type());
@@ -148,9 +498,21 @@ CV_EXPORTS_W void oclStackVertical(const std::vector<UMat>& srcImages, UMat& dst
 }
 
 CV_EXPORTS_W void oclOffsetHorizontalWrap(const UMat& srcImage, float offset, UMat& dstImage) {
+	ProfileStage stage("post-process");
+	// @added: the nearest source column is the whole offset, a plain wrapped copy
+	if (cpuBackend()) {
+		CV_Assert(srcImage.type() == CV_8UC4);
+		OclPostProcessParameters params;
+		params.wrapOffset = cvRound(offset);
+		Mat src = srcImage.getMat(ACCESS_READ);
+		Mat dst(src.size(), src.type());
+		cpuPostProcess(src, Mat(), dst, params);
+		dst.copyTo(dstImage);
+		return;
+	}
 	// get warp mat
 	UMat warpMat(srcImage.size(), CV_32FC2);
-	ocl::Kernel k("offset_horizontal_wrap", ocl::oclrenderpano::zcamutils_oclsrc);
+	OclKernel& k = oclKernel("offset_horizontal_wrap", ocl::oclrenderpano::zcamutils_oclsrc);
 	k.args(ocl::KernelArg::WriteOnly(warpMat),
 		ocl::KernelArg::Constant(&offset, sizeof(offset)));
 	size_t globalsize[] = { warpMat.cols, warpMat.rows };
@@ -169,15 +531,55 @@ CV_EXPORTS_W void oclOffsetHorizontalWrap(const UMat& srcImage, float offset, UM
 
 
 CV_EXPORTS_W void oclOffsetHorizontalWrap(UMat& image, float offset) {
+	ProfileStage stage("post-process");
 	UMat dst;
 	oclOffsetHorizontalWrap(image, offset, dst);
 	image = dst;
 	ocl::finish();
 }
 
+// @added
+CV_EXPORTS_W void oclPostProcess(const UMat& pano, const UMat& previous, UMat& dst, const OclPostProcessParameters& params) {
+	ProfileStage stage("post-process");
+	CV_Assert(pano.type() == CV_8UC4);
+	// before dst is created, dst may be previous
+	bool smooth = params.smoothThreshold > 0.0f && !previous.empty();
+	CV_Assert(!smooth || (previous.type() == CV_8UC4 && previous.size() == pano.size()));
+	dst.create(pano.size(), CV_8UC4);
+	CV_Assert(dst.u != pano.u);
+
+	const UMat& prev = smooth ? previous : dst;
+	// @added
+	if (cpuBackend()) {
+		Mat out = dst.getMat(ACCESS_WRITE);
+		cpuPostProcess(pano.getMat(ACCESS_READ), smooth ? prev.getMat(ACCESS_READ) : Mat(), out, params);
+		return;
+	}
+	int chunkCols = params.chunkWidth;
+	float factor = params.sharpFactor;
+	float threshold = smooth ? params.smoothThreshold : 0.0f;
+	int isPano = params.isPano ? 1 : 0;
+	int offset = params.wrapOffset % pano.cols;
+	offset += offset < 0 ? pano.cols : 0;
+	OclKernel& k = oclKernel("post_process", ocl::oclrenderpano::zcamutils_oclsrc,
+		KernelRegistry::instance().gaussianOptions(3, 3.0));
+	k.args(ocl::KernelArg::ReadOnlyNoSize(pano),
+		ocl::KernelArg::ReadOnlyNoSize(prev),
+		ocl::KernelArg::WriteOnly(dst),
+		ocl::KernelArg::Constant(&chunkCols, sizeof(chunkCols)),
+		ocl::KernelArg::Constant(&factor, sizeof(factor)),
+		ocl::KernelArg::Constant(&threshold, sizeof(threshold)),
+		ocl::KernelArg::Constant(&isPano, sizeof(isPano)),
+		ocl::KernelArg::Constant(&offset, sizeof(offset)));
+	// the kernel tiles by its work-group, see POST_TILE
+	size_t globalsize[] = { dst.cols, dst.rows };
+	size_t localsize[] = { 16, 16 };
+	k.run(2, globalsize, localsize, false);
+}
+
 static void olcRemoveChunkLine(UMat& chunk) {
 	CV_Assert(chunk.type() == CV_8UC4);
-	ocl::Kernel k("remove_chunk_line", ocl::oclrenderpano::zcamutils_oclsrc);
+	OclKernel& k = oclKernel("remove_chunk_line", ocl::oclrenderpano::zcamutils_oclsrc);
 	k.args(ocl::KernelArg::ReadWrite(chunk));
 	size_t globalsize[] = { chunk.rows };
 	size_t localsize[] = { 64 };
@@ -185,7 +587,14 @@ static void olcRemoveChunkLine(UMat& chunk) {
 }
 
 CV_EXPORTS_W void oclRemoveChunkLines(vector<UMat>& chunks) {
+	ProfileStage stage("post-process");
 	for (int i = 0; i < chunks.size(); ++i) {
+		// @added
+		if (cpuBackend()) {
+			Mat chunk = chunks[i].getMat(ACCESS_RW);
+			cpuRemoveChunkLine(chunk);
+			continue;
+		}
 		olcRemoveChunkLine(chunks[i]);
 	}
 	ocl::finish();
@@ -0,0 +1,67 @@
+/*
+* The CPU backend against the OpenCL kernels (oclCompareBackends()) on a synthetic image pair,
+* a smooth texture and the same texture moved by a few pixels, in the fp32 and the fp16 storage.
+*/
+#include "test_precomp.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+namespace {
+
+// a smooth BGRA texture moved by (dx, dy), opaque
+Mat texture(Size size, float dx, float dy) {
+	Mat m(size, CV_8UC4);
+	for (int y = 0; y < size.height; ++y) {
+		for (int x = 0; x < size.width; ++x) {
+			float u = x - dx;
+			float v = y - dy;
+			float b = 128.0f + 60.0f*std::sin(u*0.11f) + 50.0f*std::cos(v*0.07f + u*0.03f);
+			float g = 128.0f + 70.0f*std::sin(u*0.05f + v*0.09f);
+			float r = 128.0f + 40.0f*std::cos(u*0.13f) + 40.0f*std::sin(v*0.17f);
+			m.at<Vec4b>(y, x) = Vec4b(saturate_cast<uchar>(b), saturate_cast<uchar>(g), saturate_cast<uchar>(r), 255);
+		}
+	}
+	return m;
+}
+
+OclInitParameters compareParameters(Size size, bool half) {
+	OclInitParameters params;
+	params.numSideCams = 1;
+	params.numNovelViews = size.width/2;
+	params.camImageWidth = size.width;
+	params.opticalFlowSize = size;
+	params.halfStorage = half;
+	return params;
+}
+
+}	// namespace
+
+TEST(OclRenderPano_CpuBackend, matches_opencl_kernels)
+{
+	ocl::setUseOpenCL(true);
+	if (!ocl::useOpenCL()) {
+		throw cvtest::SkipTestException("no OpenCL device");
+	}
+	const Size size(320, 160);
+	UMat I0, I1;
+	texture(size, 0.0f, 0.0f).copyTo(I0);
+	texture(size, 3.5f, 1.25f).copyTo(I1);
+
+	for (int half = 0; half <= 1; ++half) {
+		SCOPED_TRACE(half ? "fp16 storage" : "fp32 storage");
+		OclInitParameters params = compareParameters(size, half != 0);
+		OclBackendComparison c = oclCompareBackends(I0, I1, DirectionHint::UNKNOWN, &params);
+
+		// the sweeps feed every rounding difference forward, a flow is allowed to drift a little
+		EXPECT_LE(c.flow.meanEndpointDiff, half ? 0.05 : 0.02);
+		EXPECT_LE(c.flow.maxEndpointDiff, half ? 1.0 : 0.5);
+		EXPECT_LE(std::fabs(c.flow.meanWarpErrorA - c.flow.meanWarpErrorB), 0.002);
+		// the rest is one rounding away from the kernels
+		EXPECT_LE(c.maxProjectionDiff, 1.0);
+		EXPECT_LE(c.maxNovelViewDiff, 1.0);
+		EXPECT_LE(c.maxPostProcessDiff, 1.0);
+		EXPECT_LE(c.maxColorAdjustDiff, 1.0);
+	}
+}
@@ -0,0 +1,58 @@
+/*
+* gradient_blur_32FC1 against the unfused oclSobleX/oclSobleY + oclGaussianBlur path,
+* on images that end in partial tiles of the kernel (TILE is 16).
+*/
+#include "test_precomp.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+namespace {
+
+const Size kGradientBlurSize(3, 3);
+const double kGradientBlurSigma = 0.5;
+
+void unfusedGradientBlur(const UMat& src, UMat& dx, UMat& dy) {
+	UMat gx, gy;
+	oclSobleX(src, gx);
+	oclSobleY(src, gy);
+	oclGaussianBlur(gx, dx, kGradientBlurSize, kGradientBlurSigma);
+	oclGaussianBlur(gy, dy, kGradientBlurSize, kGradientBlurSigma);
+}
+
+double maxError(const UMat& a, const UMat& b) {
+	return norm(a.getMat(ACCESS_READ), b.getMat(ACCESS_READ), NORM_INF);
+}
+
+}	// namespace
+
+TEST(OclRenderPano_GradientBlur, matches_unfused_path_on_partial_tiles)
+{
+	ocl::setUseOpenCL(true);
+	if (!ocl::useOpenCL()) {
+		throw cvtest::SkipTestException("no OpenCL device");
+	}
+	// tile aligned, partial tiles in x, in y and in both, smaller than a tile
+	const Size sizes[] = { Size(64, 32), Size(37, 32), Size(48, 23), Size(50, 17), Size(5, 3) };
+	RNG rng(20261018);
+	for (const Size& size : sizes) {
+		SCOPED_TRACE(format("%dx%d", size.width, size.height));
+		Mat m0(size, CV_32FC1), m1(size, CV_32FC1);
+		rng.fill(m0, RNG::UNIFORM, 0.0f, 1.0f);
+		rng.fill(m1, RNG::UNIFORM, 0.0f, 1.0f);
+		UMat I0 = m0.getUMat(ACCESS_READ);
+		UMat I1 = m1.getUMat(ACCESS_READ);
+
+		UMat I0x, I0y, I1x, I1y;
+		oclGradientBlur(I0, I1, I0x, I0y, I1x, I1y, kGradientBlurSize, kGradientBlurSigma);
+		UMat refI0x, refI0y, refI1x, refI1y;
+		unfusedGradientBlur(I0, refI0x, refI0y);
+		unfusedGradientBlur(I1, refI1x, refI1y);
+
+		EXPECT_LE(maxError(I0x, refI0x), 1e-5);
+		EXPECT_LE(maxError(I0y, refI0y), 1e-5);
+		EXPECT_LE(maxError(I1x, refI1x), 1e-5);
+		EXPECT_LE(maxError(I1y, refI1y), 1e-5);
+	}
+}
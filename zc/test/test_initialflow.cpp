@@ -0,0 +1,58 @@
+/*
+* The initial flow search of a direction hint (oclSearchInitialFlow()) on a texture moved by a few
+* pixels and darkened, which the search only matches on the intensity equalized image.
+*/
+#include "test_precomp.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+namespace {
+
+// a smooth texture in [0, 1] moved by dx and scaled by gain
+Mat texture(Size size, int dx, float gain) {
+	Mat m(size, CV_32FC1);
+	for (int y = 0; y < size.height; ++y) {
+		for (int x = 0; x < size.width; ++x) {
+			float u = float(x - dx);
+			float v = 0.5f + 0.25f*std::sin(u*0.9f + y*0.3f) + 0.2f*std::cos(u*0.37f - y*0.71f);
+			m.at<float>(y, x) = gain*v;
+		}
+	}
+	return m;
+}
+
+}	// namespace
+
+TEST(OclRenderPano_InitialFlow, finds_the_shift_of_the_hint_on_equalized_intensity)
+{
+	ocl::setUseOpenCL(true);
+	if (!ocl::useOpenCL()) {
+		throw cvtest::SkipTestException("no OpenCL device");
+	}
+	const Size size(64, 40);
+	const int kShift = 3;
+	// kMaxPercentage 25 searches 6 pixels, the box of DirectionHint::RIGHT (OpticalFlow::computeSearchBox())
+	const int kMaxPercentage = 25;
+	const Rect box(0, -1, 7, 3);
+
+	UMat I0, I1, alpha0, alpha1;
+	texture(size, 0, 1.0f).copyTo(I0);
+	texture(size, kShift, 0.6f).copyTo(I1);
+	alpha0 = UMat(size, CV_32FC1, Scalar(1.0));
+	alpha1 = UMat(size, CV_32FC1, Scalar(1.0));
+	UMat flow(size, CV_32FC2, Scalar::all(0));
+	oclSearchInitialFlow(I0, I1, alpha0, alpha1, flow, box, kMaxPercentage);
+
+	// the pixels whose patch (radius 2) and match are inside both images
+	Mat f = flow.getMat(ACCESS_READ);
+	int mismatches = 0;
+	for (int y = 2; y < size.height - 2; ++y) {
+		for (int x = 2; x < size.width - 2 - kShift; ++x) {
+			Point2f d = f.at<Point2f>(y, x);
+			mismatches += d.x != kShift || d.y != 0;
+		}
+	}
+	EXPECT_EQ(0, mismatches);
+}
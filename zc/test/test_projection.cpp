@@ -0,0 +1,55 @@
+/*
+* oclProjection() with the fixed-point maps of oclCompileProjectionMaps() against the float maps,
+* on sharp 0/255 edges and a source wider than the 16-bit integer parts of the old format allowed
+* 8 fraction bits for.
+*/
+#include "test_precomp.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace cv::ocl::imvt;
+
+TEST(OclRenderPano_Projection, fixed_maps_within_one_lsb_of_float_maps)
+{
+	ocl::setUseOpenCL(true);
+	if (!ocl::useOpenCL()) {
+		throw cvtest::SkipTestException("no OpenCL device");
+	}
+	// vertical and horizontal 0/255 stripes of 7 pixels
+	const Size srcSize(2100, 64);
+	Mat src(srcSize, CV_8UC4);
+	for (int y = 0; y < src.rows; ++y) {
+		for (int x = 0; x < src.cols; ++x) {
+			uchar v = ((x / 7) % 2) ? 255 : 0;
+			uchar h = ((y / 7) % 2) ? 255 : 0;
+			src.at<Vec4b>(y, x) = Vec4b(v, h, v ^ h, 255);
+		}
+	}
+	// a scaled, sheared and shifted map with arbitrary fractions, a border of it outside the source
+	const Size dstSize(2200, 72);
+	Mat xmap(dstSize, CV_32FC1), ymap(dstSize, CV_32FC1);
+	for (int y = 0; y < dstSize.height; ++y) {
+		for (int x = 0; x < dstSize.width; ++x) {
+			xmap.at<float>(y, x) = 0.9613f*x + 0.0371f*y - 6.29f;
+			ymap.at<float>(y, x) = 0.8837f*y + 0.00213f*x - 2.71f;
+		}
+	}
+
+	vector<UMat> srcs(1), xmaps(1), ymaps(1);
+	src.copyTo(srcs[0]);
+	xmap.copyTo(xmaps[0]);
+	ymap.copyTo(ymaps[0]);
+	vector<UMat> floatDst, fixedDst;
+	oclProjection(srcs, xmaps, ymaps, floatDst);
+	vector<OclProjectionMap> maps;
+	oclCompileProjectionMaps(xmaps, ymaps, vector<Size>(1, srcSize), maps);
+	ASSERT_EQ(maps.size(), size_t(1));
+	oclProjection(srcs, maps, fixedDst);
+
+	Mat diff;
+	absdiff(floatDst[0].getMat(ACCESS_READ), fixedDst[0].getMat(ACCESS_READ), diff);
+	double maxDiff = 0;
+	minMaxLoc(diff.reshape(1), 0, &maxDiff);
+	printf("max difference of the fixed-point projection: %.0f LSB\n", maxDiff);
+	EXPECT_LE(maxDiff, 1.0);
+}